@@ -7,8 +7,10 @@
  */
 
 #include "ata.h"
+#include "../kernel/init.h"
 #include "../kernel/debug.h"
 #include "../kernel/kernel.h"
+#include "../kernel/pic.h"
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -18,10 +20,19 @@ static ata_device_t primary_slave;
 static ata_device_t secondary_master;
 static ata_device_t secondary_slave;
 
+/* I/O statistics (see ata.h) */
+DEFINE_COUNTER(cnt_ata_reads, "ata", "reads");
+DEFINE_COUNTER(cnt_ata_writes, "ata", "writes");
+DEFINE_COUNTER(cnt_ata_sectors_read, "ata", "sectors_read");
+DEFINE_COUNTER(cnt_ata_sectors_written, "ata", "sectors_written");
+
 /* Current selected device for each controller */
 static uint8_t current_primary_drive = 0xFF;
 static uint8_t current_secondary_drive = 0xFF;
 
+/* Asynchronous request holding each channel, NULL when idle */
+static ata_request_t* channel_owner[2];
+
 /* I/O port functions */
 static inline void outb(uint16_t port, uint8_t val) {
     asm volatile ("outb %0, %1" : : "a"(val), "Nd"(port));
@@ -122,7 +133,7 @@ bool ata_wait_drq(ata_device_t* device) {
 }
 
 /* Initialize ATA device structure */
-static void ata_init_device(ata_device_t* device, uint16_t io_base, uint16_t ctrl_base, uint8_t drive) {
+static void __init ata_init_device(ata_device_t* device, uint16_t io_base, uint16_t ctrl_base, uint8_t drive) {
     device->io_base = io_base;
     device->ctrl_base = ctrl_base;
     device->drive = drive;
@@ -135,7 +146,7 @@ static void ata_init_device(ata_device_t* device, uint16_t io_base, uint16_t ctr
 }
 
 /* Identify a drive */
-bool ata_identify(ata_device_t* device) {
+bool __init ata_identify(ata_device_t* device) {
     uint16_t identify_data[256];
     
     /* Select the drive */
@@ -222,6 +233,24 @@ bool ata_identify(ata_device_t* device) {
     return true;
 }
 
+/* Channel index and IRQ line of a device */
+static inline uint32_t ata_channel(const ata_device_t* device) {
+    return device->io_base == ATA_PRIMARY_IO_BASE ? 0 : 1;
+}
+
+static inline uint8_t ata_irq(const ata_device_t* device) {
+    return device->io_base == ATA_PRIMARY_IO_BASE ? ATA_PRIMARY_IRQ : ATA_SECONDARY_IRQ;
+}
+
+/* Drive the event loop while an asynchronous request owns the channel */
+static void ata_wait_channel(ata_device_t* device) {
+    while (channel_owner[ata_channel(device)]) {
+        if (!async_run()) {
+            asm volatile("pause");
+        }
+    }
+}
+
 /* Read sectors from drive */
 bool ata_read_sectors(ata_device_t* device, uint32_t lba, uint8_t sector_count, void* buffer) {
     if (!device->present || sector_count == 0) {
@@ -230,6 +259,9 @@ bool ata_read_sectors(ata_device_t* device, uint32_t lba, uint8_t sector_count,
     
     uint16_t* buf = (uint16_t*)buffer;
     
+    /* Let an asynchronous request on the channel finish first */
+    ata_wait_channel(device);
+    
     /* Select the drive */
     ata_select_drive(device);
     
@@ -266,6 +298,8 @@ bool ata_read_sectors(ata_device_t* device, uint32_t lba, uint8_t sector_count,
         }
     }
     
+    counter_inc(&cnt_ata_reads);
+    counter_add(&cnt_ata_sectors_read, sector_count);
     return true;
 }
 
@@ -277,6 +311,9 @@ bool ata_write_sectors(ata_device_t* device, uint32_t lba, uint8_t sector_count,
     
     const uint16_t* buf = (const uint16_t*)buffer;
     
+    /* Let an asynchronous request on the channel finish first */
+    ata_wait_channel(device);
+    
     /* Select the drive */
     ata_select_drive(device);
     
@@ -314,11 +351,113 @@ bool ata_write_sectors(ata_device_t* device, uint32_t lba, uint8_t sector_count,
     }
     
     /* Wait for write to complete */
-    return ata_wait_ready(device);
+    if (!ata_wait_ready(device)) {
+        return false;
+    }
+    
+    counter_inc(&cnt_ata_writes);
+    counter_add(&cnt_ata_sectors_written, sector_count);
+    return true;
+}
+
+/* Coroutine behind ata_submit_read(): the same steps as
+ * ata_read_sectors(), waiting for the sector interrupts instead of
+ * spinning on the status register */
+static int ata_read_task(async_task_t* t) {
+    ata_request_t* req = (ata_request_t*)t->arg;
+    ata_device_t* device = req->device;
+    uint32_t channel = ata_channel(device);
+    uint8_t status = 0;
+    
+    ASYNC_BEGIN(t);
+    
+    /* One command per channel */
+    AWAIT_UNTIL(t, channel_owner[channel] == NULL);
+    channel_owner[channel] = req;
+    
+    ata_select_drive(device);
+    if (!ata_wait_ready(device)) {
+        debug_print("ATA: Drive not ready for async read");
+    } else {
+        uint8_t drive_head = ((device->drive == 0) ? ATA_DRIVE_MASTER : ATA_DRIVE_SLAVE) |
+                            ((req->lba >> 24) & 0x0F);
+        
+        /* Forget interrupts from earlier commands before starting this one */
+        async_event_clear(async_irq_event(ata_irq(device)));
+        
+        outb(device->io_base + ATA_REG_SECTOR_COUNT, req->count);
+        outb(device->io_base + ATA_REG_LBA_LOW, req->lba & 0xFF);
+        outb(device->io_base + ATA_REG_LBA_MID, (req->lba >> 8) & 0xFF);
+        outb(device->io_base + ATA_REG_LBA_HIGH, (req->lba >> 16) & 0xFF);
+        outb(device->io_base + ATA_REG_DRIVE_HEAD, drive_head);
+        outb(device->io_base + ATA_REG_COMMAND, ATA_CMD_READ_SECTORS);
+        
+        for (req->sector = 0; req->sector < req->count; req->sector++) {
+            /* Reading the status register also acknowledges the interrupt */
+            for (req->polls = 0; ; req->polls++) {
+                status = inb(device->io_base + ATA_REG_STATUS);
+                if ((status & (ATA_STATUS_ERR | ATA_STATUS_DF)) ||
+                    (!(status & ATA_STATUS_BSY) && (status & ATA_STATUS_DRQ)) ||
+                    req->polls >= ATA_ASYNC_MAX_POLLS) {
+                    break;
+                }
+                AWAIT_EVENT_TIMEOUT(t, async_irq_event(ata_irq(device)), ATA_ASYNC_POLL_MS);
+            }
+            
+            if ((status & (ATA_STATUS_ERR | ATA_STATUS_DF)) || !(status & ATA_STATUS_DRQ)) {
+                debug_print("ATA: Async read failed");
+                break;
+            }
+            
+            uint16_t* buf = (uint16_t*)req->buffer + req->sector * 256;
+            for (int i = 0; i < 256; i++) {
+                buf[i] = inw(device->io_base + ATA_REG_DATA);
+            }
+        }
+    }
+    
+    req->ok = req->sector == req->count;
+    if (req->ok) {
+        counter_inc(&cnt_ata_reads);
+        counter_add(&cnt_ata_sectors_read, req->count);
+    }
+    channel_owner[channel] = NULL;
+    req->complete = true;
+    async_event_signal(&req->done);
+    
+    ASYNC_END(t);
+}
+
+/* Start an asynchronous read */
+bool ata_submit_read(ata_request_t* req, ata_device_t* device, uint32_t lba, uint8_t sector_count, void* buffer) {
+    if (!device || !device->present || sector_count == 0) {
+        return false;
+    }
+    
+    req->device = device;
+    req->lba = lba;
+    req->count = sector_count;
+    req->sector = 0;
+    req->buffer = buffer;
+    req->ok = false;
+    req->complete = false;
+    async_event_init(&req->done);
+    async_spawn(&req->task, "ata-read", ata_read_task, req);
+    return true;
+}
+
+/* Wait for a request from synchronous code */
+bool ata_wait_request(ata_request_t* req) {
+    while (!req->complete) {
+        if (!async_run()) {
+            asm volatile("pause");
+        }
+    }
+    return req->ok;
 }
 
 /* Initialize ATA subsystem */
-bool ata_init(void) {
+bool __init ata_init(void) {
     debug_print("ATA: Initializing ATA/IDE subsystem...");
     
     /* Initialize device structures */
@@ -366,6 +505,16 @@ bool ata_init(void) {
         ata_print_device_info(&secondary_slave);
         found_drives = true;
     }
+    
+    /* Asynchronous requests wait for the channel interrupts */
+    if (primary_master.present || primary_slave.present) {
+        pic_unmask_irq(2);  /* Cascade */
+        pic_unmask_irq(ATA_PRIMARY_IRQ);
+    }
+    if (secondary_master.present || secondary_slave.present) {
+        pic_unmask_irq(2);
+        pic_unmask_irq(ATA_SECONDARY_IRQ);
+    }
      return found_drives;
 }
 
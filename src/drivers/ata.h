@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "../kernel/counter.h"
+#include "../kernel/async.h"
 
 /*------------------------------------------------------------------------------
  * ATA/IDE Driver for SKOS
@@ -61,6 +63,35 @@ typedef struct {
     char     model[41];     /* Drive model string */
 } ata_device_t;
 
+/* IRQ lines of the two channels */
+#define ATA_PRIMARY_IRQ     14
+#define ATA_SECONDARY_IRQ   15
+
+/* Asynchronous reads wait for each sector's interrupt, re-checking the
+ * status every ATA_ASYNC_POLL_MS in case it never comes */
+#define ATA_ASYNC_POLL_MS   1
+#define ATA_ASYNC_MAX_POLLS 1000
+
+/* Asynchronous read request; owned by the caller until 'complete' */
+typedef struct {
+    ata_device_t* device;
+    uint32_t lba;
+    uint8_t  count;
+    uint8_t  sector;        /* Sectors transferred so far */
+    uint16_t polls;         /* Status checks for the current sector */
+    void*    buffer;
+    bool     ok;
+    bool     complete;
+    async_event_t done;     /* Signalled once when complete */
+    async_task_t task;      /* Coroutine running the transfer */
+} ata_request_t;
+
+/* Commands and sectors transferred, across all drives */
+DECLARE_COUNTER(cnt_ata_reads);
+DECLARE_COUNTER(cnt_ata_writes);
+DECLARE_COUNTER(cnt_ata_sectors_read);
+DECLARE_COUNTER(cnt_ata_sectors_written);
+
 /* Function prototypes */
 
 /* Initialize ATA subsystem */
@@ -75,6 +106,14 @@ bool ata_read_sectors(ata_device_t* device, uint32_t lba, uint8_t sector_count,
 /* Write sectors to drive */
 bool ata_write_sectors(ata_device_t* device, uint32_t lba, uint8_t sector_count, const void* buffer);
 
+/* Start a read that runs from the event loop; false if the arguments are
+ * bad. The channel is shared with the synchronous calls above, which wait
+ * for any request in flight. */
+bool ata_submit_read(ata_request_t* req, ata_device_t* device, uint32_t lba, uint8_t sector_count, void* buffer);
+
+/* Run the event loop until a request completes; returns whether it succeeded */
+bool ata_wait_request(ata_request_t* req);
+
 /* Wait for drive to be ready */
 bool ata_wait_ready(ata_device_t* device);
 
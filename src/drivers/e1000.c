@@ -0,0 +1,592 @@
+/*------------------------------------------------------------------------------
+ * Intel 8254x (e1000) Network Driver Implementation
+ *------------------------------------------------------------------------------
+ * This file implements descriptor ring setup, the RX page pool, batched
+ * refills, moderated interrupts and polled completion for the e1000.
+ * See e1000.h for the overall design.
+ *------------------------------------------------------------------------------
+ */
+
+#include "e1000.h"
+#include "../kernel/init.h"
+#include "pci.h"
+#include "../kernel/kernel.h"
+#include "../kernel/memory.h"
+#include "../kernel/string.h"
+#include "../kernel/idt.h"
+#include "../kernel/pic.h"
+#include "../kernel/debug.h"
+#include "../kernel/trace.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Device IDs handled by this driver (all share the 8254x register set) */
+static const uint16_t e1000_device_ids[] = {
+    E1000_DEVICE_ID,    /* 82540EM */
+    0x100F,             /* 82545EM copper */
+    0x1004,             /* 82543GC copper */
+};
+
+/* Device state */
+static pci_device_t* nic_pci = NULL;
+static volatile uint8_t* mmio = NULL;
+static uint8_t mac_addr[E1000_ETH_ALEN];
+static bool nic_present = false;
+static e1000_rx_handler_t rx_handler = NULL;
+static e1000_stats_t stats;
+
+/* Receive ring */
+static volatile e1000_rx_desc_t* rx_ring = NULL;
+static uint16_t rx_slot_buf[E1000_NUM_RX_DESC];     /* Pool buffer posted in each slot */
+static uint32_t rx_next = 0;                         /* Next slot to harvest */
+static uint32_t rx_tail = 0;                         /* Next slot to post (mirrors RDT) */
+static uint32_t rx_posted = 0;                       /* Slots owned by the NIC */
+
+/* Receive page pool: E1000_RX_POOL_BUFFERS half-page buffers */
+static uint8_t* rx_pool = NULL;
+static uint32_t rx_pool_phys = 0;
+static uint16_t rx_free[E1000_RX_POOL_BUFFERS];      /* Stack of free buffer indices */
+static uint32_t rx_free_count = 0;
+static netbuf_t rx_netbufs[E1000_RX_POOL_BUFFERS];  /* One netbuf per pool buffer */
+
+/* Transmit ring with one bounce buffer per slot */
+static volatile e1000_tx_desc_t* tx_ring = NULL;
+static uint8_t* tx_buffers = NULL;
+static uint32_t tx_buffers_phys = 0;
+static netbuf_t* tx_slot_nb[E1000_NUM_TX_DESC];      /* Netbuf sent from each slot */
+static uint32_t tx_tail = 0;                         /* Next slot to fill */
+static uint32_t tx_clean = 0;                        /* Oldest slot not yet reclaimed */
+static uint32_t tx_doorbell = 0;                     /* Last value written to TDT */
+
+/* Set by the IRQ handler, cleared once e1000_poll() drains the ring */
+static volatile bool rx_irq_masked = false;
+
+/* RX bottom half, woken by the interrupt and run by e1000_poll() */
+static trace_task_t rx_task;
+
+/* Keep the compiler from moving buffer accesses across descriptor accesses */
+#define e1000_barrier() asm volatile("" ::: "memory")
+
+/*------------------------------------------------------------------------------
+ * Register access
+ *------------------------------------------------------------------------------
+ */
+
+static inline uint32_t e1000_read(uint32_t reg) {
+    return *(volatile uint32_t*)(mmio + reg);
+}
+
+static inline void e1000_write(uint32_t reg, uint32_t value) {
+    *(volatile uint32_t*)(mmio + reg) = value;
+}
+
+/* Read one 16-bit word from the EEPROM */
+static bool __init e1000_eeprom_read(uint8_t address, uint16_t* value) {
+    e1000_write(E1000_REG_EERD, ((uint32_t)address << 8) | E1000_EERD_START);
+
+    for (int timeout = 100000; timeout > 0; timeout--) {
+        uint32_t eerd = e1000_read(E1000_REG_EERD);
+        if (eerd & E1000_EERD_DONE) {
+            *value = (uint16_t)(eerd >> 16);
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Take the MAC from the receive address registers, or the EEPROM */
+static bool __init e1000_read_mac(void) {
+    uint32_t ral = e1000_read(E1000_REG_RAL0);
+    uint32_t rah = e1000_read(E1000_REG_RAH0);
+
+    if (!(rah & E1000_RAH_AV)) {
+        uint16_t words[3];
+        for (int i = 0; i < 3; i++) {
+            if (!e1000_eeprom_read((uint8_t)i, &words[i])) {
+                return false;
+            }
+        }
+        ral = words[0] | ((uint32_t)words[1] << 16);
+        rah = words[2] | E1000_RAH_AV;
+        e1000_write(E1000_REG_RAL0, ral);
+        e1000_write(E1000_REG_RAH0, rah);
+    }
+
+    for (int i = 0; i < 4; i++) {
+        mac_addr[i] = (uint8_t)(ral >> (i * 8));
+    }
+    mac_addr[4] = (uint8_t)rah;
+    mac_addr[5] = (uint8_t)(rah >> 8);
+    return true;
+}
+
+/*------------------------------------------------------------------------------
+ * Receive page pool
+ *------------------------------------------------------------------------------
+ */
+
+static inline uint8_t* rx_buffer_virt(uint16_t index) {
+    return rx_pool + (uint32_t)index * E1000_BUFFER_SIZE;
+}
+
+static inline uint32_t rx_buffer_phys(uint16_t index) {
+    return rx_pool_phys + (uint32_t)index * E1000_BUFFER_SIZE;
+}
+
+static inline void rx_pool_put(uint16_t index) {
+    rx_free[rx_free_count++] = index;
+}
+
+/* Last reference to a received packet dropped: back to the pool */
+static void e1000_rx_release(netbuf_t* nb) {
+    rx_pool_put((uint16_t)(nb - rx_netbufs));
+}
+
+/* Post free pool buffers to the ring. Unless forced, waits until a whole
+ * batch of slots is empty so the RDT doorbell is written once per batch. */
+static void e1000_rx_refill(bool force) {
+    uint32_t room = (E1000_NUM_RX_DESC - 1) - rx_posted;
+    if (room == 0 || (!force && room < E1000_RX_REFILL_BATCH)) {
+        return;
+    }
+
+    uint32_t posted = 0;
+    while (posted < room) {
+        if (rx_free_count == 0) {
+            stats.rx_no_buffer++;
+            break;
+        }
+
+        uint16_t index = rx_free[--rx_free_count];
+        rx_slot_buf[rx_tail] = index;
+        rx_ring[rx_tail].addr = rx_buffer_phys(index);
+        rx_ring[rx_tail].status = 0;
+        rx_tail = (rx_tail + 1) % E1000_NUM_RX_DESC;
+        posted++;
+    }
+
+    if (posted) {
+        rx_posted += posted;
+        e1000_barrier();
+        e1000_write(E1000_REG_RDT, rx_tail);
+        stats.rx_refills++;
+    }
+}
+
+/*------------------------------------------------------------------------------
+ * Initialization
+ *------------------------------------------------------------------------------
+ */
+
+static pci_device_t* __init e1000_find_pci(void) {
+    for (size_t i = 0; i < sizeof(e1000_device_ids) / sizeof(e1000_device_ids[0]); i++) {
+        pci_device_t* dev = pci_find_device(E1000_VENDOR_ID, e1000_device_ids[i]);
+        if (dev) {
+            return dev;
+        }
+    }
+    return NULL;
+}
+
+/* Allocate the rings, the RX pool and the TX bounce buffers */
+static bool __init e1000_alloc_rings(void) {
+    uint32_t phys;
+
+    rx_ring = (volatile e1000_rx_desc_t*)dma_alloc(E1000_NUM_RX_DESC * sizeof(e1000_rx_desc_t), &phys);
+    if (!rx_ring) {
+        return false;
+    }
+    e1000_write(E1000_REG_RDBAL, phys);
+    e1000_write(E1000_REG_RDBAH, 0);
+    e1000_write(E1000_REG_RDLEN, E1000_NUM_RX_DESC * sizeof(e1000_rx_desc_t));
+
+    tx_ring = (volatile e1000_tx_desc_t*)dma_alloc(E1000_NUM_TX_DESC * sizeof(e1000_tx_desc_t), &phys);
+    if (!tx_ring) {
+        return false;
+    }
+    e1000_write(E1000_REG_TDBAL, phys);
+    e1000_write(E1000_REG_TDBAH, 0);
+    e1000_write(E1000_REG_TDLEN, E1000_NUM_TX_DESC * sizeof(e1000_tx_desc_t));
+
+    rx_pool = (uint8_t*)dma_alloc(E1000_RX_POOL_BUFFERS * E1000_BUFFER_SIZE, &rx_pool_phys);
+    tx_buffers = (uint8_t*)dma_alloc(E1000_NUM_TX_DESC * E1000_BUFFER_SIZE, &tx_buffers_phys);
+    if (!rx_pool || !tx_buffers) {
+        return false;
+    }
+
+    rx_free_count = 0;
+    for (int i = E1000_RX_POOL_BUFFERS - 1; i >= 0; i--) {
+        netbuf_init(&rx_netbufs[i], rx_buffer_virt((uint16_t)i), rx_buffer_phys((uint16_t)i),
+                    E1000_BUFFER_SIZE, e1000_rx_release);
+        rx_pool_put((uint16_t)i);
+    }
+
+    for (int i = 0; i < E1000_NUM_TX_DESC; i++) {
+        tx_ring[i].status = E1000_TXD_STAT_DD;  /* Free slots look completed */
+        tx_slot_nb[i] = NULL;
+    }
+
+    return true;
+}
+
+/* Find and bring up the NIC */
+bool __init e1000_init(void) {
+    nic_present = false;
+    memset(&stats, 0, sizeof(stats));
+
+    nic_pci = e1000_find_pci();
+    if (!nic_pci || (nic_pci->bar[0] & PCI_BAR_IO)) {
+        return false;
+    }
+
+    uint32_t mmio_phys = nic_pci->bar[0] & PCI_BAR_MEM_MASK;
+    uint32_t mmio_size = pci_bar_size(nic_pci, 0);
+    if (mmio_size == 0) {
+        mmio_size = 0x20000;
+    }
+
+    pci_enable_device(nic_pci);
+    mmio = (volatile uint8_t*)map_device_memory(mmio_phys, mmio_size);
+    if (!mmio) {
+        return false;
+    }
+
+    /* Reset, then mask and acknowledge everything */
+    e1000_write(E1000_REG_IMC, 0xFFFFFFFF);
+    e1000_write(E1000_REG_CTRL, e1000_read(E1000_REG_CTRL) | E1000_CTRL_RST);
+    for (int timeout = 100000; timeout > 0 && (e1000_read(E1000_REG_CTRL) & E1000_CTRL_RST); timeout--) {
+    }
+    e1000_write(E1000_REG_IMC, 0xFFFFFFFF);
+    e1000_read(E1000_REG_ICR);
+
+    e1000_write(E1000_REG_CTRL, e1000_read(E1000_REG_CTRL) | E1000_CTRL_SLU | E1000_CTRL_ASDE);
+
+    if (!e1000_read_mac()) {
+        DEBUG_PRINT("E1000: cannot read MAC address");
+        return false;
+    }
+
+    for (int i = 0; i < 128; i++) {
+        e1000_write(E1000_REG_MTA + i * 4, 0);
+    }
+
+    if (!e1000_alloc_rings()) {
+        DEBUG_PRINT("E1000: out of DMA memory");
+        return false;
+    }
+
+    /* Receive: pre-post the whole ring before enabling */
+    rx_next = rx_tail = rx_posted = 0;
+    e1000_write(E1000_REG_RDH, 0);
+    e1000_write(E1000_REG_RDT, 0);
+    e1000_rx_refill(true);
+    e1000_write(E1000_REG_RDTR, 0);
+    e1000_write(E1000_REG_RADV, 0);
+    e1000_write(E1000_REG_RCTL, E1000_RCTL_EN | E1000_RCTL_BAM |
+                                E1000_RCTL_BSIZE_2048 | E1000_RCTL_SECRC);
+
+    /* Transmit */
+    tx_tail = tx_clean = tx_doorbell = 0;
+    e1000_write(E1000_REG_TDH, 0);
+    e1000_write(E1000_REG_TDT, 0);
+    e1000_write(E1000_REG_TIPG, 0x0060200A);
+    e1000_write(E1000_REG_TCTL, E1000_TCTL_EN | E1000_TCTL_PSP |
+                                (0x0F << E1000_TCTL_CT_SHIFT) |
+                                (0x40 << E1000_TCTL_COLD_SHIFT));
+
+    /* Interrupts: moderated, RX and link changes only */
+    e1000_write(E1000_REG_ITR, E1000_ITR_VALUE);
+    if (nic_pci->irq_line != PCI_NO_IRQ) {
+        trace_register_task(&rx_task, "e1000-rx");
+        irq_install_handler(nic_pci->irq_line, e1000_interrupt_handler);
+        if (nic_pci->irq_line >= 8) {
+            pic_unmask_irq(2);  /* Cascade */
+        }
+        pic_unmask_irq(nic_pci->irq_line);
+        rx_irq_masked = false;
+        e1000_write(E1000_REG_IMS, E1000_IMS_RX | E1000_ICR_LSC);
+    } else {
+        rx_irq_masked = true;   /* No IRQ routed: e1000_poll() finds work itself */
+    }
+
+    nic_present = true;
+    return true;
+}
+
+/*------------------------------------------------------------------------------
+ * Queries
+ *------------------------------------------------------------------------------
+ */
+
+bool e1000_present(void) {
+    return nic_present;
+}
+
+void e1000_get_mac(uint8_t mac[E1000_ETH_ALEN]) {
+    memcpy(mac, mac_addr, E1000_ETH_ALEN);
+}
+
+bool e1000_link_up(void) {
+    return nic_present && (e1000_read(E1000_REG_STATUS) & E1000_STATUS_LU);
+}
+
+void e1000_set_rx_handler(e1000_rx_handler_t handler) {
+    rx_handler = handler;
+}
+
+const e1000_stats_t* e1000_get_stats(void) {
+    return &stats;
+}
+
+/*------------------------------------------------------------------------------
+ * Transmit
+ *------------------------------------------------------------------------------
+ */
+
+/* Reclaim slots the NIC has finished with, dropping their netbufs */
+static void e1000_tx_reclaim(void) {
+    while (tx_clean != tx_tail && (tx_ring[tx_clean].status & E1000_TXD_STAT_DD)) {
+        if (tx_slot_nb[tx_clean]) {
+            netbuf_put(tx_slot_nb[tx_clean]);
+            tx_slot_nb[tx_clean] = NULL;
+        }
+        tx_clean = (tx_clean + 1) % E1000_NUM_TX_DESC;
+    }
+}
+
+/* Claim the next TX slot, reclaiming completed ones if the ring is full */
+static bool e1000_tx_slot_available(void) {
+    uint32_t next = (tx_tail + 1) % E1000_NUM_TX_DESC;
+    if (next == tx_clean) {
+        e1000_tx_reclaim();
+        if (next == tx_clean) {
+            stats.tx_ring_full++;
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Fill in the descriptor at tx_tail and advance */
+static void e1000_tx_post(uint32_t phys, uint16_t length) {
+    e1000_barrier();
+
+    tx_ring[tx_tail].addr = phys;
+    tx_ring[tx_tail].length = length;
+    tx_ring[tx_tail].cso = 0;
+    tx_ring[tx_tail].css = 0;
+    tx_ring[tx_tail].special = 0;
+    tx_ring[tx_tail].status = 0;
+    tx_ring[tx_tail].cmd = E1000_TXD_CMD_EOP | E1000_TXD_CMD_IFCS | E1000_TXD_CMD_RS;
+    tx_tail = (tx_tail + 1) % E1000_NUM_TX_DESC;
+
+    stats.tx_packets++;
+    stats.tx_bytes += length;
+}
+
+/* Queue a frame without ringing the doorbell, copying it to a bounce buffer */
+bool e1000_tx_queue(const void* frame, uint16_t length) {
+    if (!nic_present || length == 0 || length > E1000_MAX_FRAME || !e1000_tx_slot_available()) {
+        return false;
+    }
+
+    memcpy(tx_buffers + tx_tail * E1000_BUFFER_SIZE, frame, length);
+    e1000_tx_post(tx_buffers_phys + tx_tail * E1000_BUFFER_SIZE, length);
+    return true;
+}
+
+/* Queue a netbuf by reference; it is released when the NIC is done with it */
+bool e1000_tx_queue_netbuf(netbuf_t* nb) {
+    if (!nb->phys) {
+        /* Not DMA-able: fall back to the bounce buffer */
+        bool queued = e1000_tx_queue(nb->data, nb->len);
+        netbuf_put(nb);
+        return queued;
+    }
+
+    if (!nic_present || nb->len == 0 || nb->len > E1000_MAX_FRAME || !e1000_tx_slot_available()) {
+        netbuf_put(nb);
+        return false;
+    }
+
+    tx_slot_nb[tx_tail] = nb;
+    e1000_tx_post(netbuf_data_phys(nb), nb->len);
+    return true;
+}
+
+/* Hand all queued frames to the NIC with one tail write */
+void e1000_tx_flush(void) {
+    if (!nic_present || tx_doorbell == tx_tail) {
+        return;
+    }
+    e1000_barrier();
+    e1000_write(E1000_REG_TDT, tx_tail);
+    tx_doorbell = tx_tail;
+    stats.tx_doorbells++;
+}
+
+bool e1000_transmit(const void* frame, uint16_t length) {
+    if (!e1000_tx_queue(frame, length)) {
+        return false;
+    }
+    e1000_tx_flush();
+    return true;
+}
+
+/*------------------------------------------------------------------------------
+ * Receive and interrupts
+ *------------------------------------------------------------------------------
+ */
+
+/* Acknowledge the interrupt and defer RX work to e1000_poll() */
+void e1000_interrupt_handler(void) {
+    uint32_t icr = e1000_read(E1000_REG_ICR);
+    if (icr == 0) {
+        return;  /* Shared line, not ours */
+    }
+
+    stats.interrupts++;
+
+    if (icr & E1000_IMS_RX) {
+        trace_sched_wakeup(&rx_task);
+        e1000_write(E1000_REG_IMC, E1000_IMS_RX);
+        rx_irq_masked = true;
+        trace_sched_enqueue(&rx_task);
+    }
+
+    if (icr & E1000_ICR_LSC) {
+        e1000_write(E1000_REG_CTRL, e1000_read(E1000_REG_CTRL) | E1000_CTRL_SLU);
+    }
+}
+
+/* Harvest completed RX descriptors under a budget, refill, reclaim TX */
+void e1000_poll(void) {
+    if (!nic_present) {
+        return;
+    }
+
+    /* Completed transmits hold netbuf references; free them promptly */
+    e1000_tx_reclaim();
+
+    if (!rx_irq_masked) {
+        return;
+    }
+
+    stats.polls++;
+    trace_sched_switch_in(&rx_task);
+
+    uint32_t budget = E1000_RX_BUDGET;
+    while (budget > 0 && rx_posted > 0 && (rx_ring[rx_next].status & E1000_RXD_STAT_DD)) {
+        e1000_barrier();
+
+        uint16_t index = rx_slot_buf[rx_next];
+        uint8_t status = rx_ring[rx_next].status;
+        uint8_t errors = rx_ring[rx_next].errors;
+        uint16_t length = rx_ring[rx_next].length;
+
+        rx_ring[rx_next].status = 0;
+
+        /* Wrap the buffer; the pool gets it back on the last netbuf_put() */
+        netbuf_t* nb = &rx_netbufs[index];
+        netbuf_reset(nb, 0);
+        nb->refcount = 1;
+
+        if ((status & E1000_RXD_STAT_EOP) && errors == 0) {
+            stats.rx_packets++;
+            stats.rx_bytes += length;
+            nb->len = length;
+            if (rx_handler) {
+                rx_handler(nb);
+            }
+        } else {
+            stats.rx_errors++;  /* Errored or larger than one buffer */
+        }
+
+        netbuf_put(nb);
+        rx_next = (rx_next + 1) % E1000_NUM_RX_DESC;
+        rx_posted--;
+        budget--;
+
+        /* Don't let the NIC run dry on a long burst */
+        e1000_rx_refill(false);
+    }
+
+    /* Top up completely if the ring got low */
+    e1000_rx_refill(rx_posted < E1000_RX_REFILL_BATCH);
+
+    /* Ring drained: hand control back to the (moderated) interrupt. Checked
+     * with interrupts off so a packet landing in between is not stranded:
+     * its cause stays latched in ICR and fires as soon as IMS is set. */
+    if (budget > 0 && nic_pci->irq_line != PCI_NO_IRQ) {
+        uint32_t flags;
+        asm volatile("pushfl; popl %0; cli" : "=r"(flags) :: "memory");
+        if (!(rx_ring[rx_next].status & E1000_RXD_STAT_DD)) {
+            rx_irq_masked = false;
+            e1000_write(E1000_REG_IMS, E1000_IMS_RX);
+        }
+        asm volatile("pushl %0; popfl" :: "r"(flags) : "memory", "cc");
+    }
+
+    trace_sched_switch_out(&rx_task);
+}
+
+/*------------------------------------------------------------------------------
+ * Debug output
+ *------------------------------------------------------------------------------
+ */
+
+static void e1000_print_hex8(uint8_t value) {
+    const char* digits = "0123456789ABCDEF";
+    terminal_putchar(digits[value >> 4]);
+    terminal_putchar(digits[value & 0xF]);
+}
+
+void e1000_print_info(void) {
+    if (!nic_present) {
+        terminal_writestring("No e1000 network card found\n");
+        return;
+    }
+
+    terminal_writestring("eth0: e1000  MAC ");
+    for (int i = 0; i < E1000_ETH_ALEN; i++) {
+        if (i) terminal_putchar(':');
+        e1000_print_hex8(mac_addr[i]);
+    }
+    terminal_writestring(e1000_link_up() ? "  link up" : "  link down");
+    if (nic_pci->irq_line != PCI_NO_IRQ) {
+        terminal_writestring("  IRQ ");
+        terminal_write_dec(nic_pci->irq_line);
+    }
+    terminal_writestring("\n  Rings: RX ");
+    terminal_write_dec(rx_posted);
+    terminal_writestring("/");
+    terminal_write_dec(E1000_NUM_RX_DESC);
+    terminal_writestring(" posted, pool ");
+    terminal_write_dec(rx_free_count);
+    terminal_writestring(" free, TX ");
+    terminal_write_dec(E1000_NUM_TX_DESC);
+    terminal_writestring("\n  RX packets: ");
+    terminal_write_dec(stats.rx_packets);
+    terminal_writestring("  bytes: ");
+    terminal_write_dec(stats.rx_bytes);
+    terminal_writestring("  errors: ");
+    terminal_write_dec(stats.rx_errors);
+    terminal_writestring("  no buffer: ");
+    terminal_write_dec(stats.rx_no_buffer);
+    terminal_writestring("\n  TX packets: ");
+    terminal_write_dec(stats.tx_packets);
+    terminal_writestring("  bytes: ");
+    terminal_write_dec(stats.tx_bytes);
+    terminal_writestring("  ring full: ");
+    terminal_write_dec(stats.tx_ring_full);
+    terminal_writestring("\n  Interrupts: ");
+    terminal_write_dec(stats.interrupts);
+    terminal_writestring("  polls: ");
+    terminal_write_dec(stats.polls);
+    terminal_writestring("  RDT writes: ");
+    terminal_write_dec(stats.rx_refills);
+    terminal_writestring("  TDT writes: ");
+    terminal_write_dec(stats.tx_doorbells);
+    terminal_writestring("\n");
+}
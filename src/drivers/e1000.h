@@ -0,0 +1,200 @@
+#ifndef E1000_H
+#define E1000_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../kernel/netbuf.h"
+
+/*------------------------------------------------------------------------------
+ * Intel 8254x (e1000) Network Driver for SKOS
+ *------------------------------------------------------------------------------
+ * Driver for the gigabit NIC QEMU emulates with "-device e1000".
+ *
+ * Both directions use legacy descriptor rings in physically contiguous DMA
+ * memory. Receive buffers are half-page slices handed out by a fixed page
+ * pool: they are posted to the ring ahead of time, so packets land in memory
+ * with no per-packet allocation. Each is wrapped in a netbuf that is passed
+ * up the stack by reference and returns to the pool on its last
+ * netbuf_put(). Transmit takes netbufs by reference too: the descriptor
+ * points straight at the packet and the reference is dropped once the NIC
+ * reports the slot done.
+ *
+ * Interrupts are moderated by the ITR register. The IRQ handler only
+ * acknowledges the cause and masks further RX interrupts; e1000_poll(),
+ * called from the main loop, harvests completed descriptors under a budget,
+ * re-posts buffers in batches (one RDT doorbell write per batch) and
+ * re-enables interrupts once the ring is drained.
+ *------------------------------------------------------------------------------
+ */
+
+/* PCI identification */
+#define E1000_VENDOR_ID         0x8086
+#define E1000_DEVICE_ID         0x100E  /* 82540EM, QEMU's default */
+
+/* Register offsets */
+#define E1000_REG_CTRL          0x0000  /* Device control */
+#define E1000_REG_STATUS        0x0008  /* Device status */
+#define E1000_REG_EERD          0x0014  /* EEPROM read */
+#define E1000_REG_ICR           0x00C0  /* Interrupt cause read (clears) */
+#define E1000_REG_ITR           0x00C4  /* Interrupt throttling */
+#define E1000_REG_IMS           0x00D0  /* Interrupt mask set */
+#define E1000_REG_IMC           0x00D8  /* Interrupt mask clear */
+#define E1000_REG_RCTL          0x0100  /* Receive control */
+#define E1000_REG_TCTL          0x0400  /* Transmit control */
+#define E1000_REG_TIPG          0x0410  /* Transmit inter-packet gap */
+#define E1000_REG_RDBAL         0x2800  /* RX descriptor base low */
+#define E1000_REG_RDBAH         0x2804  /* RX descriptor base high */
+#define E1000_REG_RDLEN         0x2808  /* RX descriptor ring length */
+#define E1000_REG_RDH           0x2810  /* RX head */
+#define E1000_REG_RDT           0x2818  /* RX tail */
+#define E1000_REG_RDTR          0x2820  /* RX delay timer */
+#define E1000_REG_RADV          0x282C  /* RX absolute delay timer */
+#define E1000_REG_TDBAL         0x3800  /* TX descriptor base low */
+#define E1000_REG_TDBAH         0x3804  /* TX descriptor base high */
+#define E1000_REG_TDLEN         0x3808  /* TX descriptor ring length */
+#define E1000_REG_TDH           0x3810  /* TX head */
+#define E1000_REG_TDT           0x3818  /* TX tail */
+#define E1000_REG_MTA           0x5200  /* Multicast table (128 entries) */
+#define E1000_REG_RAL0          0x5400  /* Receive address low */
+#define E1000_REG_RAH0          0x5404  /* Receive address high */
+
+/* CTRL bits */
+#define E1000_CTRL_ASDE         (1 << 5)    /* Auto-speed detection */
+#define E1000_CTRL_SLU          (1 << 6)    /* Set link up */
+#define E1000_CTRL_RST          (1 << 26)   /* Device reset */
+
+/* STATUS bits */
+#define E1000_STATUS_LU         (1 << 1)    /* Link up */
+
+/* EERD bits */
+#define E1000_EERD_START        (1 << 0)
+#define E1000_EERD_DONE         (1 << 4)
+
+/* RAH bits */
+#define E1000_RAH_AV            (1u << 31)  /* Address valid */
+
+/* RCTL bits */
+#define E1000_RCTL_EN           (1 << 1)    /* Receiver enable */
+#define E1000_RCTL_UPE          (1 << 3)    /* Unicast promiscuous */
+#define E1000_RCTL_MPE          (1 << 4)    /* Multicast promiscuous */
+#define E1000_RCTL_BAM          (1 << 15)   /* Accept broadcast */
+#define E1000_RCTL_BSIZE_2048   (0 << 16)   /* 2KB receive buffers */
+#define E1000_RCTL_SECRC        (1 << 26)   /* Strip Ethernet CRC */
+
+/* TCTL bits */
+#define E1000_TCTL_EN           (1 << 1)    /* Transmitter enable */
+#define E1000_TCTL_PSP          (1 << 3)    /* Pad short packets */
+#define E1000_TCTL_CT_SHIFT     4           /* Collision threshold */
+#define E1000_TCTL_COLD_SHIFT   12          /* Collision distance */
+
+/* Interrupt causes (ICR/IMS/IMC) */
+#define E1000_ICR_TXDW          (1 << 0)    /* TX descriptor written back */
+#define E1000_ICR_LSC           (1 << 2)    /* Link status change */
+#define E1000_ICR_RXDMT0        (1 << 4)    /* RX ring below threshold */
+#define E1000_ICR_RXO           (1 << 6)    /* RX overrun */
+#define E1000_ICR_RXT0          (1 << 7)    /* RX timer expired */
+#define E1000_IMS_RX            (E1000_ICR_RXT0 | E1000_ICR_RXDMT0 | E1000_ICR_RXO)
+
+/* Descriptor bits */
+#define E1000_RXD_STAT_DD       0x01        /* Descriptor done */
+#define E1000_RXD_STAT_EOP      0x02        /* End of packet */
+#define E1000_TXD_CMD_EOP       0x01        /* End of packet */
+#define E1000_TXD_CMD_IFCS      0x02        /* Insert FCS */
+#define E1000_TXD_CMD_RS        0x08        /* Report status */
+#define E1000_TXD_STAT_DD       0x01        /* Descriptor done */
+
+/* Ring and pool sizing (ring sizes must be multiples of 8) */
+#define E1000_NUM_RX_DESC       128
+#define E1000_NUM_TX_DESC       64
+#define E1000_BUFFER_SIZE       2048
+#define E1000_RX_POOL_BUFFERS   (E1000_NUM_RX_DESC + 32)
+#define E1000_RX_REFILL_BATCH   16          /* Post RX buffers this many at a time */
+#define E1000_RX_BUDGET         64          /* Max packets per e1000_poll() */
+
+/* Interrupt moderation: ITR counts 256ns units between interrupts */
+#define E1000_MAX_IRQ_PER_SEC   8000
+#define E1000_ITR_VALUE         (1000000000 / (E1000_MAX_IRQ_PER_SEC * 256))
+
+#define E1000_ETH_ALEN          6
+#define E1000_MAX_FRAME         1514        /* Without FCS */
+
+/* Legacy receive descriptor */
+typedef struct {
+    uint64_t addr;              /* Buffer physical address */
+    uint16_t length;            /* Bytes written by the NIC */
+    uint16_t checksum;
+    uint8_t  status;
+    uint8_t  errors;
+    uint16_t special;
+} __attribute__((packed)) e1000_rx_desc_t;
+
+/* Legacy transmit descriptor */
+typedef struct {
+    uint64_t addr;              /* Buffer physical address */
+    uint16_t length;
+    uint8_t  cso;
+    uint8_t  cmd;
+    uint8_t  status;
+    uint8_t  css;
+    uint16_t special;
+} __attribute__((packed)) e1000_tx_desc_t;
+
+/* Driver statistics */
+typedef struct {
+    uint32_t rx_packets;
+    uint32_t rx_bytes;
+    uint32_t rx_errors;
+    uint32_t rx_no_buffer;      /* Refill found the pool empty */
+    uint32_t rx_refills;        /* RDT doorbell writes */
+    uint32_t tx_packets;
+    uint32_t tx_bytes;
+    uint32_t tx_ring_full;
+    uint32_t tx_doorbells;      /* TDT doorbell writes */
+    uint32_t interrupts;
+    uint32_t polls;
+} e1000_stats_t;
+
+/* Receive callback; nb->data is the Ethernet frame. Take a reference to
+ * keep it past the callback. */
+typedef void (*e1000_rx_handler_t)(netbuf_t* nb);
+
+/* Function prototypes */
+
+/* Find and bring up the NIC */
+bool e1000_init(void);
+
+/* Whether a NIC was found and initialized */
+bool e1000_present(void);
+
+/* Get the station MAC address */
+void e1000_get_mac(uint8_t mac[E1000_ETH_ALEN]);
+
+/* Whether the link is up */
+bool e1000_link_up(void);
+
+/* Set the function that receives incoming frames */
+void e1000_set_rx_handler(e1000_rx_handler_t handler);
+
+/* Queue a frame without ringing the doorbell; follow with e1000_tx_flush() */
+bool e1000_tx_queue(const void* frame, uint16_t length);
+
+/* Queue a netbuf without copying it; consumes the reference */
+bool e1000_tx_queue_netbuf(netbuf_t* nb);
+
+/* Hand all queued frames to the NIC with one tail write */
+void e1000_tx_flush(void);
+
+/* Queue and flush a single frame */
+bool e1000_transmit(const void* frame, uint16_t length);
+
+/* Process completed descriptors (call from the main loop) */
+void e1000_poll(void);
+
+/* IRQ handler installed through irq_install_handler() */
+void e1000_interrupt_handler(void);
+
+/* Statistics */
+const e1000_stats_t* e1000_get_stats(void);
+void e1000_print_info(void);
+
+#endif /* E1000_H */
@@ -12,8 +12,10 @@
  */
 
 #include "keyboard.h"
+#include "../kernel/init.h"
 #include "../kernel/kernel.h"
 #include "../kernel/pic.h"
+#include "../kernel/cache.h"
 #include <stddef.h>
 
 /*------------------------------------------------------------------------------
@@ -21,11 +23,10 @@
  *------------------------------------------------------------------------------
  */
 
-/* Keyboard state */
-static keyboard_state_t keyboard_state = {0};
-
-/* Input buffer */
-static input_buffer_t input_buffer = {0};
+/* Keyboard state and input ring: written by IRQ1, read by the main loop.
+ * The ring gets its own cache lines so polling it touches nothing else. */
+static keyboard_state_t keyboard_state __hot_data = {0};
+static input_buffer_t input_buffer __hot_data __cacheline_aligned = {0};
 
 /*------------------------------------------------------------------------------
  * Forward Declarations for Debug Functions
@@ -149,7 +150,7 @@ static int input_buffer_get(void) {
  *------------------------------------------------------------------------------
  */
 
-void keyboard_init(void) {
+void __init keyboard_init(void) {
     /* Initialize keyboard state */
     keyboard_state.shift_pressed = false;
     keyboard_state.ctrl_pressed = false;
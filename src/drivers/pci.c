@@ -0,0 +1,209 @@
+/*------------------------------------------------------------------------------
+ * PCI Configuration Space Access Implementation
+ *------------------------------------------------------------------------------
+ * This file implements PCI bus enumeration using configuration mechanism #1.
+ * Every function found at boot is recorded so drivers can look up their
+ * device by vendor/device ID.
+ *------------------------------------------------------------------------------
+ */
+
+#include "pci.h"
+#include "../kernel/init.h"
+#include "../kernel/kernel.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Enumerated functions */
+static pci_device_t pci_devices[PCI_MAX_DEVICES];
+static uint32_t pci_num_devices = 0;
+
+/* I/O port functions */
+static inline void outl(uint16_t port, uint32_t val) {
+    asm volatile ("outl %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline void outw(uint16_t port, uint16_t val) {
+    asm volatile ("outw %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline uint32_t inl(uint16_t port) {
+    uint32_t ret;
+    asm volatile ("inl %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+/*------------------------------------------------------------------------------
+ * Configuration space access
+ *------------------------------------------------------------------------------
+ */
+
+static inline uint32_t pci_address(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset) {
+    return 0x80000000 | ((uint32_t)bus << 16) | ((uint32_t)(slot & 0x1F) << 11) |
+           ((uint32_t)(func & 0x07) << 8) | (offset & 0xFC);
+}
+
+uint32_t pci_config_read32(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset) {
+    outl(PCI_CONFIG_ADDRESS, pci_address(bus, slot, func, offset));
+    return inl(PCI_CONFIG_DATA);
+}
+
+uint16_t pci_config_read16(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset) {
+    uint32_t value = pci_config_read32(bus, slot, func, offset);
+    return (uint16_t)(value >> ((offset & 2) * 8));
+}
+
+uint8_t pci_config_read8(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset) {
+    uint32_t value = pci_config_read32(bus, slot, func, offset);
+    return (uint8_t)(value >> ((offset & 3) * 8));
+}
+
+void pci_config_write32(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset, uint32_t value) {
+    outl(PCI_CONFIG_ADDRESS, pci_address(bus, slot, func, offset));
+    outl(PCI_CONFIG_DATA, value);
+}
+
+/* A real word access: rewriting the whole dword would also write back the
+ * neighbouring register, clearing write-1-to-clear bits such as Status */
+void pci_config_write16(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset, uint16_t value) {
+    outl(PCI_CONFIG_ADDRESS, pci_address(bus, slot, func, offset));
+    outw(PCI_CONFIG_DATA + (offset & 2), value);
+}
+
+/*------------------------------------------------------------------------------
+ * Enumeration
+ *------------------------------------------------------------------------------
+ */
+
+/* Record one function */
+static void __init pci_add_function(uint8_t bus, uint8_t slot, uint8_t func) {
+    if (pci_num_devices >= PCI_MAX_DEVICES) {
+        return;
+    }
+
+    pci_device_t* dev = &pci_devices[pci_num_devices++];
+    dev->bus = bus;
+    dev->slot = slot;
+    dev->func = func;
+    dev->vendor_id = pci_config_read16(bus, slot, func, PCI_VENDOR_ID);
+    dev->device_id = pci_config_read16(bus, slot, func, PCI_DEVICE_ID);
+    dev->class_code = pci_config_read8(bus, slot, func, PCI_CLASS);
+    dev->subclass = pci_config_read8(bus, slot, func, PCI_SUBCLASS);
+    dev->prog_if = pci_config_read8(bus, slot, func, PCI_PROG_IF);
+
+    /* Pin 0 means the function does not use INTx */
+    uint8_t pin = pci_config_read8(bus, slot, func, PCI_INTERRUPT_PIN);
+    uint8_t line = pci_config_read8(bus, slot, func, PCI_INTERRUPT_LINE);
+    dev->irq_line = (pin != 0 && line < 16) ? line : PCI_NO_IRQ;
+
+    for (int i = 0; i < 6; i++) {
+        dev->bar[i] = pci_config_read32(bus, slot, func, PCI_BAR0 + i * 4);
+    }
+}
+
+/* Scan all buses (brute force; fine for the handful of buses QEMU has) */
+void __init pci_init(void) {
+    pci_num_devices = 0;
+
+    for (uint32_t bus = 0; bus < 256; bus++) {
+        for (uint8_t slot = 0; slot < 32; slot++) {
+            if (pci_config_read16((uint8_t)bus, slot, 0, PCI_VENDOR_ID) == 0xFFFF) {
+                continue;
+            }
+
+            uint8_t header = pci_config_read8((uint8_t)bus, slot, 0, PCI_HEADER_TYPE);
+            uint8_t funcs = (header & 0x80) ? 8 : 1;
+
+            for (uint8_t func = 0; func < funcs; func++) {
+                if (pci_config_read16((uint8_t)bus, slot, func, PCI_VENDOR_ID) != 0xFFFF) {
+                    pci_add_function((uint8_t)bus, slot, func);
+                }
+            }
+        }
+    }
+}
+
+uint32_t pci_device_count(void) {
+    return pci_num_devices;
+}
+
+pci_device_t* pci_get_device(uint32_t index) {
+    return index < pci_num_devices ? &pci_devices[index] : NULL;
+}
+
+pci_device_t* pci_find_device(uint16_t vendor_id, uint16_t device_id) {
+    for (uint32_t i = 0; i < pci_num_devices; i++) {
+        if (pci_devices[i].vendor_id == vendor_id && pci_devices[i].device_id == device_id) {
+            return &pci_devices[i];
+        }
+    }
+    return NULL;
+}
+
+/*------------------------------------------------------------------------------
+ * Device setup
+ *------------------------------------------------------------------------------
+ */
+
+void pci_enable_device(pci_device_t* device) {
+    uint16_t command = pci_config_read16(device->bus, device->slot, device->func, PCI_COMMAND);
+    command |= PCI_COMMAND_IO | PCI_COMMAND_MEMORY | PCI_COMMAND_BUS_MASTER;
+    command &= ~PCI_COMMAND_INTX_DISABLE;
+    pci_config_write16(device->bus, device->slot, device->func, PCI_COMMAND, command);
+}
+
+/* Probe a memory BAR's size by writing all ones and reading back the mask */
+uint32_t pci_bar_size(pci_device_t* device, int bar) {
+    if (bar < 0 || bar >= 6 || (device->bar[bar] & PCI_BAR_IO)) {
+        return 0;
+    }
+
+    uint8_t offset = PCI_BAR0 + bar * 4;
+    uint16_t command = pci_config_read16(device->bus, device->slot, device->func, PCI_COMMAND);
+
+    /* Stop decoding while the BAR holds the probe value */
+    pci_config_write16(device->bus, device->slot, device->func, PCI_COMMAND,
+                       command & ~(PCI_COMMAND_IO | PCI_COMMAND_MEMORY));
+    pci_config_write32(device->bus, device->slot, device->func, offset, 0xFFFFFFFF);
+    uint32_t mask = pci_config_read32(device->bus, device->slot, device->func, offset);
+    pci_config_write32(device->bus, device->slot, device->func, offset, device->bar[bar]);
+    pci_config_write16(device->bus, device->slot, device->func, PCI_COMMAND, command);
+
+    mask &= PCI_BAR_MEM_MASK;
+    return mask ? (~mask + 1) : 0;
+}
+
+/*------------------------------------------------------------------------------
+ * Debug output
+ *------------------------------------------------------------------------------
+ */
+
+static void pci_print_hex(uint32_t value, int digits) {
+    for (int shift = (digits - 1) * 4; shift >= 0; shift -= 4) {
+        int digit = (value >> shift) & 0xF;
+        terminal_putchar(digit < 10 ? '0' + digit : 'A' + digit - 10);
+    }
+}
+
+void pci_print_devices(void) {
+    for (uint32_t i = 0; i < pci_num_devices; i++) {
+        pci_device_t* dev = &pci_devices[i];
+
+        pci_print_hex(dev->bus, 2);
+        terminal_putchar(':');
+        pci_print_hex(dev->slot, 2);
+        terminal_putchar('.');
+        pci_print_hex(dev->func, 1);
+        terminal_writestring("  ");
+        pci_print_hex(dev->vendor_id, 4);
+        terminal_putchar(':');
+        pci_print_hex(dev->device_id, 4);
+        terminal_writestring("  class ");
+        pci_print_hex(dev->class_code, 2);
+        pci_print_hex(dev->subclass, 2);
+        if (dev->irq_line != PCI_NO_IRQ) {
+            terminal_writestring("  IRQ 0x");
+            pci_print_hex(dev->irq_line, 2);
+        }
+        terminal_writestring("\n");
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef PCI_H
+#define PCI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*------------------------------------------------------------------------------
+ * PCI Configuration Space Access for SKOS
+ *------------------------------------------------------------------------------
+ * Enumerates PCI functions through configuration mechanism #1 (ports
+ * 0xCF8/0xCFC) and gives drivers access to their configuration registers.
+ *------------------------------------------------------------------------------
+ */
+
+/* Configuration mechanism #1 ports */
+#define PCI_CONFIG_ADDRESS  0xCF8
+#define PCI_CONFIG_DATA     0xCFC
+
+/* Configuration space register offsets */
+#define PCI_VENDOR_ID       0x00
+#define PCI_DEVICE_ID       0x02
+#define PCI_COMMAND         0x04
+#define PCI_STATUS          0x06
+#define PCI_REVISION_ID     0x08
+#define PCI_PROG_IF         0x09
+#define PCI_SUBCLASS        0x0A
+#define PCI_CLASS           0x0B
+#define PCI_HEADER_TYPE     0x0E
+#define PCI_BAR0            0x10
+#define PCI_INTERRUPT_LINE  0x3C
+#define PCI_INTERRUPT_PIN   0x3D
+
+/* Command register bits */
+#define PCI_COMMAND_IO          0x0001  /* I/O space decoding */
+#define PCI_COMMAND_MEMORY      0x0002  /* Memory space decoding */
+#define PCI_COMMAND_BUS_MASTER  0x0004  /* Device may initiate DMA */
+#define PCI_COMMAND_INTX_DISABLE 0x0400 /* Legacy INTx disabled */
+
+/* BAR decoding */
+#define PCI_BAR_IO          0x01
+#define PCI_BAR_MEM_MASK    0xFFFFFFF0
+#define PCI_BAR_IO_MASK     0xFFFFFFFC
+
+#define PCI_MAX_DEVICES     32
+#define PCI_NO_IRQ          0xFF
+
+/* One enumerated PCI function */
+typedef struct {
+    uint8_t  bus;
+    uint8_t  slot;
+    uint8_t  func;
+    uint16_t vendor_id;
+    uint16_t device_id;
+    uint8_t  class_code;
+    uint8_t  subclass;
+    uint8_t  prog_if;
+    uint8_t  irq_line;      /* Legacy PIC line, PCI_NO_IRQ if none */
+    uint32_t bar[6];        /* Raw BAR values */
+} pci_device_t;
+
+/* Function prototypes */
+
+/* Scan all buses and record the functions found */
+void pci_init(void);
+
+/* Configuration space access */
+uint32_t pci_config_read32(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset);
+uint16_t pci_config_read16(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset);
+uint8_t  pci_config_read8(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset);
+void pci_config_write32(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset, uint32_t value);
+void pci_config_write16(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset, uint16_t value);
+
+/* Enumeration results */
+uint32_t pci_device_count(void);
+pci_device_t* pci_get_device(uint32_t index);
+pci_device_t* pci_find_device(uint16_t vendor_id, uint16_t device_id);
+
+/* Turn on memory/I/O decoding and bus mastering for a device */
+void pci_enable_device(pci_device_t* device);
+
+/* Size of a memory BAR in bytes (0 if unimplemented) */
+uint32_t pci_bar_size(pci_device_t* device, int bar);
+
+/* Print the device list */
+void pci_print_devices(void);
+
+#endif /* PCI_H */
@@ -12,9 +12,28 @@
 #include "../kernel/pic.h"
 #include "../kernel/debug.h"
 #include "../kernel/fat32.h"
+#include "../kernel/ioring.h"
+#include "../kernel/sendfile.h"
+#include "../kernel/crc32c.h"
+#include "../kernel/initrd.h"
+#include "../kernel/fpu.h"
+#include "../kernel/net.h"
+#include "../kernel/tftp.h"
+#include "../kernel/uaccess.h"
+#include "../kernel/shrinker.h"
+#include "../kernel/swap.h"
+#include "../kernel/wss.h"
+#include "../kernel/counter.h"
+#include "../kernel/top.h"
+#include "../kernel/trace.h"
+#include "../kernel/sched.h"
+#include "../kernel/async.h"
+#include "../kernel/string.h"
 #include "timer.h"
 #include "keyboard.h"
 #include "ata.h"
+#include "pci.h"
+#include "e1000.h"
 
 /* Forward declarations for helper functions */
 static void print_hex32(uint32_t value);
@@ -112,14 +131,35 @@ static const shell_command_t commands[] = {
     {"cpuid", shell_cmd_cpuid, "Show CPU information and features"},
     {"regs", shell_cmd_regs, "Show CPU register information"},
     {"irq", shell_cmd_irq, "Show interrupt controller status"},
-    {"debug", shell_cmd_debug, "Show kernel profiling and debug statistics"},
+    {"debug", shell_cmd_debug, "Show profiling statistics (debug [on|off])"},
     {"echo", shell_cmd_echo, "Echo text back"},
     {"reboot", shell_cmd_reboot, "Reboot the system"},
     {"scancode", shell_cmd_scancode, "Enter scancode debug mode (press q to quit)"},
     {"ls", shell_cmd_ls, "List files in current directory"},
     {"cat", shell_cmd_cat, "Display contents of a file"},
+    {"cp", shell_cmd_cp, "Copy a file (usage: cp source dest)"},
+    {"crc32c", shell_cmd_crc32c, "Checksum a file with CRC32C (usage: crc32c filename)"},
+    {"sum", shell_cmd_crc32c, "Alias for crc32c; 'sum -cache' verifies the buffer cache"},
+    {"initrd", shell_cmd_initrd, "List initrd files or show one (usage: initrd [name])"},
     {"write", shell_cmd_write, "Write text to a file (usage: write filename text)"},
-    {"fsinfo", shell_cmd_fsinfo, "Show file system information"}
+    {"fsinfo", shell_cmd_fsinfo, "Show file system information"},
+    {"ioring", shell_cmd_ioring, "Read a file through a batched I/O ring (usage: ioring filename)"},
+    {"lspci", shell_cmd_lspci, "List PCI devices"},
+    {"ifconfig", shell_cmd_ifconfig, "Show network interface status and counters"},
+    {"ping", shell_cmd_ping, "ICMP echo round-trip times (ping <ip> [count])"},
+    {"udpbench", shell_cmd_udpbench, "UDP echo packet rate (udpbench [ip] [count] [size])"},
+    {"tftp", shell_cmd_tftp, "Show TFTP server status and last transfer rate"},
+    {"ucopy", shell_cmd_ucopy, "Exercise copy_from_user on mapped and unmapped pages"},
+    {"swapon", shell_cmd_swapon, "Enable swap: swapon <file> | swapon hdb"},
+    {"swap", shell_cmd_swap, "Show swap status; swap test <MB> runs a working set through it"},
+    {"wss", shell_cmd_wss, "Show working set and idle pages per area (wss scan: sample now)"},
+    {"stats", shell_cmd_stats, "Show all statistics counters (stats reset: zero them)"},
+    {"top", shell_cmd_top, "Live system monitor, refreshed every second (q to quit)"},
+    {"trace", shell_cmd_trace, "Wakeup latency histograms and worst case (trace [on|off|reset])"},
+    {"ps", shell_cmd_ps, "List threads with state, nice level and CPU time"},
+    {"spin", shell_cmd_spin, "Start a CPU-bound thread (spin <seconds> [nice])"},
+    {"nice", shell_cmd_nice, "Change a thread's nice level (nice <id> <-20..19>)"},
+    {"async", shell_cmd_async, "List coroutines; async read <lba> compares async and sync reads"}
 };
 
 #define NUM_COMMANDS (sizeof(commands) / sizeof(commands[0]))
@@ -265,6 +305,57 @@ void shell_cmd_mem(const char* args) {
     
     /* Call the memory management function to print detailed stats */
     memory_print_stats();
+    
+    for (uint32_t z = 0; z < ZONE_COUNT; z++) {
+        const memory_zone_t* zone = memory_get_zone(z);
+        if (zone->end_page == zone->start_page) {
+            continue;
+        }
+        terminal_writestring("  Zone ");
+        terminal_writestring(zone->name);
+        terminal_writestring(": ");
+        terminal_write_dec(zone->free_pages);
+        terminal_writestring("/");
+        terminal_write_dec(zone->end_page - zone->start_page);
+        terminal_writestring(" pages free, ");
+        terminal_write_dec(zone->fallbacks);
+        terminal_writestring(" fallbacks\n");
+    }
+    
+    const tlb_stats_t* tlb = memory_get_tlb_stats();
+    terminal_writestring("  TLB: ");
+    terminal_write_dec(tlb->ranges);
+    terminal_writestring(" range updates, ");
+    terminal_write_dec(tlb->page_flushes);
+    terminal_writestring(" invlpg, ");
+    terminal_write_dec(tlb->full_flushes);
+    terminal_writestring(" full flushes\n");
+    
+    const zero_pool_stats_t* zp = memory_get_zero_pool_stats();
+    terminal_writestring("  Zeroed pages: ");
+    terminal_write_dec(zp->available);
+    terminal_writestring("/");
+    terminal_write_dec(ZERO_POOL_SIZE);
+    terminal_writestring(" ready, ");
+    terminal_write_dec(zp->hits);
+    terminal_writestring(" hits, ");
+    terminal_write_dec(zp->misses);
+    terminal_writestring(" misses, ");
+    terminal_write_dec(zp->zeroed);
+    terminal_writestring(" zeroed while idle\n");
+    
+    const shrinker_stats_t* rs = shrinker_get_stats();
+    terminal_writestring("  Reclaim: ");
+    terminal_write_dec(rs->pages_freed);
+    terminal_writestring(" pages freed in ");
+    terminal_write_dec(rs->direct);
+    terminal_writestring(" direct, ");
+    terminal_write_dec(rs->background);
+    terminal_writestring(" background passes\n");
+    
+    terminal_writestring("  Init memory freed: ");
+    terminal_write_dec(memory_get_init_freed() / 1024);
+    terminal_writestring(" KB\n");
     terminal_writestring("\n");
 }
 
@@ -590,9 +681,32 @@ void shell_cmd_cpuid(const char* args) {
         if (edx & (1 << 25)) terminal_writestring("SSE ");
         if (edx & (1 << 26)) terminal_writestring("SSE2 ");
         if (ecx & (1 << 0)) terminal_writestring("SSE3 ");
+        if (ecx & (1 << 20)) terminal_writestring("SSE4.2 ");
         terminal_writestring("\n");
     }
     
+    /* Lazy FPU switching counters */
+    terminal_writestring("  SSE: ");
+    if (fpu_sse_enabled()) {
+        const fpu_stats_t* fs = fpu_get_stats();
+        char num_str[24];
+        terminal_writestring("enabled, #NM traps ");
+        uint64_to_string(fs->traps, num_str);
+        terminal_writestring(num_str);
+        terminal_writestring(", saves ");
+        uint64_to_string(fs->saves, num_str);
+        terminal_writestring(num_str);
+        terminal_writestring(", restores ");
+        uint64_to_string(fs->restores, num_str);
+        terminal_writestring(num_str);
+        terminal_writestring(", kernel regions ");
+        uint64_to_string(fs->kernel_regions, num_str);
+        terminal_writestring(num_str);
+        terminal_writestring("\n");
+    } else {
+        terminal_writestring("disabled\n");
+    }
+    
     terminal_writestring("\n");
 }
 
@@ -740,7 +854,16 @@ void shell_cmd_echo(const char* args) {
 
 /* Debug command - shows kernel profiling and debug statistics */
 void shell_cmd_debug(const char* args) {
-    (void)args; /* Unused parameter */
+    if (args && shell_strcmp(args, "on")) {
+        debug_set_profiling(true);
+        terminal_writestring("Profiling hooks enabled\n");
+        return;
+    }
+    if (args && shell_strcmp(args, "off")) {
+        debug_set_profiling(false);
+        terminal_writestring("Profiling hooks disabled\n");
+        return;
+    }
     debug_print_profiling_stats();
 }
 
@@ -904,38 +1027,18 @@ void shell_cmd_cat(const char* args) {
         return;
     }
     
-    /* Read and display file contents */
-    char buffer[513];  /* 512 bytes + null terminator */
-    size_t bytes_read;
-    size_t total_bytes = 0;
+    /* Send file contents straight from the buffer cache to the console */
+    sendfile_sink_t console;
+    sendfile_sink_console(&console);
     
     terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
     
-    while ((bytes_read = fat32_read(file, buffer, 512)) > 0) {
-        buffer[bytes_read] = '\0';  /* Null terminate for display */
-        
-        /* Display the content, handling special characters */
-        for (size_t i = 0; i < bytes_read; i++) {
-            char c = buffer[i];
-            if (c == '\n') {
-                terminal_putchar('\n');
-            } else if (c == '\t') {
-                terminal_writestring("    ");  /* Replace tabs with spaces */
-            } else if (c >= 32 && c <= 126) {
-                terminal_putchar(c);  /* Printable ASCII */
-            } else {
-                terminal_putchar('?');  /* Replace non-printable with ? */
-            }
-        }
-        
-        total_bytes += bytes_read;
-        
-        /* Break if we've read enough to avoid screen overflow */
-        if (total_bytes > 2048) {
-            terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_BROWN, VGA_COLOR_BLACK));
-            terminal_writestring("\n\n[... truncated after 2KB ...]");
-            break;
-        }
+    /* Limit output to avoid screen overflow */
+    size_t total_bytes = sendfile(&console, file, NULL, 2048);
+    
+    if (file->file_size > total_bytes) {
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_BROWN, VGA_COLOR_BLACK));
+        terminal_writestring("\n\n[... truncated after 2KB ...]");
     }
     
     fat32_close(file);
@@ -971,6 +1074,271 @@ void shell_cmd_cat(const char* args) {
     terminal_writestring("\n\n");
 }
 
+/* Copy file command - copies a file with sendfile */
+void shell_cmd_cp(const char* args) {
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
+    terminal_writestring("\n=== COPY FILE ===\n\n");
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+    
+    if (!fat32_get_fs_info()) {
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
+        terminal_writestring("File system not initialized!\n");
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+        return;
+    }
+    
+    /* Split "source dest" */
+    char source[32];
+    char dest[32];
+    size_t i = 0;
+    size_t j = 0;
+    
+    if (args) {
+        while (args[i] && args[i] != ' ' && i < sizeof(source) - 1) {
+            source[i] = args[i];
+            i++;
+        }
+        source[i] = '\0';
+        while (args[i] == ' ') {
+            i++;
+        }
+        while (args[i] && args[i] != ' ' && j < sizeof(dest) - 1) {
+            dest[j++] = args[i++];
+        }
+    }
+    dest[j] = '\0';
+    
+    if (!args || source[0] == '\0' || dest[0] == '\0') {
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
+        terminal_writestring("Usage: cp <source> <dest>\n");
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+        terminal_writestring("Example: cp README.TXT COPY.TXT\n\n");
+        return;
+    }
+    
+    if (shell_strcmp(source, dest)) {
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
+        terminal_writestring("Source and destination are the same file!\n");
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+        return;
+    }
+    
+    fat32_file_t* src = fat32_open(source);
+    if (!src) {
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
+        terminal_writestring("File not found: ");
+        terminal_writestring(source);
+        terminal_writestring("\n");
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+        return;
+    }
+    
+    fat32_file_t* dst = fat32_create(dest);
+    if (!dst) {
+        fat32_close(src);
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
+        terminal_writestring("Failed to create file: ");
+        terminal_writestring(dest);
+        terminal_writestring(" (8.3 names only)\n");
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+        return;
+    }
+    
+    sendfile_sink_t sink;
+    sendfile_sink_file(&sink, dst);
+    size_t copied = sendfile(&sink, src, NULL, src->file_size);
+    bool complete = (copied == src->file_size);
+    
+    fat32_close(dst);
+    fat32_close(src);
+    
+    char num_str[24];
+    uint64_to_string(copied, num_str);
+    if (complete) {
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK));
+        terminal_writestring("Copied ");
+    } else {
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
+        terminal_writestring("Short copy: ");
+    }
+    terminal_writestring(num_str);
+    terminal_writestring(" bytes from ");
+    terminal_writestring(source);
+    terminal_writestring(" to ");
+    terminal_writestring(dest);
+    terminal_writestring("\n\n");
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+}
+
+/* sendfile sink that folds data into a running CRC32C */
+static size_t crc_sink_write(sendfile_sink_t* sink, const uint8_t* data, size_t len) {
+    uint32_t* crc = (uint32_t*)sink->ctx;
+    *crc = crc32c_update(*crc, data, len);
+    return len;
+}
+
+/* CRC32C command - checksums a file straight out of the buffer cache */
+void shell_cmd_crc32c(const char* args) {
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
+    terminal_writestring("\n=== CRC32C CHECKSUM ===\n\n");
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+    
+    if (!args || shell_strlen(args) == 0) {
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
+        terminal_writestring("Usage: crc32c <filename>\n");
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+        terminal_writestring("       sum -cache   (verify buffer cache, debug builds)\n\n");
+        return;
+    }
+    
+    if (shell_strcmp(args, "-cache")) {
+#ifdef DEBUG_ENABLED
+        uint32_t bad = bcache_verify();
+        terminal_writestring("Corrupt cache blocks: ");
+        char bad_str[24];
+        uint64_to_string(bad, bad_str);
+        terminal_writestring(bad_str);
+        terminal_writestring("\n\n");
+#else
+        terminal_writestring("Cache checksums need a DEBUG_ENABLED build.\n\n");
+#endif
+        return;
+    }
+    
+    if (!fat32_get_fs_info()) {
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
+        terminal_writestring("File system not initialized!\n");
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+        return;
+    }
+    
+    fat32_file_t* file = fat32_open(args);
+    if (!file) {
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
+        terminal_writestring("File not found: ");
+        terminal_writestring(args);
+        terminal_writestring("\n");
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+        return;
+    }
+    
+    /* Stream the file in cache-block sized pieces, no intermediate copy */
+    uint32_t crc = CRC32C_SEED;
+    sendfile_sink_t sink;
+    sink.write = crc_sink_write;
+    sink.splice = NULL;
+    sink.ctx = &crc;
+    sink.bytes = 0;
+    
+    uint64_t start = timer_get_ticks();
+    size_t bytes = sendfile(&sink, file, NULL, file->file_size);
+    uint64_t elapsed = timer_get_ticks() - start;
+    bool complete = (bytes == file->file_size);
+    fat32_close(file);
+    crc = crc32c_final(crc);
+    
+    terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+    print_hex32(crc);
+    terminal_writestring("  ");
+    terminal_writestring(args);
+    terminal_writestring("\n");
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+    
+    char num_str[24];
+    terminal_writestring("Bytes: ");
+    uint64_to_string(bytes, num_str);
+    terminal_writestring(num_str);
+    terminal_writestring("  Ticks: ");
+    uint64_to_string(elapsed, num_str);
+    terminal_writestring(num_str);
+    terminal_writestring("  Engine: ");
+    terminal_writestring(crc32c_hw_available() ? "SSE4.2" : "slice-by-8");
+    terminal_writestring("\n");
+    
+    if (!complete) {
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
+        terminal_writestring("Read error: checksum covers a partial file\n");
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+    }
+    terminal_writestring("\n");
+}
+
+/* Initrd command - lists the initrd or prints one of its files */
+void shell_cmd_initrd(const char* args) {
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
+    terminal_writestring("\n=== INITRD ===\n\n");
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+    
+    if (!initrd_present()) {
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
+        terminal_writestring("No initrd was loaded at boot!\n");
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+        return;
+    }
+    
+    char num_str[24];
+    
+    if (!args || shell_strlen(args) == 0) {
+        /* List archive contents */
+        for (uint32_t i = 0; i < initrd_file_count(); i++) {
+            const initrd_entry_t* entry = initrd_get_entry(i);
+            terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+            terminal_writestring(entry->name);
+            terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+            terminal_writestring("  ");
+            uint64_to_string(entry->size, num_str);
+            terminal_writestring(num_str);
+            terminal_writestring(" bytes (");
+            uint64_to_string(entry->compressed_size, num_str);
+            terminal_writestring(num_str);
+            terminal_writestring(" packed)");
+            if (initrd_is_loaded(entry)) {
+                terminal_writestring(" [loaded]");
+            }
+            terminal_writestring("\n");
+        }
+        terminal_writestring("\n");
+        return;
+    }
+    
+    const initrd_entry_t* entry = initrd_find(args);
+    if (!entry) {
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
+        terminal_writestring("Not in initrd: ");
+        terminal_writestring(args);
+        terminal_writestring("\n");
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+        return;
+    }
+    
+    bool was_loaded = initrd_is_loaded(entry);
+    uint64_t start = timer_get_ticks();
+    const uint8_t* data = initrd_get_data(entry);
+    uint64_t elapsed = timer_get_ticks() - start;
+    
+    if (!data) {
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
+        terminal_writestring("Failed to unpack file (corrupt or out of memory)\n");
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+        return;
+    }
+    
+    /* Print through the console sink's character filtering */
+    sendfile_sink_t console;
+    sendfile_sink_console(&console);
+    terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+    console.write(&console, data, entry->size > 2048 ? 2048 : entry->size);
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+    
+    if (!was_loaded) {
+        terminal_writestring("\n\nUnpacked in ");
+        uint64_to_string(elapsed, num_str);
+        terminal_writestring(num_str);
+        terminal_writestring(" ticks");
+    }
+    terminal_writestring("\n\n");
+}
+
 /* Write text to file command */
 void shell_cmd_write(const char* args) {
     terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
@@ -1285,6 +1653,846 @@ void shell_cmd_fsinfo(const char* args) {
     }
     
     terminal_writestring("\n");
+    bcache_print_stats();
+    terminal_writestring("\n");
+}
+
+/* I/O ring command - reads a file with one batched ring submission */
+void shell_cmd_ioring(const char* args) {
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
+    terminal_writestring("\n=== I/O RING ===\n\n");
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+    
+    if (!fat32_get_fs_info()) {
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
+        terminal_writestring("File system not initialized!\n");
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+        return;
+    }
+    
+    if (!args || shell_strlen(args) == 0) {
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
+        terminal_writestring("Usage: ioring <filename>\n");
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+        return;
+    }
+    
+    /* open + reads + close, all in a single submission */
+    const uint32_t chunk = 512;
+    const uint32_t reads = 32;
+    ioring_t* ring = ioring_setup(reads + 2);
+    uint8_t* buffer = (uint8_t*)kmalloc(chunk * reads);
+    if (!ring || !buffer) {
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
+        terminal_writestring("Out of memory!\n");
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+        if (ring) ioring_destroy(ring);
+        if (buffer) kfree(buffer);
+        return;
+    }
+    
+    ioring_sqe_t* sqe = ioring_get_sqe(ring);
+    ioring_prep_open(sqe, 0, args, false);
+    sqe->flags = IOSQE_IO_LINK;
+    sqe->user_data = 0xFFFFFFFF;
+    
+    for (uint32_t i = 0; i < reads; i++) {
+        sqe = ioring_get_sqe(ring);
+        ioring_prep_rw(sqe, IORING_OP_READ, 0, buffer + i * chunk, chunk, i * chunk);
+        sqe->flags = IOSQE_IO_LINK;
+        sqe->user_data = i;
+    }
+    
+    sqe = ioring_get_sqe(ring);
+    ioring_prep_close(sqe, 0);
+    sqe->user_data = 0xFFFFFFFE;
+    
+    uint32_t queued = ioring_sq_ready(ring);
+    uint64_t start = timer_get_ticks();
+    int submitted = ioring_enter(ring, queued, queued);
+    uint64_t elapsed = timer_get_ticks() - start;
+    
+    /* Reap completions straight from the CQ */
+    uint32_t completions = 0;
+    uint32_t errors = 0;
+    uint64_t bytes = 0;
+    ioring_cqe_t* cqe;
+    while ((cqe = ioring_peek_cqe(ring)) != NULL) {
+        if (cqe->res < 0) {
+            errors++;
+        } else if (cqe->user_data < reads) {
+            bytes += (uint32_t)cqe->res;
+        }
+        completions++;
+        ioring_cqe_seen(ring);
+    }
+    
+    char num_str[24];
+    terminal_writestring("Submitted SQEs:   ");
+    uint64_to_string(submitted < 0 ? 0 : (uint64_t)submitted, num_str);
+    terminal_writestring(num_str);
+    terminal_writestring("\nKernel entries:   ");
+    uint64_to_string(ring->enter_calls, num_str);
+    terminal_writestring(num_str);
+    terminal_writestring("\nCompletions:      ");
+    uint64_to_string(completions, num_str);
+    terminal_writestring(num_str);
+    terminal_writestring("\nFailed:           ");
+    uint64_to_string(errors, num_str);
+    terminal_writestring(num_str);
+    terminal_writestring("\nBytes read:       ");
+    uint64_to_string(bytes, num_str);
+    terminal_writestring(num_str);
+    terminal_writestring("\nElapsed ticks:    ");
+    uint64_to_string(elapsed, num_str);
+    terminal_writestring(num_str);
+    terminal_writestring("\n\n");
+    
+    kfree(buffer);
+    ioring_destroy(ring);
+}
+
+/* List PCI devices command */
+void shell_cmd_lspci(const char* args) {
+    (void)args;
+    
+    terminal_writestring("PCI devices (");
+    char num_str[24];
+    uint64_to_string(pci_device_count(), num_str);
+    terminal_writestring(num_str);
+    terminal_writestring("):\n");
+    pci_print_devices();
+}
+
+/* Network interface status command */
+void shell_cmd_ifconfig(const char* args) {
+    (void)args;
+    net_print_info();
+    terminal_writestring("\n");
+    e1000_print_info();
+}
+
+/* Parse the next decimal argument; leaves *value untouched if there is none */
+static const char* shell_next_uint(const char* p, uint32_t* value) {
+    while (*p == ' ') p++;
+    if (*p < '0' || *p > '9') {
+        return p;
+    }
+    uint32_t v = 0;
+    while (*p >= '0' && *p <= '9') {
+        v = v * 10 + (uint32_t)(*p - '0');
+        p++;
+    }
+    *value = v;
+    return p;
+}
+
+/* State shared with the ping echo handler */
+#define PING_ID             0x534B
+#define PING_PAYLOAD        56
+#define PING_TIMEOUT_MS     1000
+
+static volatile bool ping_replied;
+static uint16_t ping_expect_seq;
+static uint64_t ping_reply_tsc;
+
+static void ping_echo_handler(uint32_t src_ip, uint16_t id, uint16_t seq, netbuf_t* nb) {
+    (void)src_ip;
+    (void)nb;
+    if (id == PING_ID && seq == ping_expect_seq) {
+        ping_reply_tsc = timer_read_tsc();
+        ping_replied = true;
+    }
+}
+
+/* ICMP echo command: round-trip latency via the loopback or eth0 */
+void shell_cmd_ping(const char* args) {
+    uint32_t dst;
+    if (!args || !net_parse_ip(args, &dst)) {
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
+        terminal_writestring("Usage: ping <ip> [count]\n");
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+        return;
+    }
+
+    uint32_t count = 4;
+    const char* p = args;
+    while (*p && *p != ' ') p++;
+    shell_next_uint(p, &count);
+    if (count == 0) count = 1;
+
+    uint8_t payload[PING_PAYLOAD];
+    for (int i = 0; i < PING_PAYLOAD; i++) {
+        payload[i] = (uint8_t)i;
+    }
+
+    timer_tsc_khz();  /* Calibrate before the first timestamp */
+    icmp_set_echo_handler(ping_echo_handler);
+
+    uint32_t received = 0;
+    uint32_t min_us = 0xFFFFFFFF, max_us = 0, total_us = 0;
+
+    for (uint32_t seq = 1; seq <= count; seq++) {
+        ping_replied = false;
+        ping_expect_seq = (uint16_t)seq;
+
+        uint64_t start_ms = timer_get_uptime_ms();
+        uint64_t t0 = timer_read_tsc();
+        if (!icmp_send_echo(dst, PING_ID, (uint16_t)seq, payload, PING_PAYLOAD)) {
+            terminal_writestring("ping: send failed (no route or no buffers)\n");
+            break;
+        }
+
+        while (!ping_replied && timer_get_uptime_ms() - start_ms < PING_TIMEOUT_MS) {
+            net_poll();
+            if (!ping_replied) {
+                asm volatile("hlt");
+            }
+        }
+
+        if (!ping_replied) {
+            terminal_writestring("Request timeout for seq ");
+            terminal_write_dec(seq);
+            terminal_writestring("\n");
+            continue;
+        }
+
+        uint32_t us = timer_tsc_to_us(ping_reply_tsc - t0);
+        received++;
+        total_us += us;
+        if (us < min_us) min_us = us;
+        if (us > max_us) max_us = us;
+
+        terminal_writestring("Reply from ");
+        net_print_ip(dst);
+        terminal_writestring(": seq=");
+        terminal_write_dec(seq);
+        terminal_writestring(" time=");
+        terminal_write_dec(us);
+        terminal_writestring(" us\n");
+    }
+
+    icmp_set_echo_handler(NULL);
+
+    terminal_writestring("--- ");
+    terminal_write_dec(count);
+    terminal_writestring(" sent, ");
+    terminal_write_dec(received);
+    terminal_writestring(" received");
+    if (received) {
+        terminal_writestring(", min/avg/max = ");
+        terminal_write_dec(min_us);
+        terminal_writestring("/");
+        terminal_write_dec(total_us / received);
+        terminal_writestring("/");
+        terminal_write_dec(max_us);
+        terminal_writestring(" us");
+    }
+    terminal_writestring(" ---\n");
+}
+
+/* State shared with the udpbench receive callback */
+#define UDPBENCH_WINDOW     32          /* Datagrams in flight */
+#define UDPBENCH_MAX_COUNT  100000
+#define UDPBENCH_IDLE_MS    1000
+
+static volatile uint32_t bench_received;
+static uint64_t bench_latency_cycles;
+
+static void udpbench_recv(udp_socket_t* sock, netbuf_t* nb, uint32_t src_ip, uint16_t src_port) {
+    (void)sock;
+    (void)src_ip;
+    (void)src_port;
+    if (nb->len >= sizeof(uint64_t)) {
+        uint64_t sent_tsc;
+        memcpy(&sent_tsc, nb->data, sizeof(sent_tsc));
+        bench_latency_cycles += timer_read_tsc() - sent_tsc;
+    }
+    bench_received++;
+}
+
+/* UDP echo benchmark: packets per second and latency against an echo port */
+void shell_cmd_udpbench(const char* args) {
+    uint32_t dst = NET_IP_LOOPBACK;
+    uint32_t count = 10000;
+    uint32_t size = 64;
+
+    const char* p = args ? args : "";
+    while (*p == ' ') p++;
+    if (*p && net_parse_ip(p, &dst)) {
+        while (*p && *p != ' ') p++;
+    }
+    p = shell_next_uint(p, &count);
+    shell_next_uint(p, &size);
+
+    if (count == 0) count = 1;
+    if (count > UDPBENCH_MAX_COUNT) count = UDPBENCH_MAX_COUNT;
+    if (size < sizeof(uint64_t)) size = sizeof(uint64_t);
+    if (size > UDP_MAX_PAYLOAD) size = UDP_MAX_PAYLOAD;
+
+    udp_socket_t* sock = udp_bind(0, udpbench_recv, NULL);
+    if (!sock) {
+        terminal_writestring("udpbench: no free sockets\n");
+        return;
+    }
+
+    static uint8_t fill[UDP_MAX_PAYLOAD];
+    for (uint32_t i = 0; i < size; i++) {
+        fill[i] = (uint8_t)i;
+    }
+
+    terminal_writestring("udpbench: ");
+    terminal_write_dec(count);
+    terminal_writestring(" x ");
+    terminal_write_dec(size);
+    terminal_writestring(" bytes to ");
+    net_print_ip(dst);
+    terminal_writestring(":");
+    terminal_write_dec(UDP_ECHO_PORT);
+    terminal_writestring("\n");
+
+    timer_tsc_khz();
+    bench_received = 0;
+    bench_latency_cycles = 0;
+
+    uint32_t sent = 0;
+    uint32_t failed = 0;
+    bool open_loop = false;   /* Peer does not echo: measure transmit only */
+    uint64_t progress_ms = timer_get_uptime_ms();
+    uint64_t start = timer_read_tsc();
+
+    while (sent < count) {
+        if (!open_loop && sent - bench_received >= UDPBENCH_WINDOW) {
+            uint32_t before = bench_received;
+            net_poll();
+            if (bench_received != before) {
+                progress_ms = timer_get_uptime_ms();
+            } else if (timer_get_uptime_ms() - progress_ms >= UDPBENCH_IDLE_MS) {
+                if (bench_received != 0) break;
+                open_loop = true;
+                terminal_writestring("No echoes; measuring transmit rate only\n");
+            }
+            continue;
+        }
+
+        netbuf_t* nb = udp_alloc();
+        if (!nb) {
+            net_poll();  /* Reclaim transmitted buffers */
+            continue;
+        }
+
+        uint64_t stamp = timer_read_tsc();
+        netbuf_append(nb, &stamp, sizeof(stamp));
+        netbuf_append(nb, fill + sizeof(stamp), (uint16_t)(size - sizeof(stamp)));
+
+        if (udp_sendto(sock, dst, UDP_ECHO_PORT, nb)) {
+            sent++;
+        } else if (++failed > count) {
+            break;
+        }
+
+        if ((sent & 15) == 0) {
+            net_poll();  /* Batch the doorbell */
+        }
+    }
+
+    /* Collect the stragglers */
+    progress_ms = timer_get_uptime_ms();
+    while (!open_loop && bench_received < sent &&
+           timer_get_uptime_ms() - progress_ms < UDPBENCH_IDLE_MS / 4) {
+        net_poll();
+    }
+    net_poll();
+
+    uint64_t cycles = timer_read_tsc() - start;
+    uint32_t elapsed_us = timer_tsc_to_us(cycles);
+    uint32_t received = bench_received;
+    udp_close(sock);
+
+    terminal_writestring("Sent ");
+    terminal_write_dec(sent);
+    terminal_writestring(", received ");
+    terminal_write_dec(received);
+    if (failed) {
+        terminal_writestring(", send failures ");
+        terminal_write_dec(failed);
+    }
+    terminal_writestring(" in ");
+    terminal_write_dec(elapsed_us / 1000);
+    terminal_writestring(" ms\n");
+
+    /* Rates in tenths of a millisecond keep the arithmetic in 32 bits */
+    uint32_t elapsed_100us = elapsed_us / 100;
+    if (elapsed_100us == 0) elapsed_100us = 1;
+    uint32_t packets = open_loop ? sent : received;
+    terminal_writestring("Rate: ");
+    terminal_write_dec(packets * 10000 / elapsed_100us);
+    terminal_writestring(" pps, ");
+    terminal_write_dec(packets * size / 1024 * 10000 / elapsed_100us);
+    terminal_writestring(" KB/s");
+    if (received) {
+        terminal_writestring(", avg latency ");
+        terminal_write_dec(timer_tsc_to_us(bench_latency_cycles) / received);
+        terminal_writestring(" us");
+    }
+    terminal_writestring("\n");
+}
+
+/* TFTP server status command */
+void shell_cmd_tftp(const char* args) {
+    (void)args;
+    tftp_print_status();
+}
+
+/* Copy a page from a mapped buffer, then across the edge into an unmapped
+ * page, and show how much each copy left behind */
+void shell_cmd_ucopy(const char* args) {
+    (void)args;
+    static uint8_t src[PAGE_SIZE];
+    static uint8_t dst[PAGE_SIZE];
+
+    /* Find an unmapped page below the kernel half */
+    uint32_t hole = 0x40000000;
+    while (hole < USER_SPACE_END && is_page_present(hole)) {
+        hole += PAGE_SIZE;
+    }
+
+    memset(src, 0xA5, sizeof(src));
+    uint32_t fixups = uaccess_fixup_count();
+    size_t left = copy_from_user(dst, src, sizeof(dst));
+    terminal_writestring("mapped:   ");
+    terminal_write_dec(sizeof(dst) - left);
+    terminal_writestring(" copied, ");
+    terminal_write_dec(left);
+    terminal_writestring(" left\n");
+
+    if (hole >= USER_SPACE_END) {
+        terminal_writestring("no unmapped page to test\n");
+        return;
+    }
+
+    /* Starts on the mapped page before the hole if there is one */
+    uint32_t from = is_page_present(hole - PAGE_SIZE) ? hole - PAGE_SIZE / 2 : hole;
+    left = copy_from_user(dst, (const void*)from, sizeof(dst));
+    terminal_writestring("unmapped: ");
+    terminal_write_dec(sizeof(dst) - left);
+    terminal_writestring(" copied, ");
+    terminal_write_dec(left);
+    terminal_writestring(" left (fault at 0x");
+    print_hex32(hole);
+    terminal_writestring(", ");
+    terminal_write_dec(uaccess_fixup_count() - fixups);
+    terminal_writestring(" fixup)\n");
+}
+
+/* Enable swap on a preallocated file or the whole primary slave disk */
+void shell_cmd_swapon(const char* args) {
+    if (!args || shell_strlen(args) == 0) {
+        terminal_writestring("Usage: swapon <file> | swapon hdb\n");
+        return;
+    }
+
+    bool ok;
+    if (shell_strcmp(args, "hdb")) {
+        ata_device_t* disk = ata_get_primary_slave();
+        ok = disk && disk != fat32_get_device() && swap_on(disk, 0, disk->sectors);
+    } else {
+        ok = swap_on_file(args);
+    }
+
+    if (!ok) {
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
+        terminal_writestring("swapon failed (missing, fragmented or already active)\n");
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+        return;
+    }
+    swap_print_stats();
+}
+
+/* Swap status, or push an anonymous working set of N MB through memory */
+void shell_cmd_swap(const char* args) {
+    char word[8];
+    const char* rest = args ? shell_parse_command(args, word, sizeof(word)) : NULL;
+    if (!args || !shell_strcmp(word, "test")) {
+        swap_print_stats();
+        return;
+    }
+
+    uint32_t mb = 0;
+    if (rest) {
+        shell_next_uint(rest, &mb);
+    }
+    if (mb == 0) {
+        terminal_writestring("Usage: swap test <MB>\n");
+        return;
+    }
+
+    uint32_t pages = mb * (1024 * 1024 / PAGE_SIZE);
+    uint32_t* area = (uint32_t*)anon_alloc(mb * 1024 * 1024);
+    if (!area) {
+        terminal_writestring("anon_alloc failed\n");
+        return;
+    }
+
+    /* Stamp every page, then check the stamps on two passes */
+    uint32_t words = PAGE_SIZE / sizeof(uint32_t);
+    uint64_t start = timer_get_uptime_ms();
+    for (uint32_t p = 0; p < pages; p++) {
+        area[p * words] = p ^ 0x5A5A5A5A;
+        area[p * words + words - 1] = p;
+    }
+    uint32_t bad = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        for (uint32_t p = 0; p < pages; p++) {
+            if (area[p * words] != (p ^ 0x5A5A5A5A) || area[p * words + words - 1] != p) {
+                bad++;
+            }
+        }
+    }
+    uint32_t elapsed = (uint32_t)(timer_get_uptime_ms() - start);
+    anon_free(area);
+
+    terminal_write_dec(pages);
+    terminal_writestring(" pages, ");
+    terminal_write_dec(bad);
+    terminal_writestring(" bad, ");
+    terminal_write_dec(elapsed);
+    terminal_writestring(" ms\n");
+    swap_print_stats();
+}
+
+/* Working set and idle page statistics from the accessed-bit scanner */
+void shell_cmd_wss(const char* args) {
+    if (args && args[0] == 's') {
+        wss_scan();
+    }
+
+    terminal_writestring("Working set (pages used in the last ");
+    terminal_write_dec(WSS_WINDOW);
+    terminal_writestring(" of ");
+    terminal_write_dec(wss_scan_count());
+    terminal_writestring(" scans, ");
+    terminal_write_dec(WSS_SCAN_INTERVAL_MS);
+    terminal_writestring(" ms apart)\n");
+    terminal_writestring("area     mapped    wss   idle  dirty  by idle age 0..");
+    terminal_write_dec(WSS_MAX_AGE);
+    terminal_writestring("+\n");
+
+    for (uint32_t i = 0; i < wss_area_count(); i++) {
+        const wss_area_t* area = wss_get_area(i);
+        uint32_t wss = wss_estimate(area, WSS_WINDOW);
+        uint32_t values[4] = { area->mapped, wss, area->mapped - wss, area->dirty };
+
+        terminal_writestring(area->name);
+        for (size_t pad = shell_strlen(area->name); pad < 7; pad++) {
+            terminal_putchar(' ');
+        }
+        for (int v = 0; v < 4; v++) {
+            char num[12];
+            uint64_to_string(values[v], num);
+            for (size_t pad = shell_strlen(num); pad < 7; pad++) {
+                terminal_putchar(' ');
+            }
+            terminal_writestring(num);
+        }
+        terminal_writestring("  ");
+        for (uint32_t age = 0; age <= WSS_MAX_AGE; age++) {
+            terminal_write_dec(area->age[age]);
+            terminal_putchar(age < WSS_MAX_AGE ? '/' : '\n');
+        }
+    }
+}
+
+/* Every counter defined with DEFINE_COUNTER, summed over CPUs */
+void shell_cmd_stats(const char* args) {
+    if (args && shell_strcmp(args, "reset")) {
+        counter_reset_all();
+        terminal_writestring("Counters reset\n");
+        return;
+    }
+
+    for (uint32_t i = 0; i < counter_count(); i++) {
+        const counter_t* c = counter_get(i);
+        char num[24];
+        size_t len = shell_strlen(c->group) + 1 + shell_strlen(c->name);
+
+        terminal_writestring(c->group);
+        terminal_putchar('.');
+        terminal_writestring(c->name);
+        uint64_to_string(counter_read(c), num);
+        for (size_t pad = len + shell_strlen(num); pad < 32; pad++) {
+            terminal_putchar(' ');
+        }
+        terminal_writestring(num);
+        terminal_putchar('\n');
+    }
+}
+
+/* Live system monitor; runs from the main loop until 'q' */
+void shell_cmd_top(const char* args) {
+    (void)args; /* Unused parameter */
+    top_start();
+}
+
+/* Wakeup latency tracing: histograms per task and overall, and the
+ * events leading up to the worst latency */
+void shell_cmd_trace(const char* args) {
+    if (args && shell_strcmp(args, "on")) {
+        trace_set_enabled(true);
+    } else if (args && shell_strcmp(args, "off")) {
+        trace_set_enabled(false);
+    } else if (args && shell_strcmp(args, "reset")) {
+        trace_reset();
+    }
+
+    terminal_writestring("Tracing ");
+    terminal_writestring(trace_enabled() ? "on" : "off");
+    terminal_writestring("\nAll tasks:\n");
+    trace_print_hist(trace_get_global_hist());
+
+    trace_task_t* task;
+    for (uint32_t i = 0; (task = trace_get_task(i)) != NULL; i++) {
+        terminal_writestring(task->name);
+        terminal_writestring(":\n");
+        trace_print_hist(&task->hist);
+    }
+
+    const trace_worst_t* worst = trace_get_worst();
+    if (worst->count == 0) {
+        return;
+    }
+    terminal_writestring("Worst case: ");
+    terminal_write_dec(timer_tsc_to_us(worst->cycles));
+    terminal_writestring(" us for ");
+    terminal_writestring(trace_task_name(worst->task));
+    terminal_writestring("\n");
+
+    /* Timestamps relative to the switch-in that ended it */
+    uint64_t end = worst->events[worst->count - 1].tsc;
+    for (uint32_t i = 0; i < worst->count; i++) {
+        const trace_event_t* ev = &worst->events[i];
+        terminal_writestring("  -");
+        terminal_write_dec(timer_tsc_to_us(end - ev->tsc));
+        terminal_writestring(" us cpu");
+        terminal_write_dec(ev->cpu);
+        terminal_writestring(" ");
+        terminal_writestring(trace_event_name(ev->type));
+        terminal_writestring(" ");
+        terminal_writestring(trace_task_name(ev->task));
+        terminal_writestring("\n");
+    }
+}
+
+/* Threads, newest first */
+void shell_cmd_ps(const char* args) {
+    (void)args; /* Unused parameter */
+
+    terminal_writestring("  ID NAME             STATE  NICE   CPU ms  SWITCHES\n");
+    thread_t* t;
+    for (uint32_t i = 0; (t = sched_get_thread(i)) != NULL; i++) {
+        char num[24];
+        uint32_t values[3] = { (uint32_t)t->nice, timer_tsc_to_us(t->sum_exec) / 1000, t->switches };
+        uint32_t widths[3] = { 6, 9, 10 };
+
+        uint64_to_string(t->id, num);
+        for (size_t pad = shell_strlen(num); pad < 4; pad++) {
+            terminal_putchar(' ');
+        }
+        terminal_writestring(num);
+        terminal_putchar(' ');
+        terminal_writestring(t->name);
+        for (size_t pad = shell_strlen(t->name); pad < THREAD_NAME_LENGTH + 1; pad++) {
+            terminal_putchar(' ');
+        }
+        terminal_writestring(thread_state_name(t->state));
+        for (size_t pad = shell_strlen(thread_state_name(t->state)); pad < 5; pad++) {
+            terminal_putchar(' ');
+        }
+
+        for (int v = 0; v < 3; v++) {
+            bool negative = v == 0 && t->nice < 0;
+            uint64_to_string(negative ? (uint32_t)-t->nice : values[v], num);
+            for (size_t pad = shell_strlen(num) + (negative ? 1 : 0); pad < widths[v]; pad++) {
+                terminal_putchar(' ');
+            }
+            if (negative) {
+                terminal_putchar('-');
+            }
+            terminal_writestring(num);
+        }
+        terminal_putchar('\n');
+    }
+
+    const runqueue_t* rq = sched_get_runqueue();
+    terminal_writestring("Runnable ");
+    terminal_write_dec(rq->nr_running);
+    terminal_writestring(", load ");
+    terminal_write_dec(rq->load);
+    terminal_writestring(", context switches ");
+    terminal_write_dec(rq->switches);
+    terminal_writestring("\n");
+}
+
+/* Burn CPU until the deadline, giving way whenever the scheduler asks */
+static void spin_thread(void* arg) {
+    uint64_t end = timer_get_uptime_ms() + (uint32_t)arg * 1000;
+    volatile uint32_t work = 0;
+
+    while (timer_get_uptime_ms() < end) {
+        for (uint32_t i = 0; i < 10000; i++) {
+            work++;
+        }
+        cond_resched();
+    }
+}
+
+/* Parse an optionally negative decimal argument */
+static const char* shell_next_int(const char* p, int* value) {
+    while (*p == ' ') p++;
+    bool negative = *p == '-';
+    uint32_t v = 0;
+    const char* end = shell_next_uint(negative ? p + 1 : p, &v);
+    if (end != (negative ? p + 1 : p)) {
+        *value = negative ? -(int)v : (int)v;
+    }
+    return end;
+}
+
+/* CPU hog for comparing shares and shell responsiveness under load */
+void shell_cmd_spin(const char* args) {
+    uint32_t seconds = 10;
+    int nice = 0;
+    if (args) {
+        const char* p = shell_next_uint(args, &seconds);
+        shell_next_int(p, &nice);
+    }
+
+    thread_t* t = thread_create("spin", spin_thread, (void*)seconds, nice);
+    if (!t) {
+        terminal_writestring("Out of memory\n");
+        return;
+    }
+    terminal_writestring("Started thread ");
+    terminal_write_dec(t->id);
+    terminal_writestring(" for ");
+    terminal_write_dec(seconds);
+    terminal_writestring(" s\n");
+}
+
+void shell_cmd_nice(const char* args) {
+    uint32_t id = 0xFFFFFFFF;
+    int nice = NICE_MAX + 1;            /* Out of range until parsed */
+    if (args) {
+        shell_next_int(shell_next_uint(args, &id), &nice);
+    }
+    if (id == 0xFFFFFFFF || nice > NICE_MAX) {
+        terminal_writestring("Usage: nice <id> <-20..19>\n");
+        return;
+    }
+
+    thread_t* t;
+    for (uint32_t i = 0; (t = sched_get_thread(i)) != NULL; i++) {
+        if (t->id == id) {
+            thread_set_nice(t, nice);
+            terminal_writestring(t->name);
+            terminal_writestring(" weight now ");
+            terminal_write_dec(t->weight);
+            terminal_writestring("\n");
+            return;
+        }
+    }
+    terminal_writestring("No such thread\n");
+}
+
+/* Read one block both ways and compare */
+static void shell_async_read(uint32_t lba) {
+    ata_device_t* device = ata_get_primary_master();
+    uint8_t* sync_buf = (uint8_t*)kmalloc(2 * 8 * 512);
+    if (!device || !sync_buf) {
+        terminal_writestring(device ? "Out of memory\n" : "No disk\n");
+        if (sync_buf) kfree(sync_buf);
+        return;
+    }
+    uint8_t* async_buf = sync_buf + 8 * 512;
+
+    uint64_t start = timer_read_tsc();
+    bool sync_ok = ata_read_sectors(device, lba, 8, sync_buf);
+    uint32_t sync_us = timer_tsc_to_us(timer_read_tsc() - start);
+
+    ata_request_t req;
+    start = timer_read_tsc();
+    bool async_ok = ata_submit_read(&req, device, lba, 8, async_buf) && ata_wait_request(&req);
+    uint32_t async_us = timer_tsc_to_us(timer_read_tsc() - start);
+
+    terminal_writestring("sync  ");
+    terminal_writestring(sync_ok ? "ok " : "failed ");
+    terminal_write_dec(sync_us);
+    terminal_writestring(" us\nasync ");
+    terminal_writestring(async_ok ? "ok " : "failed ");
+    terminal_write_dec(async_us);
+    terminal_writestring(" us, ");
+    terminal_write_dec(req.task.resumes);
+    terminal_writestring(" resumes\n");
+    if (sync_ok && async_ok) {
+        bool same = true;
+        for (uint32_t i = 0; i < 8 * 512; i++) {
+            if (sync_buf[i] != async_buf[i]) {
+                same = false;
+                break;
+            }
+        }
+        terminal_writestring(same ? "Data matches\n" : "Data differs!\n");
+    }
+    kfree(sync_buf);
+}
+
+/* Coroutines on the event loop and what they wait for */
+void shell_cmd_async(const char* args) {
+    if (args) {
+        char word[8];
+        const char* rest = shell_parse_command(args, word, sizeof(word));
+        uint32_t lba = 0xFFFFFFFF;
+        if (rest) {
+            shell_next_uint(rest, &lba);
+        }
+        if (!shell_strcmp(word, "read") || lba == 0xFFFFFFFF) {
+            terminal_writestring("Usage: async [read <lba>]\n");
+            return;
+        }
+        shell_async_read(lba);
+        return;
+    }
+
+    async_task_t* t;
+    for (uint32_t i = 0; (t = async_get_task(i)) != NULL; i++) {
+        terminal_writestring(t->name);
+        for (size_t pad = shell_strlen(t->name); pad < 18; pad++) {
+            terminal_putchar(' ');
+        }
+        if (t->queued) {
+            terminal_writestring("ready      ");
+        } else if (t->wait_event) {
+            terminal_writestring(t->wake_at_ms ? "event+timer" : "event      ");
+        } else if (t->wake_at_ms) {
+            terminal_writestring("timer      ");
+        } else {
+            terminal_writestring("idle       ");
+        }
+        terminal_writestring(" resumes ");
+        terminal_write_dec(t->resumes);
+        terminal_writestring("\n");
+    }
+
+    const async_stats_t* st = async_get_stats();
+    terminal_writestring("Spawned ");
+    terminal_write_dec(st->spawned);
+    terminal_writestring(", resumes ");
+    terminal_write_dec(st->resumes);
+    terminal_writestring(", signals ");
+    terminal_write_dec(st->signals);
+    terminal_writestring(", timeouts ");
+    terminal_write_dec(st->timeouts);
+    terminal_writestring("\n");
 }
 
 /* Helper functions for hex printing */
@@ -1367,7 +2575,11 @@ void shell_handle_input(int c) {
         /* Reset for next command */
         command_length = 0;
         cursor_position = 0;
-        shell_print_prompt();
+        
+        /* The monitor owns the screen; it prints the prompt when it quits */
+        if (!top_active()) {
+            shell_print_prompt();
+        }
         
     } else if (c == '\b') {
         /* Handle backspace - delete character to the left of cursor */
@@ -33,8 +33,28 @@ void shell_cmd_reboot(const char* args);
 void shell_cmd_scancode(const char* args);
 void shell_cmd_ls(const char* args);
 void shell_cmd_cat(const char* args);
+void shell_cmd_cp(const char* args);
+void shell_cmd_crc32c(const char* args);
+void shell_cmd_initrd(const char* args);
 void shell_cmd_write(const char* args);
 void shell_cmd_fsinfo(const char* args);
+void shell_cmd_ioring(const char* args);
+void shell_cmd_lspci(const char* args);
+void shell_cmd_ifconfig(const char* args);
+void shell_cmd_ping(const char* args);
+void shell_cmd_udpbench(const char* args);
+void shell_cmd_tftp(const char* args);
+void shell_cmd_ucopy(const char* args);
+void shell_cmd_swapon(const char* args);
+void shell_cmd_swap(const char* args);
+void shell_cmd_wss(const char* args);
+void shell_cmd_stats(const char* args);
+void shell_cmd_top(const char* args);
+void shell_cmd_trace(const char* args);
+void shell_cmd_ps(const char* args);
+void shell_cmd_spin(const char* args);
+void shell_cmd_nice(const char* args);
+void shell_cmd_async(const char* args);
 
 /* Utility functions */
 void shell_print_prompt(void);
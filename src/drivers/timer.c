@@ -8,14 +8,11 @@
  */
 
 #include "timer.h"
+#include "../kernel/init.h"
 #include "../kernel/idt.h"
 #include "../kernel/pic.h"
-
-/*------------------------------------------------------------------------------
- * Forward Declarations for Helper Functions
- *------------------------------------------------------------------------------
- */
-static uint64_t div64(uint64_t dividend, uint32_t divisor);
+#include "../kernel/patch.h"
+#include "../kernel/cache.h"
 
 /* Need I/O port access functions */
 static inline void outb(uint16_t port, uint8_t value) {
@@ -45,19 +42,19 @@ static inline void hlt(void) {
  *------------------------------------------------------------------------------
  */
 
-/* Timer state and configuration */
-static bool timer_initialized = false;
-static uint32_t timer_frequency = 0;
-static uint16_t timer_reload_value = 0;
+/* Timer state and configuration (set once by timer_init) */
+static bool timer_initialized __read_mostly = false;
+static uint32_t timer_frequency __read_mostly = 0;
+static uint16_t timer_reload_value __read_mostly = 0;
 
-/* Timing tracking variables */
-static volatile uint64_t timer_ticks = 0;
-static volatile uint64_t uptime_ms = 0;
-static uint32_t ms_per_tick = 0;
-static uint32_t ms_fraction = 0;        /* 32.32 fixed point fractional ms */
+/* Timing tracking variables, updated on every tick */
+static volatile uint64_t timer_ticks __hot_data = 0;
+static volatile uint64_t uptime_ms __hot_data = 0;
+static uint32_t ms_per_tick __read_mostly = 0;
+static uint32_t ms_fraction __read_mostly = 0;      /* 32.32 fixed point fractional ms */
 
 /* Sleep functionality */
-static volatile uint32_t sleep_countdown = 0;
+static volatile uint32_t sleep_countdown __hot_data = 0;
 
 /*------------------------------------------------------------------------------
  * Internal Helper Functions
@@ -192,7 +189,7 @@ void timer_interrupt_handler(void) {
 /**
  * @brief Initialize the timer subsystem
  */
-void timer_init(void) {
+void __init timer_init(void) {
     timer_init_frequency(TIMER_DEFAULT_FREQUENCY);
 }
 
@@ -320,6 +317,68 @@ void timer_sleep_seconds(uint32_t seconds) {
     timer_sleep_ms(seconds * 1000);
 }
 
+/*------------------------------------------------------------------------------
+ * Time-Stamp Counter
+ *------------------------------------------------------------------------------
+ */
+
+/* TSC frequency, 0 until calibrated */
+static uint32_t tsc_khz __read_mostly = 0;
+
+/**
+ * @brief Read the CPU time-stamp counter
+ */
+uint64_t timer_read_tsc(void) {
+    uint32_t low, high;
+    /* LFENCE (SSE2) keeps RDTSC from executing ahead of earlier loads */
+    __asm__ volatile (ALTERNATIVE("", "lfence", X86_FEATURE_XMM2) "rdtsc"
+                      : "=a"(low), "=d"(high) :: "memory");
+    return ((uint64_t)high << 32) | low;
+}
+
+/**
+ * @brief Get the TSC frequency in kHz, calibrating it against the PIT
+ */
+uint32_t timer_tsc_khz(void) {
+    if (tsc_khz != 0 || !timer_initialized) {
+        return tsc_khz;
+    }
+    
+    /* Calibration counts PIT ticks, so interrupts must be on */
+    uint32_t eflags;
+    __asm__ volatile ("pushfl; popl %0" : "=r"(eflags));
+    if (!(eflags & 0x200)) {
+        return 0;
+    }
+    
+    /* Start on a tick edge, then time 50ms worth of ticks */
+    uint64_t start_ms = uptime_ms;
+    while (uptime_ms == start_ms) {
+        hlt();
+    }
+    start_ms = uptime_ms;
+    uint64_t start_tsc = timer_read_tsc();
+    while (uptime_ms < start_ms + 50) {
+        hlt();
+    }
+    uint64_t elapsed_ms = uptime_ms - start_ms;
+    uint64_t elapsed_tsc = timer_read_tsc() - start_tsc;
+    
+    tsc_khz = (uint32_t)div64(elapsed_tsc, (uint32_t)elapsed_ms);
+    return tsc_khz;
+}
+
+/**
+ * @brief Convert a TSC cycle count to microseconds
+ */
+uint32_t timer_tsc_to_us(uint64_t cycles) {
+    uint32_t khz = timer_tsc_khz();
+    if (khz == 0) {
+        return 0;
+    }
+    return (uint32_t)div64(cycles * 1000, khz);
+}
+
 /**
  * @brief Check if timer is initialized
  */
@@ -367,9 +426,9 @@ bool timer_set_frequency(uint32_t frequency) {
 
 /**
  * @brief 64-bit unsigned division
- * Simple implementation for kernel use
+ * Simple implementation for kernel use (see timer.h)
  */
-static uint64_t div64(uint64_t dividend, uint32_t divisor) {
+uint64_t div64(uint64_t dividend, uint32_t divisor) {
     if (divisor == 0) return 0;  /* Avoid division by zero */
     
     /* If dividend fits in 32 bits, use regular division */
@@ -228,4 +228,38 @@ void timer_set_reload_value(uint16_t reload_value);
  */
 uint16_t timer_read_current_count(void);
 
+/**
+ * @brief Read the CPU time-stamp counter
+ * 
+ * @return Current TSC value
+ */
+uint64_t timer_read_tsc(void);
+
+/**
+ * @brief Get the TSC frequency
+ * 
+ * Calibrated against the PIT on first use, which takes about 50ms and
+ * needs interrupts enabled.
+ * 
+ * @return TSC frequency in kHz, or 0 if it cannot be calibrated
+ */
+uint32_t timer_tsc_khz(void);
+
+/**
+ * @brief Convert a TSC cycle count to microseconds
+ * 
+ * @param cycles Number of TSC cycles
+ * @return Microseconds, or 0 if the TSC is not calibrated
+ */
+uint32_t timer_tsc_to_us(uint64_t cycles);
+
+/**
+ * @brief 64-bit by 32-bit unsigned division
+ * 
+ * The kernel is built without libgcc, so 64-bit '/' does not link.
+ * 
+ * @return dividend / divisor, or 0 if divisor is 0
+ */
+uint64_t div64(uint64_t dividend, uint32_t divisor);
+
 #endif /* TIMER_H */
\ No newline at end of file
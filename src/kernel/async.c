@@ -0,0 +1,311 @@
+/*------------------------------------------------------------------------------
+ * Stackless Coroutines
+ *------------------------------------------------------------------------------
+ * This file implements the per-CPU event loop, events, timers and queues
+ * behind the await macros. See async.h.
+ *------------------------------------------------------------------------------
+ */
+
+#include "async.h"
+#include "percpu.h"
+#include "string.h"
+#include "../drivers/timer.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Per-CPU event loop */
+typedef struct {
+    async_task_t* ready_head;
+    async_task_t* ready_tail;
+    async_task_t* timers;               /* Tasks with a deadline, unordered */
+} async_loop_t;
+
+static async_loop_t loops[NR_CPUS];
+static async_event_t irq_events[16];
+static async_task_t* tasks = NULL;      /* Spawned and not yet done */
+static async_stats_t stats;
+
+#define irq_save(flags)     asm volatile("pushfl; popl %0; cli" : "=r"(flags) :: "memory")
+#define irq_restore(flags)  asm volatile("pushl %0; popfl" :: "r"(flags) : "memory", "cc")
+
+/*------------------------------------------------------------------------------
+ * Ready List and Timers
+ *------------------------------------------------------------------------------
+ */
+
+/* Queue a task on its loop; interrupts are off */
+static void async_make_ready(async_task_t* task) {
+    if (task->queued || task->done) {
+        return;
+    }
+    async_loop_t* loop = &loops[task->cpu];
+    task->queued = true;
+    task->next = NULL;
+    if (loop->ready_tail) {
+        loop->ready_tail->next = task;
+    } else {
+        loop->ready_head = task;
+    }
+    loop->ready_tail = task;
+}
+
+/* Take a task off its event's waiter list; interrupts are off */
+static void async_unwait(async_task_t* task) {
+    async_event_t* ev = task->wait_event;
+    if (!ev) {
+        return;
+    }
+    async_task_t** link = &ev->waiters;
+    while (*link && *link != task) {
+        link = &(*link)->next;
+    }
+    if (*link) {
+        *link = task->next;
+    }
+    task->wait_event = NULL;
+}
+
+static void async_timer_unlink(async_task_t* task) {
+    async_task_t** link = &loops[task->cpu].timers;
+    while (*link && *link != task) {
+        link = &(*link)->timer_next;
+    }
+    if (*link) {
+        *link = task->timer_next;
+    }
+    task->wake_at_ms = 0;
+}
+
+/* Wake tasks whose deadline has passed; interrupts are off */
+static void async_expire_timers(async_loop_t* loop) {
+    if (!loop->timers) {
+        return;
+    }
+
+    uint64_t now = timer_get_uptime_ms();
+    async_task_t** link = &loop->timers;
+    while (*link) {
+        async_task_t* task = *link;
+        if (now < task->wake_at_ms) {
+            link = &task->timer_next;
+            continue;
+        }
+        *link = task->timer_next;
+        task->wake_at_ms = 0;
+        /* Still waiting for an event: that wait timed out */
+        if (task->wait_event) {
+            async_unwait(task);
+            task->timed_out = true;
+            stats.timeouts++;
+        }
+        async_make_ready(task);
+    }
+}
+
+void async_yield(async_task_t* task) {
+    uint32_t flags;
+    irq_save(flags);
+    async_make_ready(task);
+    irq_restore(flags);
+}
+
+void async_timer_start(async_task_t* task, uint32_t ms) {
+    uint32_t flags;
+    irq_save(flags);
+    if (task->wake_at_ms) {
+        async_timer_unlink(task);
+    }
+    task->wake_at_ms = timer_get_uptime_ms() + (ms ? ms : 1);
+    task->timer_next = loops[task->cpu].timers;
+    loops[task->cpu].timers = task;
+    irq_restore(flags);
+}
+
+void async_timer_cancel(async_task_t* task) {
+    uint32_t flags;
+    irq_save(flags);
+    if (task->wake_at_ms) {
+        async_timer_unlink(task);
+    }
+    irq_restore(flags);
+}
+
+/*------------------------------------------------------------------------------
+ * Event Loop
+ *------------------------------------------------------------------------------
+ */
+
+void async_spawn(async_task_t* task, const char* name, async_fn_t fn, void* arg) {
+    memset(task, 0, sizeof(*task));
+    task->name = name;
+    task->fn = fn;
+    task->arg = arg;
+    task->cpu = this_cpu_read(cpu_id);
+
+    uint32_t flags;
+    irq_save(flags);
+    task->all_next = tasks;
+    tasks = task;
+    stats.spawned++;
+    async_make_ready(task);
+    irq_restore(flags);
+}
+
+/* Tasks readied while the pass runs wait for the next one, so a task that
+ * keeps yielding cannot starve the caller */
+uint32_t async_run(void) {
+    async_loop_t* loop = &loops[this_cpu_read(cpu_id)];
+    uint32_t flags;
+
+    irq_save(flags);
+    async_expire_timers(loop);
+    async_task_t* batch = loop->ready_head;
+    loop->ready_head = NULL;
+    loop->ready_tail = NULL;
+    irq_restore(flags);
+
+    uint32_t ran = 0;
+    while (batch) {
+        async_task_t* task = batch;
+        batch = task->next;
+
+        irq_save(flags);
+        task->queued = false;
+        irq_restore(flags);
+
+        task->resumes++;
+        stats.resumes++;
+        ran++;
+        if (task->fn(task) != ASYNC_DONE) {
+            continue;
+        }
+
+        /* Finished: drop it from the registry; the owner may reuse it */
+        irq_save(flags);
+        async_timer_cancel(task);
+        async_unwait(task);
+        async_task_t** link = &tasks;
+        while (*link && *link != task) {
+            link = &(*link)->all_next;
+        }
+        if (*link) {
+            *link = task->all_next;
+        }
+        irq_restore(flags);
+    }
+    return ran;
+}
+
+/*------------------------------------------------------------------------------
+ * Events and Queues
+ *------------------------------------------------------------------------------
+ */
+
+void async_event_init(async_event_t* ev) {
+    ev->count = 0;
+    ev->waiters = NULL;
+}
+
+/* Forget banked signals, e.g. before starting an operation whose
+ * completion will signal the event */
+void async_event_clear(async_event_t* ev) {
+    uint32_t flags;
+    irq_save(flags);
+    ev->count = 0;
+    irq_restore(flags);
+}
+
+/* Bank a signal and wake every waiter; the first to run consumes it */
+void async_event_signal(async_event_t* ev) {
+    uint32_t flags;
+    irq_save(flags);
+    ev->count++;
+    stats.signals++;
+    while (ev->waiters) {
+        async_task_t* task = ev->waiters;
+        ev->waiters = task->next;
+        task->wait_event = NULL;
+        async_make_ready(task);
+    }
+    irq_restore(flags);
+}
+
+/* Consume a signal, or register 'task' as a waiter and return false */
+bool async_event_try_wait(async_event_t* ev, async_task_t* task) {
+    uint32_t flags;
+    irq_save(flags);
+    if (ev->count > 0) {
+        ev->count--;
+        irq_restore(flags);
+        return true;
+    }
+    if (task->wait_event != ev) {
+        async_unwait(task);
+        task->wait_event = ev;
+        task->next = ev->waiters;
+        ev->waiters = task;
+    }
+    irq_restore(flags);
+    return false;
+}
+
+async_event_t* async_irq_event(uint8_t irq) {
+    return &irq_events[irq & 15];
+}
+
+/* Called for every hardware interrupt. Signals bank up while nobody
+ * listens, so users clear the event before starting the operation whose
+ * interrupt they will wait for. */
+void async_irq_signal(uint8_t irq) {
+    async_event_signal(&irq_events[irq & 15]);
+}
+
+void async_queue_init(async_queue_t* q) {
+    q->head = 0;
+    q->tail = 0;
+    async_event_init(&q->ready);
+}
+
+bool async_queue_push(async_queue_t* q, void* item) {
+    uint32_t flags;
+    irq_save(flags);
+    if (q->tail - q->head >= ASYNC_QUEUE_SIZE) {
+        irq_restore(flags);
+        return false;
+    }
+    q->items[q->tail++ & (ASYNC_QUEUE_SIZE - 1)] = item;
+    irq_restore(flags);
+    async_event_signal(&q->ready);
+    return true;
+}
+
+/* Next item, or NULL if empty; AWAIT_QUEUE() has already consumed the
+ * matching signal */
+void* async_queue_pop(async_queue_t* q) {
+    uint32_t flags;
+    void* item = NULL;
+    irq_save(flags);
+    if (q->head != q->tail) {
+        item = q->items[q->head++ & (ASYNC_QUEUE_SIZE - 1)];
+    }
+    irq_restore(flags);
+    return item;
+}
+
+/*------------------------------------------------------------------------------
+ * Statistics
+ *------------------------------------------------------------------------------
+ */
+
+async_task_t* async_get_task(uint32_t index) {
+    async_task_t* t = tasks;
+    while (t && index-- > 0) {
+        t = t->all_next;
+    }
+    return t;
+}
+
+const async_stats_t* async_get_stats(void) {
+    return &stats;
+}
@@ -0,0 +1,178 @@
+#ifndef ASYNC_H
+#define ASYNC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*------------------------------------------------------------------------------
+ * Stackless Coroutines
+ *------------------------------------------------------------------------------
+ * An async task is a function written as sequential code that can wait in
+ * the middle. It has no stack of its own. Each await records the source
+ * line in task->lc and returns, and ASYNC_BEGIN() jumps back to that line
+ * through a switch when the task is resumed:
+ *
+ *     static int reader(async_task_t* t) {
+ *         reader_t* r = t->arg;
+ *         ASYNC_BEGIN(t);
+ *         for (r->i = 0; r->i < r->count; r->i++) {
+ *             start_io(r);
+ *             AWAIT_EVENT(t, &r->io_done);
+ *         }
+ *         ASYNC_END(t);
+ *     }
+ *
+ * A task costs one async_task_t plus whatever state its caller keeps.
+ * Local variables do not survive an await, so anything needed afterwards
+ * goes in the structure behind t->arg. Two awaits must not share a source
+ * line, and awaits cannot sit inside a switch statement of their own.
+ *
+ * A task can wait for:
+ *
+ * - An event: a counting completion, signalled from anywhere including
+ *   interrupt handlers. Signals are banked, so one that arrives before the
+ *   task waits is not lost. async_irq_event() gives the event every
+ *   hardware IRQ line signals; clear it before starting the operation
+ *   whose interrupt will be awaited.
+ * - A timer: AWAIT_MS(), or a deadline on an event wait.
+ * - A queue of pointers, which signals its event once per item.
+ * - An arbitrary condition, re-checked on every pass of the event loop.
+ *
+ * Woken tasks go on their CPU's ready list. async_run() resumes them from
+ * the main loop, and it may also be called from code that has to wait for
+ * an async operation to finish. A task never runs nested inside itself.
+ *------------------------------------------------------------------------------
+ */
+
+#define ASYNC_QUEUE_SIZE    16          /* Items per queue (power of two) */
+
+typedef enum {
+    ASYNC_WAITING,                      /* Suspended at an await */
+    ASYNC_DONE,                         /* Reached ASYNC_END() */
+} async_result_t;
+
+struct async_task;
+struct async_event;
+
+typedef int (*async_fn_t)(struct async_task* task);
+
+/* Coroutine state */
+typedef struct async_task {
+    uint16_t lc;                        /* Resume point: line of the last await */
+    bool queued;                        /* On the ready list */
+    bool done;
+    bool timed_out;                     /* The last timed wait expired */
+    const char* name;
+    async_fn_t fn;
+    void* arg;
+    uint32_t cpu;                       /* Event loop that runs it */
+    uint32_t resumes;
+    struct async_event* wait_event;     /* Event being waited for, or NULL */
+    uint64_t wake_at_ms;                /* Timer deadline, 0 if none */
+    struct async_task* next;            /* Ready list or event waiters */
+    struct async_task* timer_next;      /* Timer list */
+    struct async_task* all_next;        /* Registry */
+} async_task_t;
+
+/* Counting completion */
+typedef struct async_event {
+    uint32_t count;                     /* Signals not yet consumed */
+    async_task_t* waiters;
+} async_event_t;
+
+/* Bounded queue of pointers */
+typedef struct {
+    void* items[ASYNC_QUEUE_SIZE];
+    uint32_t head;
+    uint32_t tail;
+    async_event_t ready;                /* One signal per queued item */
+} async_queue_t;
+
+/* Event loop statistics */
+typedef struct {
+    uint32_t spawned;
+    uint32_t resumes;
+    uint32_t signals;
+    uint32_t timeouts;
+} async_stats_t;
+
+/*------------------------------------------------------------------------------
+ * Coroutine Body
+ *------------------------------------------------------------------------------
+ */
+
+#define ASYNC_BEGIN(t)          switch ((t)->lc) { case 0:
+
+#define ASYNC_END(t)            } (t)->lc = 0; (t)->done = true; return ASYNC_DONE
+
+/* Return to the event loop; resume here when woken */
+#define ASYNC_SUSPEND(t) \
+    do { (t)->lc = __LINE__; return ASYNC_WAITING; case __LINE__:; } while (0)
+
+/* Let other ready tasks run first */
+#define ASYNC_YIELD(t) \
+    do { async_yield(t); ASYNC_SUSPEND(t); } while (0)
+
+/* Re-check a condition once per event loop pass */
+#define AWAIT_UNTIL(t, cond) \
+    while (!(cond)) { async_yield(t); ASYNC_SUSPEND(t); }
+
+/* Consume one signal of an event, waiting for it if there is none */
+#define AWAIT_EVENT(t, ev) \
+    while (!async_event_try_wait((ev), (t))) { ASYNC_SUSPEND(t); }
+
+/* As AWAIT_EVENT, giving up after 'ms'; (t)->timed_out tells which */
+#define AWAIT_EVENT_TIMEOUT(t, ev, ms) \
+    do { \
+        (t)->timed_out = false; \
+        async_timer_start((t), (ms)); \
+        while (!(t)->timed_out && !async_event_try_wait((ev), (t))) { ASYNC_SUSPEND(t); } \
+        async_timer_cancel(t); \
+    } while (0)
+
+/* Sleep for 'ms' milliseconds */
+#define AWAIT_MS(t, ms) \
+    do { async_timer_start((t), (ms)); ASYNC_SUSPEND(t); } while (0)
+
+/* Pop the next queue item into 'item', waiting while the queue is empty */
+#define AWAIT_QUEUE(t, q, item) \
+    do { AWAIT_EVENT((t), &(q)->ready); (item) = async_queue_pop(q); } while (0)
+
+/*------------------------------------------------------------------------------
+ * Interface
+ *------------------------------------------------------------------------------
+ */
+
+/* Start a task on this CPU's event loop; 'task' stays owned by the caller */
+void async_spawn(async_task_t* task, const char* name, async_fn_t fn, void* arg);
+
+/* Resume every task that was ready at the start of the pass; returns how
+ * many ran */
+uint32_t async_run(void);
+
+/* Events */
+void async_event_init(async_event_t* ev);
+void async_event_clear(async_event_t* ev);
+void async_event_signal(async_event_t* ev);
+bool async_event_try_wait(async_event_t* ev, async_task_t* task);
+
+/* Event signalled by each interrupt on a hardware IRQ line */
+async_event_t* async_irq_event(uint8_t irq);
+void async_irq_signal(uint8_t irq);
+
+/* Queues; push is safe from interrupt handlers and fails when full */
+void async_queue_init(async_queue_t* q);
+bool async_queue_push(async_queue_t* q, void* item);
+void* async_queue_pop(async_queue_t* q);
+
+/* Used by the await macros */
+void async_yield(async_task_t* task);
+void async_timer_start(async_task_t* task, uint32_t ms);
+void async_timer_cancel(async_task_t* task);
+
+/* Enumeration and statistics for the shell */
+async_task_t* async_get_task(uint32_t index);
+const async_stats_t* async_get_stats(void);
+
+#endif /* ASYNC_H */
@@ -0,0 +1,542 @@
+/*------------------------------------------------------------------------------
+ * Block Buffer Cache
+ *------------------------------------------------------------------------------
+ * This file implements the page-sized block cache that sits between the
+ * FAT32 file system and the ATA driver. See bcache.h for the design.
+ *------------------------------------------------------------------------------
+ */
+
+#include "bcache.h"
+#include "init.h"
+#include "memory.h"
+#include "kernel.h"
+#include "string.h"
+#include "crc32c.h"
+#include "debug.h"
+#include "shrinker.h"
+#include "async.h"
+#include "../drivers/ata.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Cache state */
+static ata_device_t* cache_device = NULL;
+static bcache_buf_t cache_bufs[BCACHE_MAX_BLOCKS];
+static bcache_buf_t* hash_table[BCACHE_HASH_SIZE];
+static bcache_buf_t* lru_head = NULL;   /* Most recently used */
+static bcache_buf_t* lru_tail = NULL;   /* Least recently used */
+static bcache_buf_t* empty_list = NULL; /* Descriptors without a page */
+static uint32_t resident = 0;           /* Descriptors with a page */
+static bcache_stats_t stats;
+static bool cache_initialized = false;
+
+/* Set while the lists are being changed; the shrinker backs off then,
+ * since it can run from an allocation made inside a cache operation */
+static bool cache_busy = false;
+
+/* Read-ahead: one coroutine fetches queued blocks, one request at a time */
+static async_queue_t readahead_queue;
+static async_task_t readahead_task;
+static ata_request_t readahead_req;
+static bcache_buf_t* readahead_buf = NULL;      /* Block in flight, pinned */
+static uint32_t readahead_block;                /* Block popped from the queue */
+static uint32_t last_miss = 0xFFFFFFFF;         /* Block of the previous miss */
+
+_Static_assert(BCACHE_BLOCK_SIZE == PAGE_SIZE, "cache blocks are single pages");
+
+/*------------------------------------------------------------------------------
+ * List helpers
+ *------------------------------------------------------------------------------
+ */
+
+static inline uint32_t bcache_hash(uint32_t block) {
+    return block & (BCACHE_HASH_SIZE - 1);
+}
+
+static void lru_unlink(bcache_buf_t* buf) {
+    if (buf->lru_prev) buf->lru_prev->lru_next = buf->lru_next;
+    else lru_head = buf->lru_next;
+    if (buf->lru_next) buf->lru_next->lru_prev = buf->lru_prev;
+    else lru_tail = buf->lru_prev;
+    buf->lru_prev = buf->lru_next = NULL;
+}
+
+static void lru_push_front(bcache_buf_t* buf) {
+    buf->lru_prev = NULL;
+    buf->lru_next = lru_head;
+    if (lru_head) lru_head->lru_prev = buf;
+    lru_head = buf;
+    if (!lru_tail) lru_tail = buf;
+}
+
+static void hash_remove(bcache_buf_t* buf) {
+    bcache_buf_t** link = &hash_table[bcache_hash(buf->block)];
+    while (*link) {
+        if (*link == buf) {
+            *link = buf->hash_next;
+            buf->hash_next = NULL;
+            return;
+        }
+        link = &(*link)->hash_next;
+    }
+}
+
+static void hash_insert(bcache_buf_t* buf) {
+    uint32_t h = bcache_hash(buf->block);
+    buf->hash_next = hash_table[h];
+    hash_table[h] = buf;
+}
+
+#ifdef DEBUG_ENABLED
+/* Record the checksum of a block's current contents */
+static void bcache_seal(bcache_buf_t* buf) {
+    buf->crc = crc32c(buf->data, buf->sectors * BCACHE_SECTOR_SIZE);
+}
+
+/* Check a block; a corrupt unpinned block is re-read from disk */
+static bool bcache_check(bcache_buf_t* buf) {
+    if (crc32c(buf->data, buf->sectors * BCACHE_SECTOR_SIZE) == buf->crc) {
+        return true;
+    }
+
+    stats.corrupt++;
+    debug_print("BCACHE: block checksum mismatch");
+
+    if (buf->refcount == 0 &&
+        ata_read_sectors(cache_device, buf->block * BCACHE_SECTORS_PER_BLOCK,
+                         (uint8_t)buf->sectors, buf->data)) {
+        bcache_seal(buf);
+    }
+    return false;
+}
+#endif
+
+static bcache_buf_t* hash_lookup(uint32_t block) {
+    for (bcache_buf_t* buf = hash_table[bcache_hash(block)]; buf; buf = buf->hash_next) {
+        if (buf->valid && buf->block == block) {
+            return buf;
+        }
+    }
+    return NULL;
+}
+
+/*------------------------------------------------------------------------------
+ * Cache pages
+ *------------------------------------------------------------------------------
+ */
+
+/* Window slot of a descriptor */
+static inline uint32_t bcache_slot(bcache_buf_t* buf) {
+    return BCACHE_WINDOW_START + (uint32_t)(buf - cache_bufs) * PAGE_SIZE;
+}
+
+/* Back an empty descriptor with a fresh page while memory is plentiful */
+static bcache_buf_t* bcache_grow(void) {
+    if (!empty_list || !shrinker_can_grow()) {
+        return NULL;
+    }
+
+    bcache_buf_t* buf = empty_list;
+    uint32_t phys = allocate_physical_page();
+    if (!phys) {
+        return NULL;
+    }
+    if (!map_range(bcache_slot(buf), phys, 1, PAGE_PRESENT | PAGE_WRITABLE)) {
+        free_physical_page(phys);
+        return NULL;
+    }
+
+    empty_list = buf->lru_next;
+    buf->data = (uint8_t*)bcache_slot(buf);
+    buf->valid = false;
+    buf->refcount = 0;
+    resident++;
+    lru_push_front(buf);
+    return buf;
+}
+
+/* Return an unpinned block's page and park the descriptor */
+static void bcache_release(bcache_buf_t* buf) {
+    if (buf->valid) {
+        hash_remove(buf);
+        buf->valid = false;
+    }
+    lru_unlink(buf);
+
+    uint32_t phys = get_physical_address(bcache_slot(buf));
+    unmap_page(bcache_slot(buf));
+    free_physical_page(phys);
+
+    buf->data = NULL;
+    buf->lru_next = empty_list;
+    empty_list = buf;
+    resident--;
+}
+
+/* Grow into free memory, otherwise recycle the least recently used
+ * unpinned block; the caller sets cache_busy */
+static bcache_buf_t* bcache_alloc(void) {
+    bcache_buf_t* buf = bcache_grow();
+    if (!buf) {
+        for (buf = lru_tail; buf && buf->refcount > 0; buf = buf->lru_prev) {
+        }
+    }
+    if (!buf) {
+        return NULL;
+    }
+
+    if (buf->valid) {
+        stats.evictions++;
+        hash_remove(buf);
+        buf->valid = false;
+    }
+    buf->readahead = false;
+    return buf;
+}
+
+/* Sectors in a block, clamped at the end of the disk */
+static uint32_t bcache_block_sectors(uint32_t block) {
+    uint32_t first = block * BCACHE_SECTORS_PER_BLOCK;
+    uint32_t count = BCACHE_SECTORS_PER_BLOCK;
+    if (cache_device->sectors > first && cache_device->sectors - first < count) {
+        count = cache_device->sectors - first;
+    }
+    return count;
+}
+
+/* Publish a block whose data has just been read */
+static void bcache_fill(bcache_buf_t* buf, uint32_t sectors) {
+    buf->sectors = sectors;
+    buf->valid = true;
+#ifdef DEBUG_ENABLED
+    bcache_seal(buf);
+#endif
+    hash_insert(buf);
+    lru_unlink(buf);
+    lru_push_front(buf);
+}
+
+/*------------------------------------------------------------------------------
+ * Read-ahead
+ *------------------------------------------------------------------------------
+ */
+
+/* Queue a block for the read-ahead coroutine unless it is already here */
+static void bcache_readahead(uint32_t block) {
+    if (block * BCACHE_SECTORS_PER_BLOCK >= cache_device->sectors || hash_lookup(block)) {
+        return;
+    }
+    if (readahead_buf && readahead_buf->block == block) {
+        return;
+    }
+    /* A full queue means the disk is behind anyway: drop the hint */
+    async_queue_push(&readahead_queue, (void*)(uintptr_t)block);
+}
+
+/* A lookup or write of a block still being read ahead waits for it */
+static void bcache_wait_readahead(uint32_t block) {
+    while (readahead_buf && readahead_buf->block == block) {
+        if (!async_run()) {
+            asm volatile("pause");
+        }
+    }
+}
+
+static int bcache_readahead_run(async_task_t* t) {
+    ASYNC_BEGIN(t);
+
+    for (;;) {
+        void* item;
+        AWAIT_QUEUE(t, &readahead_queue, item);
+        readahead_block = (uint32_t)(uintptr_t)item;
+        if (hash_lookup(readahead_block)) {
+            continue;
+        }
+
+        cache_busy = true;
+        readahead_buf = bcache_alloc();
+        if (readahead_buf) {
+            readahead_buf->block = readahead_block;
+            readahead_buf->refcount = 1;    /* Not recycled while in flight */
+        }
+        cache_busy = false;
+        if (!readahead_buf) {
+            continue;
+        }
+
+        if (ata_submit_read(&readahead_req, cache_device, readahead_block * BCACHE_SECTORS_PER_BLOCK,
+                            (uint8_t)bcache_block_sectors(readahead_block), readahead_buf->data)) {
+            AWAIT_EVENT(t, &readahead_req.done);
+            if (readahead_req.ok) {
+                cache_busy = true;
+                bcache_fill(readahead_buf, readahead_req.count);
+                readahead_buf->readahead = true;
+                cache_busy = false;
+                stats.readaheads++;
+            }
+        }
+        readahead_buf->refcount = 0;
+        readahead_buf = NULL;
+    }
+
+    ASYNC_END(t);
+}
+
+/* Shrinker: pages that could be released */
+static uint32_t bcache_shrink_count(void) {
+    return resident;
+}
+
+/* Shrinker: release unpinned blocks from the cold end of the LRU */
+static uint32_t bcache_shrink_scan(uint32_t nr_pages) {
+    uint32_t freed = 0;
+
+    if (cache_busy) {
+        return 0;
+    }
+
+    bcache_buf_t* buf = lru_tail;
+    while (buf && freed < nr_pages) {
+        bcache_buf_t* prev = buf->lru_prev;
+        if (buf->refcount == 0) {
+            bcache_release(buf);
+            freed++;
+        }
+        buf = prev;
+    }
+
+    stats.shrunk += freed;
+    return freed;
+}
+
+static shrinker_t bcache_shrinker = {
+    .name = "bcache",
+    .count = bcache_shrink_count,
+    .scan = bcache_shrink_scan,
+    .seeks = 1,                         /* One read refills eight sectors */
+};
+
+/*------------------------------------------------------------------------------
+ * Public interface
+ *------------------------------------------------------------------------------
+ */
+
+/* Initialize the cache for a device */
+bool __init bcache_init(ata_device_t* device) {
+    if (!device) {
+        return false;
+    }
+
+    /* Set first so uncached bypass I/O works even if allocation fails */
+    cache_device = device;
+
+    if (!cache_initialized) {
+        /* Pages are added on demand; start with every descriptor empty */
+        for (int i = BCACHE_MAX_BLOCKS - 1; i >= 0; i--) {
+            cache_bufs[i].lru_next = empty_list;
+            empty_list = &cache_bufs[i];
+        }
+        register_shrinker(&bcache_shrinker);
+        async_queue_init(&readahead_queue);
+        async_spawn(&readahead_task, "bcache-readahead", bcache_readahead_run, NULL);
+        cache_initialized = true;
+    }
+
+    memset(hash_table, 0, sizeof(hash_table));
+    memset(&stats, 0, sizeof(stats));
+
+    for (bcache_buf_t* buf = lru_head; buf; buf = buf->lru_next) {
+        buf->valid = false;
+        buf->refcount = 0;
+        buf->hash_next = NULL;
+    }
+
+    return true;
+}
+
+/* Pin the block containing 'lba' and return it, reading it if necessary */
+bcache_buf_t* bcache_get(uint32_t lba) {
+    if (!cache_initialized || !cache_device) {
+        return NULL;
+    }
+
+    uint32_t block = lba / BCACHE_SECTORS_PER_BLOCK;
+    bcache_wait_readahead(block);
+    bcache_buf_t* buf = hash_lookup(block);
+
+    if (buf) {
+        stats.hits++;
+#ifdef DEBUG_ENABLED
+        bcache_check(buf);
+#endif
+        if (buf->readahead) {
+            /* The stream reached the read-ahead block: keep ahead of it */
+            buf->readahead = false;
+            stats.readahead_hits++;
+            bcache_readahead(block + 1);
+        }
+        buf->refcount++;
+        lru_unlink(buf);
+        lru_push_front(buf);
+        return buf;
+    }
+
+    cache_busy = true;
+    buf = bcache_alloc();
+    if (!buf) {
+        cache_busy = false;
+        return NULL;
+    }
+    stats.misses++;
+
+    uint32_t count = bcache_block_sectors(block);
+    if (!ata_read_sectors(cache_device, block * BCACHE_SECTORS_PER_BLOCK, (uint8_t)count, buf->data)) {
+        cache_busy = false;
+        return NULL;
+    }
+
+    buf->block = block;
+    buf->refcount = 1;
+    bcache_fill(buf, count);
+    cache_busy = false;
+
+    /* A sequential reader: fetch the next block in the background */
+    if (block == last_miss + 1) {
+        bcache_readahead(block + 1);
+    }
+    last_miss = block;
+
+    return buf;
+}
+
+/* Take an extra pin on a block already held */
+void bcache_hold(bcache_buf_t* buf) {
+    if (buf) {
+        buf->refcount++;
+    }
+}
+
+/* Drop a pin taken by bcache_get()/bcache_hold() */
+void bcache_put(bcache_buf_t* buf) {
+    if (buf && buf->refcount > 0) {
+        buf->refcount--;
+    }
+}
+
+/* Read one sector through the cache */
+bool bcache_read_sector(uint32_t lba, void* buffer) {
+    bcache_buf_t* buf = bcache_get(lba);
+
+    if (!buf) {
+        /* Every block pinned or cache unavailable: go straight to disk */
+        if (!cache_device) {
+            return false;
+        }
+        stats.bypasses++;
+        return ata_read_sectors(cache_device, lba, 1, buffer);
+    }
+
+    if (lba % BCACHE_SECTORS_PER_BLOCK >= buf->sectors) {
+        bcache_put(buf);
+        return false;
+    }
+
+    memcpy(buffer, buf->data + BCACHE_OFFSET(lba), BCACHE_SECTOR_SIZE);
+    bcache_put(buf);
+    return true;
+}
+
+/* Write one sector to disk and keep any cached copy coherent */
+bool bcache_write_sector(uint32_t lba, const void* buffer) {
+    if (!cache_device) {
+        return false;
+    }
+
+    if (cache_initialized) {
+        bcache_wait_readahead(lba / BCACHE_SECTORS_PER_BLOCK);
+    }
+    if (!ata_write_sectors(cache_device, lba, 1, buffer)) {
+        return false;
+    }
+    stats.writes++;
+
+    bcache_buf_t* buf = cache_initialized ? hash_lookup(lba / BCACHE_SECTORS_PER_BLOCK) : NULL;
+    if (buf) {
+        memcpy(buf->data + BCACHE_OFFSET(lba), buffer, BCACHE_SECTOR_SIZE);
+#ifdef DEBUG_ENABLED
+        bcache_seal(buf);
+#endif
+    }
+
+    return true;
+}
+
+/* Drop every unpinned block */
+void bcache_invalidate(void) {
+    cache_busy = true;
+    for (bcache_buf_t* buf = lru_head; buf; buf = buf->lru_next) {
+        if (buf->valid && buf->refcount == 0) {
+            hash_remove(buf);
+            buf->valid = false;
+        }
+    }
+    cache_busy = false;
+}
+
+#ifdef DEBUG_ENABLED
+/* Check every cached block against its CRC */
+uint32_t bcache_verify(void) {
+    uint32_t bad = 0;
+    for (bcache_buf_t* buf = lru_head; buf; buf = buf->lru_next) {
+        if (buf->valid && !bcache_check(buf)) {
+            bad++;
+        }
+    }
+    return bad;
+}
+#endif
+
+/* Get cache statistics */
+const bcache_stats_t* bcache_get_stats(void) {
+    return &stats;
+}
+
+/* Print cache statistics */
+void bcache_print_stats(void) {
+    uint32_t cached = 0;
+    uint32_t pinned = 0;
+    for (bcache_buf_t* buf = lru_head; buf; buf = buf->lru_next) {
+        if (buf->valid) cached++;
+        if (buf->refcount > 0) pinned++;
+    }
+
+    terminal_writestring("Buffer cache: ");
+    terminal_write_dec(cached);
+    terminal_writestring(" cached, ");
+    terminal_write_dec(resident);
+    terminal_writestring("/");
+    terminal_write_dec(BCACHE_MAX_BLOCKS);
+    terminal_writestring(" pages (");
+    terminal_write_dec(pinned);
+    terminal_writestring(" pinned)\n");
+    terminal_writestring("  Hits: ");
+    terminal_write_dec(stats.hits);
+    terminal_writestring("  Misses: ");
+    terminal_write_dec(stats.misses);
+    terminal_writestring("  Evictions: ");
+    terminal_write_dec(stats.evictions);
+    terminal_writestring("\n  Bypasses: ");
+    terminal_write_dec(stats.bypasses);
+    terminal_writestring("  Writes: ");
+    terminal_write_dec(stats.writes);
+    terminal_writestring("  Corrupt: ");
+    terminal_write_dec(stats.corrupt);
+    terminal_writestring("  Shrunk: ");
+    terminal_write_dec(stats.shrunk);
+    terminal_writestring("\n  Read ahead: ");
+    terminal_write_dec(stats.readaheads);
+    terminal_writestring("  Used: ");
+    terminal_write_dec(stats.readahead_hits);
+    terminal_writestring("\n");
+}
@@ -0,0 +1,101 @@
+#ifndef BCACHE_H
+#define BCACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "../drivers/ata.h"
+
+/*------------------------------------------------------------------------------
+ * Block Buffer Cache
+ *------------------------------------------------------------------------------
+ * Caches disk contents in page-sized blocks of BCACHE_SECTORS_PER_BLOCK
+ * sectors, so a miss fetches eight sectors with one ATA command and
+ * neighbouring FAT/data sectors are then served from memory.
+ *
+ * - Blocks are found through a small hash table and recycled in LRU order.
+ * - Each block is one page mapped at a fixed slot in the cache window.
+ *   Pages are added on demand while free memory is above the shrinker's
+ *   high watermark, so the cache grows into idle RAM, and the cache's
+ *   shrinker hands unpinned pages back oldest first under pressure.
+ * - Writes are write-through: the sector goes to disk immediately and the
+ *   cached copy (if any) is updated, so the cache never holds dirty data.
+ * - Callers can pin a block with bcache_get()/bcache_put() and hand its
+ *   data around by reference; pinned blocks are never evicted.
+ * - Sequential misses start read-ahead: the next block is queued for a
+ *   coroutine that reads it asynchronously from the event loop, so a
+ *   reader that yields between blocks (TFTP, the I/O ring worker) finds it
+ *   cached. A hit on a read-ahead block queues the one after it. Lookups
+ *   and writes of a block still in flight wait for it to land.
+ * - With DEBUG_ENABLED every block carries a CRC32C of its contents that is
+ *   checked on each cache hit, catching stray writes into cached data.
+ *------------------------------------------------------------------------------
+ */
+
+#define BCACHE_SECTOR_SIZE        512
+#define BCACHE_SECTORS_PER_BLOCK  8
+#define BCACHE_BLOCK_SIZE         (BCACHE_SECTOR_SIZE * BCACHE_SECTORS_PER_BLOCK)
+#define BCACHE_MAX_BLOCKS         1024    /* Up to 4 MiB of cached data */
+#define BCACHE_HASH_SIZE          256     /* Hash buckets (power of two) */
+
+/* Cached block */
+typedef struct bcache_buf {
+    uint32_t block;                 /* Block number (first LBA / 8) */
+    uint32_t sectors;               /* Valid sectors (short at end of disk) */
+    uint32_t refcount;              /* Pins held by users */
+    bool     valid;                 /* Data has been read from disk */
+    bool     readahead;             /* Read ahead and not used yet */
+    uint8_t* data;                  /* BCACHE_BLOCK_SIZE bytes, NULL without a page */
+#ifdef DEBUG_ENABLED
+    uint32_t crc;                   /* CRC32C of data while valid */
+#endif
+    struct bcache_buf* hash_next;   /* Hash chain */
+    struct bcache_buf* lru_prev;    /* LRU list, most recent at head (or empty list) */
+    struct bcache_buf* lru_next;
+} bcache_buf_t;
+
+/* Cache statistics */
+typedef struct {
+    uint32_t hits;                  /* Lookups served from memory */
+    uint32_t misses;                /* Lookups that went to disk */
+    uint32_t evictions;             /* Valid blocks recycled */
+    uint32_t bypasses;              /* Misses served uncached (all pinned) */
+    uint32_t writes;                /* Sectors written through */
+    uint32_t corrupt;               /* Blocks failing their CRC check */
+    uint32_t shrunk;                /* Pages given back to the shrinker */
+    uint32_t readaheads;            /* Blocks read ahead */
+    uint32_t readahead_hits;        /* Read-ahead blocks later used */
+} bcache_stats_t;
+
+/* Initialize the cache for a device */
+bool bcache_init(ata_device_t* device);
+
+/* Pin the block containing 'lba' and return it, reading it if necessary */
+bcache_buf_t* bcache_get(uint32_t lba);
+
+/* Take an extra pin on a block already held */
+void bcache_hold(bcache_buf_t* buf);
+
+/* Drop a pin taken by bcache_get()/bcache_hold() */
+void bcache_put(bcache_buf_t* buf);
+
+/* Sector-granular access used by the file system */
+bool bcache_read_sector(uint32_t lba, void* buffer);
+bool bcache_write_sector(uint32_t lba, const void* buffer);
+
+/* Byte offset of 'lba' within its cache block */
+#define BCACHE_OFFSET(lba)  (((lba) % BCACHE_SECTORS_PER_BLOCK) * BCACHE_SECTOR_SIZE)
+
+/* Drop every unpinned block */
+void bcache_invalidate(void);
+
+#ifdef DEBUG_ENABLED
+/* Check every cached block against its CRC; returns the number corrupt */
+uint32_t bcache_verify(void);
+#endif
+
+/* Statistics */
+const bcache_stats_t* bcache_get_stats(void);
+void bcache_print_stats(void);
+
+#endif /* BCACHE_H */
@@ -0,0 +1,26 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+/*------------------------------------------------------------------------------
+ * Cache Line Layout Helpers
+ *------------------------------------------------------------------------------
+ * __cacheline_aligned  - start an object on its own cache line
+ * __hot_data           - data written on fast paths (interrupts, per-packet,
+ *                        per-tick); grouped into .data.hot so the hot lines
+ *                        stay few and dense
+ * __read_mostly        - data written once at init and read constantly;
+ *                        kept in .data.read_mostly, away from lines that
+ *                        are being written
+ *
+ * linker.ld places both sections at the start of .data, each on a cache
+ * line boundary.
+ *------------------------------------------------------------------------------
+ */
+
+#define CACHE_LINE_SIZE     64
+
+#define __cacheline_aligned __attribute__((aligned(CACHE_LINE_SIZE)))
+#define __hot_data          __attribute__((section(".data.hot")))
+#define __read_mostly       __attribute__((section(".data.read_mostly")))
+
+#endif /* CACHE_H */
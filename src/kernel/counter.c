@@ -0,0 +1,64 @@
+/*------------------------------------------------------------------------------
+ * Statistics Counters
+ *------------------------------------------------------------------------------
+ * This file implements the readers of the per-CPU counters. See counter.h.
+ *------------------------------------------------------------------------------
+ */
+
+#include "counter.h"
+#include "init.h"
+#include "kernel.h"
+#include "string.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Check the table fits the per-CPU slots */
+void __init counter_init(void) {
+    if (counter_count() > PERCPU_COUNTERS) {
+        terminal_setcolor(vga_entry_color(VGA_COLOR_RED, VGA_COLOR_BLACK));
+        terminal_writestring("ERROR: More counters defined than PERCPU_COUNTERS!\n");
+        while(1) asm volatile("hlt");
+    }
+}
+
+/* Sum over all online CPUs, retrying any CPU that was mid-update */
+uint64_t counter_read(const counter_t* c) {
+    uint32_t index = (uint32_t)(c - __counters_start);
+    uint64_t sum = 0;
+
+    for (uint32_t cpu = 0; cpu < percpu_online_count(); cpu++) {
+        volatile percpu_t* area = percpu_area(cpu);
+        uint32_t seq;
+        uint64_t value;
+        do {
+            seq = area->counter_seq;
+            asm volatile("" ::: "memory");
+            value = area->counters[index];
+            asm volatile("" ::: "memory");
+        } while ((seq & 1) || seq != area->counter_seq);
+        sum += value;
+    }
+    return sum;
+}
+
+/* Zero every counter on every CPU */
+void counter_reset_all(void) {
+    uint32_t flags;
+    asm volatile("pushfl; popl %0; cli" : "=r"(flags) :: "memory");
+    for (uint32_t cpu = 0; cpu < NR_CPUS; cpu++) {
+        percpu_t* area = percpu_area(cpu);
+        area->counter_seq++;
+        memset(area->counters, 0, sizeof(area->counters));
+        area->counter_seq++;
+    }
+    asm volatile("pushl %0; popfl" :: "r"(flags) : "memory", "cc");
+}
+
+uint32_t counter_count(void) {
+    return (uint32_t)(__counters_end - __counters_start);
+}
+
+const counter_t* counter_get(uint32_t index) {
+    return index < counter_count() ? &__counters_start[index] : NULL;
+}
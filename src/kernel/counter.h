@@ -0,0 +1,84 @@
+#ifndef COUNTER_H
+#define COUNTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "percpu.h"
+
+/*------------------------------------------------------------------------------
+ * Statistics Counters
+ *------------------------------------------------------------------------------
+ * A subsystem declares a counter once at file scope:
+ *
+ *     DEFINE_COUNTER(bcache_hits, "bcache", "hits");
+ *     ...
+ *     counter_inc(&bcache_hits);
+ *
+ * The descriptor goes into the __counters section, which linker.ld
+ * collects between __counters_start and __counters_end. A counter's
+ * position in that table is its slot in every CPU's percpu_t.counters[],
+ * so no registration call is needed and 'stats' lists everything that was
+ * linked in.
+ *
+ * Each CPU only ever updates its own 64-bit slots. An update is an add/adc
+ * pair bracketed by increments of the CPU's counter_seq and run with
+ * interrupts off, so the sequence is odd exactly while a slot is half
+ * written. counter_read() sums the online CPUs and retries a CPU whose
+ * sequence was odd or moved during the read, which yields whole 64-bit
+ * values on a 32-bit CPU without any shared, bouncing cache line.
+ *------------------------------------------------------------------------------
+ */
+
+/* Counter descriptor; its table offset doubles as its slot offset */
+typedef struct counter {
+    const char* group;                  /* Subsystem */
+    const char* name;
+} __attribute__((aligned(8))) counter_t;
+
+_Static_assert(sizeof(counter_t) == sizeof(uint64_t), "descriptor and slot sizes must match");
+
+/* Place descriptors in the table; also usable on arrays of counters */
+#define __counter __attribute__((section("__counters"), used))
+
+#define DEFINE_COUNTER(var, grp, nm) const counter_t var __counter = { grp, nm }
+
+#define DECLARE_COUNTER(var) extern const counter_t var
+
+/* Table collected by linker.ld */
+extern const counter_t __counters_start[];
+extern const counter_t __counters_end[];
+
+/* Add to this CPU's slot */
+static inline void counter_add(const counter_t* c, uint32_t n) {
+    uint32_t off = offsetof(percpu_t, counters) + ((uint32_t)c - (uint32_t)__counters_start);
+    uint32_t flags;
+    asm volatile("pushfl; popl %0; cli\n\t"
+                 "incl %%gs:%c3\n\t"
+                 "addl %1, %%gs:(%2)\n\t"
+                 "adcl $0, %%gs:4(%2)\n\t"
+                 "incl %%gs:%c3\n\t"
+                 "pushl %0; popfl"
+                 : "=&r"(flags)
+                 : "r"(n), "r"(off), "i"(offsetof(percpu_t, counter_seq))
+                 : "memory", "cc");
+}
+
+static inline void counter_inc(const counter_t* c) {
+    counter_add(c, 1);
+}
+
+/* Check the table fits the per-CPU slots */
+void counter_init(void);
+
+/* Sum over all online CPUs */
+uint64_t counter_read(const counter_t* c);
+
+/* Zero every counter on every CPU */
+void counter_reset_all(void);
+
+/* Number of counters and the i-th one, for display */
+uint32_t counter_count(void);
+const counter_t* counter_get(uint32_t index);
+
+#endif /* COUNTER_H */
@@ -0,0 +1,40 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*------------------------------------------------------------------------------
+ * CRC32C (Castagnoli) Checksums
+ *------------------------------------------------------------------------------
+ * CRC-32C with the reflected polynomial 0x82F63B78, as used by iSCSI, ext4
+ * and btrfs. When CPUID reports SSE4.2 the 'crc32' instruction computes it
+ * four bytes per instruction; otherwise a slice-by-8 table walk processes
+ * eight bytes per iteration.
+ *
+ * Streaming use:
+ *     uint32_t crc = CRC32C_SEED;
+ *     crc = crc32c_update(crc, chunk, len);   (repeat)
+ *     crc = crc32c_final(crc);
+ *------------------------------------------------------------------------------
+ */
+
+#define CRC32C_POLY   0x82F63B78   /* Reflected Castagnoli polynomial */
+#define CRC32C_SEED   0xFFFFFFFF   /* Initial running value */
+
+#define crc32c_final(crc)  ((crc) ^ 0xFFFFFFFF)
+
+/* Build the fallback tables and pick the implementation */
+void crc32c_init(void);
+
+/* Whether the SSE4.2 instruction path is in use */
+bool crc32c_hw_available(void);
+
+/* Fold data into a running CRC (seeded with CRC32C_SEED) */
+uint32_t crc32c_update(uint32_t crc, const void* data, size_t len);
+
+/* One-shot CRC32C of a buffer */
+uint32_t crc32c(const void* data, size_t len);
+
+#endif /* CRC32C_H */
@@ -7,7 +7,11 @@
  */
 
 #include "debug.h"
+#include "counter.h"
+#include "init.h"
 #include "kernel.h"  /* For terminal functions */
+#include "percpu.h"
+#include "string.h"
 #include <stdarg.h>
 
 /*------------------------------------------------------------------------------
@@ -23,12 +27,26 @@ uintptr_t __stack_chk_guard = STACK_CHK_GUARD;
  *------------------------------------------------------------------------------
  */
 
-/* Global profiling statistics */
+/* Event counters, one per-CPU slot each (see counter.h) */
+DEFINE_COUNTER(cnt_interrupts, "irq", "total");
+DEFINE_COUNTER(cnt_timer_interrupts, "irq", "timer");
+DEFINE_COUNTER(cnt_keyboard_interrupts, "irq", "keyboard");
+DEFINE_COUNTER(cnt_spurious_interrupts, "irq", "spurious");
+DEFINE_COUNTER(cnt_exceptions, "exception", "total");
+DEFINE_COUNTER(cnt_page_faults, "exception", "page_fault");
+DEFINE_COUNTER(cnt_gp_faults, "exception", "gpf");
+DEFINE_COUNTER(cnt_allocations, "heap", "allocs");
+DEFINE_COUNTER(cnt_frees, "heap", "frees");
+
+/* Summed snapshot handed to readers */
 static struct kernel_profiling profiling_stats = {0};
 
 /* Debug initialization flag */
 static bool debug_initialized = false;
 
+/* Profiling hooks are patched out until this is enabled */
+static_key_t debug_profiling_key = STATIC_KEY_INIT_FALSE;
+
 /*------------------------------------------------------------------------------
  * Helper Functions
  *------------------------------------------------------------------------------
@@ -91,6 +109,17 @@ static void debug_uint64_to_str(uint64_t value, char* buffer, size_t buffer_size
     buffer[pos] = '\0';
 }
 
+/* Zero every CPU's counters, heap gauges and the snapshot. Goes through
+ * the areas' linear addresses, so it also works before GS is loaded. */
+static void debug_clear_counters(void) {
+    counter_reset_all();
+    for (uint32_t cpu = 0; cpu < NR_CPUS; cpu++) {
+        percpu_area(cpu)->heap_allocated_bytes = 0;
+        percpu_area(cpu)->heap_peak_bytes = 0;
+    }
+    memset(&profiling_stats, 0, sizeof(profiling_stats));
+}
+
 /*------------------------------------------------------------------------------
  * Public Debug Functions
  *------------------------------------------------------------------------------
@@ -99,22 +128,9 @@ static void debug_uint64_to_str(uint64_t value, char* buffer, size_t buffer_size
 /**
  * @brief Initialize debugging and profiling subsystem
  */
-void debug_init(void) {
+void __init debug_init(void) {
     /* Initialize profiling counters to zero */
-    profiling_stats.total_interrupts = 0;
-    profiling_stats.timer_interrupts = 0;
-    profiling_stats.keyboard_interrupts = 0;
-    profiling_stats.spurious_interrupts = 0;
-    profiling_stats.exceptions = 0;
-    profiling_stats.page_faults = 0;
-    profiling_stats.general_protection_faults = 0;
-    profiling_stats.memory_allocations = 0;
-    profiling_stats.memory_frees = 0;
-    profiling_stats.memory_allocated_bytes = 0;
-    profiling_stats.peak_memory_usage = 0;
-    profiling_stats.system_calls = 0;
-    profiling_stats.context_switches = 0;
-    profiling_stats.max_interrupt_latency = 0;
+    debug_clear_counters();
     
     /* Initialize stack canary with a random-ish value */
     /* In a real implementation, this should be properly randomized */
@@ -122,6 +138,10 @@ void debug_init(void) {
     
     debug_initialized = true;
     
+#ifdef DEBUG_ENABLED
+    debug_set_profiling(true);
+#endif
+    
     /* Print initialization message */
     terminal_setcolor(vga_entry_color(VGA_COLOR_GREEN, VGA_COLOR_BLACK));
     terminal_writestring("Debug subsystem initialized with stack canaries\n");
@@ -132,6 +152,25 @@ void debug_init(void) {
  * @brief Get current profiling statistics
  */
 const struct kernel_profiling* debug_get_profiling_stats(void) {
+    struct kernel_profiling sum;
+    memset(&sum, 0, sizeof(sum));
+
+    sum.total_interrupts = counter_read(&cnt_interrupts);
+    sum.timer_interrupts = counter_read(&cnt_timer_interrupts);
+    sum.keyboard_interrupts = counter_read(&cnt_keyboard_interrupts);
+    sum.spurious_interrupts = counter_read(&cnt_spurious_interrupts);
+    sum.exceptions = counter_read(&cnt_exceptions);
+    sum.page_faults = counter_read(&cnt_page_faults);
+    sum.general_protection_faults = counter_read(&cnt_gp_faults);
+    sum.memory_allocations = counter_read(&cnt_allocations);
+    sum.memory_frees = counter_read(&cnt_frees);
+
+    for (uint32_t cpu = 0; cpu < percpu_online_count(); cpu++) {
+        sum.memory_allocated_bytes += percpu_area(cpu)->heap_allocated_bytes;
+        sum.peak_memory_usage += percpu_area(cpu)->heap_peak_bytes;
+    }
+
+    profiling_stats = sum;
     return &profiling_stats;
 }
 
@@ -141,40 +180,27 @@ const struct kernel_profiling* debug_get_profiling_stats(void) {
 void debug_reset_profiling_stats(void) {
     if (!debug_initialized) return;
     
-    profiling_stats.total_interrupts = 0;
-    profiling_stats.timer_interrupts = 0;
-    profiling_stats.keyboard_interrupts = 0;
-    profiling_stats.spurious_interrupts = 0;
-    profiling_stats.exceptions = 0;
-    profiling_stats.page_faults = 0;
-    profiling_stats.general_protection_faults = 0;
-    profiling_stats.memory_allocations = 0;
-    profiling_stats.memory_frees = 0;
-    profiling_stats.memory_allocated_bytes = 0;
-    profiling_stats.peak_memory_usage = 0;
-    profiling_stats.system_calls = 0;
-    profiling_stats.context_switches = 0;
-    profiling_stats.max_interrupt_latency = 0;
+    debug_clear_counters();
 }
 
 /**
  * @brief Increment interrupt counter for profiling
  */
-void debug_count_interrupt(uint8_t irq_num) {
+void __debug_count_interrupt(uint8_t irq_num) {
     if (!debug_initialized) return;
     
-    profiling_stats.total_interrupts++;
+    counter_inc(&cnt_interrupts);
     
     switch (irq_num) {
         case 0:  /* Timer interrupt */
-            profiling_stats.timer_interrupts++;
+            counter_inc(&cnt_timer_interrupts);
             break;
         case 1:  /* Keyboard interrupt */
-            profiling_stats.keyboard_interrupts++;
+            counter_inc(&cnt_keyboard_interrupts);
             break;
         case 7:  /* Spurious IRQ7 */
         case 15: /* Spurious IRQ15 */
-            profiling_stats.spurious_interrupts++;
+            counter_inc(&cnt_spurious_interrupts);
             break;
         default:
             /* Other IRQs - just counted in total */
@@ -185,17 +211,17 @@ void debug_count_interrupt(uint8_t irq_num) {
 /**
  * @brief Increment exception counter for profiling
  */
-void debug_count_exception(uint8_t exception_num) {
+void __debug_count_exception(uint8_t exception_num) {
     if (!debug_initialized) return;
     
-    profiling_stats.exceptions++;
+    counter_inc(&cnt_exceptions);
     
     switch (exception_num) {
         case 13: /* General Protection Fault */
-            profiling_stats.general_protection_faults++;
+            counter_inc(&cnt_gp_faults);
             break;
         case 14: /* Page Fault */
-            profiling_stats.page_faults++;
+            counter_inc(&cnt_page_faults);
             break;
         default:
             /* Other exceptions - just counted in total */
@@ -206,34 +232,50 @@ void debug_count_exception(uint8_t exception_num) {
 /**
  * @brief Track memory allocation for profiling
  */
-void debug_count_memory_alloc(uint32_t bytes) {
+void __debug_count_memory_alloc(uint32_t bytes) {
     if (!debug_initialized) return;
     
-    profiling_stats.memory_allocations++;
-    profiling_stats.memory_allocated_bytes += bytes;
+    counter_inc(&cnt_allocations);
+    this_cpu_add(heap_allocated_bytes, bytes);
     
     /* Update peak memory usage */
-    if (profiling_stats.memory_allocated_bytes > profiling_stats.peak_memory_usage) {
-        profiling_stats.peak_memory_usage = profiling_stats.memory_allocated_bytes;
+    uint32_t allocated = this_cpu_read(heap_allocated_bytes);
+    if (allocated > this_cpu_read(heap_peak_bytes)) {
+        this_cpu_write(heap_peak_bytes, allocated);
     }
 }
 
 /**
  * @brief Track memory deallocation for profiling
  */
-void debug_count_memory_free(uint32_t bytes) {
+void __debug_count_memory_free(uint32_t bytes) {
     if (!debug_initialized) return;
     
-    profiling_stats.memory_frees++;
+    counter_inc(&cnt_frees);
     
     /* Prevent underflow */
-    if (profiling_stats.memory_allocated_bytes >= bytes) {
-        profiling_stats.memory_allocated_bytes -= bytes;
+    uint32_t allocated = this_cpu_read(heap_allocated_bytes);
+    this_cpu_write(heap_allocated_bytes, allocated >= bytes ? allocated - bytes : 0);
+}
+
+/**
+ * @brief Turn the profiling hooks on or off
+ */
+void debug_set_profiling(bool enabled) {
+    if (enabled) {
+        static_key_enable(&debug_profiling_key);
     } else {
-        profiling_stats.memory_allocated_bytes = 0;
+        static_key_disable(&debug_profiling_key);
     }
 }
 
+/**
+ * @brief Whether the profiling hooks are live
+ */
+bool debug_profiling_enabled(void) {
+    return static_key_enabled(&debug_profiling_key);
+}
+
 /**
  * @brief Stack canary failure handler
  */
@@ -306,10 +348,14 @@ void debug_print_profiling_stats(void) {
     
     char buffer[32];
     
+    debug_get_profiling_stats();
+    
     terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
     terminal_writestring("\n=== KERNEL PROFILING STATISTICS ===\n");
     
     terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+    terminal_writestring("Profiling hooks: ");
+    terminal_writestring(debug_profiling_enabled() ? "on\n" : "off (patched out; 'debug on' to enable)\n");
     
     /* Interrupt statistics */
     terminal_writestring("Interrupts:\n");
@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "patch.h"
 
 /*------------------------------------------------------------------------------
  * Kernel Debugging and Profiling Support
@@ -88,33 +89,76 @@ const struct kernel_profiling* debug_get_profiling_stats(void);
  */
 void debug_reset_profiling_stats(void);
 
+/**
+ * @brief Static key gating the profiling hooks below
+ *
+ * The hooks are forced inline, so while disabled each one is a NOP at its
+ * call site and no call (without -O a short flag test follows the NOP).
+ * Enabled at boot in DEBUG_ENABLED builds; toggled with debug_set_profiling().
+ */
+extern static_key_t debug_profiling_key;
+
+/* Out-of-line counter updates, reached only through the hooks below */
+void __debug_count_interrupt(uint8_t irq_num);
+void __debug_count_exception(uint8_t exception_num);
+void __debug_count_memory_alloc(uint32_t bytes);
+void __debug_count_memory_free(uint32_t bytes);
+
 /**
  * @brief Increment interrupt counter for profiling
  * 
  * @param irq_num IRQ number (0-15, or 0xFF for exceptions)
  */
-void debug_count_interrupt(uint8_t irq_num);
+static __always_inline void debug_count_interrupt(uint8_t irq_num) {
+    if (static_branch_unlikely(&debug_profiling_key)) {
+        __debug_count_interrupt(irq_num);
+    }
+}
 
 /**
  * @brief Increment exception counter for profiling
  * 
  * @param exception_num Exception vector number (0-31)
  */
-void debug_count_exception(uint8_t exception_num);
+static __always_inline void debug_count_exception(uint8_t exception_num) {
+    if (static_branch_unlikely(&debug_profiling_key)) {
+        __debug_count_exception(exception_num);
+    }
+}
 
 /**
  * @brief Track memory allocation for profiling
  * 
  * @param bytes Number of bytes allocated
  */
-void debug_count_memory_alloc(uint32_t bytes);
+static __always_inline void debug_count_memory_alloc(uint32_t bytes) {
+    if (static_branch_unlikely(&debug_profiling_key)) {
+        __debug_count_memory_alloc(bytes);
+    }
+}
 
 /**
  * @brief Track memory deallocation for profiling
  * 
  * @param bytes Number of bytes freed
  */
-void debug_count_memory_free(uint32_t bytes);
+static __always_inline void debug_count_memory_free(uint32_t bytes) {
+    if (static_branch_unlikely(&debug_profiling_key)) {
+        __debug_count_memory_free(bytes);
+    }
+}
+
+/**
+ * @brief Turn the profiling hooks on or off by patching their call sites
+ * 
+ * @param enabled true to start counting
+ */
+void debug_set_profiling(bool enabled);
+
+/**
+ * @brief Whether the profiling hooks are live
+ */
+bool debug_profiling_enabled(void);
 
 /**
  * @brief Simple assertion macro for kernel debugging
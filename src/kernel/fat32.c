@@ -7,16 +7,19 @@
  */
 
 #include "fat32.h"
+#include "init.h"
 #include "memory.h"
 #include "debug.h"
 #include "kernel.h"
+#include "bcache.h"
+#include "string.h"
 #include "../drivers/ata.h"
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
-/* Global file system information */
-static fat32_fs_info_t fs_info;
+/* Global file system information (written only at mount) */
+static fat32_fs_info_t fs_info __read_mostly;
 
 /* Primary storage device */
 static ata_device_t* storage_device = NULL;
@@ -38,8 +41,8 @@ static uint32_t fat32_allocate_cluster(uint32_t previous_cluster);
 
 /*------------------------------------------------------------------------------
  * Low-level disk I/O functions
- * These are placeholder implementations that need to be replaced with
- * actual ATA/IDE driver calls when available.
+ * All sector I/O goes through the block buffer cache, which batches reads
+ * into page-sized ATA transfers and writes through to the device.
  *------------------------------------------------------------------------------
  */
 
@@ -49,7 +52,7 @@ bool fat32_read_sector(uint32_t sector, void* buffer) {
         return false;
     }
     
-    return ata_read_sectors(storage_device, sector, 1, buffer);
+    return bcache_read_sector(sector, buffer);
 }
 
 /* Write a sector to the storage device */
@@ -58,7 +61,7 @@ bool fat32_write_sector(uint32_t sector, const void* buffer) {
         return false;
     }
     
-    return ata_write_sectors(storage_device, sector, 1, buffer);
+    return bcache_write_sector(sector, buffer);
 }
 
 /*------------------------------------------------------------------------------
@@ -66,8 +69,20 @@ bool fat32_write_sector(uint32_t sector, const void* buffer) {
  *------------------------------------------------------------------------------
  */
 
+/* log2 of a power of two, or -1 if value is not one */
+static int __init fat32_log2(uint32_t value) {
+    if (value == 0 || (value & (value - 1)) != 0) {
+        return -1;
+    }
+    int shift = 0;
+    while ((1u << shift) != value) {
+        shift++;
+    }
+    return shift;
+}
+
 /* Initialize FAT32 file system */
-bool fat32_init(void) {
+bool __init fat32_init(void) {
     /* Allocate dynamic buffers */
     sector_buffer = (uint8_t*)kmalloc(512);
     if (!sector_buffer) {
@@ -112,6 +127,9 @@ bool fat32_init(void) {
         return false;
     }
     
+    /* Put the block cache in front of the device */
+    bcache_init(storage_device);
+    
     /* Try to read the boot sector */
     if (!fat32_read_sector(0, &fs_info.boot_sector)) {
         return false;
@@ -134,7 +152,19 @@ bool fat32_init(void) {
     fs_info.data_start_sector = fs_info.fat_start_sector + 
                                (fs_info.boot_sector.num_fats * fs_info.boot_sector.fat_size_32);
     fs_info.sectors_per_cluster = fs_info.boot_sector.sectors_per_cluster;
-    fs_info.bytes_per_cluster = fs_info.sectors_per_cluster * fs_info.boot_sector.bytes_per_sector;
+    fs_info.bytes_per_sector = fs_info.boot_sector.bytes_per_sector;
+    fs_info.bytes_per_cluster = fs_info.sectors_per_cluster * fs_info.bytes_per_sector;
+    
+    /* Both sizes are powers of two, so the read path can shift and mask */
+    int sector_shift = fat32_log2(fs_info.bytes_per_sector);
+    int cluster_shift = fat32_log2(fs_info.bytes_per_cluster);
+    if (sector_shift < 0 || cluster_shift < 0) {
+        return false;
+    }
+    fs_info.sector_shift = (uint8_t)sector_shift;
+    fs_info.cluster_shift = (uint8_t)cluster_shift;
+    fs_info.sector_mask = fs_info.bytes_per_sector - 1;
+    fs_info.cluster_mask = fs_info.bytes_per_cluster - 1;
     fs_info.root_dir_cluster = fs_info.boot_sector.root_cluster;
     
     /* Calculate total number of data clusters */
@@ -155,8 +185,8 @@ uint32_t fat32_get_next_cluster(uint32_t cluster) {
     
     /* Calculate FAT sector and offset */
     uint32_t fat_offset = cluster * 4;  /* 4 bytes per FAT32 entry */
-    uint32_t fat_sector = fs_info.fat_start_sector + (fat_offset / fs_info.boot_sector.bytes_per_sector);
-    uint32_t entry_offset = fat_offset % fs_info.boot_sector.bytes_per_sector;
+    uint32_t fat_sector = fs_info.fat_start_sector + (fat_offset >> fs_info.sector_shift);
+    uint32_t entry_offset = fat_offset & fs_info.sector_mask;
     
     /* Read the FAT sector */
     if (!fat32_read_sector(fat_sector, sector_buffer)) {
@@ -177,8 +207,8 @@ bool fat32_set_next_cluster(uint32_t cluster, uint32_t next_cluster) {
     
     /* Calculate FAT sector and offset */
     uint32_t fat_offset = cluster * 4;  /* 4 bytes per FAT32 entry */
-    uint32_t fat_sector = fs_info.fat_start_sector + (fat_offset / fs_info.boot_sector.bytes_per_sector);
-    uint32_t entry_offset = fat_offset % fs_info.boot_sector.bytes_per_sector;
+    uint32_t fat_sector = fs_info.fat_start_sector + (fat_offset >> fs_info.sector_shift);
+    uint32_t entry_offset = fat_offset & fs_info.sector_mask;
     
     /* Read the FAT sector */
     if (!fat32_read_sector(fat_sector, sector_buffer)) {
@@ -240,7 +270,7 @@ static fat32_dir_entry_t* fat32_find_entry(uint32_t dir_cluster, const char* fil
             
             /* Check all directory entries in this sector */
             fat32_dir_entry_t* entries = (fat32_dir_entry_t*)sector_buffer;
-            uint32_t entries_per_sector = fs_info.boot_sector.bytes_per_sector / sizeof(fat32_dir_entry_t);
+            uint32_t entries_per_sector = fs_info.bytes_per_sector / sizeof(fat32_dir_entry_t);
             
             for (uint32_t j = 0; j < entries_per_sector; j++) {
                 /* Skip deleted entries */
@@ -320,6 +350,106 @@ fat32_file_t* fat32_open(const char* filename) {
     return file;
 }
 
+/* Build a space-padded 8.3 directory name; fails for names that don't fit */
+static bool fat32_make_short_name(const char* filename, uint8_t* short_name) {
+    static const char invalid[] = "\"*+,/:;<=>?[\\]| ";
+    size_t base_len = 0;
+    size_t ext_len = 0;
+    bool in_ext = false;
+    
+    for (int i = 0; i < 11; i++) {
+        short_name[i] = ' ';
+    }
+    
+    for (const char* p = filename; *p; p++) {
+        char c = *p;
+        
+        if (c == '.') {
+            if (in_ext || base_len == 0) {
+                return false;
+            }
+            in_ext = true;
+            continue;
+        }
+        
+        for (const char* bad = invalid; *bad; bad++) {
+            if (c == *bad) {
+                return false;
+            }
+        }
+        if ((uint8_t)c < 0x20) {
+            return false;
+        }
+        
+        if (c >= 'a' && c <= 'z') c -= 32;
+        
+        if (in_ext) {
+            if (ext_len == 3) return false;
+            short_name[8 + ext_len++] = (uint8_t)c;
+        } else {
+            if (base_len == 8) return false;
+            short_name[base_len++] = (uint8_t)c;
+        }
+    }
+    
+    return base_len > 0;
+}
+
+/* Add an empty file entry to the root directory, growing it if it is full */
+static bool fat32_add_dir_entry(const char* filename) {
+    uint8_t short_name[11];
+    if (!fat32_make_short_name(filename, short_name)) {
+        return false;
+    }
+    
+    uint32_t current_cluster = fs_info.root_dir_cluster;
+    uint32_t last_cluster = current_cluster;
+    uint32_t entries_per_sector = fs_info.bytes_per_sector / sizeof(fat32_dir_entry_t);
+    
+    while (current_cluster < FAT32_EOC) {
+        uint32_t sector = fat32_cluster_to_sector(current_cluster);
+        
+        for (uint32_t i = 0; i < fs_info.sectors_per_cluster; i++) {
+            if (!fat32_read_sector(sector + i, sector_buffer)) {
+                return false;
+            }
+            
+            fat32_dir_entry_t* entries = (fat32_dir_entry_t*)sector_buffer;
+            for (uint32_t j = 0; j < entries_per_sector; j++) {
+                /* Reuse deleted slots or take the end-of-directory marker */
+                if (entries[j].name[0] == 0x00 || entries[j].name[0] == 0xE5) {
+                    memset(&entries[j], 0, sizeof(fat32_dir_entry_t));
+                    memcpy(entries[j].name, short_name, 11);
+                    entries[j].attributes = FAT_ATTR_ARCHIVE;
+                    return fat32_write_sector(sector + i, sector_buffer);
+                }
+            }
+        }
+        
+        last_cluster = current_cluster;
+        current_cluster = fat32_get_next_cluster(current_cluster);
+    }
+    
+    /* Directory is full: chain a zeroed cluster onto it */
+    uint32_t new_cluster = fat32_allocate_cluster(last_cluster);
+    if (new_cluster == 0) {
+        return false;
+    }
+    
+    uint32_t sector = fat32_cluster_to_sector(new_cluster);
+    memset(sector_buffer, 0, fs_info.bytes_per_sector);
+    for (uint32_t i = 1; i < fs_info.sectors_per_cluster; i++) {
+        if (!fat32_write_sector(sector + i, sector_buffer)) {
+            return false;
+        }
+    }
+    
+    fat32_dir_entry_t* entry = (fat32_dir_entry_t*)sector_buffer;
+    memcpy(entry->name, short_name, 11);
+    entry->attributes = FAT_ATTR_ARCHIVE;
+    return fat32_write_sector(sector, sector_buffer);
+}
+
 /* Create a new file */
 fat32_file_t* fat32_create(const char* filename) {
     if (!fs_info.initialized || !filename) {
@@ -380,8 +510,11 @@ fat32_file_t* fat32_create(const char* filename) {
     }
     file->filename[len] = '\0';
     
-    /* TODO: Create directory entry in root directory */
-    /* For now, just return the file handle - directory entry creation is complex */
+    /* Create the directory entry; size and cluster are filled in on close */
+    if (!fat32_add_dir_entry(filename)) {
+        file->is_open = false;
+        return NULL;
+    }
     
     return file;
 }
@@ -406,7 +539,7 @@ static bool fat32_update_dir_entry(fat32_file_t* file) {
             
             /* Check all directory entries in this sector */
             fat32_dir_entry_t* entries = (fat32_dir_entry_t*)sector_buffer;
-            uint32_t entries_per_sector = fs_info.boot_sector.bytes_per_sector / sizeof(fat32_dir_entry_t);
+            uint32_t entries_per_sector = fs_info.bytes_per_sector / sizeof(fat32_dir_entry_t);
             
             for (uint32_t j = 0; j < entries_per_sector; j++) {
                 /* Skip deleted entries */
@@ -425,7 +558,7 @@ static bool fat32_update_dir_entry(fat32_file_t* file) {
                 }
                 
                 /* Convert filename for comparison */
-                char converted_name[12];
+                char converted_name[13];
                 fat32_convert_filename((char*)entries[j].name, converted_name);
                 
                 if (fat32_compare_filename(file->filename, converted_name)) {
@@ -472,31 +605,43 @@ size_t fat32_read(fat32_file_t* file, void* buffer, size_t size) {
     
     size_t bytes_read = 0;
     uint8_t* dest = (uint8_t*)buffer;
+    bool io_error = false;
     
-    while (bytes_read < size && file->current_cluster < FAT32_EOC) {
-        uint32_t cluster_offset = file->position % fs_info.bytes_per_cluster;
+    while (bytes_read < size && !io_error) {
+        /* Step into the next cluster once the current one is used up */
+        if (file->position > 0 && (file->position & fs_info.cluster_mask) == 0) {
+            uint32_t next_cluster = fat32_get_next_cluster(file->current_cluster);
+            if (next_cluster >= FAT32_EOC || next_cluster < 2) {
+                break;
+            }
+            file->current_cluster = next_cluster;
+        }
+        if (file->current_cluster >= FAT32_EOC || file->current_cluster < 2) {
+            break;
+        }
+        
+        uint32_t cluster_offset = file->position & fs_info.cluster_mask;
         uint32_t bytes_in_cluster = fs_info.bytes_per_cluster - cluster_offset;
         uint32_t bytes_to_read = (size - bytes_read < bytes_in_cluster) ? 
                                 (size - bytes_read) : bytes_in_cluster;
         
         /* Read the cluster */
         uint32_t sector = fat32_cluster_to_sector(file->current_cluster);
-        uint32_t sector_offset = cluster_offset / fs_info.boot_sector.bytes_per_sector;
-        uint32_t byte_offset = cluster_offset % fs_info.boot_sector.bytes_per_sector;
+        uint32_t sector_offset = cluster_offset >> fs_info.sector_shift;
+        uint32_t byte_offset = cluster_offset & fs_info.sector_mask;
         
         /* Handle reading within a sector */
         while (bytes_to_read > 0 && sector_offset < fs_info.sectors_per_cluster) {
             if (!fat32_read_sector(sector + sector_offset, sector_buffer)) {
+                io_error = true;
                 break;
             }
             
-            uint32_t bytes_in_sector = fs_info.boot_sector.bytes_per_sector - byte_offset;
+            uint32_t bytes_in_sector = fs_info.bytes_per_sector - byte_offset;
             uint32_t copy_size = (bytes_to_read < bytes_in_sector) ? bytes_to_read : bytes_in_sector;
             
             /* Copy data from sector buffer */
-            for (uint32_t i = 0; i < copy_size; i++) {
-                dest[bytes_read + i] = sector_buffer[byte_offset + i];
-            }
+            memcpy(dest + bytes_read, sector_buffer + byte_offset, copy_size);
             
             bytes_read += copy_size;
             bytes_to_read -= copy_size;
@@ -505,11 +650,6 @@ size_t fat32_read(fat32_file_t* file, void* buffer, size_t size) {
             sector_offset++;
             byte_offset = 0;
         }
-        
-        /* Move to next cluster if we've read the entire current cluster */
-        if (cluster_offset + (size - bytes_read) >= fs_info.bytes_per_cluster) {
-            file->current_cluster = fat32_get_next_cluster(file->current_cluster);
-        }
     }
     
     return bytes_read;
@@ -575,36 +715,51 @@ size_t fat32_write(fat32_file_t* file, const void* buffer, size_t size) {
     }
     
     while (bytes_written < size) {
+        /* Step into (or allocate) the next cluster once the current one is full */
+        if (file->position > 0 && (file->position & fs_info.cluster_mask) == 0) {
+            uint32_t next_cluster = fat32_get_next_cluster(file->current_cluster);
+            
+            if (next_cluster >= FAT32_EOC || next_cluster < 2) {
+                next_cluster = fat32_allocate_cluster(file->current_cluster);
+                if (next_cluster == 0) {
+                    break;  /* Cannot allocate more clusters */
+                }
+            }
+            
+            file->current_cluster = next_cluster;
+        }
+        
         /* Calculate position within current cluster */
-        uint32_t cluster_offset = file->position % fs_info.bytes_per_cluster;
+        uint32_t cluster_offset = file->position & fs_info.cluster_mask;
         uint32_t bytes_in_cluster = fs_info.bytes_per_cluster - cluster_offset;
         uint32_t bytes_to_write = (size - bytes_written < bytes_in_cluster) ? 
                                  (size - bytes_written) : bytes_in_cluster;
         
         /* Get sector information */
         uint32_t sector = fat32_cluster_to_sector(file->current_cluster);
-        uint32_t sector_offset = cluster_offset / fs_info.boot_sector.bytes_per_sector;
-        uint32_t byte_offset = cluster_offset % fs_info.boot_sector.bytes_per_sector;
+        uint32_t sector_offset = cluster_offset >> fs_info.sector_shift;
+        uint32_t byte_offset = cluster_offset & fs_info.sector_mask;
         
         /* Write data sector by sector */
         while (bytes_to_write > 0 && sector_offset < fs_info.sectors_per_cluster) {
-            uint32_t bytes_in_sector = fs_info.boot_sector.bytes_per_sector - byte_offset;
+            uint32_t bytes_in_sector = fs_info.bytes_per_sector - byte_offset;
             uint32_t copy_size = (bytes_to_write < bytes_in_sector) ? bytes_to_write : bytes_in_sector;
             
             /* If we're not writing a full sector, read it first */
-            if (copy_size < fs_info.boot_sector.bytes_per_sector || byte_offset != 0) {
+            if (copy_size < fs_info.bytes_per_sector || byte_offset != 0) {
                 if (!fat32_read_sector(sector + sector_offset, sector_buffer)) {
                     return bytes_written;
                 }
             }
             
             /* Copy data to sector buffer */
-            for (uint32_t i = 0; i < copy_size; i++) {
-                sector_buffer[byte_offset + i] = src[bytes_written + i];
-            }
+            memcpy(sector_buffer + byte_offset, src + bytes_written, copy_size);
             
             /* Write the sector back */
             if (!fat32_write_sector(sector + sector_offset, sector_buffer)) {
+                if (file->position > file->file_size) {
+                    file->file_size = file->position;
+                }
                 return bytes_written;
             }
             
@@ -615,21 +770,6 @@ size_t fat32_write(fat32_file_t* file, const void* buffer, size_t size) {
             sector_offset++;
             byte_offset = 0;
         }
-        
-        /* If we need more space and have written entire cluster, allocate next cluster */
-        if (bytes_written < size && cluster_offset + (size - bytes_written) >= fs_info.bytes_per_cluster) {
-            uint32_t next_cluster = fat32_get_next_cluster(file->current_cluster);
-            
-            if (next_cluster >= FAT32_EOC) {
-                /* Allocate new cluster */
-                next_cluster = fat32_allocate_cluster(file->current_cluster);
-                if (next_cluster == 0) {
-                    break;  /* Cannot allocate more clusters */
-                }
-            }
-            
-            file->current_cluster = next_cluster;
-        }
     }
     
     /* Update file size if we extended it */
@@ -640,6 +780,62 @@ size_t fat32_write(fat32_file_t* file, const void* buffer, size_t size) {
     return bytes_written;
 }
 
+/* Cluster holding the file position, resolving the lazy boundary step */
+static uint32_t fat32_position_cluster(fat32_file_t* file) {
+    if (file->position > 0 && (file->position & fs_info.cluster_mask) == 0) {
+        return fat32_get_next_cluster(file->current_cluster);
+    }
+    return file->current_cluster;
+}
+
+/* Pin the cache block holding the file position.
+ * On success *offset is the byte offset of the position inside buf->data and
+ * *length the number of file bytes available there contiguously. The caller
+ * consumes them with fat32_advance() and drops the pin with bcache_put(). */
+bcache_buf_t* fat32_get_block(fat32_file_t* file, uint32_t* offset, uint32_t* length) {
+    if (!file || !file->is_open || !offset || !length ||
+        file->position >= file->file_size ||
+        fs_info.bytes_per_sector != BCACHE_SECTOR_SIZE) {
+        return NULL;
+    }
+    
+    uint32_t cluster = fat32_position_cluster(file);
+    if (cluster >= FAT32_EOC || cluster < 2) {
+        return NULL;
+    }
+    
+    uint32_t cluster_offset = file->position & fs_info.cluster_mask;
+    uint32_t lba = fat32_cluster_to_sector(cluster) + (cluster_offset >> fs_info.sector_shift);
+    
+    bcache_buf_t* buf = bcache_get(lba);
+    if (!buf) {
+        return NULL;
+    }
+    
+    uint32_t block_offset = BCACHE_OFFSET(lba) + (cluster_offset & fs_info.sector_mask);
+    uint32_t avail = buf->sectors * BCACHE_SECTOR_SIZE - block_offset;
+    uint32_t in_cluster = fs_info.bytes_per_cluster - cluster_offset;
+    uint32_t in_file = file->file_size - file->position;
+    
+    if (in_cluster < avail) avail = in_cluster;
+    if (in_file < avail) avail = in_file;
+    
+    *offset = block_offset;
+    *length = avail;
+    return buf;
+}
+
+/* Consume bytes handed out by fat32_get_block() */
+void fat32_advance(fat32_file_t* file, uint32_t bytes) {
+    if (!file || !file->is_open || bytes == 0) {
+        return;
+    }
+    
+    /* Bytes from fat32_get_block() never cross a cluster boundary */
+    file->current_cluster = fat32_position_cluster(file);
+    file->position += bytes;
+}
+
 /* Seek to a position in the file */
 bool fat32_seek(fat32_file_t* file, uint32_t position) {
     if (!file || !file->is_open) {
@@ -654,8 +850,10 @@ bool fat32_seek(fat32_file_t* file, uint32_t position) {
     file->current_cluster = file->first_cluster;
     file->position = 0;
     
-    /* Skip clusters to reach the desired position */
-    while (file->position + fs_info.bytes_per_cluster <= position && 
+    /* Skip clusters to reach the desired position. A position on a cluster
+     * boundary stays in the cluster that ends there; read/write step into
+     * the next one lazily. */
+    while (file->position + fs_info.bytes_per_cluster < position && 
            file->current_cluster < FAT32_EOC) {
         file->position += fs_info.bytes_per_cluster;
         file->current_cluster = fat32_get_next_cluster(file->current_cluster);
@@ -730,8 +928,8 @@ fat32_dir_entry_t* fat32_readdir(fat32_dir_t* dir) {
     
     while (current_cluster < FAT32_EOC) {
         /* Calculate which sector and entry within the cluster */
-        uint32_t sector_in_cluster = (entry_index * sizeof(fat32_dir_entry_t)) / fs_info.boot_sector.bytes_per_sector;
-        uint32_t entry_in_sector = ((entry_index * sizeof(fat32_dir_entry_t)) % fs_info.boot_sector.bytes_per_sector) / sizeof(fat32_dir_entry_t);
+        uint32_t sector_in_cluster = (entry_index * sizeof(fat32_dir_entry_t)) >> fs_info.sector_shift;
+        uint32_t entry_in_sector = ((entry_index * sizeof(fat32_dir_entry_t)) & fs_info.sector_mask) / sizeof(fat32_dir_entry_t);
         
         /* Read the sector */
         uint32_t sector = fat32_cluster_to_sector(current_cluster) + sector_in_cluster;
@@ -881,6 +1079,39 @@ void fat32_print_file_info(const fat32_dir_entry_t* entry) {
     terminal_writestring("\n");
 }
 
+/* Disk extent of a file whose clusters are contiguous (for raw I/O) */
+bool fat32_file_extent(fat32_file_t* file, uint32_t* first_sector, uint32_t* sectors) {
+    if (!fs_info.initialized || !file || !file->is_open || file->first_cluster < 2) {
+        return false;
+    }
+    
+    /* Walk the chain; every link must point at the next cluster */
+    uint32_t clusters = 1;
+    uint32_t cluster = file->first_cluster;
+    uint32_t next = fat32_get_next_cluster(cluster);
+    while (next < FAT32_BAD_CLUSTER) {
+        if (next != cluster + 1) {
+            return false;
+        }
+        cluster = next;
+        clusters++;
+        next = fat32_get_next_cluster(cluster);
+    }
+    
+    /* Only whole sectors inside the file's size belong to it */
+    uint32_t size_sectors = file->file_size >> fs_info.sector_shift;
+    uint32_t chain_sectors = clusters * fs_info.sectors_per_cluster;
+    
+    *first_sector = fat32_cluster_to_sector(file->first_cluster);
+    *sectors = size_sectors < chain_sectors ? size_sectors : chain_sectors;
+    return true;
+}
+
+/* Device the file system lives on */
+ata_device_t* fat32_get_device(void) {
+    return fs_info.initialized ? storage_device : NULL;
+}
+
 /* Get file system information */
 fat32_fs_info_t* fat32_get_fs_info(void) {
     return fs_info.initialized ? &fs_info : NULL;
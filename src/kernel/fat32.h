@@ -4,6 +4,8 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include "cache.h"
+#include "bcache.h"
 
 /*------------------------------------------------------------------------------
  * FAT32 File System Implementation
@@ -112,17 +114,25 @@ typedef struct {
     bool     is_open;          /* Whether directory is open */
 } fat32_dir_t;
 
-/* File system information structure */
+/* File system information structure. The geometry used on every read
+ * comes first so it shares one cache line; the boot sector copy is only
+ * needed at mount time and sits at the end. */
 typedef struct {
-    fat32_boot_sector_t boot_sector;  /* Boot sector data */
     uint32_t fat_start_sector;        /* First sector of FAT */
     uint32_t data_start_sector;       /* First sector of data area */
     uint32_t sectors_per_cluster;     /* Sectors per cluster */
     uint32_t bytes_per_cluster;       /* Bytes per cluster */
+    uint32_t bytes_per_sector;        /* Bytes per sector */
+    uint32_t cluster_mask;            /* bytes_per_cluster - 1 */
+    uint32_t sector_mask;             /* bytes_per_sector - 1 */
+    uint8_t  sector_shift;            /* log2(bytes_per_sector) */
+    uint8_t  cluster_shift;           /* log2(bytes_per_cluster) */
+    bool     initialized;             /* Whether file system is initialized */
+    
     uint32_t total_clusters;          /* Total number of clusters */
     uint32_t root_dir_cluster;        /* Root directory cluster */
-    bool     initialized;             /* Whether file system is initialized */
-} fat32_fs_info_t;
+    fat32_boot_sector_t boot_sector;  /* Boot sector data */
+} __cacheline_aligned fat32_fs_info_t;
 
 /* Function prototypes */
 
@@ -156,6 +166,10 @@ size_t fat32_write(fat32_file_t* file, const void* buffer, size_t size);
 bool fat32_seek(fat32_file_t* file, uint32_t position);
 uint32_t fat32_tell(fat32_file_t* file);
 
+/* Zero-copy access: pin the cache block holding the file position */
+bcache_buf_t* fat32_get_block(fat32_file_t* file, uint32_t* offset, uint32_t* length);
+void fat32_advance(fat32_file_t* file, uint32_t bytes);
+
 /* Directory operations */
 fat32_dir_t* fat32_opendir(const char* path);
 void fat32_closedir(fat32_dir_t* dir);
@@ -166,6 +180,10 @@ void fat32_convert_filename(const char* input, char* output);
 bool fat32_compare_filename(const char* name1, const char* name2);
 void fat32_print_file_info(const fat32_dir_entry_t* entry);
 
+/* Raw access for preallocated files (swap): the file's sectors, if contiguous */
+bool fat32_file_extent(fat32_file_t* file, uint32_t* first_sector, uint32_t* sectors);
+ata_device_t* fat32_get_device(void);
+
 /* Get file system information */
 fat32_fs_info_t* fat32_get_fs_info(void);
 
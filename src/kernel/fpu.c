@@ -0,0 +1,222 @@
+/*------------------------------------------------------------------------------
+ * FPU/SSE Context Management
+ *------------------------------------------------------------------------------
+ * This file enables the FPU and SSE, and implements lazy FXSAVE/FXRSTOR
+ * switching driven by CR0.TS and the #NM fault. See fpu.h.
+ *------------------------------------------------------------------------------
+ */
+
+#include "fpu.h"
+#include "init.h"
+#include "percpu.h"
+#include "cache.h"
+#include "string.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Control register bits */
+#define CR0_MP              (1 << 1)    /* WAIT/FWAIT honour TS */
+#define CR0_EM              (1 << 2)    /* Emulate FPU (must be clear) */
+#define CR0_TS              (1 << 3)    /* Task switched: next FPU use faults */
+#define CR0_NE              (1 << 5)    /* Native x87 error reporting */
+#define CR4_OSFXSR          (1 << 9)    /* FXSAVE/FXRSTOR and SSE enabled */
+#define CR4_OSXMMEXCPT      (1 << 10)   /* Unmasked SIMD exceptions raise #XM */
+
+/* CPUID.1:EDX */
+#define CPUID_EDX_FPU       (1 << 0)
+#define CPUID_EDX_FXSR      (1 << 24)
+#define CPUID_EDX_SSE       (1 << 25)
+
+#define MXCSR_DEFAULT       0x1F80      /* All exceptions masked, round to nearest */
+
+static bool enabled __read_mostly = false;
+static fpu_context_t initial_state;     /* Clean registers for first use */
+static fpu_context_t boot_context;      /* The kernel's main loop */
+static fpu_stats_t stats;
+
+/* Register ownership is per CPU (percpu_t fpu_owner/fpu_current/fpu_kernel_depth) */
+#define owner()             ((fpu_context_t*)this_cpu_read(fpu_owner))
+#define current()           ((fpu_context_t*)this_cpu_read(fpu_current))
+#define kernel_depth()      this_cpu_read(fpu_kernel_depth)
+
+/*------------------------------------------------------------------------------
+ * Register access
+ *------------------------------------------------------------------------------
+ */
+
+static inline uint32_t read_cr0(void) {
+    uint32_t cr0;
+    asm volatile("mov %%cr0, %0" : "=r"(cr0));
+    return cr0;
+}
+
+static inline void write_cr0(uint32_t cr0) {
+    asm volatile("mov %0, %%cr0" :: "r"(cr0) : "memory");
+}
+
+static inline void clts(void) {
+    asm volatile("clts" ::: "memory");
+}
+
+static inline void set_ts(void) {
+    write_cr0(read_cr0() | CR0_TS);
+}
+
+static inline void fxsave(fpu_context_t* ctx) {
+    asm volatile("fxsave (%0)" :: "r"(ctx->state) : "memory");
+}
+
+static inline void fxrstor(const fpu_context_t* ctx) {
+    asm volatile("fxrstor (%0)" :: "r"(ctx->state) : "memory");
+}
+
+/* Move the live registers into their owner's save area */
+static void fpu_save_owner(void) {
+    fpu_context_t* ctx = owner();
+    if (ctx) {
+        fxsave(ctx);
+        ctx->used = true;
+        stats.saves++;
+        this_cpu_write(fpu_owner, NULL);
+    }
+}
+
+/*------------------------------------------------------------------------------
+ * Public interface
+ *------------------------------------------------------------------------------
+ */
+
+/* Enable the FPU and SSE; false if the CPU lacks FXSAVE/SSE */
+bool __init fpu_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0));
+    if (eax < 1) {
+        return false;
+    }
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+    if ((edx & (CPUID_EDX_FPU | CPUID_EDX_FXSR | CPUID_EDX_SSE)) !=
+        (CPUID_EDX_FPU | CPUID_EDX_FXSR | CPUID_EDX_SSE)) {
+        return false;
+    }
+
+    uint32_t cr0 = read_cr0();
+    cr0 &= ~(CR0_EM | CR0_TS);
+    cr0 |= CR0_MP | CR0_NE;
+    write_cr0(cr0);
+
+    uint32_t cr4;
+    asm volatile("mov %%cr4, %0" : "=r"(cr4));
+    cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+    asm volatile("mov %0, %%cr4" :: "r"(cr4) : "memory");
+
+    /* Capture a clean state to hand to each context on first use */
+    uint32_t mxcsr = MXCSR_DEFAULT;
+    asm volatile("fninit");
+    asm volatile("ldmxcsr %0" :: "m"(mxcsr));
+    fxsave(&initial_state);
+    initial_state.used = true;
+
+    memset(&stats, 0, sizeof(stats));
+    fpu_context_init(&boot_context);
+    this_cpu_write(fpu_current, &boot_context);
+    this_cpu_write(fpu_owner, NULL);
+    this_cpu_write(fpu_kernel_depth, 0);
+    enabled = true;
+
+    /* Nobody owns the registers yet: the first use loads a context */
+    set_ts();
+    return true;
+}
+
+/* Whether SSE is enabled */
+bool fpu_sse_enabled(void) {
+    return enabled;
+}
+
+void fpu_context_init(fpu_context_t* ctx) {
+    ctx->used = false;
+}
+
+/* Forget a context that is going away */
+void fpu_context_release(fpu_context_t* ctx) {
+    if (owner() == ctx) {
+        this_cpu_write(fpu_owner, NULL);
+    }
+    if (current() == ctx) {
+        this_cpu_write(fpu_current, &boot_context);
+    }
+}
+
+/* Called by the scheduler with interrupts disabled. Nothing is saved here;
+ * a thread that is not the owner traps on its first FPU instruction. */
+void fpu_switch_to(fpu_context_t* next) {
+    this_cpu_write(fpu_current, next);
+    if (!enabled) {
+        return;
+    }
+
+    if (owner() == next && kernel_depth() == 0) {
+        clts();
+    } else {
+        set_ts();
+    }
+}
+
+/* #NM: give the registers to the running thread */
+bool fpu_handle_nm(void) {
+    if (!enabled) {
+        return false;
+    }
+
+    stats.traps++;
+    clts();
+
+    fpu_context_t* ctx = current();
+    if (kernel_depth() > 0 || owner() == ctx) {
+        return true;
+    }
+
+    fpu_save_owner();
+    fxrstor(ctx->used ? ctx : &initial_state);
+    stats.restores++;
+    this_cpu_write(fpu_owner, ctx);
+    return true;
+}
+
+/* Claim the registers for kernel SIMD, saving live thread state first */
+void kernel_fpu_begin(void) {
+    uint32_t flags;
+    if (!enabled) {
+        return;
+    }
+
+    asm volatile("pushfl; popl %0; cli" : "=r"(flags) :: "memory");
+    this_cpu_inc(fpu_kernel_depth);
+    if (kernel_depth() == 1) {
+        clts();
+        fpu_save_owner();
+        stats.kernel_regions++;
+    }
+    asm volatile("pushl %0; popfl" :: "r"(flags) : "memory", "cc");
+}
+
+/* End a kernel SIMD region; the owner reloads lazily */
+void kernel_fpu_end(void) {
+    uint32_t flags;
+    if (!enabled || kernel_depth() == 0) {
+        return;
+    }
+
+    asm volatile("pushfl; popl %0; cli" : "=r"(flags) :: "memory");
+    this_cpu_add(fpu_kernel_depth, -1);
+    if (kernel_depth() == 0) {
+        set_ts();
+    }
+    asm volatile("pushl %0; popfl" :: "r"(flags) : "memory", "cc");
+}
+
+const fpu_stats_t* fpu_get_stats(void) {
+    return &stats;
+}
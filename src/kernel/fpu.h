@@ -0,0 +1,68 @@
+#ifndef FPU_H
+#define FPU_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*------------------------------------------------------------------------------
+ * FPU/SSE Context Management
+ *------------------------------------------------------------------------------
+ * fpu_init() enables x87 and SSE (CR0.MP/NE, CR4.OSFXSR/OSXMMEXCPT) when the
+ * CPU has FXSAVE. FPU register state is then switched lazily:
+ *
+ * - Each thread owns an fpu_context_t. The registers belong to at most one
+ *   context at a time (the "owner").
+ * - On a switch, fpu_switch_to() only sets CR0.TS if the incoming thread
+ *   is not the owner. Nothing is saved.
+ * - The first FPU/SSE instruction the thread executes raises #NM. The
+ *   handler clears TS, FXSAVEs the previous owner and FXRSTORs the
+ *   incoming context (or a clean state on first use).
+ *
+ * Threads that never touch the FPU never trap and never pay for a save.
+ *
+ * Kernel code may use SIMD between kernel_fpu_begin() and kernel_fpu_end().
+ * begin saves the owner's state if it is live, so the region can clobber
+ * every register; end sets TS so the owner reloads on its next use.
+ * Regions nest, must not block, and must not be entered from interrupt
+ * handlers.
+ *------------------------------------------------------------------------------
+ */
+
+#define FPU_STATE_SIZE  512     /* FXSAVE area */
+
+/* Per-thread FPU context (FXSAVE needs 16-byte alignment) */
+typedef struct {
+    uint8_t state[FPU_STATE_SIZE];
+    bool    used;               /* state holds saved registers */
+} __attribute__((aligned(16))) fpu_context_t;
+
+/* Statistics */
+typedef struct {
+    uint32_t traps;             /* #NM faults taken */
+    uint32_t saves;             /* FXSAVEs */
+    uint32_t restores;          /* FXRSTORs */
+    uint32_t kernel_regions;    /* kernel_fpu_begin() calls (outermost) */
+} fpu_stats_t;
+
+/* Enable the FPU and SSE; false if the CPU lacks FXSAVE/SSE */
+bool fpu_init(void);
+
+/* Whether SSE is enabled */
+bool fpu_sse_enabled(void);
+
+/* Thread contexts */
+void fpu_context_init(fpu_context_t* ctx);
+void fpu_context_release(fpu_context_t* ctx);
+void fpu_switch_to(fpu_context_t* next);
+
+/* #NM handler: returns false if the fault is not ours to handle */
+bool fpu_handle_nm(void);
+
+/* In-kernel SIMD regions */
+void kernel_fpu_begin(void);
+void kernel_fpu_end(void);
+
+const fpu_stats_t* fpu_get_stats(void);
+
+#endif /* FPU_H */
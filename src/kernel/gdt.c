@@ -12,13 +12,14 @@
  */
 
 #include "gdt.h"
+#include "init.h"
 
 /*------------------------------------------------------------------------------
  * GDT Global Variables
  *------------------------------------------------------------------------------
  */
 
-/* The actual GDT array - 5 entries of 8 bytes each */
+/* The actual GDT array - 5 flat entries plus the per-CPU segments */
 static struct gdt_entry gdt_entries[GDT_ENTRIES];
 
 /* GDT pointer structure for LGDT instruction */
@@ -36,7 +37,7 @@ static struct gdt_ptr gdt_pointer;
  * 32-bit base address and limit into the required bit fields of the
  * 8-byte GDT descriptor format.
  * 
- * @param num Entry number (0-4) to configure
+ * @param num Entry number (0 to GDT_ENTRIES-1) to configure
  * @param base 32-bit base address of the segment
  * @param limit 32-bit limit (size) of the segment
  * @param access Access byte containing permissions and segment type
@@ -94,8 +95,11 @@ void gdt_set_gate(int32_t num, uint32_t base, uint32_t limit,
  * - Limit: 0xFFFFFFFF (entire 4GB address space)
  * - 4KB granularity (limit is in 4KB pages, not bytes)
  * - 32-bit operation
+ * 
+ * The per-CPU entries that follow are left null here and filled in by
+ * percpu_init().
  */
-void gdt_init(void)
+void __init gdt_init(void)
 {
     /*
      * Set up the GDT pointer structure for LGDT instruction:
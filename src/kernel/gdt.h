@@ -24,8 +24,12 @@
  *------------------------------------------------------------------------------
  */
 
+/* Per-CPU data segments follow the flat segments, one per CPU */
+#define GDT_MAX_CPUS        4
+#define GDT_PERCPU_FIRST    5
+
 /* Number of GDT entries we'll define */
-#define GDT_ENTRIES 5
+#define GDT_ENTRIES (GDT_PERCPU_FIRST + GDT_MAX_CPUS)
 
 /* GDT Entry indices for easy reference */
 #define GDT_NULL_SEGMENT    0  /* Required null descriptor */
@@ -39,6 +43,7 @@
 #define KERNEL_DATA_SELECTOR 0x10  /* Index 2, Ring 0 */
 #define USER_CODE_SELECTOR   0x1B  /* Index 3, Ring 3 */
 #define USER_DATA_SELECTOR   0x23  /* Index 4, Ring 3 */
+#define PERCPU_SELECTOR(cpu) (((GDT_PERCPU_FIRST + (cpu)) << 3) | 0)  /* Ring 0 */
 
 /*------------------------------------------------------------------------------
  * GDT Access Byte Flags
@@ -156,7 +161,7 @@ void gdt_init(void);
 /**
  * @brief Sets up a single GDT entry
  * 
- * @param num Entry index in the GDT (0-4)
+ * @param num Entry index in the GDT (0 to GDT_ENTRIES-1)
  * @param base Base address of the segment
  * @param limit Size of the segment
  * @param access Access byte defining permissions and type
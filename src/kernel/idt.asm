@@ -473,7 +473,8 @@ isr_common_stub:
     mov ds, ax              ; Set data segment
     mov es, ax              ; Set extra segment
     mov fs, ax              ; Set F segment
-    mov gs, ax              ; Set G segment
+                            ; GS is left alone: it always selects this CPU's
+                            ; per-CPU area (see percpu.h)
     
     push esp                ; Push pointer to interrupt_registers_t structure
     call interrupt_handler  ; Call our C interrupt handler
@@ -483,7 +484,6 @@ isr_common_stub:
     mov ds, ax
     mov es, ax
     mov fs, ax
-    mov gs, ax
     
     popa                    ; Restore all general-purpose registers
     add esp, 8              ; Clean up error code and interrupt number from stack
@@ -506,8 +506,7 @@ irq_common_stub:
     mov ax, 0x10            ; Load kernel data segment
     mov ds, ax
     mov es, ax
-    mov fs, ax
-    mov gs, ax
+    mov fs, ax              ; GS keeps the per-CPU selector
     
     push esp                ; Push pointer to interrupt_registers_t structure
     call interrupt_handler  ; Call our C interrupt handler
@@ -517,7 +516,6 @@ irq_common_stub:
     mov ds, ax
     mov es, ax
     mov fs, ax
-    mov gs, ax
     
     popa                    ; Restore all general-purpose registers
     add esp, 8              ; Clean up error code and interrupt number
@@ -14,11 +14,16 @@
  */
 
 #include "idt.h"
+#include "init.h"
 #include "gdt.h"     /* For KERNEL_CODE_SELECTOR */
 #include "kernel.h"  /* For terminal output functions */
 #include "pic.h"     /* For PIC EOI handling */
 #include "memory.h"  /* For page fault handling */
 #include "debug.h"   /* For profiling and debugging */
+#include "fpu.h"     /* For lazy FPU switching */
+#include "counter.h" /* For per-IRQ counts */
+#include "sched.h"   /* For tick accounting and wakeups */
+#include "async.h"   /* For IRQ completion events */
 #include "../drivers/timer.h"  /* For timer interrupt handling */
 
 /*------------------------------------------------------------------------------
@@ -32,6 +37,17 @@ static struct idt_entry idt_entries[IDT_ENTRIES];
 /* IDT pointer structure for LIDT instruction */
 static struct idt_ptr idt_pointer;
 
+/* Handlers installed by drivers for IRQ lines without a built-in handler */
+static irq_handler_t irq_handlers[16];
+
+/* Interrupts per IRQ line, counted whether or not profiling is enabled */
+static const counter_t irq_counts[16] __counter = {
+    { "irq", "0" },  { "irq", "1" },  { "irq", "2" },  { "irq", "3" },
+    { "irq", "4" },  { "irq", "5" },  { "irq", "6" },  { "irq", "7" },
+    { "irq", "8" },  { "irq", "9" },  { "irq", "10" }, { "irq", "11" },
+    { "irq", "12" }, { "irq", "13" }, { "irq", "14" }, { "irq", "15" },
+};
+
 /*------------------------------------------------------------------------------
  * Exception Names for Debug Output
  *------------------------------------------------------------------------------
@@ -140,7 +156,7 @@ void idt_set_gate(int num, uint32_t handler, uint16_t selector, uint8_t flags)
  * Exception handlers use trap gates (interrupts remain enabled)
  * IRQ handlers use interrupt gates (interrupts disabled on entry)
  */
-void idt_init(void)
+void __init idt_init(void)
 {
     /*
      * Set up the IDT pointer structure for LIDT instruction:
@@ -315,6 +331,29 @@ void idt_init(void)
     idt_flush((uint32_t)&idt_pointer);
 }
 
+/**
+ * @brief Installs a driver handler for a hardware IRQ line
+ *
+ * @param irq The IRQ number (0-15)
+ * @param handler Function to call, or NULL to remove
+ */
+void irq_install_handler(uint8_t irq, irq_handler_t handler)
+{
+    if (irq < 16) {
+        irq_handlers[irq] = handler;
+    }
+}
+
+/**
+ * @brief Number of interrupts taken on an IRQ line since boot
+ *
+ * @param irq The IRQ number (0-15)
+ */
+uint64_t irq_get_count(uint8_t irq)
+{
+    return irq < 16 ? counter_read(&irq_counts[irq]) : 0;
+}
+
 /**
  * @brief Common interrupt handler
  * 
@@ -335,9 +374,14 @@ void interrupt_handler(interrupt_registers_t *regs)
         /* Count this exception for profiling */
         debug_count_exception(regs->int_no);
         
+        /* Lazy FPU switching: hand the registers to the running thread */
+        if (regs->int_no == IDT_DEVICE_NOT_AVAILABLE && fpu_handle_nm()) {
+            return;
+        }
+        
         /* Handle page faults specially */
         if (regs->int_no == IDT_PAGE_FAULT) {
-            page_fault_handler(regs->err_code);
+            page_fault_handler(regs);
             return;
         }
         
@@ -428,6 +472,10 @@ void interrupt_handler(interrupt_registers_t *regs)
         /* This is a hardware IRQ */
         uint32_t irq_num = regs->int_no - 32;
         
+        /* Time from here on is busy, not idle */
+        cpu_idle_exit();
+        counter_inc(&irq_counts[irq_num]);
+        
         /* Count this interrupt for profiling */
         debug_count_interrupt(irq_num);
         
@@ -476,12 +524,23 @@ void interrupt_handler(interrupt_registers_t *regs)
         } else if (irq_num == 0) {
             /* IRQ0: Timer interrupt - handle timer ticks */
             timer_interrupt_handler();
+        } else if (irq_handlers[irq_num]) {
+            /* Driver-installed handler (PCI devices, etc.) */
+            irq_handlers[irq_num]();
         } else {
             /* Silently handle other IRQs */
         }
         
         /* Send End of Interrupt (EOI) to PIC for real IRQs */
         pic_send_eoi(irq_num);
+        
+        /* Complete coroutines awaiting this line, account the tick and
+         * wake threads waiting for an interrupt */
+        async_irq_signal(irq_num);
+        if (irq_num == 0) {
+            sched_tick();
+        }
+        sched_irq_wakeup();
     }
     
     /*
@@ -268,4 +268,31 @@ typedef struct interrupt_registers interrupt_registers_t;
  */
 void interrupt_handler(interrupt_registers_t *regs);
 
+/**
+ * @brief Hardware IRQ handler installed with irq_install_handler()
+ *
+ * Called with interrupts disabled; the EOI is sent after it returns.
+ */
+typedef void (*irq_handler_t)(void);
+
+/**
+ * @brief Installs a handler for a hardware IRQ line
+ *
+ * Used by drivers whose IRQ is only known at run time (e.g. PCI devices).
+ * Passing NULL removes the handler. The line still has to be unmasked
+ * at the PIC by the caller.
+ *
+ * @param irq The IRQ number (0-15)
+ * @param handler Function to call when the IRQ fires
+ */
+void irq_install_handler(uint8_t irq, irq_handler_t handler);
+
+/**
+ * @brief Number of interrupts taken on an IRQ line since boot
+ *
+ * @param irq The IRQ number (0-15)
+ * @return Interrupt count, summed over CPUs
+ */
+uint64_t irq_get_count(uint8_t irq);
+
 #endif /* IDT_H */
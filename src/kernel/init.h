@@ -0,0 +1,18 @@
+#ifndef INIT_H
+#define INIT_H
+
+/*------------------------------------------------------------------------------
+ * Boot-Only Code and Data
+ *------------------------------------------------------------------------------
+ * Functions marked __init and objects marked __initdata are only used while
+ * kernel_main() brings the system up. linker.ld collects them into one
+ * page-aligned region, and free_initmem() hands those pages back to the
+ * physical allocator once the kernel reaches its main loop. Nothing may
+ * call an __init function or touch __initdata after that point.
+ *------------------------------------------------------------------------------
+ */
+
+#define __init      __attribute__((section(".init.text"), noinline, cold))
+#define __initdata  __attribute__((section(".init.data")))
+
+#endif /* INIT_H */
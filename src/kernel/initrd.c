@@ -0,0 +1,198 @@
+/*------------------------------------------------------------------------------
+ * Compressed Initial RAM Disk
+ *------------------------------------------------------------------------------
+ * This file locates the initrd multiboot module, validates its file table
+ * and unpacks individual files on demand. See initrd.h for the format.
+ *------------------------------------------------------------------------------
+ */
+
+#include "initrd.h"
+#include "init.h"
+#include "memory.h"
+#include "lz4.h"
+#include "crc32c.h"
+#include "string.h"
+#include "debug.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Archive located at boot (identity mapped, below IDENTITY_MAP_END) */
+static const uint8_t* archive = NULL;
+static uint32_t archive_size = 0;
+static const initrd_header_t* header = NULL;
+static const initrd_entry_t* entries = NULL;
+
+/* Checked file contents, indexed like the file table; stored files point
+ * into the module */
+static const uint8_t* file_data[INITRD_MAX_FILES];
+
+/*------------------------------------------------------------------------------
+ * Initialization
+ *------------------------------------------------------------------------------
+ */
+
+/* Check the header and every entry before anything is trusted */
+static bool __init initrd_validate(const uint8_t* base, uint32_t size) {
+    if (size < sizeof(initrd_header_t)) {
+        return false;
+    }
+
+    const initrd_header_t* hdr = (const initrd_header_t*)base;
+    if (hdr->magic != INITRD_MAGIC || hdr->version != INITRD_VERSION ||
+        hdr->file_count > INITRD_MAX_FILES || hdr->archive_size > size) {
+        return false;
+    }
+
+    uint32_t table_end = sizeof(initrd_header_t) + hdr->file_count * sizeof(initrd_entry_t);
+    if (table_end > hdr->archive_size) {
+        return false;
+    }
+
+    const initrd_entry_t* ent = (const initrd_entry_t*)(base + sizeof(initrd_header_t));
+    for (uint32_t i = 0; i < hdr->file_count; i++) {
+        if (ent[i].name[INITRD_NAME_LEN - 1] != '\0' ||
+            ent[i].offset < table_end ||
+            ent[i].offset > hdr->archive_size ||
+            ent[i].compressed_size > hdr->archive_size - ent[i].offset) {
+            return false;
+        }
+        if ((ent[i].flags & INITRD_FLAG_STORED) && ent[i].compressed_size != ent[i].size) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Locate and validate the initrd module */
+bool __init initrd_init(multiboot_info_t* mboot_info) {
+    if (!mboot_info || !(mboot_info->flags & MULTIBOOT_INFO_MODS) || mboot_info->mods_count == 0) {
+        return false;
+    }
+
+    /* The first module whose contents carry our magic is the initrd */
+    multiboot_module_t* mods = (multiboot_module_t*)mboot_info->mods_addr;
+    for (uint32_t m = 0; m < mboot_info->mods_count; m++) {
+        const uint8_t* base = (const uint8_t*)mods[m].mod_start;
+        uint32_t size = mods[m].mod_end - mods[m].mod_start;
+
+        if (mods[m].mod_end <= mods[m].mod_start || mods[m].mod_end > IDENTITY_MAP_END) {
+            continue;
+        }
+
+        if (initrd_validate(base, size)) {
+            archive = base;
+            archive_size = size;
+            header = (const initrd_header_t*)base;
+            entries = (const initrd_entry_t*)(base + sizeof(initrd_header_t));
+            memset(file_data, 0, sizeof(file_data));
+            return true;
+        }
+    }
+
+    DEBUG_PRINT("INITRD: no valid archive among boot modules");
+    return false;
+}
+
+/*------------------------------------------------------------------------------
+ * Queries
+ *------------------------------------------------------------------------------
+ */
+
+bool initrd_present(void) {
+    return header != NULL;
+}
+
+uint32_t initrd_file_count(void) {
+    return header ? header->file_count : 0;
+}
+
+const initrd_entry_t* initrd_get_entry(uint32_t index) {
+    if (!header || index >= header->file_count) {
+        return NULL;
+    }
+    return &entries[index];
+}
+
+/* Find a file by name (case-insensitive, like FAT) */
+const initrd_entry_t* initrd_find(const char* name) {
+    if (!header || !name) {
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < header->file_count; i++) {
+        const char* a = entries[i].name;
+        const char* b = name;
+        while (*a && *b) {
+            char ca = (*a >= 'a' && *a <= 'z') ? *a - 32 : *a;
+            char cb = (*b >= 'a' && *b <= 'z') ? *b - 32 : *b;
+            if (ca != cb) {
+                break;
+            }
+            a++;
+            b++;
+        }
+        if (*a == '\0' && *b == '\0') {
+            return &entries[i];
+        }
+    }
+
+    return NULL;
+}
+
+bool initrd_is_loaded(const initrd_entry_t* entry) {
+    if (!header || !entry) {
+        return false;
+    }
+    if (entry->flags & INITRD_FLAG_STORED) {
+        return true;  /* Used in place */
+    }
+    return file_data[entry - entries] != NULL;
+}
+
+/*------------------------------------------------------------------------------
+ * Data access
+ *------------------------------------------------------------------------------
+ */
+
+/* Get a file's contents, checking and decompressing it on first use */
+const uint8_t* initrd_get_data(const initrd_entry_t* entry) {
+    if (!header || !entry || entry < entries || entry >= entries + header->file_count) {
+        return NULL;
+    }
+
+    uint32_t index = (uint32_t)(entry - entries);
+    const uint8_t* packed = archive + entry->offset;
+
+    if (file_data[index]) {
+        return file_data[index];
+    }
+
+    /* Stored files are served straight out of the module once checked */
+    if (entry->flags & INITRD_FLAG_STORED) {
+        if (crc32c(packed, entry->size) != entry->crc) {
+            DEBUG_PRINT("INITRD: corrupt file data");
+            return NULL;
+        }
+        file_data[index] = packed;
+        return packed;
+    }
+
+    /* Leave room for the decompressor's word-sized overrun */
+    uint8_t* data = (uint8_t*)kmalloc(entry->size + LZ4_WILDCOPY_SLACK);
+    if (!data) {
+        return NULL;
+    }
+
+    int produced = lz4_decompress(packed, entry->compressed_size,
+                                  data, entry->size + LZ4_WILDCOPY_SLACK);
+    if (produced != (int)entry->size || crc32c(data, entry->size) != entry->crc) {
+        DEBUG_PRINT("INITRD: corrupt file data");
+        kfree(data);
+        return NULL;
+    }
+
+    file_data[index] = data;
+    return data;
+}
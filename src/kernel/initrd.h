@@ -0,0 +1,69 @@
+#ifndef INITRD_H
+#define INITRD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "memory.h"
+
+/*------------------------------------------------------------------------------
+ * Compressed Initial RAM Disk
+ *------------------------------------------------------------------------------
+ * The initrd is a multiboot module holding a flat archive: a header, a table
+ * of file entries, then each file's data as a single LZ4 block (or stored
+ * as-is when compression would not help). Archives are produced on the host
+ * by tools/mkinitrd.
+ *
+ * Files are decompressed lazily on first access into heap memory, so boot
+ * only pays for the files that are actually used. Each entry carries a
+ * CRC32C of its uncompressed contents which is checked on first access,
+ * after unpacking for compressed files.
+ *
+ * On-disk layout (little endian):
+ *     initrd_header_t
+ *     initrd_entry_t[file_count]
+ *     file data, at entry.offset from the start of the archive
+ *------------------------------------------------------------------------------
+ */
+
+#define INITRD_MAGIC        0x44524B53  /* "SKRD" */
+#define INITRD_VERSION      1
+#define INITRD_NAME_LEN     32          /* Including NUL terminator */
+#define INITRD_MAX_FILES    64
+
+/* Entry flags */
+#define INITRD_FLAG_STORED  0x01        /* Data is not compressed */
+
+/* Archive header */
+typedef struct {
+    uint32_t magic;                 /* INITRD_MAGIC */
+    uint16_t version;               /* INITRD_VERSION */
+    uint16_t file_count;            /* Number of entries */
+    uint32_t archive_size;          /* Total archive size in bytes */
+    uint32_t reserved;
+} __attribute__((packed)) initrd_header_t;
+
+/* File table entry */
+typedef struct {
+    char     name[INITRD_NAME_LEN]; /* NUL-terminated file name */
+    uint32_t offset;                /* Data offset from archive start */
+    uint32_t compressed_size;       /* Bytes of data in the archive */
+    uint32_t size;                  /* Uncompressed size */
+    uint32_t crc;                   /* CRC32C of uncompressed data */
+    uint32_t flags;                 /* INITRD_FLAG_* */
+} __attribute__((packed)) initrd_entry_t;
+
+/* Locate and validate the initrd module */
+bool initrd_init(multiboot_info_t* mboot_info);
+
+/* Archive queries */
+bool initrd_present(void);
+uint32_t initrd_file_count(void);
+const initrd_entry_t* initrd_get_entry(uint32_t index);
+const initrd_entry_t* initrd_find(const char* name);
+bool initrd_is_loaded(const initrd_entry_t* entry);
+
+/* Get a file's contents, decompressing it on first use; NULL on error */
+const uint8_t* initrd_get_data(const initrd_entry_t* entry);
+
+#endif /* INITRD_H */
@@ -0,0 +1,336 @@
+/*------------------------------------------------------------------------------
+ * Shared Submission/Completion I/O Rings
+ *------------------------------------------------------------------------------
+ * This file implements io_uring-style SQ/CQ rings for SKOS. Submissions are
+ * batched by the submitter, handed over with one ioring_enter() call and
+ * drained by the kernel worker into the FAT32 layer. Completions are posted
+ * to the CQ where they can be reaped without entering the kernel.
+ *------------------------------------------------------------------------------
+ */
+
+#include "ioring.h"
+#include "memory.h"
+#include "fat32.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Rings known to the kernel worker */
+static ioring_t* registered_rings[IORING_MAX_RINGS];
+
+/*------------------------------------------------------------------------------
+ * Index helpers
+ *------------------------------------------------------------------------------
+ * Producer and consumer indices are free running; the slot is index & mask.
+ * Acquire/release ordering makes sure entry contents are visible before the
+ * index that publishes them.
+ *------------------------------------------------------------------------------
+ */
+
+static inline uint32_t ring_load_acquire(volatile uint32_t* p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void ring_store_release(volatile uint32_t* p, uint32_t v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+/*------------------------------------------------------------------------------
+ * Ring Setup
+ *------------------------------------------------------------------------------
+ */
+
+/* Create a ring with at least 'entries' submission slots */
+ioring_t* ioring_setup(uint32_t entries) {
+    if (entries == 0 || entries > IORING_MAX_ENTRIES) {
+        return NULL;
+    }
+
+    /* Round up to a power of two so slots can be masked */
+    uint32_t sq_entries = 1;
+    while (sq_entries < entries) {
+        sq_entries <<= 1;
+    }
+    uint32_t cq_entries = sq_entries * 2;  /* Room for completions in flight */
+
+    /* Header, SQ array and CQ array share one allocation */
+    size_t total = sizeof(ioring_t) +
+                   sq_entries * sizeof(ioring_sqe_t) +
+                   cq_entries * sizeof(ioring_cqe_t);
+    uint8_t* mem = (uint8_t*)kcalloc(1, total);
+    if (!mem) {
+        return NULL;
+    }
+
+    ioring_t* ring = (ioring_t*)mem;
+    ring->sqes = (ioring_sqe_t*)(mem + sizeof(ioring_t));
+    ring->cqes = (ioring_cqe_t*)(mem + sizeof(ioring_t) + sq_entries * sizeof(ioring_sqe_t));
+    ring->sq.ring_entries = sq_entries;
+    ring->sq.ring_mask = sq_entries - 1;
+    ring->cq.ring_entries = cq_entries;
+    ring->cq.ring_mask = cq_entries - 1;
+
+    /* Register with the kernel worker */
+    for (int i = 0; i < IORING_MAX_RINGS; i++) {
+        if (!registered_rings[i]) {
+            registered_rings[i] = ring;
+            return ring;
+        }
+    }
+
+    kfree(mem);
+    return NULL;
+}
+
+/* Close any files left in the fixed table and release the ring */
+void ioring_destroy(ioring_t* ring) {
+    if (!ring) {
+        return;
+    }
+
+    for (int i = 0; i < IORING_MAX_RINGS; i++) {
+        if (registered_rings[i] == ring) {
+            registered_rings[i] = NULL;
+        }
+    }
+
+    for (int i = 0; i < IORING_MAX_FILES; i++) {
+        if (ring->files[i]) {
+            fat32_close(ring->files[i]);
+            ring->files[i] = NULL;
+        }
+    }
+
+    kfree(ring);
+}
+
+/*------------------------------------------------------------------------------
+ * Kernel Side
+ *------------------------------------------------------------------------------
+ */
+
+/* Post a completion; drops it and flags overflow if the CQ is full */
+static void ioring_post_cqe(ioring_t* ring, uint32_t user_data, int32_t res) {
+    uint32_t tail = ring->cq.tail;
+    uint32_t head = ring_load_acquire(&ring->cq.head);
+
+    if (tail - head >= ring->cq.ring_entries) {
+        ring->cq.dropped++;
+        ring->cq.flags |= IORING_CQ_OVERFLOW;
+        return;
+    }
+
+    ioring_cqe_t* cqe = &ring->cqes[tail & ring->cq.ring_mask];
+    cqe->user_data = user_data;
+    cqe->res = res;
+    cqe->flags = 0;
+
+    ring_store_release(&ring->cq.tail, tail + 1);
+    ring->completed++;
+}
+
+/* Execute a single SQE against the file system */
+static int32_t ioring_execute(ioring_t* ring, const ioring_sqe_t* sqe) {
+    if (sqe->opcode != IORING_OP_NOP && sqe->fd >= IORING_MAX_FILES) {
+        return IORING_EINVAL;
+    }
+
+    switch (sqe->opcode) {
+        case IORING_OP_NOP:
+            return 0;
+
+        case IORING_OP_OPEN:
+        case IORING_OP_CREATE: {
+            if (ring->files[sqe->fd] || sqe->addr == 0) {
+                return IORING_EINVAL;
+            }
+            const char* name = (const char*)sqe->addr;
+            fat32_file_t* file = (sqe->opcode == IORING_OP_OPEN) ?
+                                 fat32_open(name) : fat32_create(name);
+            if (!file) {
+                return (sqe->opcode == IORING_OP_OPEN) ? IORING_ENOENT : IORING_EIO;
+            }
+            ring->files[sqe->fd] = file;
+            return sqe->fd;
+        }
+
+        case IORING_OP_READ:
+        case IORING_OP_WRITE: {
+            fat32_file_t* file = ring->files[sqe->fd];
+            if (!file) {
+                return IORING_EBADF;
+            }
+            if (sqe->addr == 0) {
+                return IORING_EINVAL;
+            }
+            if (sqe->offset != IORING_OFFSET_CURRENT && !fat32_seek(file, sqe->offset)) {
+                return IORING_EIO;
+            }
+            size_t done = (sqe->opcode == IORING_OP_READ) ?
+                          fat32_read(file, (void*)sqe->addr, sqe->len) :
+                          fat32_write(file, (const void*)sqe->addr, sqe->len);
+            if (sqe->opcode == IORING_OP_WRITE && done != sqe->len) {
+                return IORING_EIO;
+            }
+            return (int32_t)done;
+        }
+
+        case IORING_OP_CLOSE:
+            if (!ring->files[sqe->fd]) {
+                return IORING_EBADF;
+            }
+            fat32_close(ring->files[sqe->fd]);
+            ring->files[sqe->fd] = NULL;
+            return 0;
+
+        default:
+            return IORING_EINVAL;
+    }
+}
+
+/* Drain every submitted SQE of one ring */
+static void ioring_process(ioring_t* ring) {
+    while (ring->sq_submitted > 0) {
+        uint32_t head = ring->sq.head;
+        const ioring_sqe_t* sqe = &ring->sqes[head & ring->sq.ring_mask];
+        int32_t res;
+
+        if (ring->link_failed) {
+            res = IORING_ECANCELED;
+        } else {
+            res = ioring_execute(ring, sqe);
+        }
+
+        /* A failure propagates down the chain of IOSQE_IO_LINK entries */
+        ring->link_failed = (sqe->flags & IOSQE_IO_LINK) && res < 0;
+
+        ioring_post_cqe(ring, sqe->user_data, res);
+
+        /* Release the SQ slot back to the submitter */
+        ring_store_release(&ring->sq.head, head + 1);
+        ring->sq_submitted--;
+    }
+
+    ring->link_failed = false;
+    ring->sq.flags &= ~IORING_SQ_NEED_WAKEUP;
+}
+
+/* Hand submitted entries over to the kernel, optionally waiting */
+int ioring_enter(ioring_t* ring, uint32_t to_submit, uint32_t min_complete) {
+    if (!ring) {
+        return IORING_EINVAL;
+    }
+
+    ring->enter_calls++;
+
+    /* Entries queued by the submitter but not yet handed over */
+    uint32_t tail = ring_load_acquire(&ring->sq.tail);
+    uint32_t pending = tail - ring->sq.head - ring->sq_submitted;
+    if (pending > ring->sq.ring_entries) {
+        /* Submitter corrupted its tail; drop everything it claims */
+        ring->sq.dropped += pending;
+        return IORING_EINVAL;
+    }
+
+    uint32_t submit = (to_submit < pending) ? to_submit : pending;
+    ring->sq_submitted += submit;
+    if (ring->sq_submitted > 0) {
+        ring->sq.flags |= IORING_SQ_NEED_WAKEUP;
+    }
+
+    /* Waiting callers run the worker inline rather than sleeping */
+    if (min_complete > 0 && ioring_cq_ready(ring) < min_complete) {
+        ioring_process(ring);
+    }
+
+    return (int)submit;
+}
+
+/* Kernel worker: called from the idle loop */
+void ioring_worker_run(void) {
+    for (int i = 0; i < IORING_MAX_RINGS; i++) {
+        ioring_t* ring = registered_rings[i];
+        if (ring && ring->sq_submitted > 0) {
+            ioring_process(ring);
+        }
+    }
+}
+
+/*------------------------------------------------------------------------------
+ * Submitter Side
+ *------------------------------------------------------------------------------
+ */
+
+/* Queue the next free SQE, or return NULL if the SQ is full */
+ioring_sqe_t* ioring_get_sqe(ioring_t* ring) {
+    uint32_t head = ring_load_acquire(&ring->sq.head);
+    uint32_t tail = ring->sq.tail;
+
+    if (tail - head >= ring->sq.ring_entries) {
+        return NULL;
+    }
+
+    ioring_sqe_t* sqe = &ring->sqes[tail & ring->sq.ring_mask];
+    sqe->opcode = IORING_OP_NOP;
+    sqe->flags = 0;
+    sqe->fd = 0;
+    sqe->offset = IORING_OFFSET_CURRENT;
+    sqe->addr = 0;
+    sqe->len = 0;
+    sqe->user_data = 0;
+
+    /* The tail moves before the caller fills the entry. That is safe
+     * because the kernel only consumes entries handed over by
+     * ioring_enter(), so every SQE must be complete before that call. */
+    ring_store_release(&ring->sq.tail, tail + 1);
+    return sqe;
+}
+
+/* Peek at the oldest unreaped completion */
+ioring_cqe_t* ioring_peek_cqe(ioring_t* ring) {
+    uint32_t head = ring->cq.head;
+    uint32_t tail = ring_load_acquire(&ring->cq.tail);
+
+    if (head == tail) {
+        return NULL;
+    }
+    return &ring->cqes[head & ring->cq.ring_mask];
+}
+
+/* Mark the completion returned by ioring_peek_cqe() as consumed */
+void ioring_cqe_seen(ioring_t* ring) {
+    ring_store_release(&ring->cq.head, ring->cq.head + 1);
+}
+
+/* Number of SQEs queued but not yet consumed by the kernel */
+uint32_t ioring_sq_ready(ioring_t* ring) {
+    return ring_load_acquire(&ring->sq.tail) - ring_load_acquire(&ring->sq.head);
+}
+
+/* Number of CQEs waiting to be reaped */
+uint32_t ioring_cq_ready(ioring_t* ring) {
+    return ring_load_acquire(&ring->cq.tail) - ring_load_acquire(&ring->cq.head);
+}
+
+/* Prepare an open or create into a fixed file slot */
+void ioring_prep_open(ioring_sqe_t* sqe, uint16_t slot, const char* filename, bool create) {
+    sqe->opcode = create ? IORING_OP_CREATE : IORING_OP_OPEN;
+    sqe->fd = slot;
+    sqe->addr = (uint32_t)filename;
+}
+
+/* Prepare a read or write on a fixed file slot */
+void ioring_prep_rw(ioring_sqe_t* sqe, uint8_t opcode, uint16_t slot,
+                    void* buffer, uint32_t len, uint32_t offset) {
+    sqe->opcode = opcode;
+    sqe->fd = slot;
+    sqe->addr = (uint32_t)buffer;
+    sqe->len = len;
+    sqe->offset = offset;
+}
+
+/* Prepare a close of a fixed file slot */
+void ioring_prep_close(ioring_sqe_t* sqe, uint16_t slot) {
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = slot;
+}
@@ -0,0 +1,127 @@
+#ifndef IORING_H
+#define IORING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "fat32.h"
+
+/*------------------------------------------------------------------------------
+ * Shared Submission/Completion I/O Rings
+ *------------------------------------------------------------------------------
+ * Modelled on Linux io_uring. A ring is a pair of single-producer,
+ * single-consumer queues living in one memory region shared between the
+ * submitter and the kernel:
+ *
+ * - The submission queue (SQ) is produced by the submitter (it advances
+ *   sq.tail) and consumed by the kernel (it advances sq.head).
+ * - The completion queue (CQ) is produced by the kernel (cq.tail) and
+ *   consumed by the submitter (cq.head).
+ *
+ * Any number of SQEs can be queued and handed to the kernel with a single
+ * ioring_enter() call. Completions are reaped by reading the CQ directly,
+ * so no kernel entry is needed to poll for them. The kernel worker that
+ * drains submitted entries runs from the idle loop, or inline when the
+ * caller asks ioring_enter() to wait for completions.
+ *------------------------------------------------------------------------------
+ */
+
+/* Ring sizing */
+#define IORING_MAX_ENTRIES   256     /* Maximum SQ entries per ring */
+#define IORING_MAX_FILES     16      /* Fixed file slots per ring */
+#define IORING_MAX_RINGS     4       /* Rings the kernel worker tracks */
+
+/* Operation codes */
+#define IORING_OP_NOP        0       /* Complete immediately */
+#define IORING_OP_OPEN       1       /* Open file 'addr' into slot 'fd' */
+#define IORING_OP_CREATE     2       /* Create/truncate file 'addr' into slot 'fd' */
+#define IORING_OP_READ       3       /* Read 'len' bytes from slot 'fd' to 'addr' */
+#define IORING_OP_WRITE      4       /* Write 'len' bytes from 'addr' to slot 'fd' */
+#define IORING_OP_CLOSE      5       /* Close slot 'fd' */
+
+/* SQE flags */
+#define IOSQE_IO_LINK        0x01    /* Cancel the next SQE if this one fails */
+
+/* Use the file's current position instead of an explicit offset */
+#define IORING_OFFSET_CURRENT 0xFFFFFFFF
+
+/* Completion result codes (negative values in cqe.res) */
+#define IORING_EINVAL        (-1)    /* Bad opcode, slot or argument */
+#define IORING_EBADF         (-2)    /* Slot not open */
+#define IORING_ENOENT        (-3)    /* File not found */
+#define IORING_EIO           (-4)    /* Device or file system error */
+#define IORING_ECANCELED     (-5)    /* Linked predecessor failed */
+
+/* Ring flags */
+#define IORING_SQ_NEED_WAKEUP 0x01   /* Worker has queued work not yet drained */
+#define IORING_CQ_OVERFLOW    0x01   /* Completions were dropped */
+
+/* Submission queue entry */
+typedef struct {
+    uint8_t  opcode;                /* IORING_OP_* */
+    uint8_t  flags;                 /* IOSQE_* */
+    uint16_t fd;                    /* Fixed file slot */
+    uint32_t offset;                /* File offset or IORING_OFFSET_CURRENT */
+    uint32_t addr;                  /* Buffer or filename address */
+    uint32_t len;                   /* Buffer length */
+    uint32_t user_data;             /* Copied untouched into the CQE */
+} __attribute__((packed)) ioring_sqe_t;
+
+/* Completion queue entry */
+typedef struct {
+    uint32_t user_data;             /* From the originating SQE */
+    int32_t  res;                   /* Bytes transferred, slot, or -error */
+    uint32_t flags;                 /* Reserved */
+} __attribute__((packed)) ioring_cqe_t;
+
+/* Queue indices shared between producer and consumer */
+typedef struct {
+    volatile uint32_t head;         /* Consumer position (free running) */
+    volatile uint32_t tail;         /* Producer position (free running) */
+    uint32_t ring_mask;             /* ring_entries - 1 */
+    uint32_t ring_entries;          /* Power-of-two entry count */
+    volatile uint32_t flags;        /* IORING_SQ_* / IORING_CQ_* */
+    volatile uint32_t dropped;      /* Invalid SQEs or overflowed CQEs */
+} ioring_queue_t;
+
+/* A shared ring. sqes/cqes point into the same allocation as the header. */
+typedef struct {
+    ioring_queue_t sq;              /* Submission queue indices */
+    ioring_queue_t cq;              /* Completion queue indices */
+    ioring_sqe_t* sqes;             /* Submission entries */
+    ioring_cqe_t* cqes;             /* Completion entries */
+
+    /* Kernel private state */
+    uint32_t sq_submitted;          /* SQEs handed over by ioring_enter() */
+    fat32_file_t* files[IORING_MAX_FILES]; /* Fixed file table */
+    bool     link_failed;           /* Previous linked SQE failed */
+    uint32_t enter_calls;           /* Number of kernel entries */
+    uint32_t completed;             /* Number of CQEs posted */
+} ioring_t;
+
+/* Ring setup and teardown */
+ioring_t* ioring_setup(uint32_t entries);
+void ioring_destroy(ioring_t* ring);
+
+/* Hand up to to_submit queued SQEs to the kernel; optionally wait */
+int ioring_enter(ioring_t* ring, uint32_t to_submit, uint32_t min_complete);
+
+/* Kernel worker: drain submitted SQEs of every registered ring */
+void ioring_worker_run(void);
+
+/* Submitter-side helpers (no kernel entry required). An SQE from
+ * ioring_get_sqe() is queued at once but must be filled in before the
+ * ioring_enter() that submits it. */
+ioring_sqe_t* ioring_get_sqe(ioring_t* ring);
+ioring_cqe_t* ioring_peek_cqe(ioring_t* ring);
+void ioring_cqe_seen(ioring_t* ring);
+uint32_t ioring_sq_ready(ioring_t* ring);
+uint32_t ioring_cq_ready(ioring_t* ring);
+
+/* Convenience SQE preparation */
+void ioring_prep_open(ioring_sqe_t* sqe, uint16_t slot, const char* filename, bool create);
+void ioring_prep_rw(ioring_sqe_t* sqe, uint8_t opcode, uint16_t slot,
+                    void* buffer, uint32_t len, uint32_t offset);
+void ioring_prep_close(ioring_sqe_t* sqe, uint16_t slot);
+
+#endif /* IORING_H */
@@ -12,14 +12,31 @@
 #include <stdint.h>
 
 #include "kernel.h"
+#include "init.h"
 #include "gdt.h"
+#include "percpu.h"
+#include "counter.h"
 #include "idt.h"
 #include "pic.h"
 #include "memory.h"
 #include "debug.h"
 #include "fat32.h"
+#include "ioring.h"
+#include "crc32c.h"
+#include "initrd.h"
+#include "fpu.h"
+#include "patch.h"
+#include "uaccess.h"
+#include "net.h"
+#include "tftp.h"
+#include "wss.h"
+#include "top.h"
+#include "sched.h"
+#include "async.h"
 #include "../drivers/timer.h"
 #include "../drivers/ata.h"
+#include "../drivers/pci.h"
+#include "../drivers/e1000.h"
 
 /* Global variables for terminal state */
 size_t terminal_row;
@@ -149,6 +166,24 @@ void terminal_writestring(const char* data) {
         terminal_putchar(data[i]);
 }
 
+void terminal_write_dec(uint32_t value) {
+    char str[12];
+    int i = 0;
+    
+    if (value == 0) {
+        terminal_putchar('0');
+        return;
+    }
+    
+    while (value > 0) {
+        str[i++] = '0' + (value % 10);
+        value /= 10;
+    }
+    while (i > 0) {
+        terminal_putchar(str[--i]);
+    }
+}
+
 /* I/O port functions for cursor control */
 static inline void outb(uint16_t port, uint8_t val) {
     asm volatile ("outb %0, %1" : : "a"(val), "Nd"(port));
@@ -247,11 +282,26 @@ void terminal_move_cursor_end(void) {
     terminal_update_cursor();
 }
 
-/* Kernel main function */
-void kernel_main(uint32_t magic, multiboot_info_t* mboot_info) {
+/* Boot banner, dropped with the rest of the init sections */
+static char boot_banner[] __initdata =
+    "\n"
+    "  ____  _  _   ____  ____ \n"
+    " / ___|| |/ / / __ \\/ ___|\n"
+    " \\___ \\| ' / | |  | \\___ \\\n"
+    "  ___) | . \\ | |__| |___) |\n"
+    " |____/|_|\\_\\ \\____/|____/\n"
+    "\n";
+
+/* Bring up every subsystem; runs once and is reclaimed afterwards */
+static void __init kernel_init(uint32_t magic, multiboot_info_t* mboot_info) {
     /* Initialize terminal interface first for debug output */
     terminal_initialize();
     
+    /* Pick CPU-specific instruction variants before anything runs them */
+    cpu_features_init();
+    apply_alternatives();
+    exception_table_init();
+    
     /* Initialize debugging subsystem early */
     debug_init();
 
@@ -264,13 +314,7 @@ void kernel_main(uint32_t magic, multiboot_info_t* mboot_info) {
 
     /* Display SKOS ASCII art banner */
     terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
-    terminal_writestring("\n");
-    terminal_writestring("  ____  _  _   ____  ____ \n");
-    terminal_writestring(" / ___|| |/ / / __ \\/ ___|\n");
-    terminal_writestring(" \\___ \\| ' / | |  | \\___ \\\n");
-    terminal_writestring("  ___) | . \\ | |__| |___) |\n");
-    terminal_writestring(" |____/|_|\\_\\ \\____/|____/\n");
-    terminal_writestring("\n");
+    terminal_writestring(boot_banner);
     
     /* Boot sequence header */
     terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
@@ -280,6 +324,8 @@ void kernel_main(uint32_t magic, multiboot_info_t* mboot_info) {
     terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
     terminal_writestring("GDT ");
     gdt_init();
+    percpu_init();      /* GS -> this CPU's area, before any handler runs */
+    counter_init();
     terminal_setcolor(vga_entry_color(VGA_COLOR_GREEN, VGA_COLOR_BLACK));
     terminal_writestring("OK ");
     
@@ -295,6 +341,16 @@ void kernel_main(uint32_t magic, multiboot_info_t* mboot_info) {
     terminal_setcolor(vga_entry_color(VGA_COLOR_GREEN, VGA_COLOR_BLACK));
     terminal_writestring("OK ");
     
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+    terminal_writestring("FPU ");
+    if (fpu_init()) {
+        terminal_setcolor(vga_entry_color(VGA_COLOR_GREEN, VGA_COLOR_BLACK));
+        terminal_writestring("SSE ");
+    } else {
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_BROWN, VGA_COLOR_BLACK));
+        terminal_writestring("NONE ");
+    }
+    
     terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
     terminal_writestring("TIMER ");
     timer_init();
@@ -332,6 +388,19 @@ void kernel_main(uint32_t magic, multiboot_info_t* mboot_info) {
     terminal_writestring(mb_str);
     terminal_writestring("MB)\n");
     
+    /* Locate the compressed initrd; files are unpacked on first use */
+    crc32c_init();
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+    terminal_writestring("INITRD ");
+    if (initrd_init(mboot_info)) {
+        terminal_setcolor(vga_entry_color(VGA_COLOR_GREEN, VGA_COLOR_BLACK));
+        terminal_writestring("OK ");
+    } else {
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_BROWN, VGA_COLOR_BLACK));
+        terminal_writestring("NONE ");
+    }
+    
+    
     /* Initialize Devices */
     terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
     terminal_writestring("KEYBOARD ");
@@ -368,6 +437,34 @@ void kernel_main(uint32_t magic, multiboot_info_t* mboot_info) {
         terminal_writestring("NO FS\n");
     }
     
+    /* Initialize Network */
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+    terminal_writestring("PCI ");
+    pci_init();
+    terminal_setcolor(vga_entry_color(VGA_COLOR_GREEN, VGA_COLOR_BLACK));
+    terminal_writestring("OK ");
+    
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+    terminal_writestring("E1000 ");
+    if (e1000_init()) {
+        terminal_setcolor(vga_entry_color(VGA_COLOR_GREEN, VGA_COLOR_BLACK));
+        terminal_writestring("OK\n");
+    } else {
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_BROWN, VGA_COLOR_BLACK));
+        terminal_writestring("NO NIC\n");
+    }
+    
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+    terminal_writestring("NET ");
+    if (net_init()) {
+        tftp_server_start();
+        terminal_setcolor(vga_entry_color(VGA_COLOR_GREEN, VGA_COLOR_BLACK));
+        terminal_writestring("OK\n");
+    } else {
+        terminal_setcolor(vga_entry_color(VGA_COLOR_RED, VGA_COLOR_BLACK));
+        terminal_writestring("FAILED\n");
+    }
+    
     /* Enable interrupts */
     terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
     terminal_writestring("Enabling interrupts ");
@@ -380,6 +477,50 @@ void kernel_main(uint32_t magic, multiboot_info_t* mboot_info) {
     terminal_writestring("=== SYSTEM READY ===\n");
     terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
     terminal_writestring("Welcome to SKOS!\n");
+}
+
+/*------------------------------------------------------------------------------
+ * CPU Idle Accounting
+ *------------------------------------------------------------------------------
+ */
+
+DEFINE_COUNTER(cnt_idle_cycles, "cpu", "idle_cycles");
+
+/* Halt until the next interrupt. STI only takes effect after the following
+ * instruction, so an interrupt between the stamp and the HLT still wakes us. */
+void cpu_idle(void) {
+    asm volatile("cli");
+    this_cpu_ptr()->idle_enter_tsc = timer_read_tsc();
+    asm volatile("sti; hlt" ::: "memory");
+    cpu_idle_exit();
+}
+
+void cpu_idle_exit(void) {
+    percpu_t* cpu = this_cpu_ptr();
+    uint32_t flags;
+    asm volatile("pushfl; popl %0; cli" : "=r"(flags) :: "memory");
+    if (cpu->idle_enter_tsc != 0) {
+        uint64_t idle = timer_read_tsc() - cpu->idle_enter_tsc;
+        cpu->idle_enter_tsc = 0;
+        /* The timer tick wakes us long before 2^32 cycles */
+        counter_add(&cnt_idle_cycles, idle > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)idle);
+    }
+    asm volatile("pushl %0; popfl" :: "r"(flags) : "memory", "cc");
+}
+
+uint64_t cpu_idle_cycles(void) {
+    return counter_read(&cnt_idle_cycles);
+}
+
+/* Kernel main function */
+void kernel_main(uint32_t magic, multiboot_info_t* mboot_info) {
+    kernel_init(magic, mboot_info);
+    
+    /* The boot context becomes the main thread */
+    sched_init();
+    
+    /* Boot is over: give the init code and data back to the allocator */
+    free_initmem();
     
     /* Start keyboard input mode */
     terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
@@ -391,13 +532,39 @@ void kernel_main(uint32_t magic, multiboot_info_t* mboot_info) {
         if (keyboard_has_data()) {
             int c = keyboard_getchar();
             if (c != 0) {
-                /* Let the shell handle all input processing */
-                shell_handle_input(c);
+                /* Let the shell handle all input processing, unless the
+                 * system monitor owns the screen */
+                if (top_active()) {
+                    top_handle_key(c);
+                } else {
+                    shell_handle_input(c);
+                }
             }
         }
         
-        /* Halt CPU until next interrupt */
-        asm volatile ("hlt");
+        /* Resume coroutines woken by interrupts, timers and queues */
+        async_run();
+        
+        /* Drain submitted I/O ring entries */
+        ioring_worker_run();
+        
+        /* Run the network stack over packets deferred by the NIC interrupt */
+        net_poll();
+        
+        /* Retransmit stalled TFTP transfers */
+        tftp_poll();
+        
+        /* Sample accessed bits once per working-set interval */
+        wss_poll();
+        
+        /* Nothing else to do: pre-zero a few free pages */
+        memory_idle_work();
+        
+        /* Redraw the system monitor once per interval */
+        top_poll();
+        
+        /* Sleep until the next interrupt, letting other threads run */
+        sched_wait_interrupt();
     }
 }
 
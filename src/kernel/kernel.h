@@ -172,6 +172,13 @@ void terminal_putchar(char c);
  */
 void terminal_writestring(const char* data);
 
+/**
+ * @brief Outputs an unsigned value to the terminal in decimal
+ * 
+ * @param value Value to print
+ */
+void terminal_write_dec(uint32_t value);
+
 /**
  * @brief Show the cursor at the current terminal position
  */
@@ -244,4 +251,29 @@ bool terminal_is_scrolled(void);
  */
 void terminal_reset_scroll(void);
 
+/*------------------------------------------------------------------------------
+ * CPU Idle Accounting
+ *------------------------------------------------------------------------------
+ * The main loop halts through cpu_idle(), which stamps the TSC before the
+ * hlt. The next hardware interrupt calls cpu_idle_exit() on entry, so the
+ * interrupt handler's own time counts as busy. Idle cycles accumulate in
+ * the "cpu.idle_cycles" counter.
+ *------------------------------------------------------------------------------
+ */
+
+/**
+ * @brief Halt until the next interrupt, accounting the time as idle
+ */
+void cpu_idle(void);
+
+/**
+ * @brief End an idle period, if one is open (interrupt entry)
+ */
+void cpu_idle_exit(void);
+
+/**
+ * @brief Idle TSC cycles summed over all CPUs
+ */
+uint64_t cpu_idle_cycles(void);
+
 #endif /* KERNEL_H */
\ No newline at end of file
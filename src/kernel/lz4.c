@@ -0,0 +1,128 @@
+/*------------------------------------------------------------------------------
+ * LZ4 Block Decompression
+ *------------------------------------------------------------------------------
+ * This file implements a bounds-checked LZ4 block decoder that moves data
+ * with unaligned 32-bit loads and stores. See lz4.h.
+ *------------------------------------------------------------------------------
+ */
+
+#include "lz4.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* x86 tolerates unaligned accesses; tell the compiler so it doesn't assume otherwise */
+typedef uint32_t __attribute__((may_alias, aligned(1))) lz4_u32_t;
+
+/* Copy 8 bytes as two words */
+static inline void lz4_copy8(uint8_t* dst, const uint8_t* src) {
+    ((lz4_u32_t*)dst)[0] = ((const lz4_u32_t*)src)[0];
+    ((lz4_u32_t*)dst)[1] = ((const lz4_u32_t*)src)[1];
+}
+
+/* Copy in 8-byte steps until dst reaches end; may overrun by up to 7 bytes */
+static inline void lz4_wildcopy(uint8_t* dst, const uint8_t* src, uint8_t* end) {
+    do {
+        lz4_copy8(dst, src);
+        dst += 8;
+        src += 8;
+    } while (dst < end);
+}
+
+/* Read an extended length (runs of 255 terminated by a smaller byte) */
+static inline int lz4_read_length(const uint8_t** ip, const uint8_t* iend, size_t* len) {
+    uint8_t b;
+    do {
+        if (*ip >= iend) {
+            return -1;
+        }
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return 0;
+}
+
+/* Decompress src into dst */
+int lz4_decompress(const uint8_t* src, size_t src_len, uint8_t* dst, size_t dst_capacity) {
+    const uint8_t* ip = src;
+    const uint8_t* const iend = src + src_len;
+    uint8_t* op = dst;
+    uint8_t* const oend = dst + dst_capacity;
+
+    if (src_len == 0) {
+        return -1;
+    }
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+
+        /* Literals */
+        size_t lit_len = token >> 4;
+        if (lit_len == 15 && lz4_read_length(&ip, iend, &lit_len) < 0) {
+            return -1;
+        }
+        if (lit_len > (size_t)(iend - ip) || lit_len > (size_t)(oend - op)) {
+            return -1;
+        }
+
+        uint8_t* lit_end = op + lit_len;
+        if (lit_len + 8 <= (size_t)(iend - ip) && lit_len + 8 <= (size_t)(oend - op)) {
+            lz4_wildcopy(op, ip, lit_end);
+        } else {
+            for (size_t i = 0; i < lit_len; i++) {
+                op[i] = ip[i];
+            }
+        }
+        ip += lit_len;
+        op = lit_end;
+
+        /* The last sequence ends after its literals */
+        if (ip >= iend) {
+            break;
+        }
+
+        /* Match */
+        if (iend - ip < 2) {
+            return -1;
+        }
+        size_t offset = ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - dst)) {
+            return -1;
+        }
+
+        size_t match_len = token & 0x0F;
+        if (match_len == 15 && lz4_read_length(&ip, iend, &match_len) < 0) {
+            return -1;
+        }
+        match_len += LZ4_MIN_MATCH;
+        if (match_len > (size_t)(oend - op)) {
+            return -1;
+        }
+
+        const uint8_t* match = op - offset;
+        uint8_t* match_end = op + match_len;
+
+        if (offset >= 8 && match_len + 8 <= (size_t)(oend - op)) {
+            /* Source is at least a full step behind: 8-byte chunks never overlap */
+            lz4_wildcopy(op, match, match_end);
+        } else if (offset >= 4) {
+            /* Each word reads bytes that were already written */
+            while (op + 4 <= match_end) {
+                *(lz4_u32_t*)op = *(const lz4_u32_t*)match;
+                op += 4;
+                match += 4;
+            }
+            while (op < match_end) {
+                *op++ = *match++;
+            }
+        } else {
+            /* Short offsets repeat a 1-3 byte pattern */
+            while (op < match_end) {
+                *op++ = *match++;
+            }
+        }
+        op = match_end;
+    }
+
+    return (int)(op - dst);
+}
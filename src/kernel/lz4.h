@@ -0,0 +1,29 @@
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*------------------------------------------------------------------------------
+ * LZ4 Block Decompression
+ *------------------------------------------------------------------------------
+ * Decoder for the raw LZ4 block format (no frame header). Each sequence is
+ * a token, optional extra literal length bytes, literals, a 16-bit match
+ * offset and optional extra match length bytes; the final sequence carries
+ * literals only.
+ *
+ * Copies are done a machine word at a time and may write up to
+ * LZ4_WILDCOPY_SLACK bytes past the decompressed size, so destination
+ * buffers should be allocated with that much extra room. Near the end of
+ * the buffer the decoder falls back to exact byte copies, so a buffer
+ * without slack is still decoded correctly, just more slowly.
+ *------------------------------------------------------------------------------
+ */
+
+#define LZ4_WILDCOPY_SLACK  8       /* Bytes fast copies may overrun */
+#define LZ4_MIN_MATCH       4       /* Shortest encodable match */
+
+/* Decompress src into dst; returns bytes produced or -1 on malformed input */
+int lz4_decompress(const uint8_t* src, size_t src_len, uint8_t* dst, size_t dst_capacity);
+
+#endif /* LZ4_H */
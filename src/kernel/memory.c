@@ -11,8 +11,14 @@
  */
 
 #include "memory.h"
+#include "init.h"
 #include "kernel.h"
 #include "debug.h"
+#include "idt.h"
+#include "uaccess.h"
+#include "shrinker.h"
+#include "swap.h"
+#include "string.h"
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -20,6 +26,13 @@
 /* Global physical memory allocator */
 static physical_allocator_t phys_allocator;
 
+/* Physical memory zones (see allocate_physical_pages_flags()) */
+static memory_zone_t zones[ZONE_COUNT] = {
+    { .name = "DMA" },
+    { .name = "Normal" },
+    { .name = "High" },
+};
+
 /* Memory map information */
 static uint32_t memory_map_entries = 0;
 static uint32_t total_memory_kb = 0;
@@ -28,6 +41,11 @@ static uint32_t usable_memory_kb = 0;
 /* Kernel boundaries (defined in linker script) */
 extern uint32_t kernel_start;
 extern uint32_t kernel_end;
+extern uint8_t __init_start[];
+extern uint8_t __init_end[];
+
+/* Bytes handed back by free_initmem() */
+static uint32_t init_freed_bytes = 0;
 
 /* Paging structures */
 static page_directory_t *kernel_directory = 0;
@@ -36,6 +54,9 @@ static page_table_t *kernel_tables[1024] = {0};
 /* Current page directory */
 static page_directory_t *current_directory = 0;
 
+static void zones_init(void);
+static page_table_t* page_table_get(uint32_t pd_index, uint32_t flags);
+
 /*------------------------------------------------------------------------------
  * Memory detection and initialization
  *------------------------------------------------------------------------------
@@ -45,7 +66,7 @@ static page_directory_t *current_directory = 0;
  * @brief Initialize memory management system
  * @param mboot_info Multiboot information structure from GRUB
  */
-void memory_init(multiboot_info_t* mboot_info) {
+void __init memory_init(multiboot_info_t* mboot_info) {
     /* Initialize physical memory allocator */
     physical_memory_init(mboot_info);
     
@@ -60,9 +81,9 @@ void memory_init(multiboot_info_t* mboot_info) {
  * @brief Initialize physical memory allocator using multiboot memory map
  * @param mboot_info Multiboot information structure
  */
-void physical_memory_init(multiboot_info_t* mboot_info) {
+void __init physical_memory_init(multiboot_info_t* mboot_info) {
     /* Check if memory map is available */
-    if (!(mboot_info->flags & 0x40)) {
+    if (!(mboot_info->flags & MULTIBOOT_INFO_MEM_MAP)) {
         terminal_setcolor(vga_entry_color(VGA_COLOR_RED, VGA_COLOR_BLACK));
         terminal_writestring("ERROR: No memory map available from bootloader!\n");
         while(1) asm volatile("hlt");
@@ -101,9 +122,24 @@ void physical_memory_init(multiboot_info_t* mboot_info) {
     phys_allocator.total_pages = highest_address / PAGE_SIZE;
     uint32_t bitmap_size = (phys_allocator.total_pages + 31) / 32; /* Round up to nearest uint32_t */
     
-    /* Place bitmap after kernel in memory */
+    /* Place bitmap after the kernel and any boot modules GRUB loaded behind it */
     uint32_t kernel_end_addr = (uint32_t)&kernel_end;
+    if (mboot_info->flags & MULTIBOOT_INFO_MODS) {
+        multiboot_module_t* mods = (multiboot_module_t*)mboot_info->mods_addr;
+        for (uint32_t m = 0; m < mboot_info->mods_count; m++) {
+            if (mods[m].mod_end > kernel_end_addr) {
+                kernel_end_addr = mods[m].mod_end;
+            }
+        }
+    }
     uint32_t bitmap_addr = align_up(kernel_end_addr, sizeof(uint32_t));
+    
+    /* Everything up to the bitmap must stay reachable through the identity map */
+    if (bitmap_addr + bitmap_size * sizeof(uint32_t) > IDENTITY_MAP_END) {
+        terminal_setcolor(vga_entry_color(VGA_COLOR_RED, VGA_COLOR_BLACK));
+        terminal_writestring("ERROR: Kernel and boot modules exceed the 4MB identity map!\n");
+        while(1) asm volatile("hlt");
+    }
     phys_allocator.bitmap = (uint32_t*)bitmap_addr;
     
     /* Clear bitmap (all pages free initially) */
@@ -133,7 +169,7 @@ void physical_memory_init(multiboot_info_t* mboot_info) {
         mmap = (multiboot_memory_map_t*)((uint32_t)mmap + mmap->size + sizeof(mmap->size));
     }
     
-    /* Mark kernel and bitmap area as used */
+    /* Mark kernel, boot modules and bitmap area as used */
     uint32_t kernel_start_page = 0x100000 / PAGE_SIZE; /* Kernel starts at 1MB */
     uint32_t kernel_end_page = (bitmap_addr + bitmap_size * sizeof(uint32_t) + PAGE_SIZE - 1) / PAGE_SIZE;
     
@@ -157,45 +193,171 @@ void physical_memory_init(multiboot_info_t* mboot_info) {
         }
     }
     
-    phys_allocator.first_free_page = first_mb_pages;
+    zones_init();
 }
 
 /*------------------------------------------------------------------------------
  * Physical page allocation functions
  *------------------------------------------------------------------------------
+ * Frames are grouped into zones by physical address. Plain allocations
+ * start in the highest zone and only fall back downwards, so the low 16MB
+ * that legacy DMA needs is the last memory general allocations eat into.
+ * ALLOC_DIRECT further limits a request to the boot identity map, for page
+ * tables and other frames the kernel touches by physical address.
+ *------------------------------------------------------------------------------
  */
 
-/**
- * @brief Allocate a single physical page
- * @return Physical address of allocated page, or 0 if out of memory
- */
-uint32_t allocate_physical_page(void) {
-    /* Start searching from the hint */
-    for (uint32_t page = phys_allocator.first_free_page; page < phys_allocator.total_pages; page++) {
-        uint32_t bitmap_index = page / 32;
-        uint32_t bit_index = page % 32;
+/* Split the frames into zones once the bitmap is final */
+static void __init zones_init(void) {
+    static const uint32_t zone_ends[ZONE_COUNT] = {
+        ZONE_DMA_END / PAGE_SIZE, ZONE_NORMAL_END / PAGE_SIZE, 0xFFFFFFFF
+    };
+    uint32_t start = 0;
+    
+    for (uint32_t z = 0; z < ZONE_COUNT; z++) {
+        memory_zone_t* zone = &zones[z];
+        uint32_t end = zone_ends[z];
+        if (end > phys_allocator.total_pages) {
+            end = phys_allocator.total_pages;
+        }
+        if (start > end) {
+            start = end;
+        }
         
-        if (!(phys_allocator.bitmap[bitmap_index] & (1 << bit_index))) {
-            /* Found a free page */
-            phys_allocator.bitmap[bitmap_index] |= (1 << bit_index);
-            phys_allocator.used_pages++;
+        zone->start_page = start;
+        zone->end_page = end;
+        zone->first_free_page = start;
+        zone->free_pages = 0;
+        for (uint32_t page = start; page < end; page++) {
+            if (!(phys_allocator.bitmap[page / 32] & (1 << (page % 32)))) {
+                zone->free_pages++;
+            }
+        }
+        start = end;
+    }
+}
+
+/* Zone a frame belongs to */
+static memory_zone_t* zone_of(uint32_t page) {
+    for (uint32_t z = 0; z < ZONE_COUNT - 1; z++) {
+        if (page < zones[z].end_page) {
+            return &zones[z];
+        }
+    }
+    return &zones[ZONE_HIGH];
+}
+
+/* Take a run of count free frames below end_page from one zone (0 if none) */
+static uint32_t zone_alloc(memory_zone_t* zone, uint32_t count, uint32_t end_page) {
+    if (zone->free_pages < count) {
+        return 0;
+    }
+    if (end_page > zone->end_page) {
+        end_page = zone->end_page;
+    }
+    
+    uint32_t run_start = zone->first_free_page;
+    uint32_t run_length = 0;
+    
+    for (uint32_t page = zone->first_free_page; page < end_page; page++) {
+        if (phys_allocator.bitmap[page / 32] & (1 << (page % 32))) {
+            run_start = page + 1;
+            run_length = 0;
+            continue;
+        }
+        
+        if (++run_length == count) {
+            for (uint32_t p = run_start; p < run_start + count; p++) {
+                phys_allocator.bitmap[p / 32] |= (1 << (p % 32));
+            }
+            phys_allocator.used_pages += count;
+            zone->free_pages -= count;
             
             /* Update hint */
-            if (page == phys_allocator.first_free_page) {
-                phys_allocator.first_free_page++;
+            if (run_start == zone->first_free_page) {
+                zone->first_free_page += count;
+            }
+            return run_start;
+        }
+    }
+    
+    return 0;
+}
+
+/* Walk the zones flags allow, highest first */
+static uint32_t zones_alloc(uint32_t count, uint32_t flags) {
+    int highest = ZONE_HIGH;
+    if (flags & (ALLOC_DMA | ALLOC_DIRECT)) {
+        highest = ZONE_DMA;
+    } else if (flags & ALLOC_NORMAL) {
+        highest = ZONE_NORMAL;
+    }
+    uint32_t end_page = (flags & ALLOC_DIRECT) ? IDENTITY_MAP_END / PAGE_SIZE
+                                               : phys_allocator.total_pages;
+    
+    bool fell_back = false;
+    for (int z = highest; z >= 0; z--) {
+        memory_zone_t* zone = &zones[z];
+        uint32_t page = zone_alloc(zone, count, end_page);
+        if (page) {
+            if (fell_back) {
+                zone->fallbacks++;
             }
             
             /* Track allocation for profiling */
-            debug_count_memory_alloc(PAGE_SIZE);
+            debug_count_memory_alloc(count * PAGE_SIZE);
             
             return page * PAGE_SIZE;
         }
+        
+        /* An empty zone (e.g. no memory above 896MB) is not a fallback */
+        if (zone->end_page > zone->start_page) {
+            fell_back = true;
+        }
     }
     
     /* No free pages found */
     return 0;
 }
 
+/**
+ * @brief Allocate physically contiguous pages from the zones flags allow
+ * @param count Number of pages
+ * @param flags ALLOC_* zone flags
+ * @return Physical address of the first page, or 0 if no run is free
+ *
+ * When no zone can satisfy the request the registered caches are asked
+ * to shrink and the allocation is retried once.
+ */
+uint32_t allocate_physical_pages_flags(uint32_t count, uint32_t flags) {
+    if (count == 0) {
+        return 0;
+    }
+    
+    uint32_t phys = zones_alloc(count, flags);
+    if (!phys && shrink_caches(count)) {
+        phys = zones_alloc(count, flags);
+    }
+    return phys;
+}
+
+/**
+ * @brief Allocate a single physical page
+ * @return Physical address of allocated page, or 0 if out of memory
+ */
+uint32_t allocate_physical_page(void) {
+    return allocate_physical_pages_flags(1, ALLOC_HIGH);
+}
+
+/**
+ * @brief Allocate physically contiguous pages from any zone
+ * @param count Number of pages
+ * @return Physical address of the first page, or 0 if no run is free
+ */
+uint32_t allocate_physical_pages(uint32_t count) {
+    return allocate_physical_pages_flags(count, ALLOC_HIGH);
+}
+
 /**
  * @brief Free a physical page
  * @param page_addr Physical address of page to free (must be page-aligned)
@@ -218,16 +380,35 @@ void free_physical_page(uint32_t page_addr) {
         phys_allocator.bitmap[bitmap_index] &= ~(1 << bit_index);
         phys_allocator.used_pages--;
         
+        memory_zone_t* zone = zone_of(page);
+        zone->free_pages++;
+        
         /* Track deallocation for profiling */
         debug_count_memory_free(PAGE_SIZE);
         
         /* Update hint if this page is before current hint */
-        if (page < phys_allocator.first_free_page) {
-            phys_allocator.first_free_page = page;
+        if (page < zone->first_free_page) {
+            zone->first_free_page = page;
         }
     }
 }
 
+/**
+ * @brief Free pages obtained from allocate_physical_pages()
+ */
+void free_physical_pages(uint32_t page_addr, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        free_physical_page(page_addr + i * PAGE_SIZE);
+    }
+}
+
+/**
+ * @brief Zone descriptor (NULL for an invalid index)
+ */
+const memory_zone_t* memory_get_zone(uint32_t zone) {
+    return zone < ZONE_COUNT ? &zones[zone] : NULL;
+}
+
 /**
  * @brief Get total physical memory in bytes
  */
@@ -257,9 +438,9 @@ uint32_t get_free_memory(void) {
 /**
  * @brief Initialize paging system
  */
-void paging_init(void) {
+void __init paging_init(void) {
     /* Allocate page directory */
-    uint32_t phys_addr = allocate_physical_page();
+    uint32_t phys_addr = allocate_physical_pages_flags(1, ALLOC_DIRECT);
     if (!phys_addr) {
         terminal_setcolor(vga_entry_color(VGA_COLOR_RED, VGA_COLOR_BLACK));
         terminal_writestring("ERROR: Cannot allocate page directory!\n");
@@ -274,7 +455,7 @@ void paging_init(void) {
     }
     
     /* Identity map first 4MB (for kernel) */
-    uint32_t page_table_phys = allocate_physical_page();
+    uint32_t page_table_phys = allocate_physical_pages_flags(1, ALLOC_DIRECT);
     if (!page_table_phys) {
         terminal_setcolor(vga_entry_color(VGA_COLOR_RED, VGA_COLOR_BLACK));
         terminal_writestring("ERROR: Cannot allocate page table!\n");
@@ -309,51 +490,286 @@ void paging_init(void) {
     asm volatile("mov %%cr0, %0" : "=r"(cr0));
     cr0 |= 0x80000000; /* Set PG bit */
     asm volatile("mov %0, %%cr0" :: "r"(cr0));
+    
+    /* The zeroing scratch slot needs its page table up front, since
+     * creating one later would itself want a zeroed page */
+    page_table_get(ZERO_MAP_SLOT >> 22, 0);
 }
 
 /**
- * @brief Map a virtual page to a physical page
- * @param virtual_addr Virtual address (will be page-aligned)
- * @param physical_addr Physical address (will be page-aligned)
+ * @brief Release the __init/__initdata pages once boot has finished
+ *
+ * The region is filled with int3 first so a stray call into freed init
+ * code traps instead of running whatever reuses the page.
+ */
+void free_initmem(void) {
+    uint32_t start = (uint32_t)__init_start;
+    uint32_t end = (uint32_t)__init_end;
+    
+    if (init_freed_bytes != 0 || end <= start) {
+        return;
+    }
+    
+    memset(__init_start, 0xCC, end - start);
+    for (uint32_t page = start; page < end; page += PAGE_SIZE) {
+        free_physical_page(page);
+    }
+    init_freed_bytes = end - start;
+}
+
+/**
+ * @brief Bytes of boot-only code and data returned to the allocator
+ */
+uint32_t memory_get_init_freed(void) {
+    return init_freed_bytes;
+}
+
+/*------------------------------------------------------------------------------
+ * Zeroed page pool
+ *------------------------------------------------------------------------------
+ * Page tables and fresh heap pages must start out zeroed. Rather than
+ * clearing a frame when it is needed, memory_idle_work() zeroes free frames
+ * while the main loop has nothing else to do and parks them here, so
+ * allocate_zeroed_page() is normally just a pop. Frames outside the boot
+ * identity map are zeroed through a one-page scratch mapping.
+ *------------------------------------------------------------------------------
+ */
+
+static uint32_t zero_pool[ZERO_POOL_SIZE];
+static zero_pool_stats_t zero_stats;
+
+/* Clear one physical frame */
+static void zero_frame(uint32_t phys) {
+    if (phys + PAGE_SIZE <= IDENTITY_MAP_END) {
+        memset((void*)phys, 0, PAGE_SIZE);
+        return;
+    }
+    
+    map_page(ZERO_MAP_SLOT, phys, PAGE_PRESENT | PAGE_WRITABLE);
+    memset((void*)ZERO_MAP_SLOT, 0, PAGE_SIZE);
+    unmap_page(ZERO_MAP_SLOT);
+}
+
+/* Take a frame below limit from the pool, or 0 if there is none */
+static uint32_t zero_pool_pop(uint32_t limit) {
+    uint32_t flags;
+    uint32_t phys = 0;
+    
+    asm volatile("pushfl; popl %0; cli" : "=r"(flags) :: "memory");
+    for (uint32_t i = zero_stats.available; i-- > 0; ) {
+        if (zero_pool[i] < limit) {
+            phys = zero_pool[i];
+            zero_pool[i] = zero_pool[--zero_stats.available];
+            zero_stats.hits++;
+            break;
+        }
+    }
+    asm volatile("pushl %0; popfl" :: "r"(flags) : "memory", "cc");
+    return phys;
+}
+
+/**
+ * @brief Allocate a physical page whose contents are zero
+ * @param flags ALLOC_* zone flags
+ * @return Physical address of the page, or 0 if out of memory
+ *
+ * The pool is filled from the highest zone, so restricted requests
+ * usually miss it and zero a frame of their own.
+ */
+uint32_t allocate_zeroed_page(uint32_t flags) {
+    uint32_t limit = 0xFFFFFFFF;
+    if (flags & ALLOC_DIRECT) {
+        limit = IDENTITY_MAP_END;
+    } else if (flags & ALLOC_DMA) {
+        limit = ZONE_DMA_END;
+    } else if (flags & ALLOC_NORMAL) {
+        limit = ZONE_NORMAL_END;
+    }
+    
+    uint32_t phys = zero_pool_pop(limit);
+    if (phys) {
+        return phys;
+    }
+    
+    phys = allocate_physical_pages_flags(1, flags);
+    if (phys) {
+        zero_frame(phys);
+        zero_stats.misses++;
+    }
+    return phys;
+}
+
+/**
+ * @brief Background memory work; called from the idle loop
+ *
+ * Shrinks caches if free memory is low, then tops up the zeroed page pool.
+ */
+void memory_idle_work(void) {
+    shrinker_balance();
+    
+    /* Pre-zeroing must not itself push memory below the watermark */
+    if (get_free_memory() / PAGE_SIZE <= SHRINK_LOW_WATERMARK) {
+        return;
+    }
+    
+    for (uint32_t i = 0; i < ZERO_POOL_BATCH && zero_stats.available < ZERO_POOL_SIZE; i++) {
+        uint32_t phys = allocate_physical_page();
+        if (!phys) {
+            return;
+        }
+        zero_frame(phys);
+        
+        uint32_t flags;
+        asm volatile("pushfl; popl %0; cli" : "=r"(flags) :: "memory");
+        zero_pool[zero_stats.available++] = phys;
+        zero_stats.zeroed++;
+        asm volatile("pushl %0; popfl" :: "r"(flags) : "memory", "cc");
+    }
+}
+
+const zero_pool_stats_t* memory_get_zero_pool_stats(void) {
+    return &zero_stats;
+}
+
+/*------------------------------------------------------------------------------
+ * Page table updates
+ *------------------------------------------------------------------------------
+ * Updates write the PTEs first and invalidate the TLB once for the whole
+ * range afterwards. Only entries that were present before can be cached in
+ * the TLB, so mapping fresh pages needs no flush at all. A range flush uses
+ * invlpg per page up to TLB_FLUSH_CEILING pages and a CR3 reload above it,
+ * where refilling the TLB is cheaper than walking the range. With SMP this
+ * is also the one place a range would turn into a single shootdown IPI.
+ *------------------------------------------------------------------------------
+ */
+
+#define TLB_FLUSH_CEILING   33      /* Pages; above this reload CR3 instead */
+
+static tlb_stats_t tlb_stats;
+
+/* Page table covering pd_index, allocating it if needed (NULL if out of memory) */
+static page_table_t* page_table_get(uint32_t pd_index, uint32_t flags) {
+    if (kernel_directory->tables[pd_index] & PAGE_PRESENT) {
+        return kernel_tables[pd_index];
+    }
+    
+    /* Allocate new page table (already cleared); tables are reached by
+     * physical address, so they must sit inside the identity map */
+    uint32_t page_table_phys = allocate_zeroed_page(ALLOC_DIRECT);
+    if (!page_table_phys) {
+        return NULL; /* Out of memory */
+    }
+    
+    page_table_t *new_table = (page_table_t*)page_table_phys;
+    kernel_tables[pd_index] = new_table;
+    
+    /* Add to page directory */
+    kernel_directory->tables[pd_index] = page_table_phys | PAGE_PRESENT | PAGE_WRITABLE | (flags & PAGE_USER);
+    return new_table;
+}
+
+/**
+ * @brief Invalidate the TLB for [virtual_addr, +npages)
+ */
+void tlb_flush_range(uint32_t virtual_addr, uint32_t npages) {
+    if (npages > TLB_FLUSH_CEILING) {
+        uint32_t cr3;
+        asm volatile("mov %%cr3, %0; mov %0, %%cr3" : "=r"(cr3) :: "memory");
+        tlb_stats.full_flushes++;
+        return;
+    }
+    
+    for (uint32_t i = 0; i < npages; i++) {
+        asm volatile("invlpg (%0)" :: "r"(virtual_addr + i * PAGE_SIZE) : "memory");
+    }
+    tlb_stats.page_flushes += npages;
+}
+
+/**
+ * @brief Map a physically contiguous range of pages
+ * @param virtual_addr First virtual address (will be page-aligned)
+ * @param physical_addr First physical address (will be page-aligned)
+ * @param npages Number of pages
  * @param flags Page flags (present, writable, user, etc.)
+ * @return true on success, false if a page table could not be allocated
  */
-void map_page(uint32_t virtual_addr, uint32_t physical_addr, uint32_t flags) {
-    /* Align addresses to page boundaries */
+bool map_range(uint32_t virtual_addr, uint32_t physical_addr, uint32_t npages, uint32_t flags) {
     virtual_addr &= PAGE_ALIGN_MASK;
     physical_addr &= PAGE_ALIGN_MASK;
     
-    /* Get page directory and table indices */
-    uint32_t pd_index = virtual_addr >> 22;
-    uint32_t pt_index = (virtual_addr >> 12) & 0x3FF;
-    
-    /* Check if page table exists */
-    if (!(kernel_directory->tables[pd_index] & PAGE_PRESENT)) {
-        /* Allocate new page table */
-        uint32_t page_table_phys = allocate_physical_page();
-        if (!page_table_phys) {
-            return; /* Out of memory */
+    bool was_present = false;
+    bool ok = true;
+    uint32_t done = 0;
+    
+    /* One page table at a time */
+    while (done < npages) {
+        uint32_t virt = virtual_addr + done * PAGE_SIZE;
+        uint32_t pt_index = (virt >> 12) & 0x3FF;
+        uint32_t count = 1024 - pt_index;
+        if (count > npages - done) {
+            count = npages - done;
         }
         
-        page_table_t *new_table = (page_table_t*)page_table_phys;
-        kernel_tables[pd_index] = new_table;
-        
-        /* Clear new page table */
-        for (int i = 0; i < 1024; i++) {
-            new_table->pages[i] = 0;
+        page_table_t *table = page_table_get(virt >> 22, flags);
+        if (!table) {
+            ok = false;
+            break;
         }
         
-        /* Add to page directory */
-        kernel_directory->tables[pd_index] = page_table_phys | PAGE_PRESENT | PAGE_WRITABLE | (flags & PAGE_USER);
+        uint32_t phys = physical_addr + done * PAGE_SIZE;
+        for (uint32_t i = 0; i < count; i++) {
+            was_present |= (table->pages[pt_index + i] & PAGE_PRESENT) != 0;
+            table->pages[pt_index + i] = (phys + i * PAGE_SIZE) | flags;
+        }
+        done += count;
     }
     
-    /* Get page table */
-    page_table_t *table = kernel_tables[pd_index];
+    tlb_stats.ranges++;
+    if (was_present) {
+        tlb_flush_range(virtual_addr, done);
+    }
+    return ok;
+}
+
+/**
+ * @brief Unmap a range of pages with a single TLB flush
+ * @param virtual_addr First virtual address (will be page-aligned)
+ * @param npages Number of pages
+ */
+void unmap_range(uint32_t virtual_addr, uint32_t npages) {
+    virtual_addr &= PAGE_ALIGN_MASK;
     
-    /* Set page table entry */
-    table->pages[pt_index] = physical_addr | flags;
+    bool was_present = false;
+    for (uint32_t i = 0; i < npages; i++) {
+        uint32_t virt = virtual_addr + i * PAGE_SIZE;
+        uint32_t pd_index = virt >> 22;
+        
+        if (!(kernel_directory->tables[pd_index] & PAGE_PRESENT)) {
+            /* Skip the rest of an absent page table */
+            uint32_t skip = 1024 - ((virt >> 12) & 0x3FF);
+            i += skip - 1;
+            continue;
+        }
+        
+        uint32_t *pte = &kernel_tables[pd_index]->pages[(virt >> 12) & 0x3FF];
+        was_present |= (*pte & PAGE_PRESENT) != 0;
+        *pte = 0;
+    }
     
-    /* Flush TLB for this page */
-    asm volatile("invlpg (%0)" :: "r"(virtual_addr) : "memory");
+    tlb_stats.ranges++;
+    if (was_present) {
+        tlb_flush_range(virtual_addr, npages);
+    }
+}
+
+/**
+ * @brief Map a virtual page to a physical page
+ * @param virtual_addr Virtual address (will be page-aligned)
+ * @param physical_addr Physical address (will be page-aligned)
+ * @param flags Page flags (present, writable, user, etc.)
+ */
+void map_page(uint32_t virtual_addr, uint32_t physical_addr, uint32_t flags) {
+    map_range(virtual_addr, physical_addr, 1, flags);
 }
 
 /**
@@ -361,18 +777,14 @@ void map_page(uint32_t virtual_addr, uint32_t physical_addr, uint32_t flags) {
  * @param virtual_addr Virtual address to unmap
  */
 void unmap_page(uint32_t virtual_addr) {
-    virtual_addr &= PAGE_ALIGN_MASK;
-    
-    uint32_t pd_index = virtual_addr >> 22;
-    uint32_t pt_index = (virtual_addr >> 12) & 0x3FF;
-    
-    if (kernel_directory->tables[pd_index] & PAGE_PRESENT) {
-        page_table_t *table = kernel_tables[pd_index];
-        table->pages[pt_index] = 0;
-        
-        /* Flush TLB */
-        asm volatile("invlpg (%0)" :: "r"(virtual_addr) : "memory");
-    }
+    unmap_range(virtual_addr, 1);
+}
+
+/**
+ * @brief Get TLB flush statistics
+ */
+const tlb_stats_t* memory_get_tlb_stats(void) {
+    return &tlb_stats;
 }
 
 /**
@@ -397,6 +809,22 @@ uint32_t get_physical_address(uint32_t virtual_addr) {
     return (table->pages[pt_index] & PAGE_ALIGN_MASK) + offset;
 }
 
+/**
+ * @brief Page table entry for a virtual address
+ * @return Pointer to the entry, or NULL if no page table covers it
+ *
+ * For code that keeps its own state in non-present entries (swap.c).
+ * Changing a present entry through this needs a tlb_flush_range().
+ */
+uint32_t* page_table_entry(uint32_t virtual_addr) {
+    uint32_t pd_index = virtual_addr >> 22;
+    
+    if (!(kernel_directory->tables[pd_index] & PAGE_PRESENT)) {
+        return NULL;
+    }
+    return &kernel_tables[pd_index]->pages[(virtual_addr >> 12) & 0x3FF];
+}
+
 /**
  * @brief Check if a page is present
  * @param virtual_addr Virtual address to check
@@ -406,15 +834,100 @@ bool is_page_present(uint32_t virtual_addr) {
     return get_physical_address(virtual_addr) != 0;
 }
 
+/*------------------------------------------------------------------------------
+ * Device window
+ *------------------------------------------------------------------------------
+ * Device registers and DMA memory can live anywhere in physical memory, so
+ * they are mapped into a dedicated kernel window rather than relying on the
+ * low identity map. The window is only ever grown; drivers map their
+ * resources once at initialization.
+ *------------------------------------------------------------------------------
+ */
+
+/* Next free virtual address in the device window */
+static uint32_t device_window_next = DEVICE_WINDOW_START;
+
+/* Reserve window space and map [physical_addr, +size) there */
+static void* device_window_map(uint32_t physical_addr, uint32_t size, uint32_t flags) {
+    uint32_t offset = physical_addr & PAGE_OFFSET_MASK;
+    uint32_t span = align_up(size + offset, PAGE_SIZE);
+    
+    if (size == 0 || span > DEVICE_WINDOW_START + DEVICE_WINDOW_SIZE - device_window_next) {
+        return NULL;
+    }
+    
+    uint32_t virt = device_window_next;
+    uint32_t phys = physical_addr & PAGE_ALIGN_MASK;
+    if (!map_range(virt, phys, span / PAGE_SIZE, flags)) {
+        return NULL; /* Out of memory for page tables */
+    }
+    
+    device_window_next += span;
+    return (void*)(virt + offset);
+}
+
+/**
+ * @brief Map device registers (MMIO) uncached
+ * @param physical_addr Physical address of the register block
+ * @param size Size of the register block in bytes
+ * @return Virtual address of the registers, or NULL on failure
+ */
+void* map_device_memory(uint32_t physical_addr, uint32_t size) {
+    return device_window_map(physical_addr, size,
+                             PAGE_PRESENT | PAGE_WRITABLE | PAGE_NOCACHE | PAGE_WRITETHROUGH);
+}
+
+/**
+ * @brief Allocate zeroed, physically contiguous memory a device can DMA to
+ * @param size Size in bytes (rounded up to whole pages)
+ * @param physical_addr Receives the bus address of the buffer
+ * @return Virtual address of the buffer, or NULL on failure
+ *
+ * Buffers come from ZONE_DMA, which any bus master can reach.
+ */
+void* dma_alloc(uint32_t size, uint32_t* physical_addr) {
+    uint32_t pages = align_up(size, PAGE_SIZE) / PAGE_SIZE;
+    uint32_t phys = allocate_physical_pages_flags(pages, ALLOC_DMA);
+    if (!phys) {
+        return NULL;
+    }
+    
+    uint8_t* virt = (uint8_t*)device_window_map(phys, pages * PAGE_SIZE, PAGE_PRESENT | PAGE_WRITABLE);
+    if (!virt) {
+        free_physical_pages(phys, pages);
+        return NULL;
+    }
+    
+    for (uint32_t i = 0; i < pages * PAGE_SIZE; i++) {
+        virt[i] = 0;
+    }
+    
+    *physical_addr = phys;
+    return virt;
+}
+
 /**
  * @brief Handle page faults
- * @param error_code Error code from page fault interrupt
+ * @param regs Interrupt frame; EIP is rewritten when a fixup applies
  */
-void page_fault_handler(uint32_t error_code) {
+void page_fault_handler(interrupt_registers_t* regs) {
+    uint32_t error_code = regs->err_code;
+
     /* Get faulting address from CR2 */
     uint32_t fault_addr;
     asm volatile("mov %%cr2, %0" : "=r"(fault_addr));
     
+    /* Anonymous memory: zero-filled on first touch or read back from swap */
+    if (!(error_code & 0x1) && swap_handle_fault(fault_addr)) {
+        return;
+    }
+    
+    /* A kernel access to a user buffer that has a fixup (copy_from_user
+     * and friends) resumes there and reports the short copy */
+    if (!(error_code & 0x4) && fixup_exception(regs)) {
+        return;
+    }
+    
     terminal_setcolor(vga_entry_color(VGA_COLOR_RED, VGA_COLOR_BLACK));
     terminal_writestring("PAGE FAULT! Error code: ");
     
@@ -589,10 +1102,79 @@ void memory_print_map(void) {
 /* Global heap information */
 static heap_info_t heap;
 
+_Static_assert(sizeof(heap_block_t) == HEAP_ALIGN, "heap header must keep data aligned");
+
+/* Smallest block worth splitting off: a header plus one aligned unit */
+#define HEAP_MIN_BLOCK      (sizeof(heap_block_t) + HEAP_ALIGN)
+
+/* Release the backing pages of [virt, +npages) and unmap them in one go */
+static void heap_unmap_pages(uint32_t virt, uint32_t npages) {
+    for (uint32_t i = 0; i < npages; i++) {
+        uint32_t phys_addr = get_physical_address(virt + i * PAGE_SIZE);
+        if (phys_addr) {
+            free_physical_page(phys_addr);
+        }
+    }
+    unmap_range(virt, npages);
+}
+
+/**
+ * @brief Back [virt, +npages) of the heap with fresh physical pages
+ * @param zeroed Set to whether the new pages are known to be zero
+ * @return true on success; on failure nothing stays mapped
+ *
+ * Small growths are served from the zeroed page pool when it can cover
+ * them. Otherwise a physically contiguous run is mapped with one
+ * map_range(), and if memory is too fragmented the pages are gathered one
+ * at a time instead. The heap range was unmapped before, so no path
+ * flushes the TLB.
+ */
+static bool heap_map_pages(uint32_t virt, uint32_t npages, bool* zeroed) {
+    *zeroed = false;
+    if (zero_stats.available >= npages) {
+        for (uint32_t i = 0; i < npages; i++) {
+            uint32_t phys_page = allocate_zeroed_page(ALLOC_HIGH);
+            if (!phys_page ||
+                !map_range(virt + i * PAGE_SIZE, phys_page, 1, PAGE_PRESENT | PAGE_WRITABLE)) {
+                if (phys_page) {
+                    free_physical_page(phys_page);
+                }
+                heap_unmap_pages(virt, i);
+                return false;
+            }
+        }
+        *zeroed = true;
+        return true;
+    }
+    
+    uint32_t phys = allocate_physical_pages(npages);
+    if (phys) {
+        if (map_range(virt, phys, npages, PAGE_PRESENT | PAGE_WRITABLE)) {
+            return true;
+        }
+        unmap_range(virt, npages);
+        free_physical_pages(phys, npages);
+        return false;
+    }
+    
+    for (uint32_t i = 0; i < npages; i++) {
+        uint32_t phys_page = allocate_physical_page();
+        if (!phys_page ||
+            !map_range(virt + i * PAGE_SIZE, phys_page, 1, PAGE_PRESENT | PAGE_WRITABLE)) {
+            if (phys_page) {
+                free_physical_page(phys_page);
+            }
+            heap_unmap_pages(virt, i);
+            return false;
+        }
+    }
+    return true;
+}
+
 /**
  * @brief Initialize the kernel heap allocator
  */
-void heap_init(void) {
+void __init heap_init(void) {
     /* Clear heap structure */
     heap.start_addr = HEAP_START_ADDR;
     heap.end_addr = HEAP_START_ADDR;
@@ -601,17 +1183,11 @@ void heap_init(void) {
     heap.initialized = false;
     
     /* Allocate initial heap pages */
-    uint32_t initial_pages = HEAP_INITIAL_SIZE / PAGE_SIZE;
-    for (uint32_t i = 0; i < initial_pages; i++) {
-        uint32_t phys_page = allocate_physical_page();
-        if (!phys_page) {
-            terminal_setcolor(vga_entry_color(VGA_COLOR_RED, VGA_COLOR_BLACK));
-            terminal_writestring("ERROR: Cannot allocate initial heap pages!\n");
-            return;
-        }
-        
-        uint32_t virt_addr = heap.start_addr + (i * PAGE_SIZE);
-        map_page(virt_addr, phys_page, PAGE_PRESENT | PAGE_WRITABLE);
+    bool zeroed;
+    if (!heap_map_pages(heap.start_addr, HEAP_INITIAL_SIZE / PAGE_SIZE, &zeroed)) {
+        terminal_setcolor(vga_entry_color(VGA_COLOR_RED, VGA_COLOR_BLACK));
+        terminal_writestring("ERROR: Cannot allocate initial heap pages!\n");
+        return;
     }
     
     heap.end_addr = heap.start_addr + HEAP_INITIAL_SIZE;
@@ -622,6 +1198,7 @@ void heap_init(void) {
     heap.first_block->magic = HEAP_BLOCK_MAGIC;
     heap.first_block->size = HEAP_INITIAL_SIZE;
     heap.first_block->is_free = true;
+    heap.first_block->is_zero = zeroed;
     heap.first_block->next = NULL;
     heap.first_block->prev = NULL;
     
@@ -648,21 +1225,9 @@ static bool heap_expand(size_t min_increase) {
     }
     
     /* Allocate physical pages and map them */
-    for (size_t i = 0; i < pages_needed; i++) {
-        uint32_t phys_page = allocate_physical_page();
-        if (!phys_page) {
-            /* Free any pages we already allocated */
-            for (size_t j = 0; j < i; j++) {
-                uint32_t virt_addr = heap.end_addr + (j * PAGE_SIZE);
-                uint32_t phys_addr = get_physical_address(virt_addr);
-                unmap_page(virt_addr);
-                free_physical_page(phys_addr);
-            }
-            return false;
-        }
-        
-        uint32_t virt_addr = heap.end_addr + (i * PAGE_SIZE);
-        map_page(virt_addr, phys_page, PAGE_PRESENT | PAGE_WRITABLE);
+    bool zeroed;
+    if (!heap_map_pages(heap.end_addr, pages_needed, &zeroed)) {
+        return false;
     }
     
     /* Find the last block and extend it or create a new one */
@@ -674,12 +1239,14 @@ static bool heap_expand(size_t min_increase) {
     if (last_block && last_block->is_free) {
         /* Extend the last free block */
         last_block->size += increase;
+        last_block->is_zero = last_block->is_zero && zeroed;
     } else {
         /* Create a new free block at the end */
         heap_block_t* new_block = (heap_block_t*)heap.end_addr;
         new_block->magic = HEAP_BLOCK_MAGIC;
         new_block->size = increase;
         new_block->is_free = true;
+        new_block->is_zero = zeroed;
         new_block->next = NULL;
         new_block->prev = last_block;
         
@@ -700,7 +1267,7 @@ static bool heap_expand(size_t min_increase) {
  * @param size Size needed for the first part
  */
 static void heap_split_block(heap_block_t* block, size_t size) {
-    if (!block || block->size < size + sizeof(heap_block_t) + 16) {
+    if (!block || block->size < size + HEAP_MIN_BLOCK) {
         return; /* Block too small to split */
     }
     
@@ -712,6 +1279,7 @@ static void heap_split_block(heap_block_t* block, size_t size) {
     new_block->magic = HEAP_BLOCK_MAGIC;
     new_block->size = block->size - size;
     new_block->is_free = true;
+    new_block->is_zero = block->is_zero;   /* Header sits outside both data areas */
     new_block->next = block->next;
     new_block->prev = block;
     
@@ -738,6 +1306,7 @@ static void heap_coalesce(heap_block_t* block) {
     while (block->next && block->next->is_free) {
         heap_block_t* next = block->next;
         block->size += next->size;
+        block->is_zero = false;
         block->next = next->next;
         if (next->next) {
             next->next->prev = block;
@@ -750,6 +1319,7 @@ static void heap_coalesce(heap_block_t* block) {
     if (block->prev && block->prev->is_free) {
         heap_block_t* prev = block->prev;
         prev->size += block->size;
+        prev->is_zero = false;
         prev->next = block->next;
         if (block->next) {
             block->next->prev = prev;
@@ -760,20 +1330,53 @@ static void heap_coalesce(heap_block_t* block) {
 }
 
 /**
- * @brief Allocate memory from the kernel heap
+ * @brief Split the first 'offset' bytes of a free block off as a free block
+ * @param block Free block to split
+ * @param offset Bytes to leave in front (multiple of HEAP_ALIGN, >= HEAP_MIN_BLOCK)
+ * @return The block starting at block + offset
+ */
+static heap_block_t* heap_split_front(heap_block_t* block, size_t offset) {
+    heap_block_t* rest = (heap_block_t*)((uint32_t)block + offset);
+
+    rest->magic = HEAP_BLOCK_MAGIC;
+    rest->size = block->size - offset;
+    rest->is_free = true;
+    rest->is_zero = block->is_zero;
+    rest->next = block->next;
+    rest->prev = block;
+
+    if (block->next) {
+        block->next->prev = rest;
+    }
+    block->next = rest;
+    block->size = offset;
+    return rest;
+}
+
+/**
+ * @brief Allocate aligned memory from the kernel heap
  * @param size Number of bytes to allocate
+ * @param align Alignment of the returned pointer (power of two; raised to HEAP_ALIGN)
+ * @param zeroed Set to whether the memory is known to be zero
  * @return Pointer to allocated memory, or NULL if allocation failed
+ *
+ * A block whose data area is not already aligned has its leading bytes
+ * split off as a separate free block, so large alignments only cost the
+ * padding until something else reuses it.
  */
-void* kmalloc(size_t size) {
-    if (!heap.initialized || size == 0) {
+static void* heap_alloc(size_t size, size_t align, bool* zeroed) {
+    if (!heap.initialized || size == 0 || (align & (align - 1)) != 0) {
         return NULL;
     }
+    if (align < HEAP_ALIGN) {
+        align = HEAP_ALIGN;
+    }
     
-    /* Align size to 4-byte boundary and add header size */
-    size = (size + 3) & ~3;
+    /* Round size to the heap granule and add header size */
+    size = (size + HEAP_ALIGN - 1) & ~(HEAP_ALIGN - 1);
     size_t total_size = size + sizeof(heap_block_t);
     
-    /* Find a suitable free block */
+    /* Find a free block with an aligned data address that fits */
     heap_block_t* current = heap.first_block;
     while (current) {
         if (current->magic != HEAP_BLOCK_MAGIC) {
@@ -784,23 +1387,76 @@ void* kmalloc(size_t size) {
         }
         
         if (current->is_free && current->size >= total_size) {
-            /* Found a suitable block */
-            heap_split_block(current, total_size);
-            current->is_free = false;
+            uint32_t base = (uint32_t)current;
+            uint32_t data = align_up(base + sizeof(heap_block_t), align);
             
-            /* Return pointer to data area (after header) */
-            return (void*)((uint32_t)current + sizeof(heap_block_t));
+            /* Padding in front must be zero or big enough to stand alone */
+            while (data - sizeof(heap_block_t) != base &&
+                   data - sizeof(heap_block_t) - base < HEAP_MIN_BLOCK) {
+                data += align;
+            }
+            
+            uint32_t pad = data - sizeof(heap_block_t) - base;
+            if (pad + total_size <= current->size) {
+                if (pad) {
+                    current = heap_split_front(current, pad);
+                }
+                heap_split_block(current, total_size);
+                current->is_free = false;
+                *zeroed = current->is_zero;
+                current->is_zero = false;
+                
+                /* Return pointer to data area (after header) */
+                return (void*)data;
+            }
         }
         current = current->next;
     }
     
-    /* No suitable block found, try to expand heap */
-    if (!heap_expand(total_size)) {
+    /* No suitable block found, try to expand heap (with room to align) */
+    if (!heap_expand(total_size + align)) {
         return NULL; /* Out of memory */
     }
     
     /* Try allocation again after expansion */
-    return kmalloc(size);
+    return heap_alloc(size, align, zeroed);
+}
+
+/**
+ * @brief Allocate aligned memory from the kernel heap
+ * @param size Number of bytes to allocate
+ * @param align Alignment of the returned pointer (power of two; raised to HEAP_ALIGN)
+ * @return Pointer to allocated memory, or NULL if allocation failed
+ */
+void* kmalloc_aligned(size_t size, size_t align) {
+    bool zeroed;
+    return heap_alloc(size, align, &zeroed);
+}
+
+/* Default alignment: a cache line for large objects */
+static size_t heap_default_align(size_t size) {
+    return size >= HEAP_LARGE_OBJECT ? HEAP_CACHELINE : HEAP_ALIGN;
+}
+
+/**
+ * @brief Allocate memory from the kernel heap
+ * @param size Number of bytes to allocate
+ * @return Pointer to allocated memory, or NULL if allocation failed
+ *
+ * Small objects are HEAP_ALIGN aligned; objects of HEAP_LARGE_OBJECT bytes
+ * or more start on a cache line.
+ */
+void* kmalloc(size_t size) {
+    return kmalloc_aligned(size, heap_default_align(size));
+}
+
+/**
+ * @brief Allocate page-aligned memory from the kernel heap
+ * @param size Number of bytes to allocate
+ * @return Page-aligned pointer, or NULL if allocation failed
+ */
+void* kmalloc_page_aligned(size_t size) {
+    return kmalloc_aligned(size, PAGE_SIZE);
 }
 
 /**
@@ -810,15 +1466,17 @@ void* kmalloc(size_t size) {
  * @return Pointer to allocated and zeroed memory, or NULL if allocation failed
  */
 void* kcalloc(size_t count, size_t size) {
+    if (size != 0 && count > (size_t)-1 / size) {
+        return NULL; /* Overflow */
+    }
+    
     size_t total_size = count * size;
-    void* ptr = kmalloc(total_size);
+    bool zeroed;
+    void* ptr = heap_alloc(total_size, heap_default_align(total_size), &zeroed);
     
-    if (ptr) {
-        /* Zero the memory */
-        uint8_t* bytes = (uint8_t*)ptr;
-        for (size_t i = 0; i < total_size; i++) {
-            bytes[i] = 0;
-        }
+    /* Memory carved from pre-zeroed heap pages needs no clearing */
+    if (ptr && !zeroed) {
+        memset(ptr, 0, total_size);
     }
     
     return ptr;
@@ -851,6 +1509,7 @@ void kfree(void* ptr) {
     
     /* Mark block as free */
     block->is_free = true;
+    block->is_zero = false;
     
     /* Coalesce with adjacent free blocks */
     heap_coalesce(block);
@@ -879,7 +1538,7 @@ void* krealloc(void* ptr, size_t size) {
     }
     
     size_t current_data_size = block->size - sizeof(heap_block_t);
-    size_t aligned_size = (size + 3) & ~3;
+    size_t aligned_size = (size + HEAP_ALIGN - 1) & ~(HEAP_ALIGN - 1);
     
     /* If new size fits in current block, just return same pointer */
     if (aligned_size <= current_data_size) {
@@ -923,6 +1582,20 @@ size_t heap_get_allocated_size(void* ptr) {
     return block->size - sizeof(heap_block_t);
 }
 
+/**
+ * @brief Get the heap's current size and the bytes in allocated blocks
+ */
+void heap_get_usage(uint32_t* size, uint32_t* used) {
+    *size = heap.initialized ? heap.size : 0;
+    *used = 0;
+    
+    for (heap_block_t* block = heap.first_block; heap.initialized && block; block = block->next) {
+        if (!block->is_free) {
+            *used += block->size;
+        }
+    }
+}
+
 /**
  * @brief Print heap statistics for debugging
  */
@@ -1056,8 +1729,9 @@ void heap_validate(void) {
             return;
         }
         
-        /* Check size alignment */
-        if (current->size < sizeof(heap_block_t) || (current->size % 4) != 0) {
+        /* Check size and header alignment */
+        if (current->size < sizeof(heap_block_t) || (current->size % HEAP_ALIGN) != 0 ||
+            ((uint32_t)current % HEAP_ALIGN) != 0) {
             terminal_setcolor(vga_entry_color(VGA_COLOR_RED, VGA_COLOR_BLACK));
             terminal_writestring("HEAP VALIDATION FAILED: Invalid block size\n");
             terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
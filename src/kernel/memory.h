@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include "cache.h"
 
 /* Memory layout constants */
 #define PAGE_SIZE        4096        /* Standard page size: 4 KiB */
@@ -57,14 +58,65 @@ typedef struct multiboot_info {
     /* ... other fields not needed for basic memory management */
 } __attribute__((packed)) multiboot_info_t;
 
+/* Multiboot info flags */
+#define MULTIBOOT_INFO_MODS      0x08   /* mods_count/mods_addr are valid */
+#define MULTIBOOT_INFO_MEM_MAP   0x40   /* mmap_length/mmap_addr are valid */
+
+/* Multiboot module descriptor (mods_addr points to an array of these) */
+typedef struct multiboot_module {
+    uint32_t mod_start;             /* Physical start of module */
+    uint32_t mod_end;               /* Physical end (exclusive) */
+    uint32_t string;                /* Command line string */
+    uint32_t reserved;
+} __attribute__((packed)) multiboot_module_t;
+
+/* End of the boot-time identity map set up by paging_init() */
+#define IDENTITY_MAP_END  0x400000
+
+/* Kernel virtual window for device MMIO and DMA buffers */
+#define DEVICE_WINDOW_START 0xE0000000
+#define DEVICE_WINDOW_SIZE  0x10000000  /* 256MB */
+
+/* Kernel virtual window for buffer cache pages (see bcache.c) */
+#define BCACHE_WINDOW_START 0xD0000000
+
+/* Kernel virtual window for swappable anonymous memory (see swap.c) */
+#define ANON_WINDOW_START   0xD1000000
+#define ANON_WINDOW_END     0xDF000000
+
 /* Physical memory allocator */
 typedef struct {
     uint32_t *bitmap;           /* Bitmap of free/used pages */
     uint32_t total_pages;       /* Total number of pages */
     uint32_t used_pages;        /* Number of used pages */
-    uint32_t first_free_page;   /* Hint for first potentially free page */
 } physical_allocator_t;
 
+/* Physical memory zones */
+#define ZONE_DMA            0   /* Below 16MB: reachable by ISA/legacy DMA */
+#define ZONE_NORMAL         1   /* 16MB - 896MB */
+#define ZONE_HIGH           2   /* Above 896MB */
+#define ZONE_COUNT          3
+
+#define ZONE_DMA_END        0x1000000
+#define ZONE_NORMAL_END     0x38000000
+
+typedef struct {
+    const char* name;
+    uint32_t start_page;        /* First frame in the zone */
+    uint32_t end_page;          /* One past the last frame */
+    uint32_t free_pages;        /* Free frames in the zone */
+    uint32_t first_free_page;   /* Hint for first potentially free frame */
+    uint32_t fallbacks;         /* Allocations served here because a higher zone was full */
+} memory_zone_t;
+
+/* Zone-aware allocation flags. The zone bits name the highest zone an
+ * allocation may use; when it is full the allocation falls back to the
+ * zones below it in order, never to a higher one. */
+#define ALLOC_HIGH          0x0 /* Any zone, highest first (default) */
+#define ALLOC_NORMAL        0x1 /* ZONE_NORMAL, then ZONE_DMA */
+#define ALLOC_DMA           0x2 /* ZONE_DMA only */
+#define ALLOC_DIRECT        0x4 /* Below IDENTITY_MAP_END, usable without a mapping */
+
 /* Page directory and page table structures */
 typedef struct {
     uint32_t pages[1024];
@@ -81,6 +133,10 @@ void memory_init(multiboot_info_t* mboot_info);
 void physical_memory_init(multiboot_info_t* mboot_info);
 uint32_t allocate_physical_page(void);
 void free_physical_page(uint32_t page_addr);
+uint32_t allocate_physical_pages(uint32_t count);
+uint32_t allocate_physical_pages_flags(uint32_t count, uint32_t flags);
+void free_physical_pages(uint32_t page_addr, uint32_t count);
+const memory_zone_t* memory_get_zone(uint32_t zone);
 uint32_t get_total_memory(void);
 uint32_t get_used_memory(void);
 uint32_t get_free_memory(void);
@@ -89,11 +145,49 @@ uint32_t get_free_memory(void);
 void paging_init(void);
 void map_page(uint32_t virtual_addr, uint32_t physical_addr, uint32_t flags);
 void unmap_page(uint32_t virtual_addr);
+bool map_range(uint32_t virtual_addr, uint32_t physical_addr, uint32_t npages, uint32_t flags);
+void unmap_range(uint32_t virtual_addr, uint32_t npages);
 uint32_t get_physical_address(uint32_t virtual_addr);
 bool is_page_present(uint32_t virtual_addr);
+uint32_t* page_table_entry(uint32_t virtual_addr);
+void tlb_flush_range(uint32_t virtual_addr, uint32_t npages);
+
+/* TLB invalidation counters for map_range()/unmap_range() */
+typedef struct {
+    uint32_t ranges;            /* Range updates */
+    uint32_t page_flushes;      /* Single-page invlpg */
+    uint32_t full_flushes;      /* CR3 reloads */
+} tlb_stats_t;
+
+const tlb_stats_t* memory_get_tlb_stats(void);
+
+/* Return the boot-only sections (see init.h) to the physical allocator */
+void free_initmem(void);
+uint32_t memory_get_init_freed(void);
+
+/* Pre-zeroed page frames, refilled while the CPU is idle */
+#define ZERO_POOL_SIZE      64          /* Frames kept ready */
+#define ZERO_POOL_BATCH     4           /* Frames zeroed per idle pass */
+#define ZERO_MAP_SLOT       0xDFFFF000  /* Scratch mapping for zeroing high frames */
+
+typedef struct {
+    uint32_t available;         /* Frames currently in the pool */
+    uint32_t hits;              /* Zeroed frames served from the pool */
+    uint32_t misses;            /* Pool empty: zeroed on the allocation path */
+    uint32_t zeroed;            /* Frames zeroed in the background */
+} zero_pool_stats_t;
+
+uint32_t allocate_zeroed_page(uint32_t flags);
+void memory_idle_work(void);
+const zero_pool_stats_t* memory_get_zero_pool_stats(void);
+
+/* Device memory (mapped into the device window) */
+void* map_device_memory(uint32_t physical_addr, uint32_t size);
+void* dma_alloc(uint32_t size, uint32_t* physical_addr);
 
-/* Page fault handler */
-void page_fault_handler(uint32_t error_code);
+/* Page fault handler (regs is the interrupt frame, see idt.h) */
+struct interrupt_registers;
+void page_fault_handler(struct interrupt_registers* regs);
 
 /* Utility functions */
 uint32_t align_up(uint32_t addr, uint32_t alignment);
@@ -110,15 +204,20 @@ void memory_print_map(void);
 #define HEAP_INITIAL_SIZE   0x100000    /* Initial heap size: 1MB */
 #define HEAP_MAX_SIZE       0x1000000   /* Maximum heap size: 16MB */
 #define HEAP_BLOCK_MAGIC    0xDEADBEEF  /* Magic number for heap blocks */
+#define HEAP_ALIGN          16          /* Minimum alignment of every allocation */
+#define HEAP_CACHELINE      CACHE_LINE_SIZE /* Default alignment for large objects */
+#define HEAP_LARGE_OBJECT   256         /* Sizes from here up get HEAP_CACHELINE */
 
-/* Heap block structure */
+/* Heap block structure. Exactly HEAP_ALIGN bytes, so with block sizes kept
+ * to multiples of HEAP_ALIGN every data pointer is HEAP_ALIGN aligned. */
 typedef struct heap_block {
     uint32_t magic;                 /* Magic number for validation */
-    uint32_t size;                  /* Size of this block (including header) */
-    bool is_free;                   /* Whether this block is free */
+    uint32_t size : 30;             /* Size of this block (including header) */
+    uint32_t is_free : 1;           /* Whether this block is free */
+    uint32_t is_zero : 1;           /* Free block whose data is known to be zero */
     struct heap_block* next;        /* Next block in the list */
     struct heap_block* prev;        /* Previous block in the list */
-} __attribute__((packed)) heap_block_t;
+} heap_block_t;
 
 /* Heap allocator structure */
 typedef struct {
@@ -132,10 +231,13 @@ typedef struct {
 /* Heap allocator functions */
 void heap_init(void);
 void* kmalloc(size_t size);
+void* kmalloc_aligned(size_t size, size_t align);
+void* kmalloc_page_aligned(size_t size);
 void* kcalloc(size_t count, size_t size);
 void* krealloc(void* ptr, size_t size);
 void kfree(void* ptr);
 size_t heap_get_allocated_size(void* ptr);
+void heap_get_usage(uint32_t* size, uint32_t* used);
 void heap_print_stats(void);
 void heap_validate(void);
 
@@ -0,0 +1,797 @@
+/*------------------------------------------------------------------------------
+ * IPv4 Network Stack
+ *------------------------------------------------------------------------------
+ * This file implements the interfaces, Ethernet framing, ARP, IPv4, ICMP
+ * echo and UDP sockets described in net.h.
+ *------------------------------------------------------------------------------
+ */
+
+#include "net.h"
+#include "init.h"
+#include "netbuf.h"
+#include "kernel.h"
+#include "string.h"
+#include "debug.h"
+#include "../drivers/e1000.h"
+#include "../drivers/timer.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Interfaces */
+#define NET_MAX_DEVICES 2
+
+static net_device_t loopback_dev;
+static net_device_t eth0_dev;
+static net_device_t* devices[NET_MAX_DEVICES];
+static uint32_t num_devices = 0;
+static netbuf_queue_t loopback_queue;
+
+/* Protocol state */
+static net_stats_t stats;
+static uint16_t ip_next_id = 1;
+static udp_socket_t udp_sockets[UDP_MAX_SOCKETS];
+static uint16_t udp_next_ephemeral = UDP_EPHEMERAL_BASE;
+static icmp_echo_handler_t echo_handler = NULL;
+
+static const uint8_t eth_broadcast[ETH_ALEN] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+/* ARP cache */
+#define ARP_CACHE_SIZE  16
+#define ARP_RETRY_MS    1000
+
+#define ARP_FREE        0
+#define ARP_PENDING     1
+#define ARP_RESOLVED    2
+
+#define ARP_REQUEST     1
+#define ARP_REPLY       2
+
+typedef struct {
+    uint32_t ip;
+    uint8_t  mac[ETH_ALEN];
+    uint8_t  state;
+    net_device_t* dev;
+    netbuf_t* pending;              /* Latest packet waiting for resolution */
+    uint64_t requested_ms;          /* When the last request went out */
+    uint32_t last_used;             /* LRU stamp */
+} arp_entry_t;
+
+static arp_entry_t arp_cache[ARP_CACHE_SIZE];
+static uint32_t arp_clock = 0;
+
+static void ip_input(net_device_t* dev, netbuf_t* nb);
+
+/*------------------------------------------------------------------------------
+ * Ethernet
+ *------------------------------------------------------------------------------
+ */
+
+/* Prepend the Ethernet header and hand the frame to the device */
+static bool eth_output(net_device_t* dev, netbuf_t* nb, const uint8_t* dst_mac, uint16_t type) {
+    eth_hdr_t* eth = (eth_hdr_t*)netbuf_push(nb, ETH_HLEN);
+    if (!eth) {
+        dev->tx_dropped++;
+        netbuf_put(nb);
+        return false;
+    }
+
+    memcpy(eth->dst, dst_mac, ETH_ALEN);
+    memcpy(eth->src, dev->mac, ETH_ALEN);
+    eth->type = htons(type);
+
+    dev->tx_packets++;
+    return dev->xmit(dev, nb);
+}
+
+/*------------------------------------------------------------------------------
+ * ARP
+ *------------------------------------------------------------------------------
+ */
+
+static arp_entry_t* arp_lookup(uint32_t ip) {
+    for (int i = 0; i < ARP_CACHE_SIZE; i++) {
+        if (arp_cache[i].state != ARP_FREE && arp_cache[i].ip == ip) {
+            return &arp_cache[i];
+        }
+    }
+    return NULL;
+}
+
+/* Take a free entry, or evict the least recently used resolved one */
+static arp_entry_t* arp_alloc(uint32_t ip, net_device_t* dev) {
+    arp_entry_t* victim = NULL;
+
+    for (int i = 0; i < ARP_CACHE_SIZE; i++) {
+        arp_entry_t* e = &arp_cache[i];
+        if (e->state == ARP_FREE) {
+            victim = e;
+            break;
+        }
+        if (e->state == ARP_RESOLVED && (!victim || e->last_used < victim->last_used)) {
+            victim = e;
+        }
+    }
+
+    if (!victim) {
+        return NULL;
+    }
+
+    if (victim->pending) {
+        netbuf_put(victim->pending);
+    }
+    memset(victim, 0, sizeof(arp_entry_t));
+    victim->ip = ip;
+    victim->dev = dev;
+    victim->state = ARP_PENDING;
+    victim->last_used = ++arp_clock;
+    return victim;
+}
+
+static void arp_send(net_device_t* dev, uint16_t oper, const uint8_t* target_mac, uint32_t target_ip) {
+    netbuf_t* nb = netbuf_alloc(NET_HEADROOM);
+    if (!nb) {
+        return;
+    }
+
+    arp_pkt_t* arp = (arp_pkt_t*)netbuf_extend(nb, sizeof(arp_pkt_t));
+    arp->htype = htons(1);
+    arp->ptype = htons(ETH_P_IP);
+    arp->hlen = ETH_ALEN;
+    arp->plen = 4;
+    arp->oper = htons(oper);
+    memcpy(arp->sha, dev->mac, ETH_ALEN);
+    arp->spa = dev->ip;
+    memcpy(arp->tha, target_mac, ETH_ALEN);
+    arp->tpa = target_ip;
+
+    stats.arp_tx++;
+    eth_output(dev, nb, oper == ARP_REQUEST ? eth_broadcast : target_mac, ETH_P_ARP);
+}
+
+/* Record a mapping and release any packet that was waiting for it */
+static void arp_update(net_device_t* dev, uint32_t ip, const uint8_t* mac, bool create) {
+    arp_entry_t* e = arp_lookup(ip);
+    if (!e) {
+        if (!create || !(e = arp_alloc(ip, dev))) {
+            return;
+        }
+    }
+
+    memcpy(e->mac, mac, ETH_ALEN);
+    e->state = ARP_RESOLVED;
+    e->dev = dev;
+    e->last_used = ++arp_clock;
+
+    if (e->pending) {
+        netbuf_t* nb = e->pending;
+        e->pending = NULL;
+        eth_output(dev, nb, e->mac, ETH_P_IP);
+    }
+}
+
+static void arp_input(net_device_t* dev, netbuf_t* nb) {
+    if (nb->len < sizeof(arp_pkt_t)) {
+        return;
+    }
+
+    arp_pkt_t* arp = (arp_pkt_t*)nb->data;
+    if (ntohs(arp->htype) != 1 || ntohs(arp->ptype) != ETH_P_IP ||
+        arp->hlen != ETH_ALEN || arp->plen != 4) {
+        return;
+    }
+    stats.arp_rx++;
+
+    bool for_us = (arp->tpa == dev->ip);
+    arp_update(dev, arp->spa, arp->sha, for_us);
+
+    if (for_us && ntohs(arp->oper) == ARP_REQUEST) {
+        arp_send(dev, ARP_REPLY, arp->sha, arp->spa);
+    }
+}
+
+/* Send an IP packet to next_hop, resolving its MAC address first */
+static bool neigh_output(net_device_t* dev, uint32_t next_hop, netbuf_t* nb) {
+    if (dev->flags & NETDEV_LOOPBACK) {
+        return eth_output(dev, nb, dev->mac, ETH_P_IP);
+    }
+
+    if (next_hop == NET_IP_BROADCAST || next_hop == (dev->ip | ~dev->netmask)) {
+        return eth_output(dev, nb, eth_broadcast, ETH_P_IP);
+    }
+
+    arp_entry_t* e = arp_lookup(next_hop);
+    if (e && e->state == ARP_RESOLVED) {
+        e->last_used = ++arp_clock;
+        return eth_output(dev, nb, e->mac, ETH_P_IP);
+    }
+
+    if (!e && !(e = arp_alloc(next_hop, dev))) {
+        dev->tx_dropped++;
+        netbuf_put(nb);
+        return false;
+    }
+
+    /* Hold only the newest packet while resolution is in progress */
+    if (e->pending) {
+        netbuf_put(e->pending);
+        dev->tx_dropped++;
+    }
+    e->pending = nb;
+
+    uint64_t now = timer_get_uptime_ms();
+    if (e->requested_ms == 0 || now - e->requested_ms >= ARP_RETRY_MS) {
+        e->requested_ms = now ? now : 1;
+        arp_send(dev, ARP_REQUEST, eth_broadcast, next_hop);
+    }
+    return true;
+}
+
+/*------------------------------------------------------------------------------
+ * IPv4
+ *------------------------------------------------------------------------------
+ */
+
+static inline bool ip_is_loopback(uint32_t ip) {
+    return (ip & 0xFF) == 127;
+}
+
+/* Pick the interface and next hop for dst */
+static net_device_t* ip_route(uint32_t dst, uint32_t* next_hop) {
+    *next_hop = dst;
+
+    if (ip_is_loopback(dst)) {
+        return &loopback_dev;
+    }
+
+    for (uint32_t i = 0; i < num_devices; i++) {
+        net_device_t* dev = devices[i];
+        if (!(dev->flags & NETDEV_UP) || (dev->flags & NETDEV_LOOPBACK)) {
+            continue;
+        }
+        if (dst == dev->ip) {
+            return &loopback_dev;  /* Our own address never goes on the wire */
+        }
+        if (dst == NET_IP_BROADCAST || (dst & dev->netmask) == (dev->ip & dev->netmask)) {
+            return dev;
+        }
+        if (dev->gateway) {
+            *next_hop = dev->gateway;
+            return dev;
+        }
+    }
+
+    return NULL;
+}
+
+/* Source address used for packets to dst (0 if unroutable) */
+static uint32_t ip_source(uint32_t dst) {
+    uint32_t next_hop;
+    net_device_t* dev = ip_route(dst, &next_hop);
+    if (!dev) {
+        return 0;
+    }
+    return (dev == &loopback_dev) ? (ip_is_loopback(dst) ? NET_IP_LOOPBACK : dst) : dev->ip;
+}
+
+/* Prepend the IPv4 header and route the packet */
+bool ip_output(uint32_t dst_ip, uint8_t proto, netbuf_t* nb) {
+    uint32_t next_hop;
+    net_device_t* dev = ip_route(dst_ip, &next_hop);
+    if (!dev || nb->len + IP_HLEN > dev->mtu) {
+        stats.ip_no_route++;
+        netbuf_put(nb);
+        return false;
+    }
+
+    ipv4_hdr_t* ip = (ipv4_hdr_t*)netbuf_push(nb, IP_HLEN);
+    if (!ip) {
+        netbuf_put(nb);
+        return false;
+    }
+
+    ip->ver_ihl = 0x45;
+    ip->tos = 0;
+    ip->total_len = htons(nb->len);
+    ip->id = htons(ip_next_id++);
+    ip->frag_off = htons(0x4000);   /* Don't fragment */
+    ip->ttl = NET_IP_TTL;
+    ip->proto = proto;
+    ip->checksum = 0;
+    ip->src = ip_source(dst_ip);
+    ip->dst = dst_ip;
+    ip->checksum = csum_fold(csum_partial(ip, IP_HLEN, 0));
+
+    stats.ip_tx++;
+    return neigh_output(dev, next_hop, nb);
+}
+
+/* Sum of the UDP pseudo-header */
+static uint32_t ip_pseudo_sum(uint32_t src, uint32_t dst, uint8_t proto, uint16_t len) {
+    uint32_t sum = csum_add(src, dst);
+    return csum_add(sum, (uint32_t)htons(proto) + htons(len));
+}
+
+/*------------------------------------------------------------------------------
+ * ICMP
+ *------------------------------------------------------------------------------
+ */
+
+static void icmp_input(netbuf_t* nb, uint32_t src) {
+    if (nb->len < sizeof(icmp_hdr_t)) {
+        return;
+    }
+
+    icmp_hdr_t* icmp = (icmp_hdr_t*)nb->data;
+    if (!(nb->flags & NETBUF_CSUM_VALID) && csum_fold(csum_partial(icmp, nb->len, 0)) != 0) {
+        stats.ip_bad++;
+        return;
+    }
+    stats.icmp_rx++;
+
+    if (icmp->type == ICMP_ECHO_REQUEST && icmp->code == 0) {
+        /* Turn the request into the reply in place. Only the type changes,
+         * so the checksum is patched rather than recomputed. */
+        uint16_t old_word = (uint16_t)(icmp->type | (icmp->code << 8));
+        uint16_t check = icmp->checksum;
+        icmp->type = ICMP_ECHO_REPLY;
+        csum_replace16(&check, old_word, (uint16_t)(icmp->type | (icmp->code << 8)));
+        icmp->checksum = check;
+
+        stats.icmp_tx++;
+        ip_output(src, IP_PROTO_ICMP, netbuf_get(nb));
+    } else if (icmp->type == ICMP_ECHO_REPLY && echo_handler) {
+        uint16_t id = ntohs(icmp->id);
+        uint16_t seq = ntohs(icmp->seq);
+        netbuf_pull(nb, sizeof(icmp_hdr_t));
+        echo_handler(src, id, seq, nb);
+    }
+}
+
+bool icmp_send_echo(uint32_t dst_ip, uint16_t id, uint16_t seq, const void* payload, uint16_t len) {
+    netbuf_t* nb = netbuf_alloc(NET_HEADROOM);
+    if (!nb) {
+        return false;
+    }
+
+    /* Payload first, so its sum is gathered while it is copied */
+    if (len && !netbuf_append(nb, payload, len)) {
+        netbuf_put(nb);
+        return false;
+    }
+    uint32_t sum = len ? nb->csum : 0;
+
+    icmp_hdr_t* icmp = (icmp_hdr_t*)netbuf_push(nb, sizeof(icmp_hdr_t));
+    icmp->type = ICMP_ECHO_REQUEST;
+    icmp->code = 0;
+    icmp->checksum = 0;
+    icmp->id = htons(id);
+    icmp->seq = htons(seq);
+    icmp->checksum = csum_fold(csum_add(sum, csum_partial(icmp, sizeof(icmp_hdr_t), 0)));
+
+    stats.icmp_tx++;
+    return ip_output(dst_ip, IP_PROTO_ICMP, nb);
+}
+
+void icmp_set_echo_handler(icmp_echo_handler_t handler) {
+    echo_handler = handler;
+}
+
+/*------------------------------------------------------------------------------
+ * UDP
+ *------------------------------------------------------------------------------
+ */
+
+static udp_socket_t* udp_lookup(uint16_t port) {
+    for (int i = 0; i < UDP_MAX_SOCKETS; i++) {
+        if (udp_sockets[i].port == port) {
+            return &udp_sockets[i];
+        }
+    }
+    return NULL;
+}
+
+/* Bind a socket; port 0 picks an ephemeral port */
+udp_socket_t* udp_bind(uint16_t port, udp_recv_t recv, void* ctx) {
+    if (port == 0) {
+        for (int tries = 0; tries < 16384 && port == 0; tries++) {
+            uint16_t candidate = udp_next_ephemeral++;
+            if (udp_next_ephemeral == 0) {
+                udp_next_ephemeral = UDP_EPHEMERAL_BASE;
+            }
+            if (!udp_lookup(candidate)) {
+                port = candidate;
+            }
+        }
+    } else if (udp_lookup(port)) {
+        return NULL;  /* Already bound */
+    }
+
+    udp_socket_t* sock = udp_lookup(0);
+    if (!sock || port == 0) {
+        return NULL;
+    }
+
+    sock->port = port;
+    sock->recv = recv;
+    sock->ctx = ctx;
+    return sock;
+}
+
+void udp_close(udp_socket_t* sock) {
+    if (sock) {
+        sock->port = 0;
+        sock->recv = NULL;
+        sock->ctx = NULL;
+    }
+}
+
+/* Get a buffer with headroom for the UDP, IP and Ethernet headers */
+netbuf_t* udp_alloc(void) {
+    return netbuf_alloc(NET_HEADROOM);
+}
+
+/* Send nb->data as a datagram; consumes the reference */
+bool udp_sendto(udp_socket_t* sock, uint32_t dst_ip, uint16_t dst_port, netbuf_t* nb) {
+    uint32_t src_ip = ip_source(dst_ip);
+    if (!sock || nb->len > UDP_MAX_PAYLOAD || src_ip == 0) {
+        stats.ip_no_route += (src_ip == 0);
+        netbuf_put(nb);
+        return false;
+    }
+
+    /* Reuse the payload sum gathered on append (or on receive, for echoes) */
+    uint32_t payload_sum = (nb->flags & NETBUF_CSUM_PAYLOAD) ? nb->csum
+                                                            : csum_partial(nb->data, nb->len, 0);
+
+    udp_hdr_t* udp = (udp_hdr_t*)netbuf_push(nb, UDP_HLEN);
+    if (!udp) {
+        netbuf_put(nb);
+        return false;
+    }
+
+    udp->src_port = htons(sock->port);
+    udp->dst_port = htons(dst_port);
+    udp->len = htons(nb->len);
+    udp->checksum = 0;
+
+    uint32_t sum = ip_pseudo_sum(src_ip, dst_ip, IP_PROTO_UDP, nb->len);
+    sum = csum_add(sum, csum_partial(udp, UDP_HLEN, 0));
+    sum = csum_add(sum, payload_sum);
+    udp->checksum = csum_fold(sum);
+    if (udp->checksum == 0) {
+        udp->checksum = 0xFFFF;  /* 0 means "no checksum" */
+    }
+
+    stats.udp_tx++;
+    return ip_output(dst_ip, IP_PROTO_UDP, nb);
+}
+
+static void udp_input(netbuf_t* nb, uint32_t src, uint32_t dst) {
+    if (nb->len < UDP_HLEN) {
+        stats.ip_bad++;
+        return;
+    }
+
+    udp_hdr_t* udp = (udp_hdr_t*)nb->data;
+    uint16_t ulen = ntohs(udp->len);
+    if (ulen < UDP_HLEN || ulen > nb->len) {
+        stats.ip_bad++;
+        return;
+    }
+    netbuf_trim(nb, ulen);
+
+    /* Verify, keeping the payload sum for anyone who sends it on */
+    if (!(nb->flags & NETBUF_CSUM_VALID) && udp->checksum != 0) {
+        uint32_t payload_sum = csum_partial(nb->data + UDP_HLEN, ulen - UDP_HLEN, 0);
+        uint32_t sum = ip_pseudo_sum(src, dst, IP_PROTO_UDP, ulen);
+        sum = csum_add(sum, csum_partial(udp, UDP_HLEN, 0));
+        if (csum_fold(csum_add(sum, payload_sum)) != 0) {
+            stats.udp_bad_csum++;
+            return;
+        }
+        nb->csum = payload_sum;
+        nb->flags |= NETBUF_CSUM_PAYLOAD;
+    }
+    stats.udp_rx++;
+
+    udp_socket_t* sock = udp_lookup(ntohs(udp->dst_port));
+    if (!sock || !sock->recv) {
+        stats.udp_no_port++;
+        return;
+    }
+
+    uint16_t src_port = ntohs(udp->src_port);
+    netbuf_pull(nb, UDP_HLEN);
+    sock->recv(sock, nb, src, src_port);
+}
+
+/* UDP echo service (RFC 862): bounce the same buffer back */
+static void udp_echo_recv(udp_socket_t* sock, netbuf_t* nb, uint32_t src_ip, uint16_t src_port) {
+    udp_sendto(sock, src_ip, src_port, netbuf_get(nb));
+}
+
+/*------------------------------------------------------------------------------
+ * Receive path
+ *------------------------------------------------------------------------------
+ */
+
+static void ip_input(net_device_t* dev, netbuf_t* nb) {
+    if (nb->len < IP_HLEN) {
+        stats.ip_bad++;
+        return;
+    }
+
+    ipv4_hdr_t* ip = (ipv4_hdr_t*)nb->data;
+    uint16_t ihl = (ip->ver_ihl & 0x0F) * 4;
+    if ((ip->ver_ihl >> 4) != 4 || ihl < IP_HLEN || nb->len < ihl) {
+        stats.ip_bad++;
+        return;
+    }
+
+    if (!(nb->flags & NETBUF_CSUM_VALID) && csum_fold(csum_partial(ip, ihl, 0)) != 0) {
+        stats.ip_bad++;
+        return;
+    }
+
+    uint16_t total = ntohs(ip->total_len);
+    if (total < ihl || total > nb->len || (ntohs(ip->frag_off) & 0x3FFF)) {
+        stats.ip_bad++;  /* Truncated, or a fragment (not reassembled) */
+        return;
+    }
+    netbuf_trim(nb, total);  /* Drop Ethernet padding */
+
+    bool local = (dev->flags & NETDEV_LOOPBACK) || ip->dst == dev->ip ||
+                 ip->dst == NET_IP_BROADCAST || ip->dst == (dev->ip | ~dev->netmask);
+    if (!local) {
+        return;
+    }
+    stats.ip_rx++;
+
+    uint32_t src = ip->src;
+    uint32_t dst = ip->dst;
+    uint8_t proto = ip->proto;
+    netbuf_pull(nb, ihl);
+
+    if (proto == IP_PROTO_ICMP) {
+        icmp_input(nb, src);
+    } else if (proto == IP_PROTO_UDP) {
+        udp_input(nb, src, dst);
+    }
+}
+
+/* Hand a received Ethernet frame to the stack; consumes the reference */
+void net_receive(net_device_t* dev, netbuf_t* nb) {
+    nb->dev = dev;
+    dev->rx_packets++;
+
+    if (nb->len < ETH_HLEN) {
+        dev->rx_dropped++;
+        netbuf_put(nb);
+        return;
+    }
+
+    eth_hdr_t* eth = (eth_hdr_t*)nb->data;
+    uint16_t type = ntohs(eth->type);
+    netbuf_pull(nb, ETH_HLEN);
+
+    if (type == ETH_P_IP) {
+        ip_input(dev, nb);
+    } else if (type == ETH_P_ARP && !(dev->flags & NETDEV_LOOPBACK)) {
+        arp_input(dev, nb);
+    } else {
+        dev->rx_dropped++;
+    }
+
+    netbuf_put(nb);
+}
+
+/*------------------------------------------------------------------------------
+ * Devices
+ *------------------------------------------------------------------------------
+ */
+
+/* Loopback: frames go straight onto the receive queue, checksums trusted */
+static bool loopback_xmit(net_device_t* dev, netbuf_t* nb) {
+    (void)dev;
+    nb->flags |= NETBUF_CSUM_VALID;
+    netbuf_enqueue(&loopback_queue, nb);
+    return true;
+}
+
+/* eth0: zero-copy into the e1000 TX ring; the doorbell waits for flush */
+static bool eth0_xmit(net_device_t* dev, netbuf_t* nb) {
+    if (!e1000_tx_queue_netbuf(nb)) {
+        dev->tx_dropped++;
+        return false;
+    }
+    return true;
+}
+
+static void eth0_flush(net_device_t* dev) {
+    (void)dev;
+    e1000_tx_flush();
+}
+
+static void eth0_rx(netbuf_t* nb) {
+    net_receive(&eth0_dev, netbuf_get(nb));
+}
+
+/* Bring up the netbuf pool, loopback and (if present) eth0 */
+bool __init net_init(void) {
+    if (!netbuf_pool_init()) {
+        DEBUG_PRINT("NET: cannot allocate netbuf pool");
+        return false;
+    }
+
+    memset(&stats, 0, sizeof(stats));
+    memset(arp_cache, 0, sizeof(arp_cache));
+    memset(udp_sockets, 0, sizeof(udp_sockets));
+    netbuf_queue_init(&loopback_queue);
+    num_devices = 0;
+
+    memset(&loopback_dev, 0, sizeof(loopback_dev));
+    loopback_dev.name = "lo";
+    loopback_dev.flags = NETDEV_UP | NETDEV_LOOPBACK;
+    loopback_dev.mtu = NET_MTU;
+    loopback_dev.ip = NET_IP_LOOPBACK;
+    loopback_dev.netmask = NET_IP(255, 0, 0, 0);
+    loopback_dev.xmit = loopback_xmit;
+    devices[num_devices++] = &loopback_dev;
+
+    if (e1000_present()) {
+        /* QEMU user-net hands out fixed addresses */
+        memset(&eth0_dev, 0, sizeof(eth0_dev));
+        eth0_dev.name = "eth0";
+        e1000_get_mac(eth0_dev.mac);
+        eth0_dev.flags = NETDEV_UP;
+        eth0_dev.mtu = NET_MTU;
+        eth0_dev.ip = NET_IP(10, 0, 2, 15);
+        eth0_dev.netmask = NET_IP(255, 255, 255, 0);
+        eth0_dev.gateway = NET_IP(10, 0, 2, 2);
+        eth0_dev.xmit = eth0_xmit;
+        eth0_dev.flush = eth0_flush;
+        devices[num_devices++] = &eth0_dev;
+        e1000_set_rx_handler(eth0_rx);
+    }
+
+    udp_bind(UDP_ECHO_PORT, udp_echo_recv, NULL);
+    return true;
+}
+
+/* Process received frames and flush transmit queues */
+void net_poll(void) {
+    e1000_poll();
+
+    /* Deliver only what was queued on entry, so echo traffic cannot spin */
+    uint32_t budget = loopback_queue.count;
+    netbuf_t* nb;
+    while (budget-- > 0 && (nb = netbuf_dequeue(&loopback_queue)) != NULL) {
+        net_receive(&loopback_dev, nb);
+    }
+
+    /* One doorbell per poll for everything queued above */
+    for (uint32_t i = 0; i < num_devices; i++) {
+        if (devices[i]->flush) {
+            devices[i]->flush(devices[i]);
+        }
+    }
+}
+
+uint32_t net_device_count(void) {
+    return num_devices;
+}
+
+net_device_t* net_get_device(uint32_t index) {
+    return index < num_devices ? devices[index] : NULL;
+}
+
+const net_stats_t* net_get_stats(void) {
+    return &stats;
+}
+
+/*------------------------------------------------------------------------------
+ * Helpers
+ *------------------------------------------------------------------------------
+ */
+
+/* Parse dotted-quad notation into a network-order address */
+bool net_parse_ip(const char* str, uint32_t* ip) {
+    uint32_t parts[4];
+    int count = 0;
+
+    while (count < 4) {
+        if (*str < '0' || *str > '9') {
+            return false;
+        }
+        uint32_t value = 0;
+        while (*str >= '0' && *str <= '9') {
+            value = value * 10 + (uint32_t)(*str - '0');
+            if (value > 255) {
+                return false;
+            }
+            str++;
+        }
+        parts[count++] = value;
+        if (count < 4) {
+            if (*str != '.') {
+                return false;
+            }
+            str++;
+        }
+    }
+
+    if (*str != '\0' && *str != ' ') {
+        return false;
+    }
+
+    *ip = NET_IP(parts[0], parts[1], parts[2], parts[3]);
+    return true;
+}
+
+void net_print_ip(uint32_t ip) {
+    for (int i = 0; i < 4; i++) {
+        if (i) terminal_putchar('.');
+        terminal_write_dec((ip >> (i * 8)) & 0xFF);
+    }
+}
+
+void net_print_info(void) {
+    for (uint32_t i = 0; i < num_devices; i++) {
+        net_device_t* dev = devices[i];
+        terminal_writestring(dev->name);
+        terminal_writestring(": inet ");
+        net_print_ip(dev->ip);
+        terminal_writestring("  netmask ");
+        net_print_ip(dev->netmask);
+        if (dev->gateway) {
+            terminal_writestring("  gateway ");
+            net_print_ip(dev->gateway);
+        }
+        terminal_writestring("\n  RX packets: ");
+        terminal_write_dec(dev->rx_packets);
+        terminal_writestring("  dropped: ");
+        terminal_write_dec(dev->rx_dropped);
+        terminal_writestring("  TX packets: ");
+        terminal_write_dec(dev->tx_packets);
+        terminal_writestring("  dropped: ");
+        terminal_write_dec(dev->tx_dropped);
+        terminal_writestring("\n");
+    }
+
+    terminal_writestring("IP rx/tx: ");
+    terminal_write_dec(stats.ip_rx);
+    terminal_writestring("/");
+    terminal_write_dec(stats.ip_tx);
+    terminal_writestring("  bad: ");
+    terminal_write_dec(stats.ip_bad);
+    terminal_writestring("  no route: ");
+    terminal_write_dec(stats.ip_no_route);
+    terminal_writestring("\nUDP rx/tx: ");
+    terminal_write_dec(stats.udp_rx);
+    terminal_writestring("/");
+    terminal_write_dec(stats.udp_tx);
+    terminal_writestring("  bad csum: ");
+    terminal_write_dec(stats.udp_bad_csum);
+    terminal_writestring("  no port: ");
+    terminal_write_dec(stats.udp_no_port);
+    terminal_writestring("\nICMP rx/tx: ");
+    terminal_write_dec(stats.icmp_rx);
+    terminal_writestring("/");
+    terminal_write_dec(stats.icmp_tx);
+    terminal_writestring("  ARP rx/tx: ");
+    terminal_write_dec(stats.arp_rx);
+    terminal_writestring("/");
+    terminal_write_dec(stats.arp_tx);
+
+    const netbuf_stats_t* nbs = netbuf_get_stats();
+    terminal_writestring("\nNetbufs: ");
+    terminal_write_dec(nbs->free_count);
+    terminal_writestring("/");
+    terminal_write_dec(NETBUF_POOL_SIZE);
+    terminal_writestring(" free  allocs: ");
+    terminal_write_dec(nbs->allocs);
+    terminal_writestring("  failures: ");
+    terminal_write_dec(nbs->failures);
+    terminal_writestring("\n");
+}
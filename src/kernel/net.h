@@ -0,0 +1,206 @@
+#ifndef NET_H
+#define NET_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "netbuf.h"
+
+/*------------------------------------------------------------------------------
+ * IPv4 Network Stack
+ *------------------------------------------------------------------------------
+ * A small Ethernet/ARP/IPv4/ICMP/UDP stack built on netbufs. Packets move
+ * between layers by reference: each layer pushes or pulls its header in
+ * place and hands the same netbuf on.
+ *
+ * Two interfaces exist: "lo" (127.0.0.1), a loopback device that queues
+ * transmitted frames straight back to the receive path, and "eth0" on the
+ * e1000 with QEMU user-net's fixed addressing (10.0.2.15/24, gateway
+ * 10.0.2.2). Receive processing runs from net_poll() in the main loop.
+ *
+ * Addresses and ports in headers stay in network byte order; the API takes
+ * IP addresses in network order (see NET_IP) and ports in host order.
+ *------------------------------------------------------------------------------
+ */
+
+/* Byte order (the CPU is little-endian) */
+static inline uint16_t htons(uint16_t v) {
+    return (uint16_t)((v << 8) | (v >> 8));
+}
+
+static inline uint32_t htonl(uint32_t v) {
+    return (v >> 24) | ((v >> 8) & 0xFF00) | ((v << 8) & 0xFF0000) | (v << 24);
+}
+
+#define ntohs(v) htons(v)
+#define ntohl(v) htonl(v)
+
+/* Build a network-order IPv4 address from dotted-quad parts */
+#define NET_IP(a, b, c, d) \
+    ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+#define NET_IP_BROADCAST    0xFFFFFFFF
+#define NET_IP_LOOPBACK     NET_IP(127, 0, 0, 1)
+
+/* Ethernet */
+#define ETH_ALEN            6
+#define ETH_HLEN            14
+#define ETH_P_IP            0x0800
+#define ETH_P_ARP           0x0806
+
+/* IP protocol numbers */
+#define IP_PROTO_ICMP       1
+#define IP_PROTO_UDP        17
+
+/* ICMP types */
+#define ICMP_ECHO_REPLY     0
+#define ICMP_ECHO_REQUEST   8
+
+#define NET_MTU             1500
+#define NET_IP_TTL          64
+#define IP_HLEN             20
+#define UDP_HLEN            8
+#define NET_HEADROOM        64          /* Room for Ethernet + IP + UDP headers */
+#define UDP_MAX_PAYLOAD     (NET_MTU - IP_HLEN - UDP_HLEN)
+
+/* Wire formats */
+typedef struct {
+    uint8_t  dst[ETH_ALEN];
+    uint8_t  src[ETH_ALEN];
+    uint16_t type;
+} __attribute__((packed)) eth_hdr_t;
+
+typedef struct {
+    uint16_t htype;
+    uint16_t ptype;
+    uint8_t  hlen;
+    uint8_t  plen;
+    uint16_t oper;
+    uint8_t  sha[ETH_ALEN];
+    uint32_t spa;
+    uint8_t  tha[ETH_ALEN];
+    uint32_t tpa;
+} __attribute__((packed)) arp_pkt_t;
+
+typedef struct {
+    uint8_t  ver_ihl;
+    uint8_t  tos;
+    uint16_t total_len;
+    uint16_t id;
+    uint16_t frag_off;
+    uint8_t  ttl;
+    uint8_t  proto;
+    uint16_t checksum;
+    uint32_t src;
+    uint32_t dst;
+} __attribute__((packed)) ipv4_hdr_t;
+
+typedef struct {
+    uint8_t  type;
+    uint8_t  code;
+    uint16_t checksum;
+    uint16_t id;
+    uint16_t seq;
+} __attribute__((packed)) icmp_hdr_t;
+
+typedef struct {
+    uint16_t src_port;
+    uint16_t dst_port;
+    uint16_t len;
+    uint16_t checksum;
+} __attribute__((packed)) udp_hdr_t;
+
+/* Network interface */
+#define NETDEV_UP           0x01
+#define NETDEV_LOOPBACK     0x02
+
+typedef struct net_device net_device_t;
+struct net_device {
+    const char* name;
+    uint8_t  mac[ETH_ALEN];
+    uint16_t flags;
+    uint16_t mtu;
+    uint32_t ip;                /* Network byte order */
+    uint32_t netmask;
+    uint32_t gateway;
+    /* Queue a frame for transmission; consumes the reference */
+    bool   (*xmit)(net_device_t* dev, netbuf_t* nb);
+    /* Push queued frames to the hardware (optional) */
+    void   (*flush)(net_device_t* dev);
+    uint32_t rx_packets;
+    uint32_t tx_packets;
+    uint32_t rx_dropped;
+    uint32_t tx_dropped;
+};
+
+/* UDP socket */
+typedef struct udp_socket udp_socket_t;
+
+/* Receive callback: nb->data is the payload. The netbuf is only valid
+ * until the callback returns unless it takes a reference. */
+typedef void (*udp_recv_t)(udp_socket_t* sock, netbuf_t* nb, uint32_t src_ip, uint16_t src_port);
+
+struct udp_socket {
+    uint16_t   port;            /* Host order, 0 if unused */
+    udp_recv_t recv;
+    void*      ctx;
+};
+
+#define UDP_MAX_SOCKETS     8
+#define UDP_EPHEMERAL_BASE  49152
+#define UDP_ECHO_PORT       7
+
+/* ICMP echo reply observer (used by ping) */
+typedef void (*icmp_echo_handler_t)(uint32_t src_ip, uint16_t id, uint16_t seq, netbuf_t* nb);
+
+/* Protocol statistics */
+typedef struct {
+    uint32_t arp_rx;
+    uint32_t arp_tx;
+    uint32_t ip_rx;
+    uint32_t ip_tx;
+    uint32_t ip_bad;            /* Malformed, bad checksum or fragment */
+    uint32_t ip_no_route;
+    uint32_t icmp_rx;
+    uint32_t icmp_tx;
+    uint32_t udp_rx;
+    uint32_t udp_tx;
+    uint32_t udp_bad_csum;
+    uint32_t udp_no_port;
+} net_stats_t;
+
+/* Function prototypes */
+
+/* Bring up the netbuf pool, loopback and (if present) eth0 */
+bool net_init(void);
+
+/* Process received frames and flush transmit queues (call from the main loop) */
+void net_poll(void);
+
+/* Interfaces */
+uint32_t net_device_count(void);
+net_device_t* net_get_device(uint32_t index);
+
+/* Hand a received Ethernet frame to the stack; consumes the reference */
+void net_receive(net_device_t* dev, netbuf_t* nb);
+
+/* Send a packet (nb->data is the L4 header) over IPv4; consumes the reference */
+bool ip_output(uint32_t dst_ip, uint8_t proto, netbuf_t* nb);
+
+/* ICMP */
+bool icmp_send_echo(uint32_t dst_ip, uint16_t id, uint16_t seq, const void* payload, uint16_t len);
+void icmp_set_echo_handler(icmp_echo_handler_t handler);
+
+/* UDP */
+udp_socket_t* udp_bind(uint16_t port, udp_recv_t recv, void* ctx);
+void udp_close(udp_socket_t* sock);
+netbuf_t* udp_alloc(void);
+bool udp_sendto(udp_socket_t* sock, uint32_t dst_ip, uint16_t dst_port, netbuf_t* nb);
+
+/* Helpers */
+bool net_parse_ip(const char* str, uint32_t* ip);
+void net_print_ip(uint32_t ip);
+const net_stats_t* net_get_stats(void);
+void net_print_info(void);
+
+#endif /* NET_H */
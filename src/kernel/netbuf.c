@@ -0,0 +1,288 @@
+/*------------------------------------------------------------------------------
+ * Network Packet Buffers
+ *------------------------------------------------------------------------------
+ * This file implements the shared netbuf pool, reference counting, header
+ * and tail manipulation, queues and the Internet checksum. See netbuf.h.
+ *------------------------------------------------------------------------------
+ */
+
+#include "netbuf.h"
+#include "memory.h"
+#include "string.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Shared pool: NETBUF_POOL_SIZE half-page buffers in DMA memory */
+static netbuf_t pool_bufs[NETBUF_POOL_SIZE];
+static netbuf_t* pool_free = NULL;
+static netbuf_stats_t stats;
+
+/*------------------------------------------------------------------------------
+ * Pool
+ *------------------------------------------------------------------------------
+ */
+
+/* Release callback for pool buffers */
+static void netbuf_pool_release(netbuf_t* nb) {
+    nb->next = pool_free;
+    pool_free = nb;
+    stats.frees++;
+    stats.free_count++;
+}
+
+bool netbuf_pool_init(void) {
+    uint32_t phys;
+    uint8_t* storage = (uint8_t*)dma_alloc(NETBUF_POOL_SIZE * NETBUF_SIZE, &phys);
+    if (!storage) {
+        return false;
+    }
+
+    memset(&stats, 0, sizeof(stats));
+    pool_free = NULL;
+    for (int i = NETBUF_POOL_SIZE - 1; i >= 0; i--) {
+        netbuf_init(&pool_bufs[i], storage + i * NETBUF_SIZE, phys + i * NETBUF_SIZE,
+                    NETBUF_SIZE, netbuf_pool_release);
+        pool_bufs[i].next = pool_free;
+        pool_free = &pool_bufs[i];
+        stats.free_count++;
+    }
+
+    return true;
+}
+
+/* Get an empty buffer with headroom bytes reserved for headers */
+netbuf_t* netbuf_alloc(uint16_t headroom) {
+    netbuf_t* nb = pool_free;
+    if (!nb || headroom > NETBUF_SIZE) {
+        stats.failures++;
+        return NULL;
+    }
+
+    pool_free = nb->next;
+    stats.allocs++;
+    stats.free_count--;
+
+    netbuf_reset(nb, headroom);
+    nb->refcount = 1;
+    return nb;
+}
+
+const netbuf_stats_t* netbuf_get_stats(void) {
+    return &stats;
+}
+
+/*------------------------------------------------------------------------------
+ * Buffer operations
+ *------------------------------------------------------------------------------
+ */
+
+void netbuf_init(netbuf_t* nb, uint8_t* head, uint32_t phys, uint16_t size,
+                 void (*release)(netbuf_t* nb)) {
+    nb->head = head;
+    nb->phys = phys;
+    nb->size = size;
+    nb->release = release;
+    nb->refcount = 0;
+    nb->next = NULL;
+    netbuf_reset(nb, 0);
+}
+
+void netbuf_reset(netbuf_t* nb, uint16_t headroom) {
+    nb->data = nb->head + headroom;
+    nb->len = 0;
+    nb->flags = 0;
+    nb->csum = 0;
+    nb->dev = NULL;
+    nb->next = NULL;
+}
+
+/* Drop a reference; the last one hands the storage back to its owner */
+void netbuf_put(netbuf_t* nb) {
+    if (!nb || nb->refcount == 0) {
+        return;
+    }
+    if (--nb->refcount == 0 && nb->release) {
+        nb->release(nb);
+    }
+}
+
+/* Prepend len bytes of header space */
+uint8_t* netbuf_push(netbuf_t* nb, uint16_t len) {
+    if (netbuf_headroom(nb) < len) {
+        return NULL;
+    }
+    nb->data -= len;
+    nb->len += len;
+    return nb->data;
+}
+
+/* Strip len bytes of header; returns the new start of data */
+uint8_t* netbuf_pull(netbuf_t* nb, uint16_t len) {
+    if (nb->len < len) {
+        return NULL;
+    }
+    nb->data += len;
+    nb->len -= len;
+    return nb->data;
+}
+
+/* Grow the packet by len bytes the caller fills in directly. The payload
+ * checksum is no longer known afterwards. */
+uint8_t* netbuf_extend(netbuf_t* nb, uint16_t len) {
+    if (netbuf_tailroom(nb) < len) {
+        return NULL;
+    }
+    uint8_t* tail = nb->data + nb->len;
+    nb->len += len;
+    nb->flags &= ~NETBUF_CSUM_PAYLOAD;
+    return tail;
+}
+
+/* Copy data onto the end of the packet, folding it into the payload sum */
+bool netbuf_append(netbuf_t* nb, const void* data, uint16_t len) {
+    if (netbuf_tailroom(nb) < len) {
+        return false;
+    }
+
+    uint16_t offset = nb->len;
+    if (offset == 0) {
+        nb->csum = 0;
+        nb->flags |= NETBUF_CSUM_PAYLOAD;
+    }
+
+    memcpy(nb->data + offset, data, len);
+    nb->len += len;
+
+    if (nb->flags & NETBUF_CSUM_PAYLOAD) {
+        nb->csum = csum_block_add(nb->csum, csum_partial(nb->data + offset, len, 0), offset);
+    }
+    return true;
+}
+
+/* Cut the packet down to len bytes (e.g. to drop Ethernet padding) */
+void netbuf_trim(netbuf_t* nb, uint16_t len) {
+    if (len < nb->len) {
+        nb->len = len;
+        nb->flags &= ~NETBUF_CSUM_PAYLOAD;
+    }
+}
+
+/*------------------------------------------------------------------------------
+ * Queues
+ *------------------------------------------------------------------------------
+ */
+
+void netbuf_queue_init(netbuf_queue_t* q) {
+    q->head = q->tail = NULL;
+    q->count = 0;
+}
+
+/* Append nb; the queue takes over the caller's reference */
+void netbuf_enqueue(netbuf_queue_t* q, netbuf_t* nb) {
+    nb->next = NULL;
+    if (q->tail) {
+        q->tail->next = nb;
+    } else {
+        q->head = nb;
+    }
+    q->tail = nb;
+    q->count++;
+}
+
+/* Remove the oldest entry; the caller now owns its reference */
+netbuf_t* netbuf_dequeue(netbuf_queue_t* q) {
+    netbuf_t* nb = q->head;
+    if (nb) {
+        q->head = nb->next;
+        if (!q->head) {
+            q->tail = NULL;
+        }
+        nb->next = NULL;
+        q->count--;
+    }
+    return nb;
+}
+
+void netbuf_queue_purge(netbuf_queue_t* q) {
+    netbuf_t* nb;
+    while ((nb = netbuf_dequeue(q)) != NULL) {
+        netbuf_put(nb);
+    }
+}
+
+/*------------------------------------------------------------------------------
+ * Internet checksum
+ *------------------------------------------------------------------------------
+ */
+
+typedef uint32_t __attribute__((may_alias)) csum_word32_t;
+typedef uint16_t __attribute__((may_alias)) csum_word16_t;
+
+/* One's-complement sum of a block, added to sum. Works a 32-bit word at a
+ * time; carries collect in the upper half of a 64-bit accumulator. */
+uint32_t csum_partial(const void* data, size_t len, uint32_t sum) {
+    const uint8_t* p = (const uint8_t*)data;
+    uint64_t acc = sum;
+
+    while (len >= 16) {
+        acc += *(const csum_word32_t*)(p + 0);
+        acc += *(const csum_word32_t*)(p + 4);
+        acc += *(const csum_word32_t*)(p + 8);
+        acc += *(const csum_word32_t*)(p + 12);
+        p += 16;
+        len -= 16;
+    }
+    while (len >= 4) {
+        acc += *(const csum_word32_t*)p;
+        p += 4;
+        len -= 4;
+    }
+    if (len >= 2) {
+        acc += *(const csum_word16_t*)p;
+        p += 2;
+        len -= 2;
+    }
+    if (len) {
+        acc += *p;  /* Trailing byte is the low half of a little-endian word */
+    }
+
+    acc = (acc & 0xFFFFFFFF) + (acc >> 32);
+    acc = (acc & 0xFFFFFFFF) + (acc >> 32);
+    return (uint32_t)acc;
+}
+
+uint32_t csum_add(uint32_t a, uint32_t b) {
+    uint32_t sum = a + b;
+    return sum + (sum < b);
+}
+
+/* Combine the sum of a block that started offset bytes into the data */
+uint32_t csum_block_add(uint32_t sum, uint32_t block_sum, uint32_t offset) {
+    if (offset & 1) {
+        block_sum = (block_sum >> 8) | (block_sum << 24);
+    }
+    return csum_add(sum, block_sum);
+}
+
+/* Fold to 16 bits and complement: the value stored in a header */
+uint16_t csum_fold(uint32_t sum) {
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    return (uint16_t)~sum;
+}
+
+/* RFC 1624: HC' = ~(~HC + ~m + m') */
+void csum_replace16(uint16_t* check, uint16_t old_value, uint16_t new_value) {
+    uint32_t sum = (uint16_t)~*check;
+    sum += (uint16_t)~old_value;
+    sum += new_value;
+    *check = csum_fold(sum);
+}
+
+void csum_replace32(uint16_t* check, uint32_t old_value, uint32_t new_value) {
+    uint32_t sum = (uint16_t)~*check;
+    sum = csum_add(sum, ~old_value);
+    sum = csum_add(sum, new_value);
+    *check = csum_fold(sum);
+}
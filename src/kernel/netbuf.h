@@ -0,0 +1,131 @@
+#ifndef NETBUF_H
+#define NETBUF_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*------------------------------------------------------------------------------
+ * Network Packet Buffers
+ *------------------------------------------------------------------------------
+ * A netbuf describes one packet living in a page-backed, DMA-able buffer.
+ * Layers move the packet by handing the netbuf on, never by copying it:
+ * headers are added in place with netbuf_push() into headroom reserved at
+ * allocation, and stripped with netbuf_pull().
+ *
+ * Netbufs are reference counted. Whoever holds a reference may read the
+ * packet; passing a netbuf to a function that "consumes" it transfers the
+ * caller's reference. The last netbuf_put() returns the storage to its
+ * owner through the release callback - the netbuf pool for buffers from
+ * netbuf_alloc(), or a driver's own receive pool.
+ *
+ * Internet checksums are accumulated as data is appended, so a transport
+ * header checksum only has to add its own header and pseudo-header instead
+ * of walking the payload again.
+ *------------------------------------------------------------------------------
+ */
+
+#define NETBUF_SIZE         2048        /* Storage per buffer (half a page) */
+#define NETBUF_POOL_SIZE    64          /* Buffers in the shared pool */
+
+/* Flags */
+#define NETBUF_CSUM_PAYLOAD 0x0001      /* csum holds the partial sum of the L4 payload */
+#define NETBUF_CSUM_VALID   0x0002      /* Checksums already known good (loopback) */
+
+typedef struct netbuf netbuf_t;
+struct net_device;
+
+struct netbuf {
+    uint8_t*  head;                     /* Start of storage */
+    uint8_t*  data;                     /* Start of packet */
+    uint16_t  len;                      /* Packet bytes from data */
+    uint16_t  size;                     /* Storage bytes from head */
+    uint32_t  phys;                     /* Physical address of head, 0 if not DMA-able */
+    uint16_t  refcount;
+    uint16_t  flags;
+    uint32_t  csum;                     /* Partial sum, see NETBUF_CSUM_PAYLOAD */
+    struct net_device* dev;             /* Receiving device */
+    void    (*release)(netbuf_t* nb);   /* Return storage to its owner */
+    netbuf_t* next;                     /* Queue link */
+};
+
+/* FIFO of netbufs (holds one reference per entry) */
+typedef struct {
+    netbuf_t* head;
+    netbuf_t* tail;
+    uint32_t  count;
+} netbuf_queue_t;
+
+/* Pool statistics */
+typedef struct {
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t failures;
+    uint32_t free_count;
+} netbuf_stats_t;
+
+/* Pool management */
+bool netbuf_pool_init(void);
+netbuf_t* netbuf_alloc(uint16_t headroom);
+const netbuf_stats_t* netbuf_get_stats(void);
+
+/* Describe driver-owned storage (refcount starts at 0) */
+void netbuf_init(netbuf_t* nb, uint8_t* head, uint32_t phys, uint16_t size,
+                 void (*release)(netbuf_t* nb));
+
+/* Empty the packet, leaving headroom bytes in front of it */
+void netbuf_reset(netbuf_t* nb, uint16_t headroom);
+
+/* Reference counting */
+static inline netbuf_t* netbuf_get(netbuf_t* nb) {
+    nb->refcount++;
+    return nb;
+}
+void netbuf_put(netbuf_t* nb);
+
+/* Header manipulation; return NULL if there is no room */
+uint8_t* netbuf_push(netbuf_t* nb, uint16_t len);
+uint8_t* netbuf_pull(netbuf_t* nb, uint16_t len);
+
+/* Tail manipulation */
+uint8_t* netbuf_extend(netbuf_t* nb, uint16_t len);
+bool netbuf_append(netbuf_t* nb, const void* data, uint16_t len);
+void netbuf_trim(netbuf_t* nb, uint16_t len);
+
+static inline uint16_t netbuf_headroom(const netbuf_t* nb) {
+    return (uint16_t)(nb->data - nb->head);
+}
+
+static inline uint16_t netbuf_tailroom(const netbuf_t* nb) {
+    return (uint16_t)(nb->size - netbuf_headroom(nb) - nb->len);
+}
+
+/* Bus address of the packet data (for zero-copy DMA) */
+static inline uint32_t netbuf_data_phys(const netbuf_t* nb) {
+    return nb->phys ? nb->phys + netbuf_headroom(nb) : 0;
+}
+
+/* Queues */
+void netbuf_queue_init(netbuf_queue_t* q);
+void netbuf_enqueue(netbuf_queue_t* q, netbuf_t* nb);
+netbuf_t* netbuf_dequeue(netbuf_queue_t* q);
+void netbuf_queue_purge(netbuf_queue_t* q);
+
+/*------------------------------------------------------------------------------
+ * Internet checksum (RFC 1071)
+ *------------------------------------------------------------------------------
+ * Partial sums are 32-bit one's-complement accumulators over data in memory
+ * order, so the folded result can be stored into a header as-is. Sums of
+ * separate blocks combine with csum_block_add(); csum_replace16/32 apply an
+ * RFC 1624 incremental update when a header field changes.
+ *------------------------------------------------------------------------------
+ */
+
+uint32_t csum_partial(const void* data, size_t len, uint32_t sum);
+uint32_t csum_add(uint32_t a, uint32_t b);
+uint32_t csum_block_add(uint32_t sum, uint32_t block_sum, uint32_t offset);
+uint16_t csum_fold(uint32_t sum);
+void csum_replace16(uint16_t* check, uint16_t old_value, uint16_t new_value);
+void csum_replace32(uint16_t* check, uint32_t old_value, uint32_t new_value);
+
+#endif /* NETBUF_H */
@@ -0,0 +1,142 @@
+/*------------------------------------------------------------------------------
+ * Runtime Code Patching
+ *------------------------------------------------------------------------------
+ * This file implements CPU feature detection, boot-time alternatives and
+ * static keys. See patch.h.
+ *------------------------------------------------------------------------------
+ */
+
+#include "patch.h"
+#include "init.h"
+#include "string.h"
+#include "cache.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Tables collected by linker.ld */
+extern alt_instr_t __alt_instructions_start[];
+extern alt_instr_t __alt_instructions_end[];
+extern jump_entry_t __jump_table_start[];
+extern jump_entry_t __jump_table_end[];
+
+#define JMP32_OPCODE    0xE9
+#define JMP32_SIZE      5
+#define NOP_OPCODE      0x90
+
+static const uint8_t static_key_nop5[JMP32_SIZE] = { 0x3e, 0x8d, 0x74, 0x26, 0x00 };
+
+static uint32_t cpu_features[CPU_FEATURE_WORDS] __read_mostly;
+static patch_stats_t stats;
+
+/*------------------------------------------------------------------------------
+ * CPU features
+ *------------------------------------------------------------------------------
+ */
+
+void __init cpu_features_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+
+    memset(cpu_features, 0, sizeof(cpu_features));
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0));
+    if (eax >= 1) {
+        asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+        cpu_features[0] = edx;
+        cpu_features[1] = ecx;
+    }
+}
+
+bool cpu_has(uint32_t feature) {
+    uint32_t word = feature / 32;
+    return word < CPU_FEATURE_WORDS && (cpu_features[word] & (1u << (feature % 32))) != 0;
+}
+
+/*------------------------------------------------------------------------------
+ * Text patching
+ *------------------------------------------------------------------------------
+ */
+
+/* Make sure no stale prefetched bytes of the old code are executed */
+static inline void sync_core(void) {
+    uint32_t eax = 0, ebx, ecx = 0, edx;
+    asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx) :: "memory");
+}
+
+/* Overwrite kernel text with interrupts disabled */
+void text_poke(void* addr, const void* bytes, size_t len) {
+    uint32_t flags;
+    asm volatile("pushfl; popl %0; cli" : "=r"(flags) :: "memory");
+    memcpy(addr, bytes, len);
+    sync_core();
+    asm volatile("pushl %0; popfl" :: "r"(flags) : "memory", "cc");
+}
+
+/*------------------------------------------------------------------------------
+ * Alternatives
+ *------------------------------------------------------------------------------
+ */
+
+/* Patch every ALTERNATIVE() site whose feature is present */
+void __init apply_alternatives(void) {
+    uint8_t insn[255];
+
+    stats.alternatives = 0;
+    stats.alternatives_applied = 0;
+
+    for (alt_instr_t* a = __alt_instructions_start; a < __alt_instructions_end; a++) {
+        stats.alternatives++;
+        if (!cpu_has(a->feature) || a->replacementlen > a->instrlen) {
+            continue;
+        }
+
+        memcpy(insn, (const void*)a->replacement, a->replacementlen);
+        memset(insn + a->replacementlen, NOP_OPCODE, a->instrlen - a->replacementlen);
+        text_poke((void*)a->instr, insn, a->instrlen);
+        stats.alternatives_applied++;
+    }
+
+    stats.jump_entries = (uint32_t)(__jump_table_end - __jump_table_start);
+}
+
+/*------------------------------------------------------------------------------
+ * Static keys
+ *------------------------------------------------------------------------------
+ */
+
+/* Rewrite every site of key as a jump (enabled) or the NOP (disabled) */
+static void static_key_update(static_key_t* key, bool enable) {
+    for (jump_entry_t* e = __jump_table_start; e < __jump_table_end; e++) {
+        if (e->key != (uint32_t)key) {
+            continue;
+        }
+
+        if (enable) {
+            uint8_t jmp[JMP32_SIZE];
+            int32_t rel = (int32_t)(e->target - (e->code + JMP32_SIZE));
+            jmp[0] = JMP32_OPCODE;
+            memcpy(jmp + 1, &rel, sizeof(rel));
+            text_poke((void*)e->code, jmp, JMP32_SIZE);
+        } else {
+            text_poke((void*)e->code, static_key_nop5, JMP32_SIZE);
+        }
+        stats.jump_patches++;
+    }
+}
+
+void static_key_enable(static_key_t* key) {
+    if (!key->enabled) {
+        key->enabled = 1;
+        static_key_update(key, true);
+    }
+}
+
+void static_key_disable(static_key_t* key) {
+    if (key->enabled) {
+        key->enabled = 0;
+        static_key_update(key, false);
+    }
+}
+
+const patch_stats_t* patch_get_stats(void) {
+    return &stats;
+}
@@ -0,0 +1,155 @@
+#ifndef PATCH_H
+#define PATCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*------------------------------------------------------------------------------
+ * Runtime Code Patching
+ *------------------------------------------------------------------------------
+ * Two mechanisms rewrite kernel text instead of testing a flag on every
+ * call:
+ *
+ * Alternatives - ALTERNATIVE(old, new, feature) emits 'old' inline and
+ * records 'new' in a side section. apply_alternatives() copies 'new' over
+ * 'old' at boot when CPUID reports the feature, padding with NOPs.
+ * Replacements are copied verbatim, so they must not contain relative
+ * jumps or calls.
+ *
+ * Static keys - static_branch_unlikely(&key) compiles to a 5-byte NOP
+ * that falls through to the "off" path. static_key_enable() rewrites every
+ * site of that key into a jump to the "on" block, and static_key_disable()
+ * turns it back into a NOP. A disabled hook costs one NOP.
+ *
+ * Both record their sites in tables collected by linker.ld.
+ *------------------------------------------------------------------------------
+ */
+
+/* CPU feature numbers: word * 32 + bit */
+#define X86_FEATURE_FPU         (0 * 32 + 0)    /* CPUID.1:EDX */
+#define X86_FEATURE_TSC         (0 * 32 + 4)
+#define X86_FEATURE_CMOV        (0 * 32 + 15)
+#define X86_FEATURE_FXSR        (0 * 32 + 24)
+#define X86_FEATURE_XMM         (0 * 32 + 25)
+#define X86_FEATURE_XMM2        (0 * 32 + 26)
+#define X86_FEATURE_XMM3        (1 * 32 + 0)    /* CPUID.1:ECX */
+#define X86_FEATURE_XMM4_2      (1 * 32 + 20)
+#define X86_FEATURE_POPCNT      (1 * 32 + 23)
+
+#define CPU_FEATURE_WORDS       2
+
+/*------------------------------------------------------------------------------
+ * Alternatives
+ *------------------------------------------------------------------------------
+ */
+
+/* Table entry emitted by ALTERNATIVE() */
+typedef struct {
+    uint32_t instr;             /* Address of the original sequence */
+    uint32_t replacement;       /* Address of the replacement */
+    uint16_t feature;           /* X86_FEATURE_* required */
+    uint8_t  instrlen;          /* Bytes available at instr */
+    uint8_t  replacementlen;
+} __attribute__((packed)) alt_instr_t;
+
+#define __PATCH_STR(x) #x
+#define PATCH_STR(x) __PATCH_STR(x)
+
+/* 'old' is padded with NOPs to the length of 'new' if shorter */
+#define ALTERNATIVE(oldinstr, newinstr, feature)                              \
+    "661:\n\t" oldinstr "\n"                                                  \
+    "662:\n\t"                                                                \
+    ".skip -(((665f-664f)-(662b-661b)) > 0) * ((665f-664f)-(662b-661b)),0x90\n" \
+    "663:\n"                                                                  \
+    ".pushsection .altinstructions,\"a\"\n\t"                                 \
+    ".long 661b, 664f\n\t"                                                    \
+    ".word " PATCH_STR(feature) "\n\t"                                     \
+    ".byte 663b-661b, 665f-664f\n"                                            \
+    ".popsection\n"                                                           \
+    ".pushsection .altinstr_replacement,\"ax\"\n"                             \
+    "664:\n\t" newinstr "\n"                                                  \
+    "665:\n"                                                                  \
+    ".popsection\n"
+
+/* Fill in the CPU feature words from CPUID */
+void cpu_features_init(void);
+
+/* Whether CPUID reports a feature (cpu_features_init() must have run) */
+bool cpu_has(uint32_t feature);
+
+/* Patch every ALTERNATIVE() site whose feature is present */
+void apply_alternatives(void);
+
+/*------------------------------------------------------------------------------
+ * Static keys
+ *------------------------------------------------------------------------------
+ */
+
+typedef struct static_key {
+    volatile uint32_t enabled;
+} static_key_t;
+
+#define STATIC_KEY_INIT_FALSE { 0 }
+
+/* Table entry emitted by static_branch_unlikely() */
+typedef struct {
+    uint32_t code;              /* Address of the 5-byte NOP */
+    uint32_t target;            /* Address of the "on" block */
+    uint32_t key;               /* Owning static_key_t */
+} jump_entry_t;
+
+/* The tree builds without -O, where plain 'static inline' functions are
+ * emitted out of line. Wrappers around static_branch_unlikely() use this
+ * so the NOP lands at each call site. */
+#define __always_inline inline __attribute__((always_inline))
+
+/* 5-byte NOP that runs on every i386 (lea 0(%esi),%esi with a DS prefix) */
+#define STATIC_KEY_NOP5 ".byte 0x3e, 0x8d, 0x74, 0x26, 0x00"
+
+/* True only while the key is enabled; a NOP otherwise. A macro rather
+ * than an inline function so the key address stays a link-time constant
+ * without optimization. */
+#define static_branch_unlikely(key) ({                                      \
+    __label__ l_yes, l_done;                                                \
+    bool __taken;                                                           \
+    asm goto("1:\n\t" STATIC_KEY_NOP5 "\n\t"                                \
+             ".pushsection __jump_table,\"a\"\n\t"                         \
+             ".balign 4\n\t"                                                \
+             ".long 1b, %l[l_yes], %c0\n\t"                                 \
+             ".popsection"                                                  \
+             : : "i"(key) : : l_yes);                                       \
+    __taken = false;                                                        \
+    goto l_done;                                                            \
+l_yes:                                                                      \
+    __taken = true;                                                         \
+l_done:                                                                     \
+    __builtin_expect(__taken, 0);                                           \
+})
+
+void static_key_enable(static_key_t* key);
+void static_key_disable(static_key_t* key);
+
+static inline bool static_key_enabled(const static_key_t* key) {
+    return key->enabled != 0;
+}
+
+/*------------------------------------------------------------------------------
+ * Text patching
+ *------------------------------------------------------------------------------
+ */
+
+/* Patching statistics */
+typedef struct {
+    uint32_t alternatives;      /* ALTERNATIVE() sites in the kernel */
+    uint32_t alternatives_applied;
+    uint32_t jump_entries;      /* static_branch sites in the kernel */
+    uint32_t jump_patches;      /* Sites rewritten by enable/disable */
+} patch_stats_t;
+
+/* Overwrite kernel text with interrupts disabled */
+void text_poke(void* addr, const void* bytes, size_t len);
+
+const patch_stats_t* patch_get_stats(void);
+
+#endif /* PATCH_H */
@@ -0,0 +1,58 @@
+/*------------------------------------------------------------------------------
+ * Per-CPU Data
+ *------------------------------------------------------------------------------
+ * This file sets up the per-CPU areas and the GDT segments that GS uses to
+ * reach them. See percpu.h.
+ *------------------------------------------------------------------------------
+ */
+
+#include "percpu.h"
+#include "init.h"
+#include "gdt.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+static percpu_t percpu_areas[NR_CPUS];
+static uint32_t online_cpus = 0;
+
+/* Point a CPU's GDT entry at its area (byte-granular limit) */
+static void percpu_setup_segment(uint32_t cpu) {
+    percpu_t* area = &percpu_areas[cpu];
+
+    area->self = area;
+    area->cpu_id = cpu;
+    gdt_set_gate(GDT_PERCPU_FIRST + cpu, (uint32_t)area, sizeof(percpu_t) - 1,
+                 GDT_ACCESS_KERNEL_DATA, GDT_GRANULARITY_32BIT);
+}
+
+/* Load GS with a CPU's per-CPU selector */
+static inline void percpu_load_gs(uint32_t cpu) {
+    uint16_t sel = PERCPU_SELECTOR(cpu);
+    asm volatile("mov %0, %%gs" :: "r"(sel) : "memory");
+}
+
+/*------------------------------------------------------------------------------
+ * Public interface
+ *------------------------------------------------------------------------------
+ */
+
+/* Must run after gdt_init() and before anything uses this_cpu_*() */
+void __init percpu_init(void) {
+    for (uint32_t cpu = 0; cpu < NR_CPUS; cpu++) {
+        percpu_setup_segment(cpu);
+    }
+
+    /* Only the boot CPU is brought up; the others stay offline */
+    percpu_load_gs(0);
+    percpu_areas[0].online = true;
+    online_cpus = 1;
+}
+
+percpu_t* percpu_area(uint32_t cpu) {
+    return cpu < NR_CPUS ? &percpu_areas[cpu] : NULL;
+}
+
+uint32_t percpu_online_count(void) {
+    return online_cpus;
+}
@@ -0,0 +1,163 @@
+#ifndef PERCPU_H
+#define PERCPU_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "gdt.h"
+#include "cache.h"
+
+/*------------------------------------------------------------------------------
+ * Per-CPU Data
+ *------------------------------------------------------------------------------
+ * Each CPU has its own percpu_t, addressed through a GDT data segment whose
+ * base is that area. GS holds the segment on every CPU, so
+ *
+ *     this_cpu_read(cpu_id)
+ *     this_cpu_add(heap_allocated_bytes, size)
+ *
+ * compile to single %gs:offset instructions with no lookup of "which CPU
+ * am I" and no locking. Areas are cache-line aligned so CPUs never share a
+ * line. A CPU only ever touches its own area; readers wanting a system-wide
+ * total sum over percpu_area(cpu). Event counters build on this in
+ * counter.h, which adds tear-free 64-bit reads.
+ *
+ * The interrupt stubs leave GS untouched, so the accessors work in
+ * interrupt handlers too. Single-instruction updates cannot be torn by an
+ * interrupt on the same CPU; 64-bit increments are an add/adc pair whose
+ * carry survives an interrupt in between.
+ *------------------------------------------------------------------------------
+ */
+
+#define NR_CPUS             GDT_MAX_CPUS
+#define PERCPU_ALIGN        CACHE_LINE_SIZE
+#define PERCPU_COUNTERS     64          /* Slots for DEFINE_COUNTER() */
+
+/* Per-CPU area */
+typedef struct percpu {
+    struct percpu* self;                /* Linear address of this area */
+    uint32_t cpu_id;
+    bool     online;
+
+    /* Statistics counter slots, indexed by counter.h descriptors */
+    uint32_t counter_seq;               /* Odd while a slot is being updated */
+    uint64_t counters[PERCPU_COUNTERS] __attribute__((aligned(8)));
+
+    /* TSC when this CPU halted in cpu_idle(), 0 while busy */
+    uint64_t idle_enter_tsc;
+
+    /* Running thread (see sched.c) */
+    void*    current_thread;
+
+    /* Heap gauges (see debug.c) */
+    uint32_t heap_allocated_bytes;
+    uint32_t heap_peak_bytes;
+
+    /* FPU ownership for lazy switching (see fpu.c) */
+    void*    fpu_owner;                 /* Context whose state is in the registers */
+    void*    fpu_current;               /* Context of the running thread */
+    uint32_t fpu_kernel_depth;          /* kernel_fpu_begin() nesting */
+} __attribute__((aligned(PERCPU_ALIGN))) percpu_t;
+
+/* Set up the per-CPU segments and load GS for the boot CPU */
+void percpu_init(void);
+
+/* Area of a given CPU (for cross-CPU totals) */
+percpu_t* percpu_area(uint32_t cpu);
+
+/* Number of CPUs with a live area */
+uint32_t percpu_online_count(void);
+
+/*------------------------------------------------------------------------------
+ * Accessors
+ *------------------------------------------------------------------------------
+ * 'field' is a member designator of percpu_t, e.g. fpu_kernel_depth.
+ * Reads and writes take 1, 2 or 4-byte scalar fields; increments and adds
+ * also take 8-byte fields.
+ *------------------------------------------------------------------------------
+ */
+
+#define percpu_offset(field) offsetof(percpu_t, field)
+#define percpu_typeof(field) __typeof__(((percpu_t*)0)->field)
+
+#define this_cpu_read(field) ({                                               \
+    _Static_assert(sizeof(percpu_typeof(field)) == 1 ||                       \
+                   sizeof(percpu_typeof(field)) == 2 ||                       \
+                   sizeof(percpu_typeof(field)) == 4,                         \
+                   "this_cpu_read: unsupported field size");                  \
+    uint32_t __val;                                                           \
+    switch (sizeof(percpu_typeof(field))) {                                   \
+    case 1:                                                                   \
+        asm volatile("movzbl %%gs:%c1, %0" : "=r"(__val)                      \
+                     : "i"(percpu_offset(field)));                            \
+        break;                                                                \
+    case 2:                                                                   \
+        asm volatile("movzwl %%gs:%c1, %0" : "=r"(__val)                      \
+                     : "i"(percpu_offset(field)));                            \
+        break;                                                                \
+    default:                                                                  \
+        asm volatile("movl %%gs:%c1, %0" : "=r"(__val)                        \
+                     : "i"(percpu_offset(field)));                            \
+        break;                                                                \
+    }                                                                         \
+    (percpu_typeof(field))(uintptr_t)__val;                                   \
+})
+
+#define this_cpu_write(field, value) do {                                     \
+    _Static_assert(sizeof(percpu_typeof(field)) == 1 ||                       \
+                   sizeof(percpu_typeof(field)) == 2 ||                       \
+                   sizeof(percpu_typeof(field)) == 4,                         \
+                   "this_cpu_write: unsupported field size");                 \
+    uint32_t __val = (uint32_t)(uintptr_t)(value);                            \
+    switch (sizeof(percpu_typeof(field))) {                                   \
+    case 1:                                                                   \
+        asm volatile("movb %b0, %%gs:%c1" :: "q"(__val),                      \
+                     "i"(percpu_offset(field)) : "memory");                   \
+        break;                                                                \
+    case 2:                                                                   \
+        asm volatile("movw %w0, %%gs:%c1" :: "r"(__val),                      \
+                     "i"(percpu_offset(field)) : "memory");                   \
+        break;                                                                \
+    default:                                                                  \
+        asm volatile("movl %0, %%gs:%c1" :: "r"(__val),                       \
+                     "i"(percpu_offset(field)) : "memory");                   \
+        break;                                                                \
+    }                                                                         \
+} while (0)
+
+#define this_cpu_add(field, value) do {                                       \
+    _Static_assert(sizeof(percpu_typeof(field)) == 1 ||                       \
+                   sizeof(percpu_typeof(field)) == 2 ||                       \
+                   sizeof(percpu_typeof(field)) == 4 ||                       \
+                   sizeof(percpu_typeof(field)) == 8,                         \
+                   "this_cpu_add: unsupported field size");                   \
+    /* Sign-extend so negative deltas carry into the high word */             \
+    uint64_t __val = (uint64_t)(int64_t)(value);                              \
+    switch (sizeof(percpu_typeof(field))) {                                   \
+    case 1:                                                                   \
+        asm volatile("addb %b0, %%gs:%c1" :: "q"((uint32_t)__val),            \
+                     "i"(percpu_offset(field)) : "memory", "cc");             \
+        break;                                                                \
+    case 2:                                                                   \
+        asm volatile("addw %w0, %%gs:%c1" :: "r"((uint32_t)__val),            \
+                     "i"(percpu_offset(field)) : "memory", "cc");             \
+        break;                                                                \
+    case 8:                                                                   \
+        asm volatile("addl %0, %%gs:%c2\n\t"                                  \
+                     "adcl %1, %%gs:%c2+4"                                    \
+                     :: "r"((uint32_t)__val), "r"((uint32_t)(__val >> 32)),   \
+                     "i"(percpu_offset(field)) : "memory", "cc");             \
+        break;                                                                \
+    default:                                                                  \
+        asm volatile("addl %0, %%gs:%c1" :: "r"((uint32_t)__val),             \
+                     "i"(percpu_offset(field)) : "memory", "cc");             \
+        break;                                                                \
+    }                                                                         \
+} while (0)
+
+#define this_cpu_inc(field) this_cpu_add(field, 1)
+
+/* Linear address of this CPU's area */
+#define this_cpu_ptr() this_cpu_read(self)
+
+#endif /* PERCPU_H */
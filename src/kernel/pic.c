@@ -1,4 +1,5 @@
 #include "pic.h"
+#include "init.h"
 #include <stdbool.h>
 
 /*------------------------------------------------------------------------------
@@ -46,7 +47,7 @@ static inline void io_wait(void) {
  *------------------------------------------------------------------------------
  */
 
-void pic_init(void) {
+void __init pic_init(void) {
     uint8_t master_mask, slave_mask;
     
     /* Save the current interrupt masks before initialization */
@@ -0,0 +1,229 @@
+/*------------------------------------------------------------------------------
+ * Red-Black Tree
+ *------------------------------------------------------------------------------
+ * This file implements rebalancing for the intrusive red-black tree. See
+ * rbtree.h. Missing children (NULL) count as black leaves.
+ *------------------------------------------------------------------------------
+ */
+
+#include "rbtree.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define is_red(n)       ((n) != NULL && (n)->red)
+
+/* Point whatever referenced 'old' (parent or root) at 'new' */
+static void rb_replace_child(rb_root_t* root, rb_node_t* parent, rb_node_t* old, rb_node_t* new) {
+    if (!parent) {
+        root->node = new;
+    } else if (parent->left == old) {
+        parent->left = new;
+    } else {
+        parent->right = new;
+    }
+}
+
+static void rb_rotate_left(rb_node_t* x, rb_root_t* root) {
+    rb_node_t* y = x->right;
+    x->right = y->left;
+    if (y->left) {
+        y->left->parent = x;
+    }
+    y->parent = x->parent;
+    rb_replace_child(root, x->parent, x, y);
+    y->left = x;
+    x->parent = y;
+}
+
+static void rb_rotate_right(rb_node_t* x, rb_root_t* root) {
+    rb_node_t* y = x->left;
+    x->left = y->right;
+    if (y->right) {
+        y->right->parent = x;
+    }
+    y->parent = x->parent;
+    rb_replace_child(root, x->parent, x, y);
+    y->right = x;
+    x->parent = y;
+}
+
+/* Rebalance after rb_link_node() */
+void rb_insert_color(rb_node_t* node, rb_root_t* root) {
+    rb_node_t* parent;
+
+    node->red = true;
+    while ((parent = node->parent) != NULL && parent->red) {
+        /* A red parent is never the root, so the grandparent exists */
+        rb_node_t* gparent = parent->parent;
+
+        if (parent == gparent->left) {
+            rb_node_t* uncle = gparent->right;
+            if (is_red(uncle)) {
+                uncle->red = false;
+                parent->red = false;
+                gparent->red = true;
+                node = gparent;
+                continue;
+            }
+            if (node == parent->right) {
+                rb_rotate_left(parent, root);
+                node = parent;
+                parent = node->parent;
+            }
+            parent->red = false;
+            gparent->red = true;
+            rb_rotate_right(gparent, root);
+        } else {
+            rb_node_t* uncle = gparent->left;
+            if (is_red(uncle)) {
+                uncle->red = false;
+                parent->red = false;
+                gparent->red = true;
+                node = gparent;
+                continue;
+            }
+            if (node == parent->left) {
+                rb_rotate_right(parent, root);
+                node = parent;
+                parent = node->parent;
+            }
+            parent->red = false;
+            gparent->red = true;
+            rb_rotate_left(gparent, root);
+        }
+    }
+    root->node->red = false;
+}
+
+/* A black node was removed above 'node' (possibly NULL), whose parent is
+ * 'parent': push the missing black back up or rotate it in */
+static void rb_erase_color(rb_node_t* node, rb_node_t* parent, rb_root_t* root) {
+    while (node != root->node && !is_red(node)) {
+        if (node == parent->left) {
+            rb_node_t* sibling = parent->right;
+            if (sibling->red) {
+                sibling->red = false;
+                parent->red = true;
+                rb_rotate_left(parent, root);
+                sibling = parent->right;
+            }
+            if (!is_red(sibling->left) && !is_red(sibling->right)) {
+                sibling->red = true;
+                node = parent;
+                parent = node->parent;
+                continue;
+            }
+            if (!is_red(sibling->right)) {
+                sibling->left->red = false;
+                sibling->red = true;
+                rb_rotate_right(sibling, root);
+                sibling = parent->right;
+            }
+            sibling->red = parent->red;
+            parent->red = false;
+            sibling->right->red = false;
+            rb_rotate_left(parent, root);
+            node = root->node;
+        } else {
+            rb_node_t* sibling = parent->left;
+            if (sibling->red) {
+                sibling->red = false;
+                parent->red = true;
+                rb_rotate_right(parent, root);
+                sibling = parent->left;
+            }
+            if (!is_red(sibling->left) && !is_red(sibling->right)) {
+                sibling->red = true;
+                node = parent;
+                parent = node->parent;
+                continue;
+            }
+            if (!is_red(sibling->left)) {
+                sibling->right->red = false;
+                sibling->red = true;
+                rb_rotate_left(sibling, root);
+                sibling = parent->left;
+            }
+            sibling->red = parent->red;
+            parent->red = false;
+            sibling->left->red = false;
+            rb_rotate_right(parent, root);
+            node = root->node;
+        }
+    }
+    if (node) {
+        node->red = false;
+    }
+}
+
+/* Unlink a node and rebalance */
+void rb_erase(rb_node_t* node, rb_root_t* root) {
+    rb_node_t* child;
+    rb_node_t* parent;
+    bool removed_red;
+
+    if (!node->left || !node->right) {
+        child = node->left ? node->left : node->right;
+        parent = node->parent;
+        removed_red = node->red;
+        if (child) {
+            child->parent = parent;
+        }
+        rb_replace_child(root, parent, node, child);
+    } else {
+        /* Two children: the in-order successor takes the node's place */
+        rb_node_t* successor = node->right;
+        while (successor->left) {
+            successor = successor->left;
+        }
+        removed_red = successor->red;
+        child = successor->right;
+
+        if (successor->parent == node) {
+            parent = successor;
+        } else {
+            parent = successor->parent;
+            if (child) {
+                child->parent = parent;
+            }
+            parent->left = child;
+            successor->right = node->right;
+            node->right->parent = successor;
+        }
+        successor->left = node->left;
+        node->left->parent = successor;
+        successor->parent = node->parent;
+        successor->red = node->red;
+        rb_replace_child(root, node->parent, node, successor);
+    }
+
+    if (!removed_red) {
+        rb_erase_color(child, parent, root);
+    }
+}
+
+rb_node_t* rb_first(const rb_root_t* root) {
+    rb_node_t* node = root->node;
+    if (!node) {
+        return NULL;
+    }
+    while (node->left) {
+        node = node->left;
+    }
+    return node;
+}
+
+rb_node_t* rb_next(const rb_node_t* node) {
+    if (node->right) {
+        node = node->right;
+        while (node->left) {
+            node = node->left;
+        }
+        return (rb_node_t*)node;
+    }
+    while (node->parent && node == node->parent->right) {
+        node = node->parent;
+    }
+    return node->parent;
+}
@@ -0,0 +1,63 @@
+#ifndef RBTREE_H
+#define RBTREE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*------------------------------------------------------------------------------
+ * Red-Black Tree
+ *------------------------------------------------------------------------------
+ * An intrusive balanced tree: the node is embedded in the owning structure
+ * and rb_entry() gets back to it. The tree does not compare keys itself.
+ * The caller walks down to the insertion point, links the node there and
+ * lets rb_insert_color() rebalance:
+ *
+ *     rb_node_t** link = &root->node;
+ *     rb_node_t* parent = NULL;
+ *     while (*link) {
+ *         parent = *link;
+ *         link = key < rb_entry(parent, foo_t, node)->key
+ *              ? &parent->left : &parent->right;
+ *     }
+ *     rb_link_node(&foo->node, parent, link);
+ *     rb_insert_color(&foo->node, root);
+ *
+ * Insert and erase are O(log n) with at most three rotations.
+ *------------------------------------------------------------------------------
+ */
+
+typedef struct rb_node {
+    struct rb_node* parent;
+    struct rb_node* left;
+    struct rb_node* right;
+    bool red;
+} rb_node_t;
+
+typedef struct {
+    rb_node_t* node;
+} rb_root_t;
+
+#define RB_ROOT { NULL }
+
+#define rb_entry(ptr, type, member) \
+    ((type*)((char*)(ptr) - offsetof(type, member)))
+
+static inline void rb_link_node(rb_node_t* node, rb_node_t* parent, rb_node_t** link) {
+    node->parent = parent;
+    node->left = NULL;
+    node->right = NULL;
+    *link = node;
+}
+
+/* Rebalance after rb_link_node() */
+void rb_insert_color(rb_node_t* node, rb_root_t* root);
+
+/* Unlink a node and rebalance */
+void rb_erase(rb_node_t* node, rb_root_t* root);
+
+/* In-order traversal */
+rb_node_t* rb_first(const rb_root_t* root);
+rb_node_t* rb_next(const rb_node_t* node);
+
+#endif /* RBTREE_H */
@@ -0,0 +1,624 @@
+/*------------------------------------------------------------------------------
+ * Kernel Threads and Fair Scheduling
+ *------------------------------------------------------------------------------
+ * This file implements thread creation, the vruntime-ordered runqueue and
+ * the context switch. See sched.h.
+ *------------------------------------------------------------------------------
+ */
+
+#include "sched.h"
+#include "kernel.h"
+#include "memory.h"
+#include "percpu.h"
+#include "string.h"
+#include "../drivers/timer.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Nice level to weight, and 2^32 / weight. Neighbouring levels differ by
+ * a factor of about 1.25, i.e. ~10% of CPU between two competing threads. */
+static const uint32_t nice_to_weight[40] = {
+    88761, 71755, 56483, 46273, 36291,
+    29154, 23254, 18705, 14949, 11916,
+     9548,  7620,  6100,  4904,  3906,
+     3121,  2501,  1991,  1586,  1277,
+     1024,   820,   655,   526,   423,
+      335,   272,   215,   172,   137,
+      110,    87,    70,    56,    45,
+       36,    29,    23,    18,    15,
+};
+
+static const uint32_t nice_to_inv_weight[40] = {
+        48388,     59856,     76040,     92818,    118348,
+       147320,    184698,    229616,    287308,    360437,
+       449829,    563644,    704093,    875809,   1099582,
+      1376151,   1717300,   2157191,   2708050,   3363326,
+      4194304,   5237765,   6557202,   8165337,  10153587,
+     12820798,  15790321,  19976592,  24970740,  31350126,
+     39045157,  49367440,  61356676,  76695844,  95443717,
+    119304647, 148102320, 186737708, 238609294, 286331153,
+};
+
+static runqueue_t runqueues[NR_CPUS];
+#define this_rq()           (&runqueues[this_cpu_read(cpu_id)])
+
+static thread_t main_thread;
+static thread_t* threads = NULL;        /* All threads, newest first */
+static uint32_t next_thread_id = 0;
+static bool initialized = false;
+static volatile bool irq_pending = false;
+
+/* Tunables converted to TSC cycles by sched_init() */
+static uint32_t latency_cycles;
+static uint32_t min_granularity_cycles;
+static uint32_t wakeup_granularity_cycles;
+
+static void copy_name(char* dest, const char* src);
+
+/* Save callee-saved registers and the stack pointer of 'prev', resume
+ * 'next' where it last called this. Returns the thread switched away from,
+ * as seen by the resumed thread. */
+thread_t* sched_switch_stack(thread_t* prev, thread_t* next);
+
+asm(".pushsection .text\n"
+    ".globl sched_switch_stack\n"
+    "sched_switch_stack:\n"
+    "    movl 4(%esp), %eax\n"
+    "    movl 8(%esp), %edx\n"
+    "    pushl %ebp\n"
+    "    pushl %ebx\n"
+    "    pushl %esi\n"
+    "    pushl %edi\n"
+    "    movl %esp, (%eax)\n"
+    "    movl (%edx), %esp\n"
+    "    popl %edi\n"
+    "    popl %esi\n"
+    "    popl %ebx\n"
+    "    popl %ebp\n"
+    "    ret\n"
+    "sched_thread_trampoline:\n"
+    "    pushl %eax\n"
+    "    call sched_thread_start\n"
+    ".popsection\n");
+
+void sched_thread_trampoline(void);
+
+/*------------------------------------------------------------------------------
+ * Virtual Runtime
+ *------------------------------------------------------------------------------
+ */
+
+/* (a * mul) >> 32 without a 64x64 product */
+static inline uint64_t mul_u64_u32_shr32(uint64_t a, uint32_t mul) {
+    uint64_t lo = ((uint64_t)(uint32_t)a * mul) >> 32;
+    return lo + (uint64_t)(uint32_t)(a >> 32) * mul;
+}
+
+/* Run time to vruntime: delta * NICE_0_WEIGHT / weight */
+static uint64_t calc_delta_fair(uint64_t delta, const thread_t* t) {
+    if (t->weight == NICE_0_WEIGHT) {
+        return delta;
+    }
+    return mul_u64_u32_shr32(delta * NICE_0_WEIGHT, t->inv_weight);
+}
+
+static inline bool vruntime_before(uint64_t a, uint64_t b) {
+    return (int64_t)(a - b) < 0;
+}
+
+static void set_nice(thread_t* t, int nice) {
+    if (nice < NICE_MIN) nice = NICE_MIN;
+    if (nice > NICE_MAX) nice = NICE_MAX;
+    t->nice = nice;
+    t->weight = nice_to_weight[nice - NICE_MIN];
+    t->inv_weight = nice_to_inv_weight[nice - NICE_MIN];
+}
+
+/* min_vruntime only moves forward: max(itself, min(curr, leftmost)) */
+static void update_min_vruntime(runqueue_t* rq) {
+    bool found = false;
+    uint64_t vruntime = 0;
+
+    if (rq->curr && rq->curr->on_rq) {
+        vruntime = rq->curr->vruntime;
+        found = true;
+    }
+    if (rq->leftmost) {
+        uint64_t left = rb_entry(rq->leftmost, thread_t, run_node)->vruntime;
+        if (!found || vruntime_before(left, vruntime)) {
+            vruntime = left;
+        }
+        found = true;
+    }
+    if (found && vruntime_before(rq->min_vruntime, vruntime)) {
+        rq->min_vruntime = vruntime;
+    }
+}
+
+/* Charge the running thread for the time since it was last charged */
+static void update_curr(runqueue_t* rq) {
+    thread_t* curr = rq->curr;
+    if (!curr || !curr->on_rq) {
+        return;
+    }
+
+    uint64_t now = timer_read_tsc();
+    uint64_t delta = now - curr->exec_start;
+    curr->exec_start = now;
+    curr->sum_exec += delta;
+    curr->vruntime += calc_delta_fair(delta, curr);
+    update_min_vruntime(rq);
+}
+
+/* Wall-clock share of the latency period for a thread */
+static uint64_t sched_slice(const runqueue_t* rq, const thread_t* t) {
+    uint32_t nr = rq->nr_running + (t->on_rq ? 0 : 1);
+    uint32_t load = rq->load + (t->on_rq ? 0 : t->weight);
+    uint64_t period = latency_cycles;
+    if (nr > latency_cycles / min_granularity_cycles) {
+        period = (uint64_t)nr * min_granularity_cycles;
+    }
+    return div64(period * t->weight, load);
+}
+
+/* Starting vruntime for a new or waking thread */
+static void place_thread(runqueue_t* rq, thread_t* t, bool initial) {
+    uint64_t vruntime = rq->min_vruntime;
+
+    if (initial) {
+        /* Start debit: a new thread waits out one slice */
+        vruntime += calc_delta_fair(sched_slice(rq, t), t);
+        t->vruntime = vruntime;
+        return;
+    }
+
+    /* Sleeper credit, capped so long sleeps bank nothing extra */
+    vruntime -= latency_cycles / 2;
+    if (vruntime_before(t->vruntime, vruntime)) {
+        t->vruntime = vruntime;
+    }
+}
+
+/*------------------------------------------------------------------------------
+ * Runqueue
+ *------------------------------------------------------------------------------
+ */
+
+static void tree_insert(runqueue_t* rq, thread_t* t) {
+    rb_node_t** link = &rq->tasks.node;
+    rb_node_t* parent = NULL;
+    bool leftmost = true;
+
+    while (*link) {
+        parent = *link;
+        if (vruntime_before(t->vruntime, rb_entry(parent, thread_t, run_node)->vruntime)) {
+            link = &parent->left;
+        } else {
+            link = &parent->right;
+            leftmost = false;
+        }
+    }
+    rb_link_node(&t->run_node, parent, link);
+    rb_insert_color(&t->run_node, &rq->tasks);
+    if (leftmost) {
+        rq->leftmost = &t->run_node;
+    }
+}
+
+static void tree_remove(runqueue_t* rq, thread_t* t) {
+    if (rq->leftmost == &t->run_node) {
+        rq->leftmost = rb_next(&t->run_node);
+    }
+    rb_erase(&t->run_node, &rq->tasks);
+}
+
+static void enqueue_thread(runqueue_t* rq, thread_t* t) {
+    t->state = THREAD_RUNNABLE;
+    tree_insert(rq, t);
+    t->on_rq = true;
+    rq->nr_running++;
+    rq->load += t->weight;
+}
+
+static void dequeue_thread(runqueue_t* rq, thread_t* t) {
+    t->on_rq = false;
+    rq->nr_running--;
+    rq->load -= t->weight;
+}
+
+/* A woken thread far enough behind the running one takes the CPU */
+static void check_preempt_wakeup(runqueue_t* rq, thread_t* t) {
+    thread_t* curr = rq->curr;
+    if (!curr || curr->state != THREAD_RUNNING) {
+        rq->need_resched = true;
+        return;
+    }
+
+    update_curr(rq);
+    int64_t behind = (int64_t)(curr->vruntime - t->vruntime);
+    if (behind > (int64_t)calc_delta_fair(wakeup_granularity_cycles, t)) {
+        rq->need_resched = true;
+    }
+}
+
+/* The running thread used up its slice, or fell too far behind */
+static void check_preempt_tick(runqueue_t* rq) {
+    thread_t* curr = rq->curr;
+    if (!curr || curr->state != THREAD_RUNNING || rq->nr_running < 2) {
+        return;
+    }
+
+    uint64_t ran = curr->sum_exec - curr->prev_sum_exec;
+    uint64_t ideal = sched_slice(rq, curr);
+    if (ran > ideal) {
+        rq->need_resched = true;
+        return;
+    }
+    if (ran >= min_granularity_cycles && rq->leftmost) {
+        thread_t* left = rb_entry(rq->leftmost, thread_t, run_node);
+        if ((int64_t)(curr->vruntime - left->vruntime) > (int64_t)ideal) {
+            rq->need_resched = true;
+        }
+    }
+}
+
+/*------------------------------------------------------------------------------
+ * Switching
+ *------------------------------------------------------------------------------
+ */
+
+/* Runs on the incoming thread right after the stack switch */
+static void sched_finish_switch(thread_t* last) {
+    if (last->state != THREAD_DEAD) {
+        return;
+    }
+
+    /* Its stack is no longer in use: free it */
+    thread_t** link = &threads;
+    while (*link && *link != last) {
+        link = &(*link)->next;
+    }
+    if (*link) {
+        *link = last->next;
+    }
+    trace_unregister_task(&last->trace);
+    fpu_context_release(&last->fpu);
+    kfree(last->stack);
+    kfree(last);
+}
+
+/* First code a new thread runs, entered from the trampoline */
+static void __attribute__((used, noreturn)) sched_thread_start(thread_t* last) {
+    sched_finish_switch(last);
+    asm volatile("sti");
+
+    thread_t* self = thread_current();
+    self->fn(self->arg);
+    thread_exit();
+}
+
+static void __attribute__((noreturn)) sched_stack_overflow(const thread_t* t) {
+    terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_RED));
+    terminal_writestring("Kernel stack overflow in thread ");
+    terminal_writestring(t->name);
+    terminal_writestring("\nSystem halted.\n");
+    for (;;) {
+        asm volatile("cli; hlt");
+    }
+}
+
+void schedule(void) {
+    uint32_t flags;
+    asm volatile("pushfl; popl %0; cli" : "=r"(flags) :: "memory");
+
+    runqueue_t* rq = this_rq();
+    thread_t* prev = rq->curr;
+    bool blocked = prev->state != THREAD_RUNNING;
+
+    if (prev->stack && *(uint32_t*)prev->stack != THREAD_STACK_CANARY) {
+        sched_stack_overflow(prev);
+    }
+
+    update_curr(rq);
+    rq->need_resched = false;
+
+    if (!blocked) {
+        /* Still counted in the load: just put it back in the tree */
+        prev->state = THREAD_RUNNABLE;
+        tree_insert(rq, prev);
+    } else {
+        if (prev->on_rq) {
+            dequeue_thread(rq, prev);
+        }
+        trace_sched_switch_out(&prev->trace);
+    }
+
+    /* Nothing runnable: halt until an interrupt wakes a thread */
+    while (!rq->leftmost) {
+        cpu_idle();
+        asm volatile("cli" ::: "memory");
+    }
+
+    thread_t* next = rb_entry(rq->leftmost, thread_t, run_node);
+    tree_remove(rq, next);
+    next->state = THREAD_RUNNING;
+    next->exec_start = timer_read_tsc();
+    next->prev_sum_exec = next->sum_exec;
+    rq->curr = next;
+    update_min_vruntime(rq);
+
+    if (next != prev) {
+        if (!blocked) {
+            trace_sched_switch_out(&prev->trace);
+        }
+        trace_sched_switch_in(&next->trace);
+        rq->switches++;
+        next->switches++;
+
+        fpu_switch_to(&next->fpu);
+        this_cpu_write(current_thread, next);
+        thread_t* last = sched_switch_stack(prev, next);
+        sched_finish_switch(last);
+    } else if (blocked) {
+        trace_sched_switch_in(&next->trace);
+    }
+
+    asm volatile("pushl %0; popfl" :: "r"(flags) : "memory", "cc");
+}
+
+/*------------------------------------------------------------------------------
+ * Public Interface
+ *------------------------------------------------------------------------------
+ */
+
+/* Adopt the boot context as the main thread */
+void sched_init(void) {
+    uint32_t khz = timer_tsc_khz();
+    if (khz == 0) {
+        khz = 1000000;                  /* Uncalibrated: assume 1 GHz */
+    }
+    latency_cycles = SCHED_LATENCY_MS * khz;
+    min_granularity_cycles = SCHED_MIN_GRANULARITY_US * (khz / 1000);
+    wakeup_granularity_cycles = SCHED_WAKEUP_GRANULARITY_US * (khz / 1000);
+
+    memset(runqueues, 0, sizeof(runqueues));
+    runqueue_t* rq = this_rq();
+
+    thread_t* t = &main_thread;
+    memset(t, 0, sizeof(*t));
+    t->id = next_thread_id++;
+    copy_name(t->name, "main");
+    set_nice(t, 0);
+    fpu_context_init(&t->fpu);
+    trace_register_task(&t->trace, t->name);
+
+    t->state = THREAD_RUNNING;
+    t->on_rq = true;
+    t->exec_start = timer_read_tsc();
+    rq->nr_running = 1;
+    rq->load = t->weight;
+    rq->curr = t;
+    threads = t;
+
+    asm volatile("cli");
+    fpu_switch_to(&t->fpu);
+    this_cpu_write(current_thread, t);
+    initialized = true;
+    asm volatile("sti");
+}
+
+/* Create a runnable thread; NULL if out of memory */
+thread_t* thread_create(const char* name, thread_fn_t fn, void* arg, int nice) {
+    thread_t* t = kmalloc_aligned(sizeof(thread_t), 16);
+    if (!t) {
+        return NULL;
+    }
+    memset(t, 0, sizeof(*t));
+
+    t->stack = kmalloc_aligned(THREAD_STACK_SIZE, 16);
+    if (!t->stack) {
+        kfree(t);
+        return NULL;
+    }
+    *(uint32_t*)t->stack = THREAD_STACK_CANARY;
+
+    /* Initial frame popped by sched_switch_stack: edi, esi, ebx, ebp, return */
+    uint32_t* sp = (uint32_t*)((uint8_t*)t->stack + THREAD_STACK_SIZE);
+    *--sp = (uint32_t)sched_thread_trampoline;
+    *--sp = 0;
+    *--sp = 0;
+    *--sp = 0;
+    *--sp = 0;
+    t->esp = (uint32_t)sp;
+
+    copy_name(t->name, name);
+    t->fn = fn;
+    t->arg = arg;
+    set_nice(t, nice);
+    fpu_context_init(&t->fpu);
+    trace_register_task(&t->trace, t->name);
+
+    uint32_t flags;
+    asm volatile("pushfl; popl %0; cli" : "=r"(flags) :: "memory");
+    runqueue_t* rq = this_rq();
+    t->id = next_thread_id++;
+    t->next = threads;
+    threads = t;
+    update_curr(rq);
+    place_thread(rq, t, true);
+    enqueue_thread(rq, t);
+    trace_sched_enqueue(&t->trace);
+    asm volatile("pushl %0; popfl" :: "r"(flags) : "memory", "cc");
+    return t;
+}
+
+/* End the calling thread; the next thread to run frees it */
+void thread_exit(void) {
+    asm volatile("cli");
+    thread_current()->state = THREAD_DEAD;
+    schedule();
+    for (;;) {
+        asm volatile("hlt");
+    }
+}
+
+thread_t* thread_current(void) {
+    return (thread_t*)this_cpu_read(current_thread);
+}
+
+void thread_set_nice(thread_t* t, int nice) {
+    uint32_t flags;
+    asm volatile("pushfl; popl %0; cli" : "=r"(flags) :: "memory");
+    runqueue_t* rq = this_rq();
+    if (t == rq->curr) {
+        update_curr(rq);
+    }
+    if (t->on_rq) {
+        rq->load -= t->weight;
+    }
+    set_nice(t, nice);
+    if (t->on_rq) {
+        rq->load += t->weight;
+    }
+    asm volatile("pushl %0; popfl" :: "r"(flags) : "memory", "cc");
+}
+
+/* Let any thread with less vruntime run */
+void thread_yield(void) {
+    schedule();
+}
+
+void thread_sleep_ms(uint32_t ms) {
+    if (ms == 0) {
+        thread_yield();
+        return;
+    }
+
+    uint32_t flags;
+    asm volatile("pushfl; popl %0; cli" : "=r"(flags) :: "memory");
+    thread_t* self = thread_current();
+    self->wake_at_ms = timer_get_uptime_ms() + ms;
+    self->state = THREAD_SLEEPING;
+    schedule();
+    asm volatile("pushl %0; popfl" :: "r"(flags) : "memory", "cc");
+}
+
+void thread_wakeup(thread_t* t) {
+    uint32_t flags;
+    asm volatile("pushfl; popl %0; cli" : "=r"(flags) :: "memory");
+    if (t->state == THREAD_SLEEPING && !t->on_rq) {
+        runqueue_t* rq = this_rq();
+        t->wake_at_ms = 0;
+        t->wait_interrupt = false;
+        trace_sched_wakeup(&t->trace);
+        update_curr(rq);
+        place_thread(rq, t, false);
+        enqueue_thread(rq, t);
+        trace_sched_enqueue(&t->trace);
+        check_preempt_wakeup(rq, t);
+    }
+    asm volatile("pushl %0; popfl" :: "r"(flags) : "memory", "cc");
+}
+
+void cond_resched(void) {
+    if (initialized && this_rq()->need_resched) {
+        schedule();
+    }
+}
+
+/* Block until the next hardware interrupt. An interrupt that arrived
+ * since the last call returns at once, so none is missed. */
+void sched_wait_interrupt(void) {
+    if (!initialized) {
+        cpu_idle();
+        return;
+    }
+
+    uint32_t flags;
+    asm volatile("pushfl; popl %0; cli" : "=r"(flags) :: "memory");
+    if (irq_pending) {
+        irq_pending = false;
+    } else {
+        thread_t* self = thread_current();
+        self->wait_interrupt = true;
+        self->state = THREAD_SLEEPING;
+        schedule();
+    }
+    asm volatile("pushl %0; popfl" :: "r"(flags) : "memory", "cc");
+}
+
+/* Every hardware interrupt: wake the threads waiting for one */
+void sched_irq_wakeup(void) {
+    if (!initialized) {
+        return;
+    }
+
+    bool woke = false;
+    for (thread_t* t = threads; t; t = t->next) {
+        if (t->wait_interrupt && t->state == THREAD_SLEEPING) {
+            thread_wakeup(t);
+            woke = true;
+        }
+    }
+    if (!woke) {
+        irq_pending = true;
+    }
+}
+
+/* Timer interrupt: charge the running thread, end timed sleeps, and ask
+ * for a switch when the slice is used up */
+void sched_tick(void) {
+    if (!initialized) {
+        return;
+    }
+
+    runqueue_t* rq = this_rq();
+    update_curr(rq);
+
+    uint64_t now_ms = timer_get_uptime_ms();
+    for (thread_t* t = threads; t; t = t->next) {
+        if (t->state == THREAD_SLEEPING && t->wake_at_ms != 0 && now_ms >= t->wake_at_ms) {
+            thread_wakeup(t);
+        }
+    }
+
+    check_preempt_tick(rq);
+}
+
+thread_t* sched_get_thread(uint32_t index) {
+    thread_t* t = threads;
+    while (t && index-- > 0) {
+        t = t->next;
+    }
+    return t;
+}
+
+const runqueue_t* sched_get_runqueue(void) {
+    return this_rq();
+}
+
+const char* thread_state_name(thread_state_t state) {
+    switch (state) {
+        case THREAD_RUNNABLE: return "ready";
+        case THREAD_RUNNING:  return "run";
+        case THREAD_SLEEPING: return "sleep";
+        case THREAD_DEAD:     return "dead";
+    }
+    return "?";
+}
+
+/*------------------------------------------------------------------------------
+ * Helper Functions
+ *------------------------------------------------------------------------------
+ */
+
+/* Copy a thread name, truncated to fit */
+static void copy_name(char* dest, const char* src) {
+    size_t i = 0;
+    while (src[i] && i < THREAD_NAME_LENGTH - 1) {
+        dest[i] = src[i];
+        i++;
+    }
+    dest[i] = '\0';
+}
@@ -0,0 +1,141 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "rbtree.h"
+#include "fpu.h"
+#include "trace.h"
+
+/*------------------------------------------------------------------------------
+ * Kernel Threads and Fair Scheduling
+ *------------------------------------------------------------------------------
+ * Runnable threads are ordered by virtual runtime in a red-black tree, and
+ * the leftmost (least served) one runs next:
+ *
+ * - A thread's vruntime advances by its TSC run time scaled by
+ *   NICE_0_WEIGHT / weight, with weights from the nice level (-20..19,
+ *   each step about 10% of CPU share). Equal vruntimes mean fair shares.
+ * - Over SCHED_LATENCY_MS every runnable thread should get a turn. Each
+ *   one's slice is its weighted share of that period. The period grows
+ *   when there are more threads than it has SCHED_MIN_GRANULARITY_US
+ *   slices.
+ * - A new thread starts one slice behind min_vruntime, so spawning cannot
+ *   jump the queue. A thread that slept resumes at most half a latency
+ *   period before min_vruntime. That sleeper credit lets I/O-bound and
+ *   interactive threads (the shell) run ahead of CPU hogs on wakeup
+ *   without letting long sleepers bank unlimited CPU.
+ * - A wakeup preempts the running thread if the woken one is more than
+ *   SCHED_WAKEUP_GRANULARITY_US of vruntime behind.
+ *
+ * Kernel code shares unlocked data everywhere, so switches only happen at
+ * defined points: blocking, thread_yield(), and cond_resched(). The timer
+ * tick and wakeups only set need_resched. Long-running threads must call
+ * cond_resched() regularly.
+ *
+ * The boot context becomes the "main" thread that runs the shell and the
+ * pollers. It sleeps in sched_wait_interrupt() until the next hardware
+ * interrupt. When nothing is runnable, schedule() halts in cpu_idle().
+ *------------------------------------------------------------------------------
+ */
+
+#define THREAD_STACK_SIZE               8192
+#define THREAD_NAME_LENGTH              16
+#define THREAD_STACK_CANARY             0x5CED5CED
+
+#define NICE_MIN                        (-20)
+#define NICE_MAX                        19
+#define NICE_0_WEIGHT                   1024
+
+#define SCHED_LATENCY_MS                6
+#define SCHED_MIN_GRANULARITY_US        750
+#define SCHED_WAKEUP_GRANULARITY_US     1000
+
+typedef enum {
+    THREAD_RUNNABLE,                    /* In the tree, waiting for the CPU */
+    THREAD_RUNNING,
+    THREAD_SLEEPING,
+    THREAD_DEAD,                        /* Freed by the next thread to run */
+} thread_state_t;
+
+typedef void (*thread_fn_t)(void* arg);
+
+typedef struct thread {
+    uint32_t esp;                       /* Saved stack pointer; must stay first */
+    uint32_t id;
+    char name[THREAD_NAME_LENGTH];
+    thread_state_t state;
+
+    /* Fair scheduling */
+    int nice;
+    uint32_t weight;
+    uint32_t inv_weight;                /* 2^32 / weight */
+    uint64_t vruntime;
+    uint64_t exec_start;                /* TSC when accounting last caught up */
+    uint64_t sum_exec;                  /* TSC cycles run */
+    uint64_t prev_sum_exec;             /* sum_exec when last switched in */
+    rb_node_t run_node;
+    bool on_rq;                         /* Counted in the runqueue load */
+
+    /* Sleeping */
+    uint64_t wake_at_ms;                /* Timed sleep deadline, 0 if none */
+    bool wait_interrupt;
+
+    uint32_t switches;
+    uint64_t monitor_exec;              /* sum_exec at top's last refresh */
+
+    void* stack;                        /* NULL for the boot thread */
+    thread_fn_t fn;
+    void* arg;
+    fpu_context_t fpu;
+    trace_task_t trace;
+    struct thread* next;                /* All threads */
+} thread_t;
+
+/* Per-CPU runqueue */
+typedef struct {
+    rb_root_t tasks;                    /* Runnable threads by vruntime */
+    rb_node_t* leftmost;
+    thread_t* curr;
+    uint32_t nr_running;                /* Including curr if runnable */
+    uint32_t load;                      /* Sum of on_rq weights */
+    uint64_t min_vruntime;
+    bool need_resched;
+    uint32_t switches;
+} runqueue_t;
+
+/* Adopt the boot context as the main thread */
+void sched_init(void);
+
+/* Create a runnable thread; NULL if out of memory */
+thread_t* thread_create(const char* name, thread_fn_t fn, void* arg, int nice);
+
+/* End the calling thread */
+void thread_exit(void) __attribute__((noreturn));
+
+thread_t* thread_current(void);
+void thread_set_nice(thread_t* thread, int nice);
+void thread_yield(void);
+void thread_sleep_ms(uint32_t ms);
+void thread_wakeup(thread_t* thread);
+
+/* Switch to the leftmost thread (or idle until there is one) */
+void schedule(void);
+
+/* Switch if the tick or a wakeup asked for it */
+void cond_resched(void);
+
+/* Block until the next hardware interrupt */
+void sched_wait_interrupt(void);
+
+/* Interrupt hooks: wake interrupt waiters / account the tick */
+void sched_irq_wakeup(void);
+void sched_tick(void);
+
+/* Enumeration for ps/top */
+thread_t* sched_get_thread(uint32_t index);
+const runqueue_t* sched_get_runqueue(void);
+const char* thread_state_name(thread_state_t state);
+
+#endif /* SCHED_H */
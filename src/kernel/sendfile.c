@@ -0,0 +1,249 @@
+/*------------------------------------------------------------------------------
+ * sendfile/splice
+ *------------------------------------------------------------------------------
+ * This file implements sendfile() from FAT32 files to console, file and
+ * pipe sinks on top of the block buffer cache. See sendfile.h.
+ *------------------------------------------------------------------------------
+ */
+
+#include "sendfile.h"
+#include "fat32.h"
+#include "bcache.h"
+#include "kernel.h"
+#include "string.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*------------------------------------------------------------------------------
+ * sendfile
+ *------------------------------------------------------------------------------
+ */
+
+/* Hand one chunk to the sink, by reference if it can take one */
+static size_t sendfile_push(sendfile_sink_t* sink, bcache_buf_t* buf, uint32_t offset, uint32_t len) {
+    size_t n;
+
+    if (sink->splice) {
+        n = sink->splice(sink, buf, offset, len);
+    } else if (sink->write) {
+        n = sink->write(sink, buf->data + offset, len);
+    } else {
+        n = 0;
+    }
+
+    sink->bytes += n;
+    return n;
+}
+
+/* Move up to len bytes of src to sink */
+size_t sendfile(sendfile_sink_t* sink, fat32_file_t* src, uint32_t* offset, size_t len) {
+    if (!sink || !src || !src->is_open) {
+        return 0;
+    }
+
+    uint32_t saved_position = fat32_tell(src);
+    if (offset && !fat32_seek(src, *offset)) {
+        return 0;
+    }
+
+    size_t moved = 0;
+    while (moved < len) {
+        uint32_t block_offset;
+        uint32_t avail;
+        bcache_buf_t* buf = fat32_get_block(src, &block_offset, &avail);
+
+        if (!buf) {
+            /* Cache unusable (odd sector size or every block pinned):
+             * fall back to a bounce buffer for copying sinks */
+            uint8_t bounce[BCACHE_SECTOR_SIZE];
+            size_t want = len - moved;
+            if (!sink->write || want == 0) {
+                break;
+            }
+            if (want > sizeof(bounce)) {
+                want = sizeof(bounce);
+            }
+            size_t got = fat32_read(src, bounce, want);
+            if (got == 0) {
+                break;
+            }
+            size_t n = sink->write(sink, bounce, got);
+            sink->bytes += n;
+            moved += n;
+            if (n < got) {
+                /* Un-read what the sink refused */
+                fat32_seek(src, fat32_tell(src) - (uint32_t)(got - n));
+                break;
+            }
+            continue;
+        }
+
+        uint32_t chunk = avail;
+        if (chunk > len - moved) {
+            chunk = (uint32_t)(len - moved);
+        }
+
+        size_t n = sendfile_push(sink, buf, block_offset, chunk);
+        bcache_put(buf);
+
+        fat32_advance(src, (uint32_t)n);
+        moved += n;
+
+        if (n < chunk) {
+            break;  /* Sink is full */
+        }
+    }
+
+    if (offset) {
+        *offset += (uint32_t)moved;
+        fat32_seek(src, saved_position);
+    }
+
+    return moved;
+}
+
+/*------------------------------------------------------------------------------
+ * Console sink
+ *------------------------------------------------------------------------------
+ */
+
+static size_t console_sink_write(sendfile_sink_t* sink, const uint8_t* data, size_t len) {
+    (void)sink;
+
+    for (size_t i = 0; i < len; i++) {
+        char c = (char)data[i];
+        if (c == '\n') {
+            terminal_putchar('\n');
+        } else if (c == '\t') {
+            terminal_writestring("    ");  /* Replace tabs with spaces */
+        } else if (c >= 32 && c <= 126) {
+            terminal_putchar(c);  /* Printable ASCII */
+        } else {
+            terminal_putchar('?');  /* Replace non-printable with ? */
+        }
+    }
+
+    return len;
+}
+
+void sendfile_sink_console(sendfile_sink_t* sink) {
+    sink->write = console_sink_write;
+    sink->splice = NULL;
+    sink->ctx = NULL;
+    sink->bytes = 0;
+}
+
+/*------------------------------------------------------------------------------
+ * File sink
+ *------------------------------------------------------------------------------
+ */
+
+static size_t file_sink_write(sendfile_sink_t* sink, const uint8_t* data, size_t len) {
+    return fat32_write((fat32_file_t*)sink->ctx, data, len);
+}
+
+void sendfile_sink_file(sendfile_sink_t* sink, fat32_file_t* file) {
+    sink->write = file_sink_write;
+    sink->splice = NULL;
+    sink->ctx = file;
+    sink->bytes = 0;
+}
+
+/*------------------------------------------------------------------------------
+ * Pipes
+ *------------------------------------------------------------------------------
+ */
+
+static size_t pipe_sink_splice(sendfile_sink_t* sink, bcache_buf_t* buf, uint32_t offset, uint32_t len) {
+    pipe_t* pipe = (pipe_t*)sink->ctx;
+
+    if (pipe->tail - pipe->head >= PIPE_SLOTS || len == 0) {
+        return 0;
+    }
+
+    pipe_slot_t* slot = &pipe->slots[pipe->tail % PIPE_SLOTS];
+    bcache_hold(buf);
+    slot->buf = buf;
+    slot->offset = offset;
+    slot->len = len;
+    pipe->tail++;
+    pipe->bytes += len;
+
+    return len;
+}
+
+void sendfile_sink_pipe(sendfile_sink_t* sink, pipe_t* pipe) {
+    sink->write = NULL;
+    sink->splice = pipe_sink_splice;
+    sink->ctx = pipe;
+    sink->bytes = 0;
+}
+
+void pipe_init(pipe_t* pipe) {
+    memset(pipe, 0, sizeof(pipe_t));
+}
+
+/* Consume n bytes from the head slot, releasing it when drained */
+static void pipe_consume(pipe_t* pipe, pipe_slot_t* slot, uint32_t n) {
+    slot->offset += n;
+    slot->len -= n;
+    pipe->bytes -= n;
+
+    if (slot->len == 0) {
+        bcache_put(slot->buf);
+        slot->buf = NULL;
+        pipe->head++;
+    }
+}
+
+/* Copy queued data out of the pipe */
+size_t pipe_read(pipe_t* pipe, void* buffer, size_t len) {
+    uint8_t* dest = (uint8_t*)buffer;
+    size_t copied = 0;
+
+    while (copied < len && pipe->head != pipe->tail) {
+        pipe_slot_t* slot = &pipe->slots[pipe->head % PIPE_SLOTS];
+        uint32_t n = slot->len;
+        if (n > len - copied) {
+            n = (uint32_t)(len - copied);
+        }
+
+        memcpy(dest + copied, slot->buf->data + slot->offset, n);
+        copied += n;
+        pipe_consume(pipe, slot, n);
+    }
+
+    return copied;
+}
+
+/* Forward queued data to another sink, by reference where possible */
+size_t pipe_splice(pipe_t* pipe, sendfile_sink_t* sink, size_t len) {
+    size_t moved = 0;
+
+    while (moved < len && pipe->head != pipe->tail) {
+        pipe_slot_t* slot = &pipe->slots[pipe->head % PIPE_SLOTS];
+        uint32_t chunk = slot->len;
+        if (chunk > len - moved) {
+            chunk = (uint32_t)(len - moved);
+        }
+
+        size_t n = sendfile_push(sink, slot->buf, slot->offset, chunk);
+        moved += n;
+        pipe_consume(pipe, slot, (uint32_t)n);
+
+        if (n < chunk) {
+            break;
+        }
+    }
+
+    return moved;
+}
+
+/* Drop every queued reference */
+void pipe_release(pipe_t* pipe) {
+    while (pipe->head != pipe->tail) {
+        pipe_slot_t* slot = &pipe->slots[pipe->head % PIPE_SLOTS];
+        pipe_consume(pipe, slot, slot->len);
+    }
+}
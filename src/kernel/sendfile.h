@@ -0,0 +1,67 @@
+#ifndef SENDFILE_H
+#define SENDFILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "fat32.h"
+#include "bcache.h"
+
+/*------------------------------------------------------------------------------
+ * sendfile/splice
+ *------------------------------------------------------------------------------
+ * Moves file data to a sink straight out of the block buffer cache instead
+ * of bouncing it through a caller-supplied buffer.
+ *
+ * A sink either copies the bytes it is given (write) or, if it supports
+ * splice, takes a pin on the cache block and keeps a reference to the data
+ * without copying it at all. Pipes are splice sinks: they queue block
+ * references which are later copied out once by the reader, or forwarded by
+ * reference again with pipe_splice().
+ *------------------------------------------------------------------------------
+ */
+
+typedef struct sendfile_sink sendfile_sink_t;
+
+/* Output endpoint for sendfile()/pipe_splice() */
+struct sendfile_sink {
+    /* Copy up to len bytes out of data; returns bytes consumed */
+    size_t (*write)(sendfile_sink_t* sink, const uint8_t* data, size_t len);
+    /* Optional: take a reference to len bytes at buf->data + offset */
+    size_t (*splice)(sendfile_sink_t* sink, bcache_buf_t* buf, uint32_t offset, uint32_t len);
+    void*    ctx;                   /* Sink private data */
+    uint32_t bytes;                 /* Total bytes accepted */
+};
+
+/* Pipe buffer of spliced cache references */
+#define PIPE_SLOTS 16
+
+typedef struct {
+    bcache_buf_t* buf;              /* Pinned cache block */
+    uint32_t offset;                /* Start of data inside buf->data */
+    uint32_t len;                   /* Bytes left in this slot */
+} pipe_slot_t;
+
+typedef struct {
+    pipe_slot_t slots[PIPE_SLOTS];
+    uint32_t head;                  /* Next slot to read */
+    uint32_t tail;                  /* Next slot to fill */
+    uint32_t bytes;                 /* Bytes queued */
+} pipe_t;
+
+/* Move up to len bytes of src to sink. If offset is non-NULL, read from
+ * *offset and advance it, leaving the file position untouched. */
+size_t sendfile(sendfile_sink_t* sink, fat32_file_t* src, uint32_t* offset, size_t len);
+
+/* Sink constructors */
+void sendfile_sink_console(sendfile_sink_t* sink);
+void sendfile_sink_file(sendfile_sink_t* sink, fat32_file_t* file);
+void sendfile_sink_pipe(sendfile_sink_t* sink, pipe_t* pipe);
+
+/* Pipe operations */
+void pipe_init(pipe_t* pipe);
+size_t pipe_read(pipe_t* pipe, void* buffer, size_t len);
+size_t pipe_splice(pipe_t* pipe, sendfile_sink_t* sink, size_t len);
+void pipe_release(pipe_t* pipe);
+
+#endif /* SENDFILE_H */
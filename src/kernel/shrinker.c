@@ -0,0 +1,104 @@
+/*------------------------------------------------------------------------------
+ * Cache Shrinkers
+ *------------------------------------------------------------------------------
+ * This file implements the shrinker registry and the reclaim passes run
+ * for failing allocations and from the idle loop. See shrinker.h.
+ *------------------------------------------------------------------------------
+ */
+
+#include "shrinker.h"
+#include "memory.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+static shrinker_t* shrinkers = NULL;
+static shrinker_stats_t stats;
+
+/* Set while a pass runs, so an allocation made by reclaim cannot recurse */
+static bool reclaiming = false;
+
+/* Register a cache; the list stays sorted by seeks */
+void register_shrinker(shrinker_t* shrinker) {
+    if (!shrinker || !shrinker->scan) {
+        return;
+    }
+    shrinker->freed = 0;
+    
+    shrinker_t** link = &shrinkers;
+    while (*link && (*link)->seeks <= shrinker->seeks) {
+        link = &(*link)->next;
+    }
+    shrinker->next = *link;
+    *link = shrinker;
+}
+
+/* Remove a cache */
+void unregister_shrinker(shrinker_t* shrinker) {
+    shrinker_t** link = &shrinkers;
+    while (*link) {
+        if (*link == shrinker) {
+            *link = shrinker->next;
+            shrinker->next = NULL;
+            return;
+        }
+        link = &(*link)->next;
+    }
+}
+
+/* One pass over the registry; each cache gives what it can until the
+ * request is met */
+static uint32_t shrink_pass(uint32_t nr_pages) {
+    uint32_t freed = 0;
+    
+    if (reclaiming) {
+        return 0;
+    }
+    reclaiming = true;
+    
+    for (shrinker_t* s = shrinkers; s && freed < nr_pages; s = s->next) {
+        if (s->count && s->count() == 0) {
+            continue;
+        }
+        uint32_t n = s->scan(nr_pages - freed);
+        s->freed += n;
+        freed += n;
+    }
+    
+    stats.pages_freed += freed;
+    reclaiming = false;
+    return freed;
+}
+
+/* Direct reclaim for an allocation that found no free pages */
+uint32_t shrink_caches(uint32_t nr_pages) {
+    if (reclaiming || !shrinkers) {
+        return 0;
+    }
+    stats.direct++;
+    return shrink_pass(nr_pages);
+}
+
+/* Background reclaim from the idle loop */
+void shrinker_balance(void) {
+    uint32_t free_pages = get_free_memory() / PAGE_SIZE;
+    
+    if (free_pages >= SHRINK_LOW_WATERMARK || !shrinkers) {
+        return;
+    }
+    stats.background++;
+    shrink_pass(SHRINK_HIGH_WATERMARK - free_pages);
+}
+
+/* Caches check this before growing */
+bool shrinker_can_grow(void) {
+    return get_free_memory() / PAGE_SIZE > SHRINK_HIGH_WATERMARK;
+}
+
+const shrinker_stats_t* shrinker_get_stats(void) {
+    return &stats;
+}
+
+shrinker_t* shrinker_list(void) {
+    return shrinkers;
+}
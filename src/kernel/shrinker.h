@@ -0,0 +1,64 @@
+#ifndef SHRINKER_H
+#define SHRINKER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*------------------------------------------------------------------------------
+ * Cache Shrinkers
+ *------------------------------------------------------------------------------
+ * Caches that hold memory they could give back (the buffer cache and swap
+ * today) register a shrinker. The physical page allocator calls
+ * shrink_caches() when an allocation is about to fail and retries once; the
+ * idle loop calls shrinker_balance() to bring free memory back up to
+ * SHRINK_HIGH_WATERMARK whenever it drops below SHRINK_LOW_WATERMARK. Caches
+ * should only grow while free memory is above the high watermark, which lets
+ * them fill idle RAM without pushing the rest of the kernel into allocation
+ * failures.
+ *
+ * A shrinker releases unpinned, clean objects oldest first and reports how
+ * many pages that freed. Shrinkers are asked in order of 'seeks', the cost
+ * of bringing an object back, so cheap caches go before swap. A shrinker's
+ * callbacks run in whatever context triggered the allocation, so they must
+ * not allocate memory themselves.
+ *------------------------------------------------------------------------------
+ */
+
+#define SHRINK_LOW_WATERMARK    256     /* Pages (1 MiB): start reclaiming when idle */
+#define SHRINK_HIGH_WATERMARK   512     /* Pages (2 MiB): stop reclaiming; caches may grow */
+#define DEFAULT_SEEKS           2
+
+typedef struct shrinker {
+    const char* name;
+    uint32_t (*count)(void);            /* Pages the cache could release now */
+    uint32_t (*scan)(uint32_t nr_pages);/* Release up to nr_pages, LRU first; returns pages freed */
+    uint32_t seeks;                     /* Cost to recreate an object (lower is asked first) */
+    uint32_t freed;                     /* Pages released so far */
+    struct shrinker* next;
+} shrinker_t;
+
+/* Reclaim statistics */
+typedef struct {
+    uint32_t direct;                    /* Passes run for a failing allocation */
+    uint32_t background;                /* Passes run from the idle loop */
+    uint32_t pages_freed;               /* Pages released over all passes */
+} shrinker_stats_t;
+
+/* Add or remove a cache */
+void register_shrinker(shrinker_t* shrinker);
+void unregister_shrinker(shrinker_t* shrinker);
+
+/* Ask the registered caches for nr_pages; returns pages actually freed */
+uint32_t shrink_caches(uint32_t nr_pages);
+
+/* Reclaim up to the high watermark if free memory is below the low one */
+void shrinker_balance(void);
+
+/* True while free memory is above the high watermark */
+bool shrinker_can_grow(void);
+
+const shrinker_stats_t* shrinker_get_stats(void);
+shrinker_t* shrinker_list(void);
+
+#endif /* SHRINKER_H */
@@ -0,0 +1,87 @@
+/*------------------------------------------------------------------------------
+ * Kernel Memory and String Primitives
+ *------------------------------------------------------------------------------
+ * This file implements memcpy/memset and friends for SKOS. GCC may emit calls
+ * to these even in freestanding mode, so they must always be linked in.
+ *------------------------------------------------------------------------------
+ */
+
+#include "string.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Copy n bytes; regions must not overlap */
+void* memcpy(void* dest, const void* src, size_t n) {
+    void* ret = dest;
+    size_t dwords = n >> 2;
+    size_t bytes = n & 3;
+
+    asm volatile ("rep movsl"
+                  : "+D"(dest), "+S"(src), "+c"(dwords)
+                  :
+                  : "memory");
+    asm volatile ("rep movsb"
+                  : "+D"(dest), "+S"(src), "+c"(bytes)
+                  :
+                  : "memory");
+    return ret;
+}
+
+/* Copy n bytes; regions may overlap */
+void* memmove(void* dest, const void* src, size_t n) {
+    uint8_t* d = (uint8_t*)dest;
+    const uint8_t* s = (const uint8_t*)src;
+
+    if (d <= s || d >= s + n) {
+        return memcpy(dest, src, n);
+    }
+
+    /* Overlapping with dest above src: copy backwards */
+    while (n > 0) {
+        n--;
+        d[n] = s[n];
+    }
+    return dest;
+}
+
+/* Fill n bytes with value */
+void* memset(void* dest, int value, size_t n) {
+    void* ret = dest;
+    uint32_t pattern = (uint8_t)value;
+    pattern |= pattern << 8;
+    pattern |= pattern << 16;
+    size_t dwords = n >> 2;
+    size_t bytes = n & 3;
+
+    asm volatile ("rep stosl"
+                  : "+D"(dest), "+c"(dwords)
+                  : "a"(pattern)
+                  : "memory");
+    asm volatile ("rep stosb"
+                  : "+D"(dest), "+c"(bytes)
+                  : "a"(pattern)
+                  : "memory");
+    return ret;
+}
+
+/* Compare n bytes */
+int memcmp(const void* a, const void* b, size_t n) {
+    const uint8_t* pa = (const uint8_t*)a;
+    const uint8_t* pb = (const uint8_t*)b;
+
+    for (size_t i = 0; i < n; i++) {
+        if (pa[i] != pb[i]) {
+            return pa[i] - pb[i];
+        }
+    }
+    return 0;
+}
+
+/* Length of a NUL-terminated string */
+size_t strlen(const char* str) {
+    size_t len = 0;
+    while (str[len]) {
+        len++;
+    }
+    return len;
+}
@@ -0,0 +1,22 @@
+#ifndef STRING_H
+#define STRING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*------------------------------------------------------------------------------
+ * Kernel Memory and String Primitives
+ *------------------------------------------------------------------------------
+ * Freestanding replacements for the libc routines GCC expects to exist.
+ * The block copies use x86 string instructions so large moves run a dword
+ * at a time instead of byte by byte.
+ *------------------------------------------------------------------------------
+ */
+
+void* memcpy(void* dest, const void* src, size_t n);
+void* memmove(void* dest, const void* src, size_t n);
+void* memset(void* dest, int value, size_t n);
+int memcmp(const void* a, const void* b, size_t n);
+size_t strlen(const char* str);
+
+#endif /* STRING_H */
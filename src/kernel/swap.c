@@ -0,0 +1,475 @@
+/*------------------------------------------------------------------------------
+ * Anonymous Memory and Swap
+ *------------------------------------------------------------------------------
+ * This file implements demand-zero anonymous memory, the clock page
+ * replacement policy and clustered swap I/O. See swap.h for the design.
+ *------------------------------------------------------------------------------
+ */
+
+#include "swap.h"
+#include "memory.h"
+#include "shrinker.h"
+#include "wss.h"
+#include "fat32.h"
+#include "kernel.h"
+#include "string.h"
+#include "../drivers/ata.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Reserved range of the anonymous window */
+typedef struct {
+    uint32_t start;
+    uint32_t npages;
+} anon_region_t;
+
+/* Regions, sorted by start address */
+static anon_region_t regions[ANON_MAX_REGIONS];
+static uint32_t region_count = 0;
+static uint32_t anon_pages = 0;             /* Pages over all regions */
+
+/* Swap area */
+static ata_device_t* swap_device = NULL;
+static uint32_t swap_first_sector = 0;
+static uint32_t* slot_owner = NULL;         /* Page stored in each slot, 0 if free */
+static uint32_t slot_hint = 0;              /* No free slot below this */
+static uint8_t* staging = NULL;             /* SWAP_CLUSTER pages for cluster I/O */
+
+/* Next page the clock looks at */
+static uint32_t clock_hand = 0;
+
+static swap_stats_t stats;
+
+/*------------------------------------------------------------------------------
+ * Swap slots
+ *------------------------------------------------------------------------------
+ */
+
+static inline uint32_t slot_sector(uint32_t slot) {
+    return swap_first_sector + slot * SWAP_SECTORS_PER_PAGE;
+}
+
+/* First run of 'want' free slots, or the longest shorter run; *got is its length */
+static uint32_t slot_find(uint32_t want, uint32_t* got) {
+    uint32_t best = 0;
+    uint32_t best_len = 0;
+    uint32_t run_start = 0;
+    uint32_t run = 0;
+
+    for (uint32_t s = slot_hint; s < stats.slots && best_len < want; s++) {
+        if (slot_owner[s]) {
+            run = 0;
+            continue;
+        }
+        if (run++ == 0) {
+            run_start = s;
+        }
+        if (run > best_len) {
+            best = run_start;
+            best_len = run;
+        }
+    }
+
+    *got = best_len;
+    return best;
+}
+
+static void slot_claim(uint32_t slot, uint32_t virt) {
+    slot_owner[slot] = virt;
+    stats.slots_used++;
+    if (slot == slot_hint) {
+        slot_hint++;
+    }
+}
+
+static void slot_release(uint32_t slot) {
+    slot_owner[slot] = 0;
+    stats.slots_used--;
+    if (slot < slot_hint) {
+        slot_hint = slot;
+    }
+}
+
+/*------------------------------------------------------------------------------
+ * Regions
+ *------------------------------------------------------------------------------
+ */
+
+static inline uint32_t region_end(const anon_region_t* r) {
+    return r->start + r->npages * PAGE_SIZE;
+}
+
+/* Region containing a virtual address */
+static anon_region_t* anon_find(uint32_t virt) {
+    for (uint32_t i = 0; i < region_count; i++) {
+        if (virt >= regions[i].start && virt < region_end(&regions[i])) {
+            return &regions[i];
+        }
+    }
+    return NULL;
+}
+
+/* Reserve anonymous memory; pages are zero-filled on first touch */
+void* anon_alloc(uint32_t size) {
+    if (size == 0 || size > ANON_WINDOW_END - ANON_WINDOW_START ||
+        region_count == ANON_MAX_REGIONS) {
+        return NULL;
+    }
+    uint32_t npages = align_up(size, PAGE_SIZE) / PAGE_SIZE;
+    uint32_t span = npages * PAGE_SIZE;
+
+    /* First fit between the existing regions */
+    uint32_t start = ANON_WINDOW_START;
+    uint32_t i = 0;
+    while (i < region_count && regions[i].start - start < span) {
+        start = region_end(&regions[i]);
+        i++;
+    }
+    if (i == region_count && ANON_WINDOW_END - start < span) {
+        return NULL;
+    }
+
+    memmove(&regions[i + 1], &regions[i], (region_count - i) * sizeof(anon_region_t));
+    regions[i].start = start;
+    regions[i].npages = npages;
+    region_count++;
+    anon_pages += npages;
+
+    if (region_count == 1) {
+        clock_hand = start;
+    }
+    return (void*)start;
+}
+
+/* Release anonymous memory, including any pages out on swap */
+void anon_free(void* addr) {
+    anon_region_t* r = anon_find((uint32_t)addr);
+    if (!r || r->start != (uint32_t)addr) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < r->npages; i++) {
+        uint32_t* pte = page_table_entry(r->start + i * PAGE_SIZE);
+        if (!pte) {
+            continue;
+        }
+        if (*pte & PAGE_PRESENT) {
+            free_physical_page(*pte & PAGE_ALIGN_MASK);
+            stats.resident--;
+        } else if (*pte & PTE_SWAPPED) {
+            slot_release(*pte >> 12);
+        }
+    }
+    unmap_range(r->start, r->npages);
+
+    anon_pages -= r->npages;
+    uint32_t i = (uint32_t)(r - regions);
+    region_count--;
+    memmove(&regions[i], &regions[i + 1], (region_count - i) * sizeof(anon_region_t));
+}
+
+/*------------------------------------------------------------------------------
+ * Page replacement
+ *------------------------------------------------------------------------------
+ */
+
+/* Page after virt in the regions, wrapping around */
+static uint32_t clock_advance(uint32_t virt) {
+    virt += PAGE_SIZE;
+    for (uint32_t i = 0; i < region_count; i++) {
+        if (virt < regions[i].start) {
+            return regions[i].start;
+        }
+        if (virt < region_end(&regions[i])) {
+            return virt;
+        }
+    }
+    return region_count ? regions[0].start : 0;
+}
+
+/* Second chance: pick up to max resident pages not accessed since the
+ * hand last passed them. A page the working-set scanner saw accessed in
+ * its latest pass (age 0) counts as accessed too. Gives up after two
+ * sweeps of the window. */
+static uint32_t clock_select(uint32_t* victims, uint32_t max) {
+    uint32_t n = 0;
+
+    for (uint32_t budget = 2 * anon_pages; n < max && budget > 0; budget--) {
+        uint32_t virt = clock_hand;
+        clock_hand = clock_advance(clock_hand);
+        if (!anon_find(virt)) {
+            continue; /* Hand was left in a freed region */
+        }
+
+        uint32_t* pte = page_table_entry(virt);
+        if (!pte || !(*pte & PAGE_PRESENT)) {
+            continue;
+        }
+        stats.scanned++;
+
+        if ((*pte & PAGE_ACCESSED) || pte_age(*pte) == 0) {
+            *pte = (*pte & ~(PAGE_ACCESSED | PTE_AGE_MASK)) | (1 << PTE_AGE_SHIFT);
+            tlb_flush_range(virt, 1);
+            continue;
+        }
+
+        /* A small window can bring the hand round to a page already picked */
+        bool picked = false;
+        for (uint32_t i = 0; i < n; i++) {
+            picked |= victims[i] == virt;
+        }
+        if (!picked) {
+            victims[n++] = virt;
+        }
+    }
+    return n;
+}
+
+/* Write out up to nr_pages in clusters; returns pages freed */
+static uint32_t swap_out(uint32_t nr_pages) {
+    uint32_t freed = 0;
+
+    while (freed < nr_pages) {
+        uint32_t want = nr_pages - freed;
+        if (want > SWAP_CLUSTER) {
+            want = SWAP_CLUSTER;
+        }
+
+        uint32_t got;
+        uint32_t slot = slot_find(want, &got);
+        if (got == 0) {
+            break; /* Swap full */
+        }
+
+        uint32_t victims[SWAP_CLUSTER];
+        uint32_t n = clock_select(victims, got);
+        if (n == 0) {
+            break;
+        }
+
+        /* Gather the victims into adjacent slots and write them at once */
+        for (uint32_t i = 0; i < n; i++) {
+            memcpy(staging + i * PAGE_SIZE, (const void*)victims[i], PAGE_SIZE);
+        }
+        if (!ata_write_sectors(swap_device, slot_sector(slot),
+                               (uint8_t)(n * SWAP_SECTORS_PER_PAGE), staging)) {
+            break;
+        }
+        stats.writes++;
+
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t* pte = page_table_entry(victims[i]);
+            uint32_t phys = *pte & PAGE_ALIGN_MASK;
+            *pte = ((slot + i) << 12) | PTE_SWAPPED;
+            tlb_flush_range(victims[i], 1);
+            slot_claim(slot + i, victims[i]);
+            free_physical_page(phys);
+        }
+        stats.swap_outs += n;
+        stats.resident -= n;
+        freed += n;
+    }
+
+    return freed;
+}
+
+/* Read back the cluster holding a swapped-out page */
+static bool swap_in(uint32_t virt, uint32_t pte) {
+    uint32_t slot = pte >> 12;
+    uint32_t base = slot & ~(SWAP_CLUSTER - 1);
+    uint32_t count = stats.slots - base;
+    if (count > SWAP_CLUSTER) {
+        count = SWAP_CLUSTER;
+    }
+
+    /* Frames first: getting one may evict other pages, which needs the
+     * staging buffer. Neighbours only get a frame while memory is not low. */
+    uint32_t frames[SWAP_CLUSTER] = {0};
+    frames[slot - base] = allocate_physical_page();
+    if (!frames[slot - base]) {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (base + i != slot && slot_owner[base + i] &&
+            get_free_memory() / PAGE_SIZE > SHRINK_LOW_WATERMARK) {
+            frames[i] = allocate_physical_page();
+        }
+    }
+
+    bool ok = ata_read_sectors(swap_device, slot_sector(base),
+                               (uint8_t)(count * SWAP_SECTORS_PER_PAGE), staging);
+    stats.reads++;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (!frames[i]) {
+            continue;
+        }
+
+        /* The slot must still hold its owner's page */
+        uint32_t owner = slot_owner[base + i];
+        uint32_t* p = owner ? page_table_entry(owner) : NULL;
+        if (!ok || !p || *p != (((base + i) << 12) | PTE_SWAPPED) ||
+            !map_range(owner, frames[i], 1, PAGE_PRESENT | PAGE_WRITABLE)) {
+            free_physical_page(frames[i]);
+            continue;
+        }
+
+        /* Copying sets the accessed bit; clear it and mark the page as
+         * not recently used so untouched neighbours stay first in line
+         * for the clock */
+        memcpy((void*)owner, staging + i * PAGE_SIZE, PAGE_SIZE);
+        *p = (*p & ~(PAGE_ACCESSED | PAGE_DIRTY | PTE_AGE_MASK)) | (1 << PTE_AGE_SHIFT);
+        tlb_flush_range(owner, 1);
+
+        slot_release(base + i);
+        stats.resident++;
+        if (owner == virt) {
+            stats.swap_ins++;
+        } else {
+            stats.readahead++;
+        }
+    }
+
+    return ok;
+}
+
+/* Back a page on first touch */
+static bool anon_zero_fill(uint32_t virt) {
+    uint32_t phys = allocate_zeroed_page(ALLOC_HIGH);
+    if (!phys) {
+        return false;
+    }
+    if (!map_range(virt, phys, 1, PAGE_PRESENT | PAGE_WRITABLE)) {
+        free_physical_page(phys);
+        return false;
+    }
+    stats.resident++;
+    stats.zero_fills++;
+    return true;
+}
+
+/* Page fault hook */
+bool swap_handle_fault(uint32_t fault_addr) {
+    if (fault_addr < ANON_WINDOW_START || fault_addr >= ANON_WINDOW_END) {
+        return false;
+    }
+
+    uint32_t virt = fault_addr & PAGE_ALIGN_MASK;
+    if (!anon_find(virt)) {
+        return false;
+    }
+
+    uint32_t* pte = page_table_entry(virt);
+    if (pte && (*pte & PTE_SWAPPED)) {
+        return swap_in(virt, *pte);
+    }
+    return anon_zero_fill(virt);
+}
+
+/*------------------------------------------------------------------------------
+ * Activation
+ *------------------------------------------------------------------------------
+ */
+
+/* Shrinker: resident anonymous pages, if there is room to write them */
+static uint32_t swap_shrink_count(void) {
+    return stats.slots_used < stats.slots ? stats.resident : 0;
+}
+
+static uint32_t swap_shrink_scan(uint32_t nr_pages) {
+    return swap_out(nr_pages);
+}
+
+static shrinker_t swap_shrinker = {
+    .name = "swap",
+    .count = swap_shrink_count,
+    .scan = swap_shrink_scan,
+    .seeks = DEFAULT_SEEKS,
+};
+
+/* Activate swap on raw sectors of a device */
+bool swap_on(ata_device_t* device, uint32_t first_sector, uint32_t sectors) {
+    if (swap_device || !device || !device->present) {
+        return false;
+    }
+
+    uint32_t slots = sectors / SWAP_SECTORS_PER_PAGE;
+    if (slots < SWAP_CLUSTER || slots > (1u << 20)) {
+        return false; /* Too small, or slot numbers would not fit a PTE */
+    }
+
+    slot_owner = (uint32_t*)kcalloc(slots, sizeof(uint32_t));
+    staging = (uint8_t*)kmalloc_page_aligned(SWAP_CLUSTER * PAGE_SIZE);
+    if (!slot_owner || !staging) {
+        kfree(slot_owner);
+        kfree(staging);
+        slot_owner = NULL;
+        staging = NULL;
+        return false;
+    }
+
+    swap_device = device;
+    swap_first_sector = first_sector;
+    slot_hint = 0;
+    stats.slots = slots;
+    stats.slots_used = 0;
+    register_shrinker(&swap_shrinker);
+    return true;
+}
+
+/* Activate swap on a preallocated contiguous FAT32 file */
+bool swap_on_file(const char* filename) {
+    fat32_file_t* file = fat32_open(filename);
+    if (!file) {
+        return false;
+    }
+
+    uint32_t first_sector;
+    uint32_t sectors;
+    bool contiguous = fat32_file_extent(file, &first_sector, &sectors);
+    fat32_close(file);
+
+    return contiguous && swap_on(fat32_get_device(), first_sector, sectors);
+}
+
+/*------------------------------------------------------------------------------
+ * Statistics
+ *------------------------------------------------------------------------------
+ */
+
+const swap_stats_t* swap_get_stats(void) {
+    return &stats;
+}
+
+/* Print swap statistics */
+void swap_print_stats(void) {
+    terminal_writestring("Swap: ");
+    if (!swap_device) {
+        terminal_writestring("off");
+    } else {
+        terminal_write_dec(stats.slots_used);
+        terminal_writestring("/");
+        terminal_write_dec(stats.slots);
+        terminal_writestring(" pages used");
+    }
+    terminal_writestring(", ");
+    terminal_write_dec(stats.resident);
+    terminal_writestring(" anonymous pages resident\n");
+
+    terminal_writestring("  Zero fills: ");
+    terminal_write_dec(stats.zero_fills);
+    terminal_writestring("  Out: ");
+    terminal_write_dec(stats.swap_outs);
+    terminal_writestring("  In: ");
+    terminal_write_dec(stats.swap_ins);
+    terminal_writestring("  Readahead: ");
+    terminal_write_dec(stats.readahead);
+    terminal_writestring("\n  Writes: ");
+    terminal_write_dec(stats.writes);
+    terminal_writestring("  Reads: ");
+    terminal_write_dec(stats.reads);
+    terminal_writestring("  Clock scanned: ");
+    terminal_write_dec(stats.scanned);
+    terminal_writestring("\n");
+}
@@ -0,0 +1,72 @@
+#ifndef SWAP_H
+#define SWAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "../drivers/ata.h"
+
+/*------------------------------------------------------------------------------
+ * Anonymous Memory and Swap
+ *------------------------------------------------------------------------------
+ * anon_alloc() hands out ranges of the anonymous window whose pages are
+ * only backed on first touch, by a zeroed frame. Once a swap area is
+ * active (a raw disk, or a preallocated contiguous FAT32 file) those pages
+ * can also be evicted, so a working set larger than RAM slows down instead
+ * of failing allocations.
+ *
+ * - Eviction runs through a shrinker, so it happens when the physical
+ *   allocator runs dry or free memory drops below the low watermark, and
+ *   only after the cheaper caches have given up what they can.
+ * - Victims are chosen by a clock sweep over the anonymous window: a page
+ *   whose PAGE_ACCESSED bit is set (or that the working-set scanner last
+ *   saw accessed, see wss.h) gets a second chance, any other is evicted.
+ * - I/O is clustered. Up to SWAP_CLUSTER victims go to adjacent slots in
+ *   one write, and a fault reads the whole aligned cluster around its slot,
+ *   mapping the neighbours that were swapped out with it while memory
+ *   allows.
+ * - A swapped-out page keeps its slot number in its non-present PTE,
+ *   marked with PTE_SWAPPED. Present PTEs use the same bit for the
+ *   scanner's idle age.
+ *
+ * Anonymous memory must not be touched from interrupt handlers, since a
+ * fault on it may do disk I/O.
+ *------------------------------------------------------------------------------
+ */
+
+#define SWAP_CLUSTER        8           /* Pages per swap read or write */
+#define SWAP_SECTORS_PER_PAGE 8
+#define PTE_SWAPPED         0x200       /* Non-present PTE holds a swap slot (bits 12-31) */
+#define ANON_MAX_REGIONS    32
+
+/* Swap statistics */
+typedef struct {
+    uint32_t slots;                     /* Slots in the swap area (0 = no swap) */
+    uint32_t slots_used;                /* Slots holding a page */
+    uint32_t resident;                  /* Anonymous pages in memory */
+    uint32_t zero_fills;                /* First-touch faults */
+    uint32_t swap_outs;                 /* Pages written out */
+    uint32_t swap_ins;                  /* Pages read back on a fault */
+    uint32_t readahead;                 /* Neighbours mapped by a clustered read */
+    uint32_t writes;                    /* Write commands issued */
+    uint32_t reads;                     /* Read commands issued */
+    uint32_t scanned;                   /* Pages looked at by the clock */
+} swap_stats_t;
+
+/* Reserve / release anonymous memory */
+void* anon_alloc(uint32_t size);
+void anon_free(void* addr);
+
+/* Activate swap on raw sectors [first_sector, +sectors) of a device */
+bool swap_on(ata_device_t* device, uint32_t first_sector, uint32_t sectors);
+
+/* Activate swap on a preallocated contiguous FAT32 file */
+bool swap_on_file(const char* filename);
+
+/* Page fault hook; true if the fault was resolved */
+bool swap_handle_fault(uint32_t fault_addr);
+
+const swap_stats_t* swap_get_stats(void);
+void swap_print_stats(void);
+
+#endif /* SWAP_H */
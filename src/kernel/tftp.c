@@ -0,0 +1,514 @@
+/*------------------------------------------------------------------------------
+ * TFTP Server
+ *------------------------------------------------------------------------------
+ * This file implements the read-only TFTP server described in tftp.h.
+ *------------------------------------------------------------------------------
+ */
+
+#include "tftp.h"
+#include "init.h"
+#include "net.h"
+#include "netbuf.h"
+#include "fat32.h"
+#include "bcache.h"
+#include "kernel.h"
+#include "string.h"
+#include "../drivers/timer.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TFTP_HDR_LEN        4
+#define TFTP_MAX_BLKSIZE    (UDP_MAX_PAYLOAD - TFTP_HDR_LEN)
+#define TFTP_MIN_BLKSIZE    8
+
+/* One read transfer */
+typedef struct {
+    bool     active;
+    uint32_t peer_ip;
+    uint16_t peer_port;
+    fat32_file_t* file;
+    uint32_t file_size;
+    uint16_t blksize;
+    uint16_t window;
+    bool     oack_pending;          /* OACK sent, waiting for ACK 0 */
+    char     oack[96];              /* Accepted options, resent on timeout */
+    uint16_t oack_len;
+    uint32_t acked;                 /* Highest block acknowledged (unwrapped) */
+    uint32_t next_block;            /* Next block to send */
+    uint32_t last_block;            /* Final (short) block */
+    uint32_t retries;
+    uint64_t last_activity_ms;
+    uint64_t start_tsc;
+} tftp_session_t;
+
+static udp_socket_t* server_sock = NULL;
+static tftp_session_t sessions[TFTP_MAX_SESSIONS];
+static tftp_stats_t stats;
+
+
+/*------------------------------------------------------------------------------
+ * Packet construction
+ *------------------------------------------------------------------------------
+ */
+
+static inline void put16(uint8_t* p, uint16_t v) {
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static void tftp_send_error(uint32_t ip, uint16_t port, uint16_t code, const char* msg) {
+    netbuf_t* nb = udp_alloc();
+    if (!nb) {
+        return;
+    }
+
+    uint8_t hdr[TFTP_HDR_LEN];
+    put16(hdr, TFTP_ERROR);
+    put16(hdr + 2, code);
+    netbuf_append(nb, hdr, TFTP_HDR_LEN);
+    netbuf_append(nb, msg, (uint16_t)(strlen(msg) + 1));
+    udp_sendto(server_sock, ip, port, nb);
+}
+
+static bool tftp_send_oack(tftp_session_t* s) {
+    netbuf_t* nb = udp_alloc();
+    if (!nb) {
+        return false;
+    }
+
+    uint8_t hdr[2];
+    put16(hdr, TFTP_OACK);
+    netbuf_append(nb, hdr, 2);
+    netbuf_append(nb, s->oack, s->oack_len);
+    return udp_sendto(server_sock, s->peer_ip, s->peer_port, nb);
+}
+
+/* Fill and send one DATA block. File bytes are copied from pinned cache
+ * blocks straight into the netbuf. */
+static bool tftp_send_block(tftp_session_t* s, uint32_t block) {
+    uint32_t position = (block - 1) * s->blksize;
+    uint32_t len = s->blksize;
+    if (position + len > s->file_size) {
+        len = s->file_size - position;
+    }
+
+    netbuf_t* nb = udp_alloc();
+    if (!nb) {
+        return false;
+    }
+
+    uint8_t hdr[TFTP_HDR_LEN];
+    put16(hdr, TFTP_DATA);
+    put16(hdr + 2, (uint16_t)block);
+    netbuf_append(nb, hdr, TFTP_HDR_LEN);
+
+    if (fat32_tell(s->file) != position) {
+        fat32_seek(s->file, position);
+    }
+
+    while (len > 0) {
+        uint32_t offset, avail;
+        bcache_buf_t* buf = fat32_get_block(s->file, &offset, &avail);
+        if (buf) {
+            if (avail > len) avail = len;
+            netbuf_append(nb, buf->data + offset, (uint16_t)avail);
+            bcache_put(buf);
+            fat32_advance(s->file, avail);
+        } else {
+            /* Not cache-addressable: read through the file instead */
+            uint8_t* tail = netbuf_extend(nb, (uint16_t)len);
+            avail = fat32_read(s->file, tail, len);
+            if (avail != len) {
+                netbuf_put(nb);
+                return false;
+            }
+        }
+        len -= avail;
+    }
+
+    stats.blocks_sent++;
+    return udp_sendto(server_sock, s->peer_ip, s->peer_port, nb);
+}
+
+/*------------------------------------------------------------------------------
+ * Sessions
+ *------------------------------------------------------------------------------
+ */
+
+static tftp_session_t* tftp_find_session(uint32_t ip, uint16_t port) {
+    for (int i = 0; i < TFTP_MAX_SESSIONS; i++) {
+        if (sessions[i].active && sessions[i].peer_ip == ip && sessions[i].peer_port == port) {
+            return &sessions[i];
+        }
+    }
+    return NULL;
+}
+
+static void tftp_end_session(tftp_session_t* s, bool success) {
+    if (success) {
+        uint32_t us = timer_tsc_to_us(timer_read_tsc() - s->start_tsc);
+        stats.transfers++;
+        stats.bytes_sent += s->file_size;
+        stats.last_bytes = s->file_size;
+        stats.last_us = us ? us : 1;
+        stats.last_blksize = s->blksize;
+        stats.last_window = s->window;
+
+        size_t n = 0;
+        while (s->file->filename[n] && n < sizeof(stats.last_name) - 1) {
+            stats.last_name[n] = s->file->filename[n];
+            n++;
+        }
+        stats.last_name[n] = '\0';
+    } else {
+        stats.failures++;
+    }
+
+    fat32_close(s->file);
+    s->file = NULL;
+    s->active = false;
+}
+
+/* Send the next window, starting at next_block */
+static void tftp_send_window(tftp_session_t* s) {
+    uint32_t end = s->acked + s->window;
+    if (end > s->last_block) {
+        end = s->last_block;
+    }
+
+    while (s->next_block <= end) {
+        if (!tftp_send_block(s, s->next_block)) {
+            break;  /* Out of buffers; tftp_poll() resumes */
+        }
+        s->next_block++;
+    }
+}
+
+/* Append "name\0value\0" to the OACK */
+static void tftp_oack_add(tftp_session_t* s, const char* name, uint32_t value) {
+    char digits[12];
+    int n = 0;
+    do {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+
+    size_t name_len = strlen(name) + 1;
+    if (s->oack_len + name_len + n + 1 > sizeof(s->oack)) {
+        return;
+    }
+    memcpy(s->oack + s->oack_len, name, name_len);
+    s->oack_len += name_len;
+    while (n > 0) {
+        s->oack[s->oack_len++] = digits[--n];
+    }
+    s->oack[s->oack_len++] = '\0';
+}
+
+/* Case-insensitive compare for option names */
+static bool tftp_option_is(const char* a, const char* b) {
+    while (*a && *b) {
+        char ca = (*a >= 'A' && *a <= 'Z') ? *a + 32 : *a;
+        if (ca != *b) {
+            return false;
+        }
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+static uint32_t tftp_parse_uint(const char* s) {
+    uint32_t v = 0;
+    while (*s >= '0' && *s <= '9') {
+        v = v * 10 + (uint32_t)(*s++ - '0');
+        if (v > 0xFFFFFF) break;
+    }
+    return v;
+}
+
+/* Start a transfer for a read request */
+static void tftp_handle_rrq(uint32_t ip, uint16_t port, const char* req, uint16_t len) {
+    tftp_session_t* s = tftp_find_session(ip, port);
+    if (s) {
+        /* Retransmitted request: the reply was lost */
+        if (s->oack_pending) {
+            tftp_send_oack(s);
+        } else if (s->acked == 0) {
+            s->next_block = 1;
+            tftp_send_window(s);
+        }
+        return;
+    }
+
+    /* Split the request into NUL-terminated strings */
+    const char* fields[16];
+    int nfields = 0;
+    uint16_t start = 0;
+    for (uint16_t i = 0; i < len && nfields < 16; i++) {
+        if (req[i] == '\0') {
+            fields[nfields++] = req + start;
+            start = i + 1;
+        }
+    }
+    if (nfields < 2) {
+        tftp_send_error(ip, port, TFTP_ERR_ILLEGAL_OP, "Malformed request");
+        stats.failures++;
+        return;
+    }
+
+    for (int i = 0; i < TFTP_MAX_SESSIONS && !s; i++) {
+        if (!sessions[i].active) {
+            s = &sessions[i];
+        }
+    }
+    if (!s) {
+        tftp_send_error(ip, port, TFTP_ERR_UNDEFINED, "Server busy");
+        stats.failures++;
+        return;
+    }
+
+    const char* name = fields[0];
+    while (*name == '/') name++;
+
+    fat32_file_t* file = fat32_open(name);
+    if (!file) {
+        tftp_send_error(ip, port, TFTP_ERR_NOT_FOUND, "File not found");
+        stats.failures++;
+        return;
+    }
+
+    memset(s, 0, sizeof(tftp_session_t));
+    s->active = true;
+    s->peer_ip = ip;
+    s->peer_port = port;
+    s->file = file;
+    s->file_size = file->file_size;
+    s->blksize = TFTP_DEFAULT_BLKSIZE;
+    s->window = 1;
+
+    /* Options come in name/value pairs after the mode */
+    for (int i = 2; i + 1 < nfields; i += 2) {
+        uint32_t value = tftp_parse_uint(fields[i + 1]);
+        if (tftp_option_is(fields[i], "blksize") && value >= TFTP_MIN_BLKSIZE) {
+            s->blksize = value > TFTP_MAX_BLKSIZE ? TFTP_MAX_BLKSIZE : (uint16_t)value;
+            tftp_oack_add(s, "blksize", s->blksize);
+        } else if (tftp_option_is(fields[i], "windowsize") && value >= 1) {
+            s->window = value > TFTP_MAX_WINDOW ? TFTP_MAX_WINDOW : (uint16_t)value;
+            tftp_oack_add(s, "windowsize", s->window);
+        } else if (tftp_option_is(fields[i], "tsize")) {
+            tftp_oack_add(s, "tsize", s->file_size);
+        }
+    }
+
+    s->last_block = s->file_size / s->blksize + 1;
+    s->next_block = 1;
+    s->last_activity_ms = timer_get_uptime_ms();
+    timer_tsc_khz();
+    s->start_tsc = timer_read_tsc();
+
+    if (s->oack_len) {
+        s->oack_pending = true;
+        tftp_send_oack(s);
+    } else {
+        tftp_send_window(s);
+    }
+}
+
+static void tftp_handle_ack(tftp_session_t* s, uint16_t block) {
+    if (s->oack_pending) {
+        if (block != 0) {
+            return;
+        }
+        s->oack_pending = false;
+    } else {
+        /* Map the 16-bit block number onto the blocks in flight */
+        uint16_t delta = (uint16_t)(block - (uint16_t)s->acked);
+        if (delta == 0 || delta >= s->next_block - s->acked) {
+            return;  /* Duplicate or stale */
+        }
+        s->acked += delta;
+    }
+
+    s->retries = 0;
+    s->last_activity_ms = timer_get_uptime_ms();
+
+    if (s->acked == s->last_block) {
+        tftp_end_session(s, true);
+        return;
+    }
+
+    /* An ACK short of the window end means the rest was lost (RFC 7440) */
+    s->next_block = s->acked + 1;
+    tftp_send_window(s);
+}
+
+/* UDP receive callback for port 69 */
+static void tftp_recv(udp_socket_t* sock, netbuf_t* nb, uint32_t src_ip, uint16_t src_port) {
+    (void)sock;
+    if (nb->len < 2) {
+        return;
+    }
+
+    const uint8_t* p = nb->data;
+    uint16_t opcode = (uint16_t)((p[0] << 8) | p[1]);
+    tftp_session_t* s;
+
+    switch (opcode) {
+        case TFTP_RRQ:
+            tftp_handle_rrq(src_ip, src_port, (const char*)p + 2, nb->len - 2);
+            break;
+
+        case TFTP_WRQ:
+            tftp_send_error(src_ip, src_port, TFTP_ERR_ACCESS, "Server is read-only");
+            stats.failures++;
+            break;
+
+        case TFTP_ACK:
+            s = tftp_find_session(src_ip, src_port);
+            if (!s) {
+                tftp_send_error(src_ip, src_port, TFTP_ERR_UNKNOWN_TID, "Unknown transfer");
+            } else if (nb->len >= TFTP_HDR_LEN) {
+                tftp_handle_ack(s, (uint16_t)((p[2] << 8) | p[3]));
+            }
+            break;
+
+        case TFTP_ERROR:
+            /* Client gave up (e.g. rejected an option) */
+            s = tftp_find_session(src_ip, src_port);
+            if (s) {
+                tftp_end_session(s, false);
+            }
+            break;
+
+        default:
+            tftp_send_error(src_ip, src_port, TFTP_ERR_ILLEGAL_OP, "Illegal operation");
+            break;
+    }
+}
+
+/*------------------------------------------------------------------------------
+ * Public interface
+ *------------------------------------------------------------------------------
+ */
+
+bool __init tftp_server_start(void) {
+    if (server_sock) {
+        return true;
+    }
+    memset(sessions, 0, sizeof(sessions));
+    memset(&stats, 0, sizeof(stats));
+    server_sock = udp_bind(TFTP_PORT, tftp_recv, NULL);
+    return server_sock != NULL;
+}
+
+/* Retransmit from the first unacknowledged block after a timeout */
+void tftp_poll(void) {
+    if (!server_sock) {
+        return;
+    }
+
+    uint64_t now = 0;
+    for (int i = 0; i < TFTP_MAX_SESSIONS; i++) {
+        tftp_session_t* s = &sessions[i];
+        if (!s->active) {
+            continue;
+        }
+        if (now == 0) {
+            now = timer_get_uptime_ms();
+        }
+
+        if (now - s->last_activity_ms < TFTP_TIMEOUT_MS) {
+            /* Resume a window cut short by a buffer shortage */
+            if (!s->oack_pending && s->next_block <= s->acked + s->window &&
+                s->next_block <= s->last_block) {
+                tftp_send_window(s);
+            }
+            continue;
+        }
+
+        if (++s->retries > TFTP_MAX_RETRIES) {
+            tftp_send_error(s->peer_ip, s->peer_port, TFTP_ERR_UNDEFINED, "Timeout");
+            tftp_end_session(s, false);
+            continue;
+        }
+
+        stats.retransmits++;
+        s->last_activity_ms = now;
+        if (s->oack_pending) {
+            tftp_send_oack(s);
+        } else {
+            s->next_block = s->acked + 1;
+            tftp_send_window(s);
+        }
+    }
+}
+
+const tftp_stats_t* tftp_get_stats(void) {
+    return &stats;
+}
+
+void tftp_print_status(void) {
+    terminal_writestring("TFTP server: ");
+    if (!server_sock) {
+        terminal_writestring("not running\n");
+        return;
+    }
+    terminal_writestring("listening on UDP port ");
+    terminal_write_dec(TFTP_PORT);
+    terminal_writestring("\n");
+
+    for (int i = 0; i < TFTP_MAX_SESSIONS; i++) {
+        tftp_session_t* s = &sessions[i];
+        if (!s->active) {
+            continue;
+        }
+        terminal_writestring("  sending ");
+        terminal_writestring(s->file->filename);
+        terminal_writestring(" to ");
+        net_print_ip(s->peer_ip);
+        terminal_writestring(":");
+        terminal_write_dec(s->peer_port);
+        terminal_writestring(", block ");
+        terminal_write_dec(s->acked);
+        terminal_writestring("/");
+        terminal_write_dec(s->last_block);
+        terminal_writestring("\n");
+    }
+
+    terminal_writestring("Transfers: ");
+    terminal_write_dec(stats.transfers);
+    terminal_writestring("  failed: ");
+    terminal_write_dec(stats.failures);
+    terminal_writestring("  blocks: ");
+    terminal_write_dec(stats.blocks_sent);
+    terminal_writestring("  retransmits: ");
+    terminal_write_dec(stats.retransmits);
+    terminal_writestring("\n");
+
+    if (stats.transfers == 0) {
+        return;
+    }
+
+    /* MB/s with two decimals: bytes per second, then scaled by 100/2^20 */
+    uint64_t bytes_per_s = div64((uint64_t)stats.last_bytes * 1000000, stats.last_us);
+    uint32_t centi_mbs = (uint32_t)((bytes_per_s * 100) >> 20);
+
+    terminal_writestring("Last: ");
+    terminal_writestring(stats.last_name);
+    terminal_writestring(", ");
+    terminal_write_dec(stats.last_bytes);
+    terminal_writestring(" bytes in ");
+    terminal_write_dec(stats.last_us / 1000);
+    terminal_writestring(" ms = ");
+    terminal_write_dec(centi_mbs / 100);
+    terminal_putchar('.');
+    terminal_write_dec((centi_mbs % 100) / 10);
+    terminal_write_dec(centi_mbs % 10);
+    terminal_writestring(" MB/s (blksize ");
+    terminal_write_dec(stats.last_blksize);
+    terminal_writestring(", window ");
+    terminal_write_dec(stats.last_window);
+    terminal_writestring(")\n");
+}
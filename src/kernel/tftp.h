@@ -0,0 +1,76 @@
+#ifndef TFTP_H
+#define TFTP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*------------------------------------------------------------------------------
+ * TFTP Server
+ *------------------------------------------------------------------------------
+ * Read-only TFTP (RFC 1350) serving files from the FAT32 root directory,
+ * with the option extensions blksize (RFC 2348), tsize (RFC 2349) and
+ * windowsize (RFC 7440).
+ *
+ * Data blocks are filled straight from pinned buffer cache blocks into
+ * netbufs, one copy per byte, with the UDP payload checksum gathered during
+ * that copy. A window of blocks is sent per acknowledgement; an early ACK
+ * or a timeout rewinds to the first unacknowledged block.
+ *
+ * All transfers run from port 69 rather than a fresh port per transfer, so
+ * a single QEMU hostfwd rule is enough to reach the server:
+ *
+ *     make run   (forwards host udp/6969 to guest port 69)
+ *     curl --tftp-blksize 1428 -o out tftp://localhost:6969/README.TXT
+ *------------------------------------------------------------------------------
+ */
+
+#define TFTP_PORT               69
+#define TFTP_MAX_SESSIONS       2
+#define TFTP_DEFAULT_BLKSIZE    512
+#define TFTP_MAX_WINDOW         32          /* Bounded by netbufs / TX ring */
+#define TFTP_TIMEOUT_MS         1000
+#define TFTP_MAX_RETRIES        5
+
+/* Opcodes */
+#define TFTP_RRQ                1
+#define TFTP_WRQ                2
+#define TFTP_DATA               3
+#define TFTP_ACK                4
+#define TFTP_ERROR              5
+#define TFTP_OACK               6
+
+/* Error codes */
+#define TFTP_ERR_UNDEFINED      0
+#define TFTP_ERR_NOT_FOUND      1
+#define TFTP_ERR_ACCESS         2
+#define TFTP_ERR_ILLEGAL_OP     4
+#define TFTP_ERR_UNKNOWN_TID    5
+#define TFTP_ERR_OPTION         8
+
+/* Server statistics */
+typedef struct {
+    uint32_t transfers;             /* Completed */
+    uint32_t failures;              /* Aborted or refused */
+    uint32_t blocks_sent;
+    uint32_t retransmits;
+    uint64_t bytes_sent;            /* File bytes in completed transfers */
+    /* Most recent completed transfer */
+    char     last_name[32];
+    uint32_t last_bytes;
+    uint32_t last_us;
+    uint16_t last_blksize;
+    uint16_t last_window;
+} tftp_stats_t;
+
+/* Start listening on TFTP_PORT */
+bool tftp_server_start(void);
+
+/* Retransmit stalled transfers (call from the main loop) */
+void tftp_poll(void);
+
+/* Statistics and status */
+const tftp_stats_t* tftp_get_stats(void);
+void tftp_print_status(void);
+
+#endif /* TFTP_H */
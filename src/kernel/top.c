@@ -0,0 +1,377 @@
+/*------------------------------------------------------------------------------
+ * System Monitor
+ *------------------------------------------------------------------------------
+ * This file implements the 'top' screen. See top.h.
+ *------------------------------------------------------------------------------
+ */
+
+#include "top.h"
+#include "kernel.h"
+#include "idt.h"
+#include "memory.h"
+#include "bcache.h"
+#include "string.h"
+#include "sched.h"
+#include "../drivers/ata.h"
+#include "../drivers/timer.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* External terminal variables from kernel.c */
+extern size_t terminal_row;
+extern size_t terminal_column;
+extern uint16_t* terminal_buffer;
+
+#define TOP_CELLS           (VGA_WIDTH * VGA_HEIGHT)
+#define TOP_FULL_REDRAW     10          /* Refreshes between full repaints */
+#define TOP_BAR_WIDTH       40
+
+/* Counter values at one refresh */
+typedef struct {
+    uint64_t tsc;
+    uint64_t ms;
+    uint64_t idle;                      /* Idle TSC cycles */
+    uint64_t irqs[16];
+    uint64_t disk_reads;
+    uint64_t disk_writes;
+    uint64_t sectors_read;
+    uint64_t sectors_written;
+    uint32_t bcache_hits;
+    uint32_t bcache_misses;
+    uint32_t zero_hits;
+    uint32_t zero_misses;
+} top_sample_t;
+
+static bool active = false;
+static top_sample_t last;
+
+static uint16_t frame[TOP_CELLS];       /* Screen being composed */
+static uint16_t shown[TOP_CELLS];       /* What video memory holds */
+static uint16_t saved[TOP_CELLS];       /* Screen from before top started */
+static size_t saved_row;
+static size_t saved_column;
+
+static uint32_t refreshes = 0;
+static uint32_t cells_written = 0;      /* By the last refresh */
+static uint32_t refresh_us = 0;         /* Cost of the last refresh */
+
+
+/*------------------------------------------------------------------------------
+ * Composing
+ *------------------------------------------------------------------------------
+ */
+
+#define COLOR_TITLE     vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK)
+#define COLOR_LABEL     vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK)
+#define COLOR_VALUE     vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK)
+#define COLOR_QUIET     vga_entry_color(VGA_COLOR_DARK_GREY, VGA_COLOR_BLACK)
+#define COLOR_BUSY      vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK)
+
+static void top_clear_frame(void) {
+    uint16_t blank = vga_entry(' ', COLOR_LABEL);
+    for (uint32_t i = 0; i < TOP_CELLS; i++) {
+        frame[i] = blank;
+    }
+}
+
+static uint32_t top_put_str(uint32_t row, uint32_t col, const char* str, uint8_t color) {
+    while (*str && col < VGA_WIDTH) {
+        frame[row * VGA_WIDTH + col++] = vga_entry(*str++, color);
+    }
+    return col;
+}
+
+/* Right-aligned in 'width' columns */
+static uint32_t top_put_num(uint32_t row, uint32_t col, uint32_t width, uint64_t value, uint8_t color) {
+    char digits[21];
+    uint32_t len = 0;
+    do {
+        uint64_t q = div64(value, 10);
+        digits[len++] = '0' + (char)(value - q * 10);
+        value = q;
+    } while (value > 0);
+
+    for (; width > len; width--) {
+        col = top_put_str(row, col, " ", color);
+    }
+    while (len > 0 && col < VGA_WIDTH) {
+        frame[row * VGA_WIDTH + col++] = vga_entry(digits[--len], color);
+    }
+    return col;
+}
+
+/* "ddd.d%" from a value in tenths of a percent */
+static uint32_t top_put_permille(uint32_t row, uint32_t col, uint32_t permille, uint8_t color) {
+    col = top_put_num(row, col, 3, permille / 10, color);
+    col = top_put_str(row, col, ".", color);
+    col = top_put_num(row, col, 1, permille % 10, color);
+    return top_put_str(row, col, "%", color);
+}
+
+/* Label followed by a right-aligned value, dimmed when zero */
+static uint32_t top_put_field(uint32_t row, uint32_t col, const char* label, uint32_t width, uint64_t value) {
+    col = top_put_str(row, col, label, COLOR_LABEL);
+    return top_put_num(row, col, width, value, value ? COLOR_VALUE : COLOR_QUIET);
+}
+
+/* part / whole in tenths of a percent */
+static uint32_t top_permille(uint64_t part, uint64_t whole) {
+    while (whole > 0xFFFFFFFF) {
+        part >>= 1;
+        whole >>= 1;
+    }
+    if (whole == 0) {
+        return 0;
+    }
+    uint64_t permille = div64(part * 1000, (uint32_t)whole);
+    return permille > 1000 ? 1000 : (uint32_t)permille;
+}
+
+/* Events per second over an interval */
+static uint64_t top_rate(uint64_t delta, uint32_t ms) {
+    return div64(delta * 1000, ms);
+}
+
+/*------------------------------------------------------------------------------
+ * Refresh
+ *------------------------------------------------------------------------------
+ */
+
+static void top_sample(top_sample_t* s) {
+    s->tsc = timer_read_tsc();
+    s->ms = timer_get_uptime_ms();
+    s->idle = cpu_idle_cycles();
+    for (uint8_t irq = 0; irq < 16; irq++) {
+        s->irqs[irq] = irq_get_count(irq);
+    }
+    s->disk_reads = counter_read(&cnt_ata_reads);
+    s->disk_writes = counter_read(&cnt_ata_writes);
+    s->sectors_read = counter_read(&cnt_ata_sectors_read);
+    s->sectors_written = counter_read(&cnt_ata_sectors_written);
+
+    const bcache_stats_t* bc = bcache_get_stats();
+    s->bcache_hits = bc->hits;
+    s->bcache_misses = bc->misses;
+
+    const zero_pool_stats_t* zp = memory_get_zero_pool_stats();
+    s->zero_hits = zp->hits;
+    s->zero_misses = zp->misses;
+}
+
+static void top_compose_cpu(uint32_t row, const top_sample_t* now) {
+    uint32_t idle = top_permille(now->idle - last.idle, now->tsc - last.tsc);
+    uint32_t busy = 1000 - idle;
+
+    uint32_t col = top_put_str(row, 0, "CPU    busy ", COLOR_LABEL);
+    col = top_put_permille(row, col, busy, COLOR_VALUE);
+    col = top_put_str(row, col, "   idle ", COLOR_LABEL);
+    col = top_put_permille(row, col, idle, COLOR_VALUE);
+
+    col = top_put_str(row, col + 3, "[", COLOR_LABEL);
+    uint32_t filled = (busy * TOP_BAR_WIDTH + 500) / 1000;
+    for (uint32_t i = 0; i < TOP_BAR_WIDTH; i++) {
+        col = top_put_str(row, col, i < filled ? "|" : ".", i < filled ? COLOR_BUSY : COLOR_QUIET);
+    }
+    top_put_str(row, col, "]", COLOR_LABEL);
+}
+
+static void top_compose_irqs(uint32_t row, const top_sample_t* now, uint32_t ms) {
+    uint64_t total = 0;
+    for (uint8_t irq = 0; irq < 16; irq++) {
+        uint64_t rate = top_rate(now->irqs[irq] - last.irqs[irq], ms);
+        uint32_t col = (irq % 8) * 10;
+        total += rate;
+
+        top_put_num(row + 1 + irq / 8, col, 3, irq, COLOR_LABEL);
+        top_put_str(row + 1 + irq / 8, col + 3, ":", COLOR_LABEL);
+        top_put_num(row + 1 + irq / 8, col + 4, 6, rate, rate ? COLOR_VALUE : COLOR_QUIET);
+    }
+
+    uint32_t col = top_put_str(row, 0, "Interrupts/s", COLOR_TITLE);
+    top_put_field(row, col + 4, "total ", 8, total);
+}
+
+static void top_compose_disk(uint32_t row, const top_sample_t* now, uint32_t ms) {
+    top_put_str(row, 0, "Disk", COLOR_TITLE);
+    uint32_t col = top_put_field(row + 1, 2, "reads/s ", 6, top_rate(now->disk_reads - last.disk_reads, ms));
+    col = top_put_field(row + 1, col + 3, "writes/s ", 6, top_rate(now->disk_writes - last.disk_writes, ms));
+    col = top_put_field(row + 1, col + 3, "read KB/s ", 7, top_rate(now->sectors_read - last.sectors_read, ms) / 2);
+    top_put_field(row + 1, col + 3, "written KB/s ", 7, top_rate(now->sectors_written - last.sectors_written, ms) / 2);
+}
+
+static void top_compose_usage(uint32_t row, const char* label, uint32_t used, uint32_t total) {
+    uint32_t col = top_put_str(row, 2, label, COLOR_LABEL);
+    col = top_put_field(row, col, "used ", 8, used / 1024);
+    col = top_put_str(row, col, " KB of ", COLOR_LABEL);
+    col = top_put_num(row, col, 8, total / 1024, COLOR_VALUE);
+    col = top_put_str(row, col, " KB  ", COLOR_LABEL);
+    top_put_permille(row, col, top_permille(used, total), COLOR_VALUE);
+}
+
+static void top_compose_memory(uint32_t row) {
+    uint32_t heap_size;
+    uint32_t heap_used;
+    heap_get_usage(&heap_size, &heap_used);
+
+    uint32_t phys_used = get_used_memory();
+    top_put_str(row, 0, "Memory", COLOR_TITLE);
+    top_compose_usage(row + 1, "physical  ", phys_used, phys_used + get_free_memory());
+    top_compose_usage(row + 2, "heap      ", heap_used, heap_size);
+}
+
+static void top_compose_cache(uint32_t row, const char* label, uint32_t hits, uint32_t misses, uint32_t ms) {
+    uint32_t col = top_put_str(row, 2, label, COLOR_LABEL);
+    col = top_put_str(row, col, "hit ", COLOR_LABEL);
+    col = top_put_permille(row, col, top_permille(hits, hits + misses), COLOR_VALUE);
+    col = top_put_field(row, col + 3, "hits/s ", 7, top_rate(hits, ms));
+    top_put_field(row, col + 3, "misses/s ", 7, top_rate(misses, ms));
+}
+
+/* CPU share of the newest four threads over the interval */
+static void top_compose_threads(uint32_t row, const top_sample_t* now) {
+    uint64_t cycles = now->tsc - last.tsc;
+    top_put_str(row, 0, "Threads", COLOR_TITLE);
+    top_put_field(row, 12, "switches ", 8, sched_get_runqueue()->switches);
+
+    /* Every thread's baseline moves, so one that scrolls into view later
+     * shows its share of this interval rather than of all time */
+    thread_t* t;
+    for (uint32_t i = 0; (t = sched_get_thread(i)) != NULL; i++) {
+        uint32_t r = row + 1 + i;
+        uint32_t cpu = top_permille(t->sum_exec - t->monitor_exec, cycles);
+        t->monitor_exec = t->sum_exec;
+        if (i >= 4) {
+            continue;
+        }
+
+        top_put_num(r, 0, 4, t->id, COLOR_LABEL);
+        top_put_str(r, 6, t->name, COLOR_VALUE);
+        top_put_str(r, 24, thread_state_name(t->state), COLOR_LABEL);
+        uint32_t col = top_put_str(r, 31, "nice ", COLOR_LABEL);
+        if (t->nice < 0) {
+            top_put_str(r, col, "-", COLOR_VALUE);
+        }
+        top_put_num(r, col + 1, 2, t->nice < 0 ? -t->nice : t->nice, COLOR_VALUE);
+        top_put_permille(r, 42, cpu, cpu ? COLOR_BUSY : COLOR_QUIET);
+    }
+}
+
+static void top_compose(const top_sample_t* now) {
+    uint32_t ms = (uint32_t)(now->ms - last.ms);
+    if (ms == 0) {
+        ms = 1;
+    }
+
+    top_clear_frame();
+
+    uint32_t secs = (uint32_t)div64(now->ms, 1000);
+    uint32_t col = top_put_str(0, 0, "SKOS system monitor", COLOR_TITLE);
+    col = top_put_str(0, col + 6, "up ", COLOR_LABEL);
+    col = top_put_num(0, col, 1, secs / 3600, COLOR_VALUE);
+    col = top_put_str(0, col, ":", COLOR_VALUE);
+    col = top_put_num(0, col, 1, (secs / 60) % 60 / 10, COLOR_VALUE);
+    col = top_put_num(0, col, 1, (secs / 60) % 10, COLOR_VALUE);
+    col = top_put_str(0, col, ":", COLOR_VALUE);
+    col = top_put_num(0, col, 1, secs % 60 / 10, COLOR_VALUE);
+    col = top_put_num(0, col, 1, secs % 10, COLOR_VALUE);
+    col = top_put_field(0, col + 6, "interval ms ", 4, ms);
+    top_put_str(0, VGA_WIDTH - 9, "q: quit", COLOR_QUIET);
+
+    top_compose_cpu(2, now);
+    top_compose_irqs(4, now, ms);
+    top_compose_disk(8, now, ms);
+    top_compose_memory(11);
+
+    top_put_str(15, 0, "Caches", COLOR_TITLE);
+    top_compose_cache(16, "bcache     ", now->bcache_hits - last.bcache_hits,
+                      now->bcache_misses - last.bcache_misses, ms);
+    top_compose_cache(17, "zero pool  ", now->zero_hits - last.zero_hits,
+                      now->zero_misses - last.zero_misses, ms);
+
+    top_compose_threads(19, now);
+
+    col = top_put_field(VGA_HEIGHT - 1, 0, "refresh ", 1, refreshes);
+    col = top_put_field(VGA_HEIGHT - 1, col, ": cells written ", 1, cells_written);
+    top_put_field(VGA_HEIGHT - 1, col, ", cost us ", 1, refresh_us);
+}
+
+/* Copy changed cells to video memory; every TOP_FULL_REDRAW refreshes
+ * copy them all, which repairs anything else that wrote to the screen */
+static void top_flush(void) {
+    bool full = (refreshes % TOP_FULL_REDRAW) == 0;
+    cells_written = 0;
+    for (uint32_t i = 0; i < TOP_CELLS; i++) {
+        if (full || frame[i] != shown[i]) {
+            terminal_buffer[i] = frame[i];
+            shown[i] = frame[i];
+            cells_written++;
+        }
+    }
+}
+
+static void top_refresh(void) {
+    uint64_t start = timer_read_tsc();
+    top_sample_t now;
+    top_sample(&now);
+
+    top_compose(&now);
+    top_flush();
+
+    last = now;
+    refreshes++;
+    refresh_us = timer_tsc_to_us(timer_read_tsc() - start);
+}
+
+/*------------------------------------------------------------------------------
+ * Public Interface
+ *------------------------------------------------------------------------------
+ */
+
+/* Save the screen and show the first frame, averaged since boot */
+void top_start(void) {
+    if (active) {
+        return;
+    }
+
+    memcpy(saved, terminal_buffer, sizeof(saved));
+    saved_row = terminal_row;
+    saved_column = terminal_column;
+    terminal_hide_cursor();
+    timer_tsc_khz();
+
+    memset(&last, 0, sizeof(last));
+    refreshes = 0;
+    active = true;
+    top_refresh();
+}
+
+/* Put the shell's screen back */
+void top_stop(void) {
+    if (!active) {
+        return;
+    }
+
+    active = false;
+    memcpy(terminal_buffer, saved, sizeof(saved));
+    terminal_row = saved_row;
+    terminal_column = saved_column;
+    terminal_show_cursor();
+    shell_print_prompt();
+}
+
+bool top_active(void) {
+    return active;
+}
+
+void top_poll(void) {
+    if (active && timer_get_uptime_ms() - last.ms >= TOP_INTERVAL_MS) {
+        top_refresh();
+    }
+}
+
+void top_handle_key(int c) {
+    if (c == 'q' || c == 'Q') {
+        top_stop();
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef TOP_H
+#define TOP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*------------------------------------------------------------------------------
+ * System Monitor
+ *------------------------------------------------------------------------------
+ * 'top' takes over the screen and refreshes every TOP_INTERVAL_MS with
+ * CPU utilization, interrupt rates per IRQ line, disk I/O, memory usage
+ * and cache hit rates. It runs from the main loop rather than blocking in
+ * the shell, so the system keeps polling the network, the I/O ring and
+ * the scanners while it is watched.
+ *
+ * - CPU time is split by TSC: cycles spent halted in cpu_idle() are idle,
+ *   everything else (including interrupt handlers) is busy.
+ * - Rates are counter deltas over the measured interval.
+ * - Each refresh composes the whole screen off-line and then writes only
+ *   the cells that changed to video memory, which is uncached and slow.
+ *   The monitor reports its own cost on the last line.
+ *
+ * The previous screen contents are saved on entry and put back on exit.
+ *------------------------------------------------------------------------------
+ */
+
+#define TOP_INTERVAL_MS     1000
+
+/* Enter / leave the monitor */
+void top_start(void);
+void top_stop(void);
+bool top_active(void);
+
+/* Main loop hook: refresh when an interval has passed */
+void top_poll(void);
+
+/* Keyboard input while active; 'q' quits */
+void top_handle_key(int c);
+
+#endif /* TOP_H */
@@ -0,0 +1,251 @@
+/*------------------------------------------------------------------------------
+ * Scheduler Tracepoints and Wakeup Latency
+ *------------------------------------------------------------------------------
+ * This file implements the tracepoint bodies, the per-CPU event rings and
+ * the latency histograms. See trace.h.
+ *------------------------------------------------------------------------------
+ */
+
+#include "trace.h"
+#include "kernel.h"
+#include "percpu.h"
+#include "string.h"
+#include "../drivers/timer.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+static_key_t trace_sched_key = STATIC_KEY_INIT_FALSE;
+
+static trace_event_t rings[NR_CPUS][TRACE_RING_SIZE];
+static uint32_t ring_head[NR_CPUS];     /* Events ever written per CPU */
+
+static latency_hist_t global_hist;
+static trace_worst_t worst;
+
+static trace_task_t* tasks = NULL;
+static uint32_t next_task_id = 1;
+
+static const char* const event_names[] = {
+    "wakeup", "enqueue", "switch-in", "switch-out",
+};
+
+/*------------------------------------------------------------------------------
+ * Recording
+ *------------------------------------------------------------------------------
+ */
+
+/* Append to this CPU's ring; interrupts are off */
+static void trace_record(trace_event_type_t type, const trace_task_t* task, uint64_t tsc) {
+    uint32_t cpu = this_cpu_read(cpu_id);
+    trace_event_t* ev = &rings[cpu][ring_head[cpu] & (TRACE_RING_SIZE - 1)];
+    ev->tsc = tsc;
+    ev->type = (uint16_t)type;
+    ev->cpu = (uint16_t)cpu;
+    ev->task = task->id;
+    ring_head[cpu]++;
+}
+
+static void hist_add(latency_hist_t* hist, uint32_t cycles) {
+    uint32_t bucket = cycles ? 31 - __builtin_clz(cycles) : 0;
+    hist->buckets[bucket]++;
+    hist->count++;
+    hist->total_cycles += cycles;
+    if (cycles > hist->max_cycles) {
+        hist->max_cycles = cycles;
+    }
+}
+
+/* Keep the last events of this CPU's ring with a new worst case */
+static void trace_capture_worst(const trace_task_t* task, uint32_t cycles) {
+    uint32_t cpu = this_cpu_read(cpu_id);
+    uint32_t head = ring_head[cpu];
+    uint32_t count = head < TRACE_WORST_EVENTS ? head : TRACE_WORST_EVENTS;
+
+    worst.cycles = cycles;
+    worst.task = task->id;
+    worst.count = count;
+    for (uint32_t i = 0; i < count; i++) {
+        worst.events[i] = rings[cpu][(head - count + i) & (TRACE_RING_SIZE - 1)];
+    }
+}
+
+void __trace_sched_wakeup(trace_task_t* task) {
+    uint32_t flags;
+    asm volatile("pushfl; popl %0; cli" : "=r"(flags) :: "memory");
+    uint64_t now = timer_read_tsc();
+    trace_record(TRACE_WAKEUP, task, now);
+    /* Latency runs from the first of several wakeups */
+    if (task->wake_tsc == 0) {
+        task->wake_tsc = now;
+    }
+    asm volatile("pushl %0; popfl" :: "r"(flags) : "memory", "cc");
+}
+
+void __trace_sched_enqueue(trace_task_t* task) {
+    uint32_t flags;
+    asm volatile("pushfl; popl %0; cli" : "=r"(flags) :: "memory");
+    trace_record(TRACE_ENQUEUE, task, timer_read_tsc());
+    asm volatile("pushl %0; popfl" :: "r"(flags) : "memory", "cc");
+}
+
+void __trace_sched_switch_in(trace_task_t* task) {
+    uint32_t flags;
+    asm volatile("pushfl; popl %0; cli" : "=r"(flags) :: "memory");
+    uint64_t now = timer_read_tsc();
+    trace_record(TRACE_SWITCH_IN, task, now);
+
+    if (task->wake_tsc != 0 && now > task->wake_tsc) {
+        uint64_t delta = now - task->wake_tsc;
+        uint32_t cycles = delta > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)delta;
+        hist_add(&task->hist, cycles);
+        hist_add(&global_hist, cycles);
+        if (cycles > worst.cycles) {
+            trace_capture_worst(task, cycles);
+        }
+    }
+    task->wake_tsc = 0;
+    asm volatile("pushl %0; popfl" :: "r"(flags) : "memory", "cc");
+}
+
+void __trace_sched_switch_out(trace_task_t* task) {
+    uint32_t flags;
+    asm volatile("pushfl; popl %0; cli" : "=r"(flags) :: "memory");
+    trace_record(TRACE_SWITCH_OUT, task, timer_read_tsc());
+    asm volatile("pushl %0; popfl" :: "r"(flags) : "memory", "cc");
+}
+
+/*------------------------------------------------------------------------------
+ * Control and Results
+ *------------------------------------------------------------------------------
+ */
+
+void trace_register_task(trace_task_t* task, const char* name) {
+    memset(task, 0, sizeof(*task));
+    task->name = name;
+    task->id = next_task_id++;
+    task->next = tasks;
+    tasks = task;
+}
+
+void trace_unregister_task(trace_task_t* task) {
+    trace_task_t** link = &tasks;
+    while (*link) {
+        if (*link == task) {
+            *link = task->next;
+            task->next = NULL;
+            return;
+        }
+        link = &(*link)->next;
+    }
+}
+
+void trace_set_enabled(bool enabled) {
+    if (enabled) {
+        /* Calibrate now rather than on the first report */
+        timer_tsc_khz();
+
+        /* Stamps left from before tracing was last turned off would span
+         * the whole disabled period */
+        uint32_t flags;
+        asm volatile("pushfl; popl %0; cli" : "=r"(flags) :: "memory");
+        for (trace_task_t* t = tasks; t; t = t->next) {
+            t->wake_tsc = 0;
+        }
+        asm volatile("pushl %0; popfl" :: "r"(flags) : "memory", "cc");
+
+        static_key_enable(&trace_sched_key);
+    } else {
+        static_key_disable(&trace_sched_key);
+    }
+}
+
+bool trace_enabled(void) {
+    return static_key_enabled(&trace_sched_key);
+}
+
+void trace_reset(void) {
+    uint32_t flags;
+    asm volatile("pushfl; popl %0; cli" : "=r"(flags) :: "memory");
+    memset(&global_hist, 0, sizeof(global_hist));
+    memset(&worst, 0, sizeof(worst));
+    memset(ring_head, 0, sizeof(ring_head));
+    for (trace_task_t* t = tasks; t; t = t->next) {
+        memset(&t->hist, 0, sizeof(t->hist));
+        t->wake_tsc = 0;
+    }
+    asm volatile("pushl %0; popfl" :: "r"(flags) : "memory", "cc");
+}
+
+const latency_hist_t* trace_get_global_hist(void) {
+    return &global_hist;
+}
+
+const trace_worst_t* trace_get_worst(void) {
+    return &worst;
+}
+
+trace_task_t* trace_get_task(uint32_t index) {
+    trace_task_t* t = tasks;
+    while (t && index-- > 0) {
+        t = t->next;
+    }
+    return t;
+}
+
+const char* trace_task_name(uint32_t id) {
+    for (trace_task_t* t = tasks; t; t = t->next) {
+        if (t->id == id) {
+            return t->name;
+        }
+    }
+    return "?";
+}
+
+const char* trace_event_name(uint16_t type) {
+    return type <= TRACE_SWITCH_OUT ? event_names[type] : "?";
+}
+
+/*------------------------------------------------------------------------------
+ * Printing
+ *------------------------------------------------------------------------------
+ */
+
+/* Print a histogram, bucket bounds in microseconds */
+void trace_print_hist(const latency_hist_t* hist) {
+    terminal_writestring("  wakeups ");
+    terminal_write_dec(hist->count);
+    if (hist->count == 0) {
+        terminal_writestring("\n");
+        return;
+    }
+    terminal_writestring(", avg ");
+    terminal_write_dec(timer_tsc_to_us(hist->total_cycles) / hist->count);
+    terminal_writestring(" us, max ");
+    terminal_write_dec(timer_tsc_to_us(hist->max_cycles));
+    terminal_writestring(" us\n");
+
+    /* Bars scaled so the fullest bucket is 40 wide */
+    uint32_t peak = 0;
+    for (uint32_t b = 0; b < TRACE_HIST_BUCKETS; b++) {
+        if (hist->buckets[b] > peak) {
+            peak = hist->buckets[b];
+        }
+    }
+    uint32_t step = (peak + 39) / 40;
+
+    for (uint32_t b = 0; b < TRACE_HIST_BUCKETS; b++) {
+        if (hist->buckets[b] == 0) {
+            continue;
+        }
+        terminal_writestring("    < ");
+        terminal_write_dec(timer_tsc_to_us(2ULL << b));
+        terminal_writestring(" us: ");
+        terminal_write_dec(hist->buckets[b]);
+        terminal_writestring(" ");
+        for (uint32_t i = 0; i < (hist->buckets[b] + step - 1) / step; i++) {
+            terminal_putchar('#');
+        }
+        terminal_writestring("\n");
+    }
+}
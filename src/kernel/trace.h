@@ -0,0 +1,136 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "patch.h"
+
+/*------------------------------------------------------------------------------
+ * Scheduler Tracepoints and Wakeup Latency
+ *------------------------------------------------------------------------------
+ * Anything that is woken and later runs is a trace_task_t: a deferred
+ * interrupt bottom half polled from the main loop today, and a thread once
+ * there is a scheduler. Four tracepoints mark its life:
+ *
+ *     trace_sched_wakeup(t)      work arrived (usually in an IRQ handler)
+ *     trace_sched_enqueue(t)     t was made runnable
+ *     trace_sched_switch_in(t)   t starts running
+ *     trace_sched_switch_out(t)  t stops running
+ *
+ * Each event is stamped with the TSC and appended to the CPU's ring of the
+ * last TRACE_RING_SIZE events. The time from the first wakeup to the next
+ * switch-in is the wakeup latency; it goes into the task's histogram and
+ * the global one. Buckets are powers of two of TSC cycles, so recording
+ * needs no division. When a latency beats the worst seen so far, the ring
+ * is copied out, keeping the events that led up to the worst case.
+ *
+ * The tracepoints sit behind a static key and are forced inline: while
+ * tracing is off each one is a NOP at its call site and no call (without
+ * -O a short flag test follows the NOP).
+ *------------------------------------------------------------------------------
+ */
+
+#define TRACE_RING_SIZE         256     /* Events per CPU (power of two) */
+#define TRACE_WORST_EVENTS      32      /* Events kept with the worst case */
+#define TRACE_HIST_BUCKETS      32      /* Bucket b: [2^b, 2^(b+1)) cycles */
+
+typedef enum {
+    TRACE_WAKEUP,
+    TRACE_ENQUEUE,
+    TRACE_SWITCH_IN,
+    TRACE_SWITCH_OUT,
+} trace_event_type_t;
+
+/* Wakeup latency histogram */
+typedef struct {
+    uint32_t count;
+    uint32_t max_cycles;
+    uint64_t total_cycles;
+    uint32_t buckets[TRACE_HIST_BUCKETS];
+} latency_hist_t;
+
+/* Traced task */
+typedef struct trace_task {
+    const char* name;
+    uint32_t id;
+    uint64_t wake_tsc;                  /* First pending wakeup, 0 if none */
+    latency_hist_t hist;
+    struct trace_task* next;            /* Registry (see trace_register_task) */
+} trace_task_t;
+
+/* Ring entry */
+typedef struct {
+    uint64_t tsc;
+    uint16_t type;                      /* trace_event_type_t */
+    uint16_t cpu;
+    uint32_t task;                      /* trace_task_t id */
+} trace_event_t;
+
+/* Worst wakeup latency seen, with the events leading up to it */
+typedef struct {
+    uint32_t cycles;
+    uint32_t task;
+    uint32_t count;                     /* Valid entries in events[] */
+    trace_event_t events[TRACE_WORST_EVENTS];
+} trace_worst_t;
+
+/* Make a task visible to trace_get_task() and give it an id */
+void trace_register_task(trace_task_t* task, const char* name);
+void trace_unregister_task(trace_task_t* task);
+
+/**
+ * @brief Static key gating the tracepoints below
+ *
+ * Toggled with trace_set_enabled().
+ */
+extern static_key_t trace_sched_key;
+
+/* Out-of-line tracepoint bodies, reached only through the hooks below */
+void __trace_sched_wakeup(trace_task_t* task);
+void __trace_sched_enqueue(trace_task_t* task);
+void __trace_sched_switch_in(trace_task_t* task);
+void __trace_sched_switch_out(trace_task_t* task);
+
+static __always_inline void trace_sched_wakeup(trace_task_t* task) {
+    if (static_branch_unlikely(&trace_sched_key)) {
+        __trace_sched_wakeup(task);
+    }
+}
+
+static __always_inline void trace_sched_enqueue(trace_task_t* task) {
+    if (static_branch_unlikely(&trace_sched_key)) {
+        __trace_sched_enqueue(task);
+    }
+}
+
+static __always_inline void trace_sched_switch_in(trace_task_t* task) {
+    if (static_branch_unlikely(&trace_sched_key)) {
+        __trace_sched_switch_in(task);
+    }
+}
+
+static __always_inline void trace_sched_switch_out(trace_task_t* task) {
+    if (static_branch_unlikely(&trace_sched_key)) {
+        __trace_sched_switch_out(task);
+    }
+}
+
+/* Turn the tracepoints on or off by patching their call sites */
+void trace_set_enabled(bool enabled);
+bool trace_enabled(void);
+
+/* Clear histograms, rings and the worst case */
+void trace_reset(void);
+
+/* Results */
+const latency_hist_t* trace_get_global_hist(void);
+const trace_worst_t* trace_get_worst(void);
+trace_task_t* trace_get_task(uint32_t index);
+const char* trace_task_name(uint32_t id);
+const char* trace_event_name(uint16_t type);
+
+/* Print a histogram, bucket bounds in microseconds */
+void trace_print_hist(const latency_hist_t* hist);
+
+#endif /* TRACE_H */
@@ -0,0 +1,124 @@
+/*------------------------------------------------------------------------------
+ * User Memory Access
+ *------------------------------------------------------------------------------
+ * This file implements the exception table lookup and the fault-tolerant
+ * user copy routines. See uaccess.h.
+ *------------------------------------------------------------------------------
+ */
+
+#include "uaccess.h"
+#include "counter.h"
+#include "init.h"
+#include "string.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Table collected by linker.ld */
+extern exception_table_entry_t __ex_table_start[];
+extern exception_table_entry_t __ex_table_end[];
+
+DEFINE_COUNTER(cnt_fixups, "uaccess", "fixups");
+
+/*------------------------------------------------------------------------------
+ * Exception table
+ *------------------------------------------------------------------------------
+ */
+
+/* Entries come out of the link in object order; insertion sort is cheap
+ * for a table this size and handles the nearly sorted case well */
+void __init exception_table_init(void) {
+    exception_table_entry_t* start = __ex_table_start;
+    uint32_t count = (uint32_t)(__ex_table_end - __ex_table_start);
+
+    for (uint32_t i = 1; i < count; i++) {
+        exception_table_entry_t e = start[i];
+        uint32_t j = i;
+        while (j > 0 && start[j - 1].insn > e.insn) {
+            start[j] = start[j - 1];
+            j--;
+        }
+        start[j] = e;
+    }
+}
+
+uint32_t search_exception_table(uint32_t eip) {
+    uint32_t lo = 0;
+    uint32_t hi = (uint32_t)(__ex_table_end - __ex_table_start);
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        uint32_t insn = __ex_table_start[mid].insn;
+        if (insn == eip) {
+            return __ex_table_start[mid].fixup;
+        }
+        if (insn < eip) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return 0;
+}
+
+bool fixup_exception(interrupt_registers_t* regs) {
+    uint32_t fixup = search_exception_table(regs->eip);
+    if (fixup == 0) {
+        return false;
+    }
+    regs->eip = fixup;
+    counter_inc(&cnt_fixups);
+    return true;
+}
+
+uint32_t uaccess_fixup_count(void) {
+    return (uint32_t)counter_read(&cnt_fixups);
+}
+
+/*------------------------------------------------------------------------------
+ * Copy routines
+ *------------------------------------------------------------------------------
+ */
+
+/* Dwords first, then the 0-3 byte tail. On a fault in the dword loop ECX
+ * still holds the dwords left, so the fixup converts it back to bytes and
+ * adds the tail; a fault in the byte loop leaves the byte count in ECX. */
+static size_t __copy_user(void* to, const void* from, size_t n) {
+    uint32_t d0, d1, d2;
+
+    asm volatile("1:\trep movsl\n\t"
+                 "movl %3, %0\n"
+                 "2:\trep movsb\n"
+                 "3:\n"
+                 ".pushsection .fixup,\"ax\"\n"
+                 "4:\tleal (%3,%0,4), %0\n\t"
+                 "jmp 3b\n"
+                 ".popsection\n"
+                 _ASM_EXTABLE(1b, 4b)
+                 _ASM_EXTABLE(2b, 3b)
+                 : "=&c"(d0), "=&D"(d1), "=&S"(d2)
+                 : "r"(n & 3), "0"(n / 4), "1"(to), "2"(from)
+                 : "memory");
+    return d0;
+}
+
+/* Copy from a user address into a kernel buffer */
+size_t copy_from_user(void* to, const void* from, size_t n) {
+    size_t left = n;
+    if (access_ok(from, n)) {
+        left = __copy_user(to, from, n);
+    }
+    if (left) {
+        /* Never hand back stale kernel data in the uncopied tail */
+        memset((uint8_t*)to + (n - left), 0, left);
+    }
+    return left;
+}
+
+/* Copy from a kernel buffer to a user address */
+size_t copy_to_user(void* to, const void* from, size_t n) {
+    if (!access_ok(to, n)) {
+        return n;
+    }
+    return __copy_user(to, from, n);
+}
@@ -0,0 +1,65 @@
+#ifndef UACCESS_H
+#define UACCESS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "memory.h"
+#include "idt.h"
+
+/*------------------------------------------------------------------------------
+ * User Memory Access
+ *------------------------------------------------------------------------------
+ * copy_from_user()/copy_to_user() move data between kernel buffers and
+ * caller-supplied user addresses without checking the pages first. The
+ * copy runs as a plain rep movsl; each instruction that may fault on the
+ * user side has an entry in the __ex_table section pairing its address
+ * with a fixup address. When the page fault handler finds the faulting
+ * EIP in the table it resumes at the fixup, which makes the copy return
+ * the number of bytes it did not move. A copy that does not fault pays
+ * nothing for the check.
+ *
+ * The only up-front test is a range check that the buffer lies below the
+ * kernel half of the address space.
+ *------------------------------------------------------------------------------
+ */
+
+#define USER_SPACE_END  KERNEL_VIRTUAL_BASE
+
+/* Exception table entry: a faulting instruction and where to resume */
+typedef struct {
+    uint32_t insn;
+    uint32_t fixup;
+} exception_table_entry_t;
+
+/* Record that the instruction at label 'from' resumes at label 'to' */
+#define _ASM_EXTABLE(from, to)                                                \
+    ".pushsection __ex_table,\"a\"\n\t"                                       \
+    ".balign 4\n\t"                                                           \
+    ".long " #from ", " #to "\n"                                              \
+    ".popsection\n"
+
+/* Whether [addr, addr+size) is a plausible user range */
+static inline bool access_ok(const void* addr, size_t size) {
+    uint32_t start = (uint32_t)addr;
+    return start + size >= start && start + size <= USER_SPACE_END;
+}
+
+/* Sort the exception table so lookups can binary search; call once at boot */
+void exception_table_init(void);
+
+/* Fixup address for a faulting EIP, or 0 if it has none */
+uint32_t search_exception_table(uint32_t eip);
+
+/* Copy n bytes; return the number of bytes NOT copied (0 on success).
+ * copy_from_user() zeroes the part of 'to' it could not fill. */
+size_t copy_from_user(void* to, const void* from, size_t n);
+size_t copy_to_user(void* to, const void* from, size_t n);
+
+/* Redirect a kernel-mode fault to its fixup; false if it has none */
+bool fixup_exception(interrupt_registers_t* regs);
+
+/* Number of faults resolved through the exception table */
+uint32_t uaccess_fixup_count(void);
+
+#endif /* UACCESS_H */
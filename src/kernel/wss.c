@@ -0,0 +1,111 @@
+/*------------------------------------------------------------------------------
+ * Working Set Estimation
+ *------------------------------------------------------------------------------
+ * This file implements the periodic accessed-bit scanner. See wss.h.
+ *------------------------------------------------------------------------------
+ */
+
+#include "wss.h"
+#include "memory.h"
+#include "bcache.h"
+#include "string.h"
+#include "../drivers/timer.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+static wss_area_t areas[] = {
+    { .name = "heap",   .start = HEAP_START_ADDR,     .end = HEAP_START_ADDR + HEAP_MAX_SIZE },
+    { .name = "bcache", .start = BCACHE_WINDOW_START, .end = BCACHE_WINDOW_START + BCACHE_MAX_BLOCKS * PAGE_SIZE },
+    { .name = "anon",   .start = ANON_WINDOW_START,   .end = ANON_WINDOW_END },
+};
+
+#define WSS_AREAS   (sizeof(areas) / sizeof(areas[0]))
+
+static uint64_t last_scan_ms = 0;
+static uint32_t scans = 0;
+
+/* Age every present page of one area */
+static void wss_scan_area(wss_area_t* area) {
+    memset(area->age, 0, sizeof(area->age));
+    area->mapped = 0;
+    area->dirty = 0;
+    
+    bool flush = false;
+    uint32_t virt = area->start;
+    while (virt < area->end) {
+        uint32_t* pte = page_table_entry(virt);
+        if (!pte) {
+            /* No page table: skip to the next 4MB boundary */
+            virt = (virt & 0xFFC00000) + 0x400000;
+            continue;
+        }
+        
+        if (*pte & PAGE_PRESENT) {
+            uint32_t age = pte_age(*pte);
+            if (*pte & PAGE_ACCESSED) {
+                age = 0;
+                flush = true;
+            } else if (age < WSS_MAX_AGE) {
+                age++;
+            }
+            *pte = (*pte & ~(PAGE_ACCESSED | PTE_AGE_MASK)) | (age << PTE_AGE_SHIFT);
+            
+            area->mapped++;
+            area->age[age]++;
+            if (*pte & PAGE_DIRTY) {
+                area->dirty++;
+            }
+        }
+        virt += PAGE_SIZE;
+    }
+    
+    /* Cleared accessed bits only count again once the TLB forgets them;
+     * over a whole area this is a single CR3 reload */
+    if (flush) {
+        tlb_flush_range(area->start, (area->end - area->start) / PAGE_SIZE);
+    }
+}
+
+/* Scan every area now */
+void wss_scan(void) {
+    for (uint32_t i = 0; i < WSS_AREAS; i++) {
+        wss_scan_area(&areas[i]);
+    }
+    scans++;
+}
+
+/* Scan if the interval has passed */
+void wss_poll(void) {
+    if (!timer_is_initialized()) {
+        return;
+    }
+    
+    uint64_t now = timer_get_uptime_ms();
+    if (now - last_scan_ms < WSS_SCAN_INTERVAL_MS) {
+        return;
+    }
+    last_scan_ms = now;
+    wss_scan();
+}
+
+/* Pages used within the last 'window' scans */
+uint32_t wss_estimate(const wss_area_t* area, uint32_t window) {
+    uint32_t pages = 0;
+    for (uint32_t age = 0; age < window && age <= WSS_MAX_AGE; age++) {
+        pages += area->age[age];
+    }
+    return pages;
+}
+
+uint32_t wss_area_count(void) {
+    return WSS_AREAS;
+}
+
+const wss_area_t* wss_get_area(uint32_t index) {
+    return index < WSS_AREAS ? &areas[index] : NULL;
+}
+
+uint32_t wss_scan_count(void) {
+    return scans;
+}
@@ -0,0 +1,60 @@
+#ifndef WSS_H
+#define WSS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*------------------------------------------------------------------------------
+ * Working Set Estimation
+ *------------------------------------------------------------------------------
+ * Every WSS_SCAN_INTERVAL_MS the scanner walks the PTEs of the kernel's
+ * dynamically mapped areas (heap, buffer cache, anonymous memory). A page
+ * with PAGE_ACCESSED set was touched since the last pass: the bit is
+ * cleared and the page's idle age drops to zero. A page without it ages
+ * by one scan, saturating at WSS_MAX_AGE. The age lives in the software
+ * bits of the present PTE, so tracking needs no memory of its own and a
+ * fresh mapping starts out young.
+ *
+ * Per area the scanner keeps a histogram of idle ages. The working set is
+ * estimated as the pages used within the last WSS_WINDOW scans, and
+ * everything older counts as idle. The swap clock reads the same age, so
+ * a page the scanner saw in use is not evicted just because the scan
+ * cleared its accessed bit first.
+ *------------------------------------------------------------------------------
+ */
+
+#define WSS_SCAN_INTERVAL_MS    1000
+#define WSS_WINDOW              4       /* Scans: younger pages are in the working set */
+#define WSS_MAX_AGE             7
+
+/* Idle age in present PTEs (bits 9-11; non-present entries use them for swap) */
+#define PTE_AGE_SHIFT           9
+#define PTE_AGE_MASK            (WSS_MAX_AGE << PTE_AGE_SHIFT)
+#define pte_age(pte)            (((pte) & PTE_AGE_MASK) >> PTE_AGE_SHIFT)
+
+/* Scanned area */
+typedef struct {
+    const char* name;
+    uint32_t start;                     /* Virtual range */
+    uint32_t end;
+    uint32_t mapped;                    /* Present pages at the last scan */
+    uint32_t dirty;                     /* Of those, with PAGE_DIRTY set */
+    uint32_t age[WSS_MAX_AGE + 1];      /* Pages by scans since last access */
+} wss_area_t;
+
+/* Scan if the interval has passed; called from the main loop */
+void wss_poll(void);
+
+/* Scan every area now */
+void wss_scan(void);
+
+/* Pages of an area used within the last 'window' scans */
+uint32_t wss_estimate(const wss_area_t* area, uint32_t window);
+
+/* Areas, for reporting */
+uint32_t wss_area_count(void);
+const wss_area_t* wss_get_area(uint32_t index);
+uint32_t wss_scan_count(void);
+
+#endif /* WSS_H */
@@ -0,0 +1,235 @@
+/*------------------------------------------------------------------------------
+ * mkinitrd - build an SKOS initrd archive
+ *------------------------------------------------------------------------------
+ * Host tool. Packs the given files into the archive format described in
+ * src/kernel/initrd.h, compressing each one as a single LZ4 block and
+ * storing it uncompressed when that would not save space.
+ *
+ * Usage: mkinitrd <output> <file>...
+ *------------------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "../src/kernel/initrd.h"
+
+/*------------------------------------------------------------------------------
+ * LZ4 block compressor (greedy, single hash probe)
+ *------------------------------------------------------------------------------
+ */
+
+#define HASH_BITS      12
+#define MIN_MATCH      4
+#define LAST_LITERALS  5    /* Format rule: the block ends with >= 5 literals */
+#define MF_LIMIT       12   /* Format rule: no match starts in the last 12 bytes */
+#define MAX_OFFSET     65535
+
+static uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t hash4(uint32_t v) {
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static uint8_t* write_length(uint8_t* op, size_t len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+static uint8_t* emit_sequence(uint8_t* op, const uint8_t* lit, size_t lit_len,
+                              size_t offset, size_t match_len, int last) {
+    uint8_t* token = op++;
+    *token = (uint8_t)((lit_len >= 15 ? 15 : lit_len) << 4);
+    if (lit_len >= 15) {
+        op = write_length(op, lit_len - 15);
+    }
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+
+    if (last) {
+        return op;
+    }
+
+    *op++ = (uint8_t)(offset & 0xFF);
+    *op++ = (uint8_t)(offset >> 8);
+
+    size_t ml = match_len - MIN_MATCH;
+    *token |= (uint8_t)(ml >= 15 ? 15 : ml);
+    if (ml >= 15) {
+        op = write_length(op, ml - 15);
+    }
+    return op;
+}
+
+/* Worst-case compressed size for n input bytes */
+static size_t lz4_bound(size_t n) {
+    return n + n / 255 + 16;
+}
+
+static size_t lz4_compress(const uint8_t* in, size_t n, uint8_t* out) {
+    static int32_t table[1 << HASH_BITS];
+    uint8_t* op = out;
+    size_t anchor = 0;
+    size_t i = 0;
+
+    for (size_t h = 0; h < (1 << HASH_BITS); h++) {
+        table[h] = -1;
+    }
+
+    if (n > MF_LIMIT) {
+        size_t match_start_limit = n - MF_LIMIT;
+        size_t match_end_limit = n - LAST_LITERALS;
+
+        while (i < match_start_limit) {
+            uint32_t seq = read32(in + i);
+            uint32_t h = hash4(seq);
+            int32_t ref = table[h];
+            table[h] = (int32_t)i;
+
+            if (ref < 0 || i - (size_t)ref > MAX_OFFSET || read32(in + ref) != seq) {
+                i++;
+                continue;
+            }
+
+            size_t len = MIN_MATCH;
+            while (i + len < match_end_limit && in[ref + len] == in[i + len]) {
+                len++;
+            }
+
+            op = emit_sequence(op, in + anchor, i - anchor, i - (size_t)ref, len, 0);
+            i += len;
+            anchor = i;
+        }
+    }
+
+    op = emit_sequence(op, in + anchor, n - anchor, 0, 0, 1);
+    return (size_t)(op - out);
+}
+
+/*------------------------------------------------------------------------------
+ * CRC32C (bitwise; speed does not matter on the host)
+ *------------------------------------------------------------------------------
+ */
+
+static uint32_t crc32c(const uint8_t* p, size_t n) {
+    uint32_t crc = 0xFFFFFFFF;
+    while (n--) {
+        crc ^= *p++;
+        for (int k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ ((crc & 1) ? 0x82F63B78 : 0);
+        }
+    }
+    return crc ^ 0xFFFFFFFF;
+}
+
+/*------------------------------------------------------------------------------
+ * Archive writer
+ *------------------------------------------------------------------------------
+ */
+
+static uint8_t* read_file(const char* path, size_t* size) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t* buf = malloc(len > 0 ? (size_t)len : 1);
+    if (buf && len > 0 && fread(buf, 1, (size_t)len, f) != (size_t)len) {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(f);
+    *size = (size_t)(len > 0 ? len : 0);
+    return buf;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <output> <file>...\n", argv[0]);
+        return 1;
+    }
+
+    int count = argc - 2;
+    if (count > INITRD_MAX_FILES) {
+        fprintf(stderr, "mkinitrd: at most %d files\n", INITRD_MAX_FILES);
+        return 1;
+    }
+
+    initrd_entry_t* table = calloc((size_t)count, sizeof(initrd_entry_t));
+    uint8_t** blobs = calloc((size_t)count, sizeof(uint8_t*));
+    uint32_t offset = sizeof(initrd_header_t) + count * sizeof(initrd_entry_t);
+    size_t total_in = 0;
+
+    for (int i = 0; i < count; i++) {
+        const char* path = argv[i + 2];
+        const char* base = strrchr(path, '/');
+        base = base ? base + 1 : path;
+
+        if (strlen(base) >= INITRD_NAME_LEN) {
+            fprintf(stderr, "mkinitrd: name too long: %s\n", base);
+            return 1;
+        }
+
+        size_t size;
+        uint8_t* data = read_file(path, &size);
+        if (!data) {
+            fprintf(stderr, "mkinitrd: cannot read %s\n", path);
+            return 1;
+        }
+
+        uint8_t* packed = malloc(lz4_bound(size));
+        size_t packed_size = size ? lz4_compress(data, size, packed) : 0;
+
+        strcpy(table[i].name, base);
+        table[i].size = (uint32_t)size;
+        table[i].crc = crc32c(data, size);
+        table[i].offset = offset;
+
+        if (size == 0 || packed_size >= size) {
+            table[i].flags = INITRD_FLAG_STORED;
+            table[i].compressed_size = (uint32_t)size;
+            blobs[i] = data;
+            free(packed);
+        } else {
+            table[i].compressed_size = (uint32_t)packed_size;
+            blobs[i] = packed;
+            free(data);
+        }
+
+        offset += table[i].compressed_size;
+        total_in += size;
+    }
+
+    initrd_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = INITRD_MAGIC;
+    header.version = INITRD_VERSION;
+    header.file_count = (uint16_t)count;
+    header.archive_size = offset;
+
+    FILE* out = fopen(argv[1], "wb");
+    if (!out) {
+        fprintf(stderr, "mkinitrd: cannot create %s\n", argv[1]);
+        return 1;
+    }
+    fwrite(&header, sizeof(header), 1, out);
+    fwrite(table, sizeof(initrd_entry_t), (size_t)count, out);
+    for (int i = 0; i < count; i++) {
+        fwrite(blobs[i], 1, table[i].compressed_size, out);
+    }
+    fclose(out);
+
+    printf("mkinitrd: %d files, %zu -> %u bytes\n", count, total_in, offset);
+    return 0;
+}